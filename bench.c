@@ -0,0 +1,685 @@
+/*
+ * OSCam micro benchmarks
+ * This file times hot primitives in isolation and prints the results as JSON
+ * Build this file using `make bench`
+ */
+#include "globals.h"
+
+#include "cscrypt/md5.h"
+#if defined(READER_DRE) || defined(MODULE_SCAM) || defined(READER_VIACCESS)
+#include "cscrypt/des.h"
+#define BENCH_DES 1
+#endif
+#include "module-webif-tpl.h"
+#include "oscam-aes.h"
+#include "oscam-cache.h"
+#include "oscam-chk.h"
+#include "oscam-client.h"
+#include "oscam-config.h"
+#include "oscam-garbage.h"
+#include "oscam-hashtable.h"
+#include "oscam-lock.h"
+#include "oscam-string.h"
+#include "oscam-time.h"
+
+typedef void (BENCH_FN)(uint32_t);
+
+struct bench_type
+{
+	const char  *name;          // Benchmark name, keep it stable so results can be compared between releases
+	uint32_t    iterations;     // Number of operations per run
+	BENCH_FN    *setup_fn;      // Called before timing starts (optional)
+	BENCH_FN    *run_fn;        // Executes iterations operations
+	BENCH_FN    *teardown_fn;   // Called after timing stops (optional)
+};
+
+static volatile uint32_t bench_sink; // Keeps the compiler from optimizing results away
+static uint8_t bench_data[512];
+
+/* crc32 / MD5 / AES / DES */
+
+static void bench_crc32(uint32_t n)
+{
+	uint32_t i, crc = 0;
+	for(i = 0; i < n; i++)
+		{ crc = crc32(crc, bench_data, 188); }
+	bench_sink = crc;
+}
+
+static void bench_md5(uint32_t n)
+{
+	uint8_t md5tmp[MD5_DIGEST_LENGTH];
+	uint32_t i;
+	for(i = 0; i < n; i++)
+	{
+		bench_data[0] = i;
+		MD5(bench_data, 128, md5tmp);
+	}
+	bench_sink = md5tmp[0];
+}
+
+static void bench_md5_multi(uint32_t n)
+{
+	uint8_t digests[8][MD5_DIGEST_LENGTH];
+	const unsigned char *input[8];
+	unsigned char *output[8];
+	unsigned long len[8];
+	uint32_t i;
+	for(i = 0; i < 8; i++)
+	{
+		input[i] = bench_data + i * 16;
+		output[i] = digests[i];
+		len[i] = 128;
+	}
+	for(i = 0; i < n; i += 8)
+		{ MD5_multi(input, len, output, 8); }
+	bench_sink = digests[7][0];
+}
+
+static struct aes_keys bench_aes;
+
+static void bench_aes_setup(uint32_t UNUSED(n))
+{
+	aes_set_key(&bench_aes, "0123456789ABCDEF0123456789ABCDEF");
+}
+
+static void bench_aes_encrypt(uint32_t n)
+{
+	uint32_t i;
+	for(i = 0; i < n; i++)
+		{ aes_encrypt_idx(&bench_aes, bench_data, 16); }
+	bench_sink = bench_data[0];
+}
+
+static void bench_aes_decrypt(uint32_t n)
+{
+	uint32_t i;
+	for(i = 0; i < n; i++)
+		{ aes_decrypt(&bench_aes, bench_data, 16); }
+	bench_sink = bench_data[0];
+}
+
+#ifdef BENCH_DES
+static uint32_t bench_des_schedule[32];
+
+static void bench_des_setup(uint32_t UNUSED(n))
+{
+	static const uint8_t key[8] = { 0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xEF };
+	des_set_key(key, bench_des_schedule);
+}
+
+static void bench_des_encrypt(uint32_t n)
+{
+	uint32_t i;
+	for(i = 0; i < n; i++)
+		{ des(bench_data, bench_des_schedule, 1); }
+	bench_sink = bench_data[0];
+}
+#endif
+
+/* LLIST */
+
+static LLIST *bench_ll;
+
+static void bench_ll_setup(uint32_t UNUSED(n))
+{
+	bench_ll = ll_create("bench_ll");
+}
+
+static void bench_ll_fill(uint32_t n)
+{
+	uint32_t i;
+	bench_ll = ll_create("bench_ll");
+	for(i = 0; i < n; i++)
+		{ ll_append(bench_ll, bench_data + (i & 0xFF)); }
+}
+
+static void bench_ll_teardown(uint32_t UNUSED(n))
+{
+	ll_destroy(&bench_ll);
+}
+
+static void bench_ll_append(uint32_t n)
+{
+	uint32_t i;
+	for(i = 0; i < n; i++)
+		{ ll_append(bench_ll, bench_data + (i & 0xFF)); }
+}
+
+static void bench_ll_iterate(uint32_t UNUSED(n))
+{
+	LL_ITER it = ll_iter_create(bench_ll);
+	uint8_t *obj;
+	uint32_t sum = 0;
+	while((obj = ll_iter_next(&it)))
+		{ sum += *obj; }
+	bench_sink = sum;
+}
+
+static void bench_ll_remove_first(uint32_t n)
+{
+	uint32_t i;
+	for(i = 0; i < n; i++)
+		{ ll_remove_first(bench_ll); }
+}
+
+/* tommy_hashlin via oscam-hashtable.c */
+
+struct bench_hash_entry
+{
+	uint32_t key;
+	node ht_node;
+	node ll_node;
+};
+
+static hash_table bench_ht;
+static list bench_ht_ll;
+static struct bench_hash_entry *bench_ht_entries;
+
+static int bench_hash_compare(const void *arg, const void *obj)
+{
+	return memcmp(arg, &((const struct bench_hash_entry *)obj)->key, sizeof(uint32_t));
+}
+
+static void bench_hash_setup(uint32_t n)
+{
+	init_hash_table(&bench_ht, &bench_ht_ll);
+	if(!cs_malloc(&bench_ht_entries, n * sizeof(struct bench_hash_entry)))
+		{ exit(1); }
+}
+
+static void bench_hash_add(uint32_t n)
+{
+	uint32_t i;
+	for(i = 0; i < n; i++)
+	{
+		struct bench_hash_entry *e = &bench_ht_entries[i];
+		e->key = i * 2654435761U;
+		add_hash_table(&bench_ht, &e->ht_node, &bench_ht_ll, &e->ll_node, e, &e->key, sizeof(e->key));
+	}
+}
+
+static void bench_hash_find_setup(uint32_t n)
+{
+	bench_hash_setup(n);
+	bench_hash_add(n);
+}
+
+static void bench_hash_find(uint32_t n)
+{
+	uint32_t i, key, found = 0;
+	for(i = 0; i < n; i++)
+	{
+		key = i * 2654435761U;
+		if(find_hash_table(&bench_ht, &key, sizeof(key), &bench_hash_compare))
+			{ found++; }
+	}
+	bench_sink = found;
+}
+
+static void bench_hash_teardown(uint32_t UNUSED(n))
+{
+	deinitialize_hash_table(&bench_ht);
+	NULLFREE(bench_ht_entries);
+}
+
+/* cs_rwlock_int */
+
+static CS_MUTEX_LOCK bench_lock;
+
+static void bench_rwlock_read(uint32_t n)
+{
+	uint32_t i;
+	for(i = 0; i < n; i++)
+	{
+		cs_readlock(__func__, &bench_lock);
+		cs_readunlock(__func__, &bench_lock);
+	}
+}
+
+static void bench_rwlock_write(uint32_t n)
+{
+	uint32_t i;
+	for(i = 0; i < n; i++)
+	{
+		cs_writelock(__func__, &bench_lock);
+		cs_writeunlock(__func__, &bench_lock);
+	}
+}
+
+/* check_cache / add_cache */
+
+static ECM_REQUEST *bench_er;
+
+static void bench_cache_setup(uint32_t UNUSED(n))
+{
+	if(!cs_malloc(&bench_er, sizeof(ECM_REQUEST)))
+		{ exit(1); }
+	bench_er->ecm[0] = 0x80;
+	bench_er->ecmlen = 128;
+	bench_er->caid = 0x0500;
+	bench_er->prid = 0x032830;
+	bench_er->srvid = 0x1234;
+	bench_er->rc = E_NOTFOUND;
+}
+
+static void bench_add_cache(uint32_t n)
+{
+	uint32_t i;
+	for(i = 0; i < n; i++)
+	{
+		bench_er->csp_hash = i + 1;
+		memcpy(bench_er->cw, &i, sizeof(i));
+		add_cache(bench_er);
+	}
+}
+
+static void bench_check_cache_setup(uint32_t n)
+{
+	bench_cache_setup(n);
+	bench_add_cache(n);
+}
+
+static void bench_check_cache_hit(uint32_t n)
+{
+	struct ecm_request_t *ecm;
+	uint32_t i, found = 0;
+	for(i = 0; i < n; i++)
+	{
+		bench_er->csp_hash = i + 1;
+		if((ecm = check_cache(bench_er, NULL)))
+		{
+			found++;
+			NULLFREE(ecm);
+		}
+	}
+	bench_sink = found;
+}
+
+static void bench_check_cache_miss(uint32_t n)
+{
+	uint32_t i, found = 0;
+	for(i = 0; i < n; i++)
+	{
+		bench_er->csp_hash = n + i + 1;
+		if(check_cache(bench_er, NULL))
+			{ found++; }
+	}
+	bench_sink = found;
+}
+
+static void bench_cache_teardown(uint32_t UNUSED(n))
+{
+	cleanup_cache(true);
+	NULLFREE(bench_er);
+}
+
+/* compiled oscam.whitelist / oscam.ratelimit / oscam.services */
+
+extern uint32_t cfg_sidtab_generation;
+
+static struct s_client *bench_cl;
+
+static void bench_rules_er(uint32_t i)
+{
+	bench_er->caid = 0x0500 + (i & 7);
+	bench_er->prid = i & 3;
+	bench_er->srvid = (i * 7) & 0x1FFF;
+	bench_er->chid = 0;
+	bench_er->ecmlen = 0x80;
+}
+
+// generated whitelist: caid:prov:srvid lines for 10000 channels plus a few wildcard rules at the end
+static void bench_whitelist_setup(uint32_t UNUSED(n))
+{
+	struct s_global_whitelist *rules = NULL, *entry, **last = &rules;
+	uint32_t i;
+
+	bench_cache_setup(0);
+	for(i = 0; i < 10004; i++)
+	{
+		if(!cs_malloc(&entry, sizeof(struct s_global_whitelist)))
+			{ exit(1); }
+		entry->line = i + 1;
+		entry->type = i < 10000 ? 'w' : 'i';
+		entry->caid = i < 10002 ? 0x0500 + (i & 7) : 0;
+		entry->provid = i < 10000 ? i & 3 : 0;
+		entry->srvid = i < 10000 ? i : 0;
+		*last = entry;
+		last = &entry->next;
+	}
+	global_whitelist_set(rules);
+}
+
+static void bench_whitelist(uint32_t n)
+{
+	uint32_t i, line, found = 0;
+	for(i = 0; i < n; i++)
+	{
+		bench_rules_er(i);
+		found += chk_global_whitelist(bench_er, &line);
+	}
+	bench_sink = found;
+}
+
+static void bench_whitelist_teardown(uint32_t UNUSED(n))
+{
+	global_whitelist_set(NULL);
+	NULLFREE(bench_er);
+}
+
+static void bench_ratelimit_setup(uint32_t UNUSED(n))
+{
+	struct s_rlimit *rules = NULL, *entry, **last = &rules;
+	uint32_t i;
+
+	bench_cache_setup(0);
+	for(i = 0; i < 10000; i++)
+	{
+		if(!cs_malloc(&entry, sizeof(struct s_rlimit)))
+			{ exit(1); }
+		entry->rl.caid = 0x0500 + (i & 7);
+		entry->rl.provid = i & 3;
+		entry->rl.srvid = i;
+		entry->rl.ratelimitecm = 1;
+		entry->rl.ratelimittime = 9000;
+		*last = entry;
+		last = &entry->next;
+	}
+	ratelimit_set(rules);
+}
+
+static void bench_ratelimit(uint32_t n)
+{
+	uint32_t i, found = 0;
+	for(i = 0; i < n; i++)
+	{
+		bench_rules_er(i);
+		found += get_ratelimit(bench_er).ratelimitecm;
+	}
+	bench_sink = found;
+}
+
+static void bench_ratelimit_teardown(uint32_t UNUSED(n))
+{
+	ratelimit_set(NULL);
+	NULLFREE(bench_er);
+}
+
+// 64 services with 500 srvids each, the client is allowed half of them
+static void bench_services_setup(uint32_t UNUSED(n))
+{
+	struct s_sidtab *sidtab, **last = &cfg.sidtab;
+	uint32_t i, j;
+
+	bench_cache_setup(0);
+	if(!cs_malloc(&bench_cl, sizeof(struct s_client)))
+		{ exit(1); }
+	for(i = 0; i < 64; i++)
+	{
+		if(!cs_malloc(&sidtab, sizeof(struct s_sidtab)) || !cs_malloc(&sidtab->caid, sizeof(uint16_t))
+				|| !cs_malloc(&sidtab->srvid, 500 * sizeof(uint16_t)))
+			{ exit(1); }
+		snprintf(sidtab->label, sizeof(sidtab->label), "bench%u", i);
+		sidtab->caid[0] = 0x0500 + (i & 7);
+		sidtab->num_caid = 1;
+		for(j = 0; j < 500; j++)
+			{ sidtab->srvid[j] = (i * 500 + j) & 0x1FFF; }
+		sidtab->num_srvid = 500;
+		*last = sidtab;
+		last = &sidtab->next;
+	}
+	cfg_sidtab_generation++;
+	bench_cl->sidtabs.ok = 0x5555555555555555ULL;
+}
+
+static void bench_services(uint32_t n)
+{
+	uint32_t i, found = 0;
+	for(i = 0; i < n; i++)
+	{
+		bench_rules_er(i);
+		found += chk_srvid(bench_cl, bench_er);
+	}
+	bench_sink = found;
+}
+
+static void bench_services_teardown(uint32_t UNUSED(n))
+{
+	init_free_sidtab();
+	NULLFREE(bench_cl);
+	NULLFREE(bench_er);
+}
+
+// oscam.srvid2 sized list: 30000 services, 8 caids with 4 provids each
+static struct s_srvid *bench_srvid;
+
+static void bench_servicename_setup(uint32_t UNUSED(n))
+{
+	struct s_srvid *srvid;
+	uint32_t i, j;
+
+	if(!cs_malloc(&bench_srvid, 30000 * sizeof(struct s_srvid)))
+		{ exit(1); }
+	for(i = 0; i < 30000; i++)
+	{
+		srvid = &bench_srvid[i];
+		if(!cs_malloc(&srvid->caid, sizeof(struct s_srvid_caid)) || !cs_malloc(&srvid->caid[0].provid, 4 * sizeof(uint32_t))
+				|| !cs_malloc(&srvid->data, 16))
+			{ exit(1); }
+		srvid->srvid = 1 + (i & 0x7FFF);
+		srvid->ncaid = 1;
+		srvid->caid[0].caid = 0x0500 + (i >> 15);
+		srvid->caid[0].nprovid = 4;
+		for(j = 0; j < 4; j++)
+			{ srvid->caid[0].provid[j] = j; }
+		snprintf(srvid->data, 16, "service %u", i);
+		srvid->name = srvid->data;
+		srvid->next = cfg.srvid[srvid->srvid >> 12];
+		cfg.srvid[srvid->srvid >> 12] = srvid;
+	}
+	srvid_index_build(cfg.srvid);
+}
+
+static void bench_servicename(uint32_t n)
+{
+	char buf[64];
+	uint32_t i, len = 0;
+	for(i = 0; i < n; i++)
+	{
+		get_servicename(NULL, 1 + ((i * 7) & 0x7FFF), i & 3, 0x0500, buf, sizeof(buf));
+		len += buf[0];
+	}
+	bench_sink = len;
+}
+
+static void bench_servicename_teardown(uint32_t UNUSED(n))
+{
+	uint32_t i;
+
+	memset(cfg.srvid, 0, sizeof(cfg.srvid));
+	srvid_index_build(cfg.srvid);
+	for(i = 0; i < 30000; i++)
+	{
+		NULLFREE(bench_srvid[i].caid[0].provid);
+		NULLFREE(bench_srvid[i].caid);
+		NULLFREE(bench_srvid[i].data);
+	}
+	NULLFREE(bench_srvid);
+}
+
+/* add_garbage */
+
+static void bench_add_garbage(uint32_t n)
+{
+	uint32_t i;
+	void *ptr;
+	for(i = 0; i < n; i++)
+	{
+		if(cs_malloc(&ptr, 64))
+			{ add_garbage(ptr); }
+	}
+}
+
+/* tpl_* */
+
+#ifdef WEBIF
+static struct templatevars *bench_vars;
+
+static void bench_tpl_setup(uint32_t UNUSED(n))
+{
+	bench_vars = tpl_create();
+}
+
+static void bench_tpl_teardown(uint32_t UNUSED(n))
+{
+	tpl_clear(bench_vars);
+}
+
+static void bench_tpl_addvar(uint32_t n)
+{
+	char name[16];
+	uint32_t i;
+	for(i = 0; i < n; i++)
+	{
+		snprintf(name, sizeof(name), "VAR%u", i & 0xFF);
+		tpl_addVar(bench_vars, TPLADD, name, "value");
+	}
+}
+
+static void bench_tpl_append(uint32_t n)
+{
+	uint32_t i;
+	for(i = 0; i < n; i++)
+		{ tpl_addVar(bench_vars, TPLAPPEND, "ROWS", "<TR><TD>row</TD></TR>\n"); }
+}
+
+static void bench_tpl_getvar_setup(uint32_t n)
+{
+	bench_tpl_setup(n);
+	bench_tpl_addvar(256);
+}
+
+static void bench_tpl_getvar(uint32_t n)
+{
+	char name[16];
+	uint32_t i, len = 0;
+	for(i = 0; i < n; i++)
+	{
+		snprintf(name, sizeof(name), "VAR%u", i & 0xFF);
+		len += strlen(tpl_getVar(bench_vars, name));
+	}
+	bench_sink = len;
+}
+
+static void bench_tpl_gettpl(uint32_t n)
+{
+	uint32_t i, len = 0;
+	for(i = 0; i < n; i++)
+	{
+		struct templatevars *vars = tpl_create();
+		tpl_addVar(vars, TPLADD, "CSIDX", "1a2b3c4d");
+		tpl_addVar(vars, TPLADD, "CLIENTTYPE", "c");
+		tpl_addVar(vars, TPLADD, "USERENC", "user");
+		len += strlen(tpl_getTpl(vars, "JSONSTATUSBIT"));
+		tpl_clear(vars);
+	}
+	bench_sink = len;
+}
+#endif
+
+static void run_benchmark(const struct bench_type *b, int32_t first)
+{
+	struct timespec start, end;
+	int64_t elapsed_ns;
+	double ns_per_op, ops_per_sec;
+
+	if(b->setup_fn)
+		{ b->setup_fn(b->iterations); }
+	cs_gettime(&start);
+	b->run_fn(b->iterations);
+	cs_gettime(&end);
+	if(b->teardown_fn)
+		{ b->teardown_fn(b->iterations); }
+
+	elapsed_ns = (int64_t)(end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+	if(elapsed_ns <= 0)
+		{ elapsed_ns = 1; }
+	ns_per_op = (double)elapsed_ns / b->iterations;
+	ops_per_sec = (double)b->iterations * 1000000000.0 / elapsed_ns;
+
+	printf("%s\t\t{ \"name\": \"%s\", \"iterations\": %u, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f }",
+		   first ? "" : ",\n", b->name, b->iterations, ns_per_op, ops_per_sec);
+	fflush(stdout);
+}
+
+static void bench_init(void)
+{
+	uint32_t i;
+
+	if(pthread_key_create(&getclient, NULL))
+	{
+		fprintf(stderr, "Could not create getclient, exiting...");
+		exit(1);
+	}
+	memset(&cfg, 0, sizeof(struct s_config));
+	init_first_client();
+	cs_lock_create(__func__, &clientlist_lock, "clientlist_lock", 5000);
+	cs_lock_create(__func__, &readerlist_lock, "readerlist_lock", 5000);
+	cs_lock_create(__func__, &bench_lock, "bench_lock", 5000);
+	init_cache();
+	start_garbage_collector(0);
+#ifdef WEBIF
+	webif_tpls_prepare();
+#endif
+	for(i = 0; i < sizeof(bench_data); i++)
+		{ bench_data[i] = i * 7; }
+}
+
+void run_all_benchmarks(void)
+{
+	const struct bench_type benchmarks[] =
+	{
+		{ "crc32_188b",          1000000, NULL,                    bench_crc32,            NULL },
+		{ "md5_128b",            1000000, NULL,                    bench_md5,              NULL },
+		{ "md5_multi_128b",      1000000, NULL,                    bench_md5_multi,        NULL },
+		{ "aes_encrypt_16b",     1000000, bench_aes_setup,         bench_aes_encrypt,      NULL },
+		{ "aes_decrypt_16b",     1000000, bench_aes_setup,         bench_aes_decrypt,      NULL },
+#ifdef BENCH_DES
+		{ "des_encrypt_8b",      1000000, bench_des_setup,         bench_des_encrypt,      NULL },
+#endif
+		{ "ll_append",           1000000, bench_ll_setup,          bench_ll_append,        bench_ll_teardown },
+		{ "ll_iterate",          1000000, bench_ll_fill,           bench_ll_iterate,       bench_ll_teardown },
+		{ "ll_remove_first",     1000000, bench_ll_fill,           bench_ll_remove_first,  bench_ll_teardown },
+		{ "hashtable_add",       1000000, bench_hash_setup,        bench_hash_add,         bench_hash_teardown },
+		{ "hashtable_find",      1000000, bench_hash_find_setup,   bench_hash_find,        bench_hash_teardown },
+		{ "rwlock_read",         1000000, NULL,                    bench_rwlock_read,      NULL },
+		{ "rwlock_write",        1000000, NULL,                    bench_rwlock_write,     NULL },
+		{ "add_cache",           100000,  bench_cache_setup,       bench_add_cache,        bench_cache_teardown },
+		{ "check_cache_hit",     100000,  bench_check_cache_setup, bench_check_cache_hit,  bench_cache_teardown },
+		{ "check_cache_miss",    100000,  bench_check_cache_setup, bench_check_cache_miss, bench_cache_teardown },
+		{ "add_garbage",         1000000, NULL,                    bench_add_garbage,      NULL },
+		{ "whitelist_10k",       1000000, bench_whitelist_setup,   bench_whitelist,        bench_whitelist_teardown },
+		{ "ratelimit_10k",       1000000, bench_ratelimit_setup,   bench_ratelimit,        bench_ratelimit_teardown },
+		{ "services_64x500",     1000000, bench_services_setup,    bench_services,         bench_services_teardown },
+		{ "servicename_30k",     1000000, bench_servicename_setup, bench_servicename,      bench_servicename_teardown },
+#ifdef WEBIF
+		{ "tpl_addvar",          1000000, bench_tpl_setup,         bench_tpl_addvar,       bench_tpl_teardown },
+		{ "tpl_append",          20000,   bench_tpl_setup,         bench_tpl_append,       bench_tpl_teardown },
+		{ "tpl_getvar",          1000000, bench_tpl_getvar_setup,  bench_tpl_getvar,       bench_tpl_teardown },
+		{ "tpl_gettpl",          100000,  NULL,                    bench_tpl_gettpl,       NULL },
+#endif
+		{ NULL, 0, NULL, NULL, NULL },
+	};
+	const struct bench_type *b;
+
+	bench_init();
+	printf("{\n\t\"version\": \"%s\",\n\t\"revision\": \"%s\",\n\t\"target\": \"%s\",\n\t\"benchmarks\": [\n",
+		   CS_VERSION, CS_SVN_VERSION, CS_TARGET);
+	for(b = benchmarks; b->name; b++)
+		{ run_benchmark(b, b == benchmarks); }
+	printf("\n\t]\n}\n");
+	fflush(stdout);
+
+	stop_garbage_collector();
+}
@@ -0,0 +1,15 @@
+// This file is generated by ./config.sh --objdir build/x86_64-linux-gnu-zlib --make-config.mak
+const char *config_mak =
+  "\nCFG: strings FILE | sed -n 's/^CFG~//p' | openssl enc -d -base64 | gzip -d\n"
+  "CFG~H4sIAGUo1WoCA32US3LbMAyG9z1FZ3KBxBln0kUWEAhRrCmSJSj5seENuu/tSyWu\n"
+  "CFG~TQl0Vxp+P54UiKfv6F1vdD6aNGROEMzH729Pku4FRu9ty/zKdzLO9OP9WVC4dP4k\n"
+  "CFG~6IggmDUdxnNIvig1vxTh488NUWf6zbG4zmS93uKfvyaK5ztNfsKhHDd1s71nHGCm\n"
+  "CFG~rOZu6fzmFwlUZpUyDhCZEt8lExUln/VEzMZVFSBncMkgMFZlLfkUdVNlOHo1WSof\n"
+  "CFG~Z5KPG1vbrSIi4EB0qtgx4xmLe+F4qFuzqHgKwcdUX7Sliv6LYT0eenOqvU2Y3xru\n"
+  "CFG~11oRRvX6eo9Q473o7AvnhEFIjo6LKl2w4Bbl8gNICHoZsS2MoEgDJyFwKzZTNGBl\n"
+  "CFG~Su844VHwAE75CLKSIaWw+YcIUS0TRHE9URSzA10HudKvmRK4nOAk6eeTOfp4YKEx\n"
+  "CFG~oYw+G0As09oQFHk9lWqFpOpLv7Lkne6hHvmr0E32sygh6Gj63jgZXW/s7zeWw+DJ\n"
+  "CFG~rWezUo1LFB1YuWVaRo2N9h+zXfVCGlaMplkw47txL01pDPXrqH1GiNo3JdXt0I8P\n"
+  "CFG~2hf7fKvtmz1wKpuqnsY6Xywzw4/ylTrTg3wBy6K7ZSsrO4/GGXup2logEK9BxLc1\n"
+  "CFG~KE/8ZU3U1qcMKqxJZ7Sblmv6C6K9gyDxBgAA\n"
+  ;
@@ -0,0 +1,15 @@
+// This file is generated by ./config.sh --objdir build/x86_64-linux-gnu --make-config.mak
+const char *config_mak =
+  "\nCFG: strings FILE | sed -n 's/^CFG~//p' | openssl enc -d -base64 | gzip -d\n"
+  "CFG~H4sIADQo1WoCA32US3LkIAyG93OKqcoFJp3qVGaRhSxkzDQGBmH3Y8MNZp/bByed\n"
+  "CFG~NLboWbn4fj2x0MNP9K43Oh9NGjInCOb1348HSfcCo/e2ZX7lOxln+v3yS1C4dP4k\n"
+  "CFG~6IggmDUdxnNIXiiXIhX4hagz/evb6licZ7Jeb/GfvxPF840mP+FQjpvK2d7CDzBT\n"
+  "CFG~VnO39P7tFwlUZpUyDhCZEt8kExUln/VEzMZVFSBncMkgMFZlLfkUdVNlOHo1WSof\n"
+  "CFG~Z5KPG1vbrSIi4EB0qtgx4xmLe+F4qFuzqHgKwcdUX6ilin7FsB4PvTnV3ibMzw33\n"
+  "CFG~a60Io3p6ukWo8V509olzwiAkR8dFlS5YcIty+QEkBL0M2RZGUKSBkxC4FZspGrAy\n"
+  "CFG~pXec8Ch4AKd8BFnJkFLY/EOEqJYJorieKIrZga6DXOnnTAlcTnCS9OPRHH08sNCY\n"
+  "CFG~UEafDSCWaW0IiryeSrVCUvWlX1nyTvdQj/xV6Cb7UZQQdDR9b5yMrjf2txvLYfDk\n"
+  "CFG~1rNZqcYlig6s3DMto8ZO+4/ZrnohDStG0yyY8cW4x6Y0hvp11D4jRO2bkup26Mc7\n"
+  "CFG~7YuNvtX2zR44lU1VT2OdL5aZ4Xv5Sp3pTr6AZdF9ZysrO4/GGXup2logEK9BxOc1\n"
+  "CFG~KE/8cU3U1qcMKqxJZ7Sblmt6B4kOKYDzBgAA\n"
+  ;
@@ -308,6 +308,7 @@ list_config() {
 	have_flag USE_AZBOX && echo "CONFIG_WITH_AZBOX=y" || echo "# CONFIG_WITH_AZBOX=n"
 	have_flag USE_MCA && echo "CONFIG_WITH_MCA=y" || echo "# CONFIG_WITH_MCA=n"
 	have_flag USE_LIBCRYPTO && echo "CONFIG_WITH_LIBCRYPTO=y" || echo "# CONFIG_WITH_LIBCRYPTO=n"
+	have_flag USE_ZLIB && echo "CONFIG_WITH_ZLIB=y" || echo "# CONFIG_WITH_ZLIB=n"
 	for OPT in $addons $protocols WITH_CARDREADER $readers
 	do
 		enabled $OPT && echo "CONFIG_$OPT=y" || echo "# CONFIG_$OPT=n"
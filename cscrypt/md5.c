@@ -276,6 +276,276 @@ unsigned char *MD5(const unsigned char *input, unsigned long len, unsigned char
 }
 #endif
 
+/*
+ * Multi-buffer MD5
+ *
+ * Digests several independent buffers at once by running one MD5 state per
+ * vector lane (4 lanes with SSE2/NEON, 8 lanes with AVX2). Intended for
+ * bursts of short messages like ECMs and EMMs where the scalar transform
+ * is latency bound. Without SIMD support it falls back to calling MD5()
+ * for each buffer.
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MD5_MB_LANES 8
+typedef __m256i md5_vec;
+#define V_SET1(x)      _mm256_set1_epi32((int32_t)(x))
+#define V_LOAD(p)      _mm256_loadu_si256((const __m256i *)(p))
+#define V_STORE(p, v)  _mm256_storeu_si256((__m256i *)(p), v)
+#define V_ADD(a, b)    _mm256_add_epi32(a, b)
+#define V_AND(a, b)    _mm256_and_si256(a, b)
+#define V_OR(a, b)     _mm256_or_si256(a, b)
+#define V_XOR(a, b)    _mm256_xor_si256(a, b)
+#define V_ORNOT(a, b)  _mm256_or_si256(a, _mm256_xor_si256(b, _mm256_set1_epi32(-1)))
+#define V_ROTL(a, s)   _mm256_or_si256(_mm256_slli_epi32(a, s), _mm256_srli_epi32(a, 32 - (s)))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MD5_MB_LANES 4
+typedef __m128i md5_vec;
+#define V_SET1(x)      _mm_set1_epi32((int32_t)(x))
+#define V_LOAD(p)      _mm_loadu_si128((const __m128i *)(p))
+#define V_STORE(p, v)  _mm_storeu_si128((__m128i *)(p), v)
+#define V_ADD(a, b)    _mm_add_epi32(a, b)
+#define V_AND(a, b)    _mm_and_si128(a, b)
+#define V_OR(a, b)     _mm_or_si128(a, b)
+#define V_XOR(a, b)    _mm_xor_si128(a, b)
+#define V_ORNOT(a, b)  _mm_or_si128(a, _mm_xor_si128(b, _mm_set1_epi32(-1)))
+#define V_ROTL(a, s)   _mm_or_si128(_mm_slli_epi32(a, s), _mm_srli_epi32(a, 32 - (s)))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MD5_MB_LANES 4
+typedef uint32x4_t md5_vec;
+#define V_SET1(x)      vdupq_n_u32((uint32_t)(x))
+#define V_LOAD(p)      vld1q_u32((const uint32_t *)(p))
+#define V_STORE(p, v)  vst1q_u32((uint32_t *)(p), v)
+#define V_ADD(a, b)    vaddq_u32(a, b)
+#define V_AND(a, b)    vandq_u32(a, b)
+#define V_OR(a, b)     vorrq_u32(a, b)
+#define V_XOR(a, b)    veorq_u32(a, b)
+#define V_ORNOT(a, b)  vornq_u32(a, b)
+#define V_ROTL(a, s)   vorrq_u32(vshlq_n_u32(a, s), vshrq_n_u32(a, 32 - (s)))
+#endif
+
+#ifdef MD5_MB_LANES
+
+#define VF1(x, y, z) V_XOR(z, V_AND(x, V_XOR(y, z)))
+#define VF2(x, y, z) VF1(z, x, y)
+#define VF3(x, y, z) V_XOR(V_XOR(x, y), z)
+#define VF4(x, y, z) V_XOR(y, V_ORNOT(x, z))
+
+#define MD5VSTEP(f, w, x, y, z, data, k, s) \
+	( w = V_ADD(w, V_ADD(f(x, y, z), V_ADD(data, V_SET1(k)))), w = V_ROTL(w, s), w = V_ADD(w, x) )
+
+static void MD5_multi_transform(md5_vec st[4], const md5_vec in[16])
+{
+	md5_vec a = st[0];
+	md5_vec b = st[1];
+	md5_vec c = st[2];
+	md5_vec d = st[3];
+
+	MD5VSTEP(VF1, a, b, c, d, in[ 0], 0xd76aa478,  7);
+	MD5VSTEP(VF1, d, a, b, c, in[ 1], 0xe8c7b756, 12);
+	MD5VSTEP(VF1, c, d, a, b, in[ 2], 0x242070db, 17);
+	MD5VSTEP(VF1, b, c, d, a, in[ 3], 0xc1bdceee, 22);
+	MD5VSTEP(VF1, a, b, c, d, in[ 4], 0xf57c0faf,  7);
+	MD5VSTEP(VF1, d, a, b, c, in[ 5], 0x4787c62a, 12);
+	MD5VSTEP(VF1, c, d, a, b, in[ 6], 0xa8304613, 17);
+	MD5VSTEP(VF1, b, c, d, a, in[ 7], 0xfd469501, 22);
+	MD5VSTEP(VF1, a, b, c, d, in[ 8], 0x698098d8,  7);
+	MD5VSTEP(VF1, d, a, b, c, in[ 9], 0x8b44f7af, 12);
+	MD5VSTEP(VF1, c, d, a, b, in[10], 0xffff5bb1, 17);
+	MD5VSTEP(VF1, b, c, d, a, in[11], 0x895cd7be, 22);
+	MD5VSTEP(VF1, a, b, c, d, in[12], 0x6b901122,  7);
+	MD5VSTEP(VF1, d, a, b, c, in[13], 0xfd987193, 12);
+	MD5VSTEP(VF1, c, d, a, b, in[14], 0xa679438e, 17);
+	MD5VSTEP(VF1, b, c, d, a, in[15], 0x49b40821, 22);
+
+	MD5VSTEP(VF2, a, b, c, d, in[ 1], 0xf61e2562,  5);
+	MD5VSTEP(VF2, d, a, b, c, in[ 6], 0xc040b340,  9);
+	MD5VSTEP(VF2, c, d, a, b, in[11], 0x265e5a51, 14);
+	MD5VSTEP(VF2, b, c, d, a, in[ 0], 0xe9b6c7aa, 20);
+	MD5VSTEP(VF2, a, b, c, d, in[ 5], 0xd62f105d,  5);
+	MD5VSTEP(VF2, d, a, b, c, in[10], 0x02441453,  9);
+	MD5VSTEP(VF2, c, d, a, b, in[15], 0xd8a1e681, 14);
+	MD5VSTEP(VF2, b, c, d, a, in[ 4], 0xe7d3fbc8, 20);
+	MD5VSTEP(VF2, a, b, c, d, in[ 9], 0x21e1cde6,  5);
+	MD5VSTEP(VF2, d, a, b, c, in[14], 0xc33707d6,  9);
+	MD5VSTEP(VF2, c, d, a, b, in[ 3], 0xf4d50d87, 14);
+	MD5VSTEP(VF2, b, c, d, a, in[ 8], 0x455a14ed, 20);
+	MD5VSTEP(VF2, a, b, c, d, in[13], 0xa9e3e905,  5);
+	MD5VSTEP(VF2, d, a, b, c, in[ 2], 0xfcefa3f8,  9);
+	MD5VSTEP(VF2, c, d, a, b, in[ 7], 0x676f02d9, 14);
+	MD5VSTEP(VF2, b, c, d, a, in[12], 0x8d2a4c8a, 20);
+
+	MD5VSTEP(VF3, a, b, c, d, in[ 5], 0xfffa3942,  4);
+	MD5VSTEP(VF3, d, a, b, c, in[ 8], 0x8771f681, 11);
+	MD5VSTEP(VF3, c, d, a, b, in[11], 0x6d9d6122, 16);
+	MD5VSTEP(VF3, b, c, d, a, in[14], 0xfde5380c, 23);
+	MD5VSTEP(VF3, a, b, c, d, in[ 1], 0xa4beea44,  4);
+	MD5VSTEP(VF3, d, a, b, c, in[ 4], 0x4bdecfa9, 11);
+	MD5VSTEP(VF3, c, d, a, b, in[ 7], 0xf6bb4b60, 16);
+	MD5VSTEP(VF3, b, c, d, a, in[10], 0xbebfbc70, 23);
+	MD5VSTEP(VF3, a, b, c, d, in[13], 0x289b7ec6,  4);
+	MD5VSTEP(VF3, d, a, b, c, in[ 0], 0xeaa127fa, 11);
+	MD5VSTEP(VF3, c, d, a, b, in[ 3], 0xd4ef3085, 16);
+	MD5VSTEP(VF3, b, c, d, a, in[ 6], 0x04881d05, 23);
+	MD5VSTEP(VF3, a, b, c, d, in[ 9], 0xd9d4d039,  4);
+	MD5VSTEP(VF3, d, a, b, c, in[12], 0xe6db99e5, 11);
+	MD5VSTEP(VF3, c, d, a, b, in[15], 0x1fa27cf8, 16);
+	MD5VSTEP(VF3, b, c, d, a, in[ 2], 0xc4ac5665, 23);
+
+	MD5VSTEP(VF4, a, b, c, d, in[ 0], 0xf4292244,  6);
+	MD5VSTEP(VF4, d, a, b, c, in[ 7], 0x432aff97, 10);
+	MD5VSTEP(VF4, c, d, a, b, in[14], 0xab9423a7, 15);
+	MD5VSTEP(VF4, b, c, d, a, in[ 5], 0xfc93a039, 21);
+	MD5VSTEP(VF4, a, b, c, d, in[12], 0x655b59c3,  6);
+	MD5VSTEP(VF4, d, a, b, c, in[ 3], 0x8f0ccc92, 10);
+	MD5VSTEP(VF4, c, d, a, b, in[10], 0xffeff47d, 15);
+	MD5VSTEP(VF4, b, c, d, a, in[ 1], 0x85845dd1, 21);
+	MD5VSTEP(VF4, a, b, c, d, in[ 8], 0x6fa87e4f,  6);
+	MD5VSTEP(VF4, d, a, b, c, in[15], 0xfe2ce6e0, 10);
+	MD5VSTEP(VF4, c, d, a, b, in[ 6], 0xa3014314, 15);
+	MD5VSTEP(VF4, b, c, d, a, in[13], 0x4e0811a1, 21);
+	MD5VSTEP(VF4, a, b, c, d, in[ 4], 0xf7537e82,  6);
+	MD5VSTEP(VF4, d, a, b, c, in[11], 0xbd3af235, 10);
+	MD5VSTEP(VF4, c, d, a, b, in[ 2], 0x2ad7d2bb, 15);
+	MD5VSTEP(VF4, b, c, d, a, in[ 9], 0xeb86d391, 21);
+
+	st[0] = V_ADD(st[0], a);
+	st[1] = V_ADD(st[1], b);
+	st[2] = V_ADD(st[2], c);
+	st[3] = V_ADD(st[3], d);
+}
+
+static inline uint32_t md5_get_le32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void md5_put_le32(unsigned char *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+struct md5_lane
+{
+	const unsigned char *data;  // Message, read in place for all full blocks
+	unsigned long full;         // Number of full 64 byte blocks in data
+	unsigned long blocks;       // Total blocks including padding
+	unsigned char tail[128];    // Trailing bytes + 0x80 + padding + bit length
+};
+
+static void md5_lane_prepare(struct md5_lane *l, const unsigned char *input, unsigned long len)
+{
+	unsigned long rem = len & 0x3F;
+	uint64_t bits = (uint64_t)len << 3;
+	unsigned char *p;
+
+	l->data = input;
+	l->full = len >> 6;
+	l->blocks = l->full + (rem < 56 ? 1 : 2);
+
+	memset(l->tail, 0, sizeof(l->tail));
+	if(rem)
+		{ memcpy(l->tail, input + (l->full << 6), rem); }
+	l->tail[rem] = 0x80;
+
+	p = l->tail + ((l->blocks - l->full) << 6) - 8;
+	md5_put_le32(p, (uint32_t)bits);
+	md5_put_le32(p + 4, (uint32_t)(bits >> 32));
+}
+
+static void MD5_multi_group(const unsigned char *const input[], const unsigned long len[], unsigned char *const output[], int count)
+{
+	static const unsigned char zero_block[64];
+	struct md5_lane lane[MD5_MB_LANES];
+	uint32_t words[16][MD5_MB_LANES];
+	uint32_t state[4][MD5_MB_LANES];
+	md5_vec in[16], st[4];
+	unsigned long b, maxblocks = 0;
+	int i, j;
+
+	for(i = 0; i < count; i++)
+	{
+		md5_lane_prepare(&lane[i], input[i], len[i]);
+		if(lane[i].blocks > maxblocks)
+			{ maxblocks = lane[i].blocks; }
+	}
+
+	st[0] = V_SET1(0x67452301);
+	st[1] = V_SET1(0xefcdab89);
+	st[2] = V_SET1(0x98badcfe);
+	st[3] = V_SET1(0x10325476);
+
+	for(b = 0; b < maxblocks; b++)
+	{
+		int done = 0;
+
+		// Transpose one block of every lane so word j of all lanes is contiguous
+		for(i = 0; i < MD5_MB_LANES; i++)
+		{
+			const unsigned char *p = zero_block;
+			if(i < count && b < lane[i].blocks)
+			{
+				p = b < lane[i].full ? lane[i].data + (b << 6) : lane[i].tail + ((b - lane[i].full) << 6);
+				if(b == lane[i].blocks - 1)
+					{ done = 1; }
+			}
+			for(j = 0; j < 16; j++)
+				{ words[j][i] = md5_get_le32(p + (j << 2)); }
+		}
+		for(j = 0; j < 16; j++)
+			{ in[j] = V_LOAD(words[j]); }
+
+		MD5_multi_transform(st, in);
+
+		if(!done)
+			{ continue; }
+
+		// At least one lane consumed its last block, extract its digest
+		for(j = 0; j < 4; j++)
+			{ V_STORE(state[j], st[j]); }
+		for(i = 0; i < count; i++)
+		{
+			if(b != lane[i].blocks - 1)
+				{ continue; }
+			for(j = 0; j < 4; j++)
+				{ md5_put_le32(output[i] + (j << 2), state[j][i]); }
+		}
+	}
+}
+
+void MD5_multi(const unsigned char *const input[], const unsigned long len[], unsigned char *const output_hash[], int count)
+{
+	int n;
+	while(count > 0)
+	{
+		n = count > MD5_MB_LANES ? MD5_MB_LANES : count;
+		if(n == 1)
+			{ MD5(input[0], len[0], output_hash[0]); }
+		else
+			{ MD5_multi_group(input, len, output_hash, n); }
+		input += n;
+		len += n;
+		output_hash += n;
+		count -= n;
+	}
+}
+
+#else
+
+void MD5_multi(const unsigned char *const input[], const unsigned long len[], unsigned char *const output_hash[], int count)
+{
+	int i;
+	for(i = 0; i < count; i++)
+		{ MD5(input[i], len[i], output_hash[i]); }
+}
+
+#endif
+
 /* This string is magic for this algorithm.  Having
    it this way, we can get better later on */
 static const char __md5__magic[] = "$1$";
@@ -9,6 +9,9 @@
 unsigned char *MD5(const unsigned char *input, unsigned long len, unsigned char *output_hash);
 #endif
 
+/* Digest count independent buffers, output_hash[i] = MD5(input[i], len[i]) */
+void MD5_multi(const unsigned char *const input[], const unsigned long len[], unsigned char *const output_hash[], int count);
+
 char *__md5_crypt(const char *text_pass, const char *salt, char *crypted_passwd);
 
 #endif
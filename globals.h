@@ -476,6 +476,12 @@ typedef unsigned char uchar;
 #define E_99                99 //this code is undocumented
 #define E_UNHANDLED 100 //for selection of unhandled, use >= E_UNHANDLED
 
+//ECM latency histogram kinds:
+#define LATENCY_CACHE   0  //time to cache answer
+#define LATENCY_READER  1  //time to reader answer
+#define LATENCY_TOTAL   2  //time to send_dcw
+#define LATENCY_KINDS   3
+
 #define CS_MAX_MOD 20
 #define MOD_CONN_TCP    1
 #define MOD_CONN_UDP    2
@@ -1134,6 +1140,14 @@ struct s_cwresponse
 	int32_t         rc;
 };
 
+struct s_latency_hist;
+struct s_udp_batch;
+
+struct s_latency
+{
+	struct s_latency_hist *hist[LATENCY_KINDS];   // allocated on first sample, see oscam-latency.c
+};
+
 struct s_cascadeuser
 {
 	uint16_t        caid;
@@ -1216,6 +1230,7 @@ struct s_client
 	int32_t         udp_fd;
 	struct SOCKADDR udp_sa;
 	socklen_t       udp_sa_len;
+	struct s_udp_batch *udp_batch;      // replies not yet flushed, see net_udp_send()
 	int8_t          tcp_nodelay;
 	int8_t          log;
 	int32_t         logcounter;
@@ -1239,6 +1254,13 @@ struct s_client
 	int32_t         cwcacheexpush;      // count pushed ecms/cws
 	int32_t         cwcacheexgot;       // count got ecms/cws
 	int32_t         cwcacheexhit;       // count hit ecms/cws
+	int32_t         cwcacheexdrop;      // count ecms/cws dropped because the push queue was full
+	struct s_cacheex_push *cacheex_push_queue; // ring of ecms/cws waiting to be pushed
+	uint16_t        cacheex_push_head;
+	uint16_t        cacheex_push_count;
+	int8_t          cacheex_push_pending; // push job queued
+	time_t          cacheex_push_since;   // when the push job was queued
+	int8_t          cacheex_push_full;
 	LLIST           *ll_cacheex_stats;  // list for Cacheex statistics
 	int8_t          cacheex_maxhop;
 	int32_t         cwcacheexerr;       // cw=00 or chksum wrong
@@ -1255,6 +1277,8 @@ struct s_client
 	int32_t         cwlastresptimes_last; // ringbuffer pointer
 	int8_t          wihidden;           // hidden in webinterface status
 	char            lastreader[64];     // last cw got from this reader
+	uint32_t        webif_status_hash;  // checksum of the status row sent last
+	uint64_t        webif_status_seq;   // sequence number of the last change of the status row
 #endif
 
 	uchar           ucrc[4];            // needed by monitor and used by camd35
@@ -1666,6 +1690,7 @@ struct s_reader                                     //contains device info, read
 	uint32_t        ecmstout;
 	uint32_t        webif_ecmstout;
 	uint32_t        ecmnotfoundlimit;                   // config setting. restart reader if ecmsnok >= ecmnotfoundlimit
+	struct s_latency latency;                           // reader answer times
 	int32_t         ecmsfilteredhead;                   // count filtered ECM's by ECM Headerwhitelist
 	int32_t         ecmsfilteredlen;                    // count filtered ECM's by ECM Whitelist
 	int32_t         webif_ecmsfilteredhead;             // count filtered ECM's by ECM Headerwhitelist to readers ecminfo
@@ -1814,14 +1839,19 @@ struct s_auth
 #endif
 	int32_t         emmok;
 	int32_t         emmnok;
+	struct s_latency latency;           // cache and send_dcw times
 #ifdef CS_CACHEEX
 	int32_t         cwcacheexpush;      // count pushed ecms/cws
 	int32_t         cwcacheexgot;       // count got ecms/cws
 	int32_t         cwcacheexhit;       // count hit ecms/cws
+	int32_t         cwcacheexdrop;      // count ecms/cws dropped because the push queue was full
 	int32_t         cwcacheexerr; //cw=00 or chksum wrong
 	int32_t         cwcacheexerrcw; //Same Hex, different CW
 	int32_t			cwc_info;			// count of in/out comming cacheex ecms with CWCinfo
 #endif
+	uint32_t        cfg_crc;            // crc of the oscam.user lines it was read from, 0 once edited
+	uint32_t        readerdb_gen;       // cfg.readerdb_gen and cfg_sidtab_generation when au and services were resolved
+	uint32_t        sidtab_gen;
 	struct s_auth   *next;
 };
 
@@ -1974,6 +2004,7 @@ struct s_config
 	struct s_tierid *tierid;
 	struct s_provid *provid;
 	struct s_sidtab *sidtab;
+	uint32_t        readerdb_gen;       // bumped when the readers are reloaded
 #ifdef MODULE_MONITOR
 	int32_t         mon_port;
 	IN_ADDR_T       mon_srvip;
@@ -1997,6 +2028,10 @@ struct s_config
 	char            *http_extern_jquery;
 #endif
 	int32_t         http_refresh;
+	int32_t         http_threads;
+	int8_t          http_compress;
+	int8_t          http_compress_level;
+	int32_t         http_compress_min;
 	int32_t         poll_refresh;
 	int8_t          http_hide_idle_clients;
 	char            *http_hide_type;
@@ -2252,8 +2287,6 @@ struct s_config
 
 	//Global whitelist:
 	struct s_global_whitelist *global_whitelist;
-	int8_t global_whitelist_use_l;
-	int8_t global_whitelist_use_m;
 
 	char        *ecmfmt;
 	char        *pidfile;
@@ -2374,6 +2407,9 @@ char *get_provider(uint32_t provid, uint16_t caid, char *buf, uint32_t buflen);
 char *get_providername(uint32_t provid, uint16_t caid, char *buf, uint32_t buflen);
 char *get_providername_or_null(uint32_t provid, uint16_t caid, char *buf, uint32_t buflen);
 void add_provider(uint16_t caid, uint32_t provid, const char *name, const char *sat, const char *lang);
+void srvid_index_build(struct s_srvid **srvid);
+void provid_index_build(struct s_provid *provid);
+void tierid_index_build(struct s_tierid *tierid);
 const char *get_cl_lastprovidername(struct s_client *cl);
 bool boxtype_is(const char *boxtype);
 bool boxname_is(const char *boxname);
@@ -0,0 +1,980 @@
+/*
+ * OSCam ECM load generator
+ * This file opens client sessions against a running OSCam, replays synthetic
+ * ECM streams and prints per-request latency percentiles and results as JSON.
+ * Sessions wait for each answer before sending the next ECM, so a slow server
+ * lowers the achieved rate; latencies are taken from the scheduled send time.
+ * Build this file using `make loadgen`
+ */
+#include "globals.h"
+
+#include <netdb.h>
+
+#include "cscrypt/md5.h"
+#include "oscam-aes.h"
+#include "oscam-string.h"
+#include "oscam-time.h"
+#ifdef MODULE_NEWCAMD
+#include "module-newcamd-des.h"
+#endif
+#ifdef MODULE_CCCAM
+#include "cscrypt/sha1.h"
+#include "module-cccam-data.h"
+// Implemented in module-cccam.c, there is no public header for them
+void cc_init_crypt(struct cc_crypt_block *block, uint8_t *key, int32_t len);
+void cc_crypt(struct cc_crypt_block *block, uint8_t *data, int32_t len, cc_crypt_mode_t mode);
+void cc_xor(uint8_t *buf);
+#endif
+
+#define LG_MAX_SERVICES 64
+#define LG_RECENT_ECMS  32
+#define LG_MAX_CARDS    256
+#define LG_NETBUF_SIZE  (MAX_ECM_SIZE + 64)
+
+enum lg_result
+{
+	LG_OK = 0,      // Control word received
+	LG_NOTFOUND,    // Server answered "not found"
+	LG_TIMEOUT,     // No answer within the timeout
+	LG_ERROR,       // Send/receive error or connection lost
+	LG_NOCARD,      // CCcam only: the server announced no card for the caid
+	LG_RESULTS
+};
+
+static const char *lg_result_txt[LG_RESULTS] = { "ok", "notfound", "timeout", "error", "nocard" };
+
+struct lg_service
+{
+	uint16_t        caid;
+	uint32_t        prid;
+	uint16_t        srvid;
+};
+
+struct lg_ecm
+{
+	const struct lg_service *srv;
+	uint16_t        len;
+	uint8_t         data[MAX_ECM_SIZE];
+};
+
+struct lg_session;
+
+typedef int32_t (LG_CONNECT_FN)(struct lg_session *);
+typedef int32_t (LG_ECM_FN)(struct lg_session *, struct lg_ecm *, int64_t deadline);
+
+struct lg_proto
+{
+	const char      *name;
+	int32_t         is_udp;
+	LG_CONNECT_FN   *connect_fn;    // Opens the socket and logs in, returns 0 on success
+	LG_ECM_FN       *ecm_fn;        // Sends one ECM and waits for the answer, returns an lg_result
+};
+
+struct lg_session
+{
+	int32_t         id;
+	pthread_t       thread;
+	int32_t         fd;
+	int32_t         connected;
+	uint32_t        rnd;
+	uint16_t        idx;
+#if defined(MODULE_CAMD35) || defined(MODULE_CAMD35_TCP)
+	struct aes_keys aes;
+	uint8_t         ucrc[4];
+#endif
+#ifdef MODULE_NEWCAMD
+	uint8_t         deskey[16];
+	uint16_t        msgid;
+#endif
+#ifdef MODULE_CCCAM
+	struct cc_crypt_block block[2];
+	uint8_t         node_id[8];
+	uint32_t        card_id[LG_MAX_CARDS];
+	uint16_t        card_caid[LG_MAX_CARDS];
+	int32_t         cards;
+#endif
+	struct lg_ecm   recent[LG_RECENT_ECMS]; // Recently sent ECMs, replayed to produce cache hits
+	int32_t         recent_cnt;
+	uint32_t        count[LG_RESULTS];
+	uint32_t        *lat;                   // Latency of answered requests in microseconds
+	uint32_t        lat_cnt, lat_size;
+};
+
+static struct
+{
+	const struct lg_proto *proto;
+	char            host[128];
+	int32_t         port;
+	char            user[64];
+	char            pwd[64];
+	uint8_t         ncd_key[14];
+	int32_t         sessions;
+	int32_t         rate;           // ECMs per second and session
+	int32_t         duration;       // Seconds
+	int32_t         dup_ratio;      // Percentage of ECMs replayed from the recent ones
+	int32_t         ecm_len;
+	int32_t         timeout;        // Milliseconds
+	uint32_t        seed;
+	struct lg_service services[LG_MAX_SERVICES];
+	int32_t         nservices;
+	struct sockaddr_storage addr;
+	socklen_t       addr_len;
+	int64_t         stop_at;
+} lg;
+
+static int64_t lg_now_us(void)
+{
+	struct timespec ts;
+	cs_gettime(&ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t lg_rand(struct lg_session *s)
+{
+	// xorshift32, deterministic per session so runs can be repeated
+	uint32_t x = s->rnd;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return s->rnd = x;
+}
+
+/* Socket helpers */
+
+static int32_t lg_socket_open(void)
+{
+	int32_t fd, no_delay = 1;
+
+	fd = socket(lg.addr.ss_family, lg.proto->is_udp ? SOCK_DGRAM : SOCK_STREAM, lg.proto->is_udp ? IPPROTO_UDP : IPPROTO_TCP);
+	if(fd < 0)
+		{ return -1; }
+	if(connect(fd, (struct sockaddr *)&lg.addr, lg.addr_len) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	if(!lg.proto->is_udp)
+		{ setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (void *)&no_delay, sizeof(no_delay)); }
+	return fd;
+}
+
+// Waits until fd is readable or deadline (lg_now_us() based) has passed
+// Returns 1 if readable, 0 on timeout, -1 on error
+static int32_t lg_wait(int32_t fd, int64_t deadline)
+{
+	struct pollfd pfd;
+	int64_t left;
+	int32_t rc;
+
+	while(1)
+	{
+		left = deadline - lg_now_us();
+		if(left <= 0)
+			{ return 0; }
+		pfd.fd = fd;
+		pfd.events = POLLIN | POLLPRI;
+		rc = poll(&pfd, 1, (int32_t)((left + 999) / 1000));
+		if(rc < 0)
+		{
+			if(errno == EINTR)
+				{ continue; }
+			return -1;
+		}
+		if(rc == 0)
+			{ return 0; }
+		if(pfd.revents & (POLLERR | POLLNVAL))
+			{ return -1; }
+		return 1;
+	}
+}
+
+// Reads exactly len bytes from a stream socket
+// Returns len on success, 0 on timeout, -1 on error or disconnect
+static int32_t lg_recv_all(int32_t fd, uint8_t *buf, int32_t len, int64_t deadline)
+{
+	int32_t got = 0, rc, n;
+
+	while(got < len)
+	{
+		if((rc = lg_wait(fd, deadline)) <= 0)
+			{ return rc; }
+		n = recv(fd, buf + got, len - got, 0);
+		if(n < 0 && (errno == EINTR || errno == EAGAIN))
+			{ continue; }
+		if(n <= 0)
+			{ return -1; }
+		got += n;
+	}
+	return len;
+}
+
+static int32_t lg_send_all(int32_t fd, const uint8_t *buf, int32_t len)
+{
+	int32_t sent = 0, n;
+
+	while(sent < len)
+	{
+		n = send(fd, buf + sent, len - sent, MSG_NOSIGNAL);
+		if(n < 0 && errno == EINTR)
+			{ continue; }
+		if(n <= 0)
+			{ return -1; }
+		sent += n;
+	}
+	return len;
+}
+
+/* camd35 (UDP) and cs378x (camd35 over TCP) */
+
+#if defined(MODULE_CAMD35) || defined(MODULE_CAMD35_TCP)
+static int32_t camd35_lg_connect(struct lg_session *s)
+{
+	uint8_t md5tmp[MD5_DIGEST_LENGTH];
+
+	if((s->fd = lg_socket_open()) < 0)
+		{ return -1; }
+	i2b_buf(4, crc32(0L, MD5((uint8_t *)lg.user, strlen(lg.user), md5tmp), 16), s->ucrc);
+	aes_set_key(&s->aes, (char *)MD5((uint8_t *)lg.pwd, strlen(lg.pwd), md5tmp));
+	return 0;
+}
+
+static int32_t camd35_lg_recv(struct lg_session *s, uint8_t *buf, int64_t deadline)
+{
+	int32_t rc, n, buflen;
+
+	if(lg.proto->is_udp)
+	{
+		if((rc = lg_wait(s->fd, deadline)) <= 0)
+			{ return rc; }
+		n = recv(s->fd, buf, LG_NETBUF_SIZE, 0);
+		if(n < 36)
+			{ return -1; }
+		aes_decrypt(&s->aes, buf + 4, n - 4);
+		return n - 4;
+	}
+
+	// Minimum packet is 4 byte ucrc + 32 byte data, the rest depends on the decrypted length
+	if((rc = lg_recv_all(s->fd, buf, 36, deadline)) <= 0)
+		{ return rc; }
+	aes_decrypt(&s->aes, buf + 4, 32);
+	buflen = (buf[4] == 0) ? (((buf[4 + 21] & 0x0f) << 8) | buf[4 + 22]) + 3 : buf[5];
+	n = boundary(4, ((buf[4] == 3) ? 0x34 : 0) + 20 + buflen);
+	if(n > LG_NETBUF_SIZE - 4)
+		{ return -1; }
+	if(n > 32)
+	{
+		if((rc = lg_recv_all(s->fd, buf + 36, n - 32, deadline)) <= 0)
+			{ return rc; }
+		aes_decrypt(&s->aes, buf + 36, n - 32);
+	}
+	return n;
+}
+
+static int32_t camd35_lg_ecm(struct lg_session *s, struct lg_ecm *ecm, int64_t deadline)
+{
+	uint8_t rbuf[LG_NETBUF_SIZE], *sbuf = rbuf + 4, *buf;
+	int32_t l, n;
+	uint16_t idx = ++s->idx;
+
+	memcpy(rbuf, s->ucrc, 4);
+	memset(sbuf, 0, 20);
+	memset(sbuf + 20, 0xff, ecm->len + 15);
+	sbuf[1] = ecm->len;
+	i2b_buf(2, ecm->srv->srvid, sbuf + 8);
+	i2b_buf(2, ecm->srv->caid, sbuf + 10);
+	i2b_buf(4, ecm->srv->prid, sbuf + 12);
+	i2b_buf(2, idx, sbuf + 16);
+	sbuf[18] = 0xff;
+	sbuf[19] = 0xff;
+	memcpy(sbuf + 20, ecm->data, ecm->len);
+	i2b_buf(4, crc32(0L, sbuf + 20, ecm->len), sbuf + 4);
+	l = boundary(4, 20 + ecm->len);
+	aes_encrypt_idx(&s->aes, sbuf, l);
+	if(lg_send_all(s->fd, rbuf, l + 4) < 0)
+		{ return LG_ERROR; }
+
+	while(1)
+	{
+		n = camd35_lg_recv(s, rbuf, deadline);
+		if(n == 0)
+			{ return LG_TIMEOUT; }
+		if(n < 0)
+			{ return LG_ERROR; }
+		buf = rbuf + 4;
+		if((buf[0] != 0x01 && buf[0] != 0x44 && buf[0] != 0x08) || b2i(2, buf + 16) != idx)
+			{ continue; } // keepalive, EMM request or a late answer of an older ECM
+		return (buf[0] == 0x01) ? LG_OK : LG_NOTFOUND;
+	}
+}
+#endif
+
+/* newcamd 5.25 */
+
+#ifdef MODULE_NEWCAMD
+#define LG_NCD_LOGIN        0xE0
+#define LG_NCD_LOGIN_ACK    0xE1
+#define LG_NCD_CARD_DATA_REQ 0xE3
+#define LG_NCD_CARD_DATA    0xE4
+#define LG_NCD_CLIENT_ID    0x8888
+
+static int32_t newcamd_lg_send(struct lg_session *s, uint8_t *data, int32_t len, uint8_t *key, uint16_t sid, const struct lg_service *srv)
+{
+	uint8_t netbuf[LG_NETBUF_SIZE + 32];
+
+	data[1] = (data[1] & 0xf0) | (((len - 3) >> 8) & 0x0f);
+	data[2] = (len - 3) & 0xff;
+	memset(netbuf, 0, 12);
+	memcpy(netbuf + 12, data, len);
+	len += 12;
+	s->msgid++;
+	netbuf[2] = s->msgid >> 8;
+	netbuf[3] = s->msgid & 0xff;
+	netbuf[4] = sid >> 8;
+	netbuf[5] = sid & 0xff;
+	if(srv)
+	{
+		netbuf[6] = srv->caid >> 8;
+		netbuf[7] = srv->caid & 0xff;
+		netbuf[8] = (srv->prid >> 16) & 0xff;
+		netbuf[9] = (srv->prid >> 8) & 0xff;
+		netbuf[10] = srv->prid & 0xff;
+	}
+	netbuf[0] = (len - 2) >> 8;
+	netbuf[1] = (len - 2) & 0xff;
+	if((len = nc_des_encrypt(netbuf, len, key)) < 0)
+		{ return -1; }
+	netbuf[0] = (len - 2) >> 8;
+	netbuf[1] = (len - 2) & 0xff;
+	return lg_send_all(s->fd, netbuf, len);
+}
+
+// Receives one message, buf gets the msgid (2 bytes) followed by the payload
+// Returns the length of buf, 0 on timeout and -1 on error
+static int32_t newcamd_lg_recv(struct lg_session *s, uint8_t *buf, uint8_t *key, int64_t deadline)
+{
+	uint8_t netbuf[LG_NETBUF_SIZE + 32];
+	int32_t len, rc;
+
+	if((rc = lg_recv_all(s->fd, netbuf, 2, deadline)) <= 0)
+		{ return rc; }
+	len = (netbuf[0] << 8) | netbuf[1];
+	if(len > (int32_t)sizeof(netbuf) - 2)
+		{ return -1; }
+	if((rc = lg_recv_all(s->fd, netbuf + 2, len, deadline)) <= 0)
+		{ return rc; }
+	if((len = nc_des_decrypt(netbuf, len + 2, key)) < 15)
+		{ return -1; }
+	rc = (((netbuf[13] & 0x0f) << 8) | netbuf[14]) + 3;
+	if(rc > len - 12)
+		{ return -1; }
+	buf[0] = netbuf[2];
+	buf[1] = netbuf[3];
+	memcpy(buf + 2, netbuf + 12, rc);
+	return rc + 2;
+}
+
+static int32_t newcamd_lg_connect(struct lg_session *s)
+{
+	uint8_t keymod[14], key[16], buf[LG_NETBUF_SIZE];
+	char passwdcrypt[120];
+	int32_t idx;
+	int64_t deadline = lg_now_us() + (int64_t)lg.timeout * 1000;
+
+	if((s->fd = lg_socket_open()) < 0)
+		{ return -1; }
+	s->msgid = 0;
+	if(lg_recv_all(s->fd, keymod, sizeof(keymod), deadline) != sizeof(keymod))
+		{ return -1; }
+	nc_des_login_key_get(keymod, lg.ncd_key, sizeof(lg.ncd_key), key);
+
+	idx = 3;
+	buf[0] = LG_NCD_LOGIN;
+	buf[1] = 0;
+	cs_strncpy((char *)buf + idx, lg.user, sizeof(buf) - idx);
+	__md5_crypt(lg.pwd, "$1$abcdefgh$", passwdcrypt);
+	idx += strlen(lg.user) + 1;
+	cs_strncpy((char *)buf + idx, passwdcrypt, sizeof(buf) - idx);
+	if(newcamd_lg_send(s, buf, idx + strlen(passwdcrypt) + 1, key, LG_NCD_CLIENT_ID, NULL) < 0)
+		{ return -1; }
+	if(newcamd_lg_recv(s, buf, key, deadline) != 5 || buf[2] != LG_NCD_LOGIN_ACK)
+		{ return -1; }
+
+	nc_des_login_key_get(lg.ncd_key, (uint8_t *)passwdcrypt, strlen(passwdcrypt), s->deskey);
+	buf[0] = LG_NCD_CARD_DATA_REQ;
+	buf[1] = buf[2] = 0;
+	if(newcamd_lg_send(s, buf, 3, s->deskey, 0, NULL) < 0)
+		{ return -1; }
+	if(newcamd_lg_recv(s, buf, s->deskey, deadline) < 16 || buf[2] != LG_NCD_CARD_DATA)
+		{ return -1; }
+	return 0;
+}
+
+static int32_t newcamd_lg_ecm(struct lg_session *s, struct lg_ecm *ecm, int64_t deadline)
+{
+	uint8_t buf[LG_NETBUF_SIZE];
+	uint16_t msgid;
+	int32_t n;
+
+	memcpy(buf, ecm->data, ecm->len);
+	if(newcamd_lg_send(s, buf, ecm->len, s->deskey, ecm->srv->srvid, ecm->srv) < 0)
+		{ return LG_ERROR; }
+	msgid = s->msgid;
+
+	while(1)
+	{
+		n = newcamd_lg_recv(s, buf, s->deskey, deadline);
+		if(n == 0)
+			{ return LG_TIMEOUT; }
+		if(n < 0)
+			{ return LG_ERROR; }
+		if((buf[2] != 0x80 && buf[2] != 0x81) || ((buf[0] << 8) | buf[1]) != msgid)
+			{ continue; } // keepalive, card updates or a late answer of an older ECM
+		return (n >= 21) ? LG_OK : LG_NOTFOUND;
+	}
+}
+#endif
+
+/* CCcam (non extended mode, one ECM at a time per session) */
+
+#ifdef MODULE_CCCAM
+static int32_t cccam_lg_send(struct lg_session *s, const uint8_t *data, int32_t len, cc_msg_type_t cmd)
+{
+	uint8_t netbuf[LG_NETBUF_SIZE + 4];
+
+	if(cmd == MSG_NO_HEADER)
+		{ memcpy(netbuf, data, len); }
+	else
+	{
+		netbuf[0] = 0;
+		netbuf[1] = cmd & 0xff;
+		netbuf[2] = len >> 8;
+		netbuf[3] = len & 0xff;
+		if(data)
+			{ memcpy(netbuf + 4, data, len); }
+		len += 4;
+	}
+	cc_crypt(&s->block[ENCRYPT], netbuf, len, ENCRYPT);
+	return lg_send_all(s->fd, netbuf, len);
+}
+
+static int32_t cccam_lg_recv(struct lg_session *s, uint8_t *buf, int32_t maxlen, int64_t deadline)
+{
+	int32_t size, rc;
+
+	if((rc = lg_recv_all(s->fd, buf, 4, deadline)) <= 0)
+		{ return rc; }
+	cc_crypt(&s->block[DECRYPT], buf, 4, DECRYPT);
+	size = (buf[2] << 8) | buf[3];
+	if(size + 4 > maxlen)
+		{ return -1; }
+	if(size)
+	{
+		// The header is already consumed, a partial body would desync the stream
+		if(lg_recv_all(s->fd, buf + 4, size, deadline + (int64_t)lg.timeout * 1000) != size)
+			{ return -1; }
+		cc_crypt(&s->block[DECRYPT], buf + 4, size, DECRYPT);
+	}
+	return size + 4;
+}
+
+static void cccam_lg_parse(struct lg_session *s, uint8_t *buf, int32_t n)
+{
+	uint32_t id;
+	int32_t i;
+
+	if(buf[1] == MSG_NEW_CARD && n >= 4 + 11 && s->cards < LG_MAX_CARDS)
+	{
+		s->card_id[s->cards] = b2i(4, buf + 4);
+		s->card_caid[s->cards] = b2i(2, buf + 4 + 8);
+		s->cards++;
+	}
+	else if(buf[1] == MSG_CARD_REMOVED && n >= 8)
+	{
+		id = b2i(4, buf + 4);
+		for(i = 0; i < s->cards; i++)
+		{
+			if(s->card_id[i] == id)
+			{
+				s->cards--;
+				s->card_id[i] = s->card_id[s->cards];
+				s->card_caid[i] = s->card_caid[s->cards];
+				break;
+			}
+		}
+	}
+}
+
+static int32_t cccam_lg_connect(struct lg_session *s)
+{
+	uint8_t data[20], hash[SHA_DIGEST_LENGTH], buf[LG_NETBUF_SIZE];
+	char pwd[64];
+	SHA_CTX ctx;
+	int32_t n;
+	int64_t deadline = lg_now_us() + (int64_t)lg.timeout * 1000;
+	const int32_t size = 20 + 8 + 6 + 26 + 4 + 28 + 1;
+
+	if((s->fd = lg_socket_open()) < 0)
+		{ return -1; }
+	s->cards = 0;
+	if(lg_recv_all(s->fd, data, 16, deadline) != 16)
+		{ return -1; }
+
+	cc_xor(data);
+	SHA1_Init(&ctx);
+	SHA1_Update(&ctx, data, 16);
+	SHA1_Final(hash, &ctx);
+	cc_init_crypt(&s->block[DECRYPT], hash, 20);
+	cc_crypt(&s->block[DECRYPT], data, 16, DECRYPT);
+	cc_init_crypt(&s->block[ENCRYPT], data, 16);
+	cc_crypt(&s->block[ENCRYPT], hash, 20, DECRYPT);
+	cccam_lg_send(s, hash, 20, MSG_NO_HEADER);
+
+	memset(buf, 0, 20);
+	memcpy(buf, lg.user, strlen(lg.user));
+	cccam_lg_send(s, buf, 20, MSG_NO_HEADER);
+
+	memset(pwd, 0, sizeof(pwd));
+	cs_strncpy(pwd, lg.pwd, sizeof(pwd));
+	cc_crypt(&s->block[ENCRYPT], (uint8_t *)pwd, strlen(pwd), ENCRYPT);
+	if(cccam_lg_send(s, (const uint8_t *)"CCcam", 6, MSG_NO_HEADER) < 0)
+		{ return -1; }
+
+	if(lg_recv_all(s->fd, data, 20, deadline) != 20)
+		{ return -1; }
+	cc_crypt(&s->block[DECRYPT], data, 20, DECRYPT);
+	if(memcmp(data, "CCcam", 5))
+		{ return -1; }
+
+	memset(buf, 0, size);
+	memcpy(buf, lg.user, strlen(lg.user));
+	memcpy(buf + 20, s->node_id, 8);
+	memcpy(buf + 29, "2.0.11", 6);
+	memcpy(buf + 61, "2892", 4);
+	if(cccam_lg_send(s, buf, size, MSG_CLI_DATA) < 0)
+		{ return -1; }
+
+	// Collect the card announcements, the server sends them right after the login
+	deadline = lg_now_us() + (int64_t)lg.timeout * 1000;
+	while((n = cccam_lg_recv(s, buf, sizeof(buf), deadline)) > 0)
+	{
+		cccam_lg_parse(s, buf, n);
+		if(s->cards && lg_wait(s->fd, lg_now_us() + 200000) <= 0)
+			{ break; }
+	}
+	return (n < 0) ? -1 : 0;
+}
+
+static int32_t cccam_lg_ecm(struct lg_session *s, struct lg_ecm *ecm, int64_t deadline)
+{
+	uint8_t buf[LG_NETBUF_SIZE];
+	uint64_t node_id = b2ll(8, s->node_id);
+	uint32_t card_id = 0;
+	uint8_t tmp;
+	int32_t i, n, found = 0;
+
+	for(i = 0; i < s->cards; i++)
+	{
+		if(s->card_caid[i] == ecm->srv->caid)
+		{
+			card_id = s->card_id[i];
+			found = 1;
+			break;
+		}
+	}
+	if(!found)
+		{ return LG_NOCARD; }
+
+	i2b_buf(2, ecm->srv->caid, buf);
+	i2b_buf(4, ecm->srv->prid, buf + 2);
+	i2b_buf(4, card_id, buf + 6);
+	i2b_buf(2, ecm->srv->srvid, buf + 10);
+	buf[12] = ecm->len & 0xff;
+	memcpy(buf + 13, ecm->data, ecm->len);
+	if(cccam_lg_send(s, buf, ecm->len + 13, MSG_CW_ECM) < 0)
+		{ return LG_ERROR; }
+
+	while(1)
+	{
+		n = cccam_lg_recv(s, buf, sizeof(buf), deadline);
+		if(n == 0)
+			{ return LG_TIMEOUT; }
+		if(n < 0)
+			{ return LG_ERROR; }
+		if(buf[1] == MSG_CW_NOK1 || buf[1] == MSG_CW_NOK2)
+			{ return LG_NOTFOUND; }
+		if(buf[1] != MSG_CW_ECM || n < 4 + 16)
+		{
+			cccam_lg_parse(s, buf, n);
+			continue;
+		}
+		// Same as cc_cw_crypt() followed by the additional crypto step of the reader
+		for(i = 0; i < 16; i++)
+		{
+			tmp = buf[4 + i] ^ (node_id >> (4 * i));
+			if(i & 1)
+				{ tmp = ~tmp; }
+			buf[4 + i] = (card_id >> (2 * i)) ^ tmp;
+		}
+		cc_crypt(&s->block[DECRYPT], buf + 4, n - 4, ENCRYPT);
+		return LG_OK;
+	}
+}
+#endif
+
+static const struct lg_proto lg_protos[] =
+{
+#ifdef MODULE_CAMD35
+	{ "camd35",  1, camd35_lg_connect,  camd35_lg_ecm },
+#endif
+#ifdef MODULE_CAMD35_TCP
+	{ "cs378x",  0, camd35_lg_connect,  camd35_lg_ecm },
+#endif
+#ifdef MODULE_NEWCAMD
+	{ "newcamd", 0, newcamd_lg_connect, newcamd_lg_ecm },
+#endif
+#ifdef MODULE_CCCAM
+	{ "cccam",   0, cccam_lg_connect,   cccam_lg_ecm },
+#endif
+	{ NULL, 0, NULL, NULL },
+};
+
+/* ECM stream */
+
+static void lg_build_ecm(struct lg_session *s, struct lg_ecm *ecm)
+{
+	int32_t i;
+
+	if(s->recent_cnt && (int32_t)(lg_rand(s) % 100) < lg.dup_ratio)
+	{
+		memcpy(ecm, &s->recent[lg_rand(s) % MIN(s->recent_cnt, LG_RECENT_ECMS)], sizeof(*ecm));
+		return;
+	}
+
+	ecm->srv = &lg.services[lg_rand(s) % lg.nservices];
+	ecm->len = lg.ecm_len;
+	ecm->data[0] = (s->recent_cnt & 1) ? 0x81 : 0x80;
+	ecm->data[1] = 0x70 | (((ecm->len - 3) >> 8) & 0x0f);
+	ecm->data[2] = (ecm->len - 3) & 0xff;
+	for(i = 3; i < ecm->len; i++)
+		{ ecm->data[i] = lg_rand(s) & 0xff; }
+	// Seca reads the provider from the ECM, keep it consistent with the request
+	if(caid_is_seca(ecm->srv->caid))
+		{ i2b_buf(2, ecm->srv->prid, ecm->data + 3); }
+	// Keep the session id in the payload so sessions never produce the same ECM by accident
+	ecm->data[ecm->len - 2] = s->id >> 8;
+	ecm->data[ecm->len - 1] = s->id & 0xff;
+
+	memcpy(&s->recent[s->recent_cnt % LG_RECENT_ECMS], ecm, sizeof(*ecm));
+	s->recent_cnt++;
+}
+
+static void lg_add_latency(struct lg_session *s, uint32_t us)
+{
+	if(s->lat_cnt == s->lat_size)
+	{
+		uint32_t size = s->lat_size ? s->lat_size * 2 : 1024;
+		uint32_t *lat = realloc(s->lat, size * sizeof(uint32_t));
+		if(!lat)
+			{ return; } // keep what was collected so far
+		s->lat = lat;
+		s->lat_size = size;
+	}
+	s->lat[s->lat_cnt++] = us;
+}
+
+static void lg_disconnect(struct lg_session *s)
+{
+	if(s->fd >= 0)
+		{ close(s->fd); }
+	s->fd = -1;
+	s->connected = 0;
+}
+
+static void *lg_session_thread(void *arg)
+{
+	struct lg_session *s = arg;
+	struct lg_ecm *ecm;
+	int64_t next_send, now, start, sched;
+	int64_t interval = 1000000 / lg.rate;
+	int32_t rc;
+
+	if(!cs_malloc(&ecm, sizeof(struct lg_ecm)))
+		{ return NULL; }
+
+	// Spread the sessions over the first interval
+	next_send = lg_now_us() + (interval * s->id) / lg.sessions;
+	while(next_send < lg.stop_at)
+	{
+		now = lg_now_us();
+		if(now >= lg.stop_at)
+			{ break; }
+		if(next_send > now)
+			{ cs_sleepus(next_send - now); }
+		sched = next_send;
+		next_send += interval;
+
+		if(!s->connected)
+		{
+			if(lg.proto->connect_fn(s) < 0)
+			{
+				lg_disconnect(s);
+				s->count[LG_ERROR]++;
+				continue;
+			}
+			s->connected = 1;
+			// the login is not part of the request latency
+			sched = lg_now_us();
+			next_send = sched + interval;
+		}
+
+		lg_build_ecm(s, ecm);
+		start = lg_now_us();
+		rc = lg.proto->ecm_fn(s, ecm, start + (int64_t)lg.timeout * 1000);
+		s->count[rc]++;
+		// Time spent behind schedule counts as latency
+		if(rc == LG_OK || rc == LG_NOTFOUND)
+			{ lg_add_latency(s, (uint32_t)(lg_now_us() - sched)); }
+		// Stream protocols can not resync after a lost answer
+		if(rc == LG_ERROR || (rc == LG_TIMEOUT && !lg.proto->is_udp))
+			{ lg_disconnect(s); }
+	}
+
+	lg_disconnect(s);
+	NULLFREE(ecm);
+	return NULL;
+}
+
+/* Setup and report */
+
+static int32_t lg_cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+static uint32_t lg_percentile(const uint32_t *sorted, uint32_t cnt, double pct)
+{
+	uint32_t rank;
+
+	if(!cnt)
+		{ return 0; }
+	rank = (uint32_t)(pct / 100.0 * cnt + 0.5);
+	if(rank < 1)
+		{ rank = 1; }
+	if(rank > cnt)
+		{ rank = cnt; }
+	return sorted[rank - 1];
+}
+
+// Parses "caid[@prid]:srvid[,...]", all values hex
+static int32_t lg_parse_services(char *value)
+{
+	char *ptr, *saveptr = NULL, *c;
+	struct lg_service *srv;
+
+	lg.nservices = 0;
+	for(ptr = strtok_r(value, ",", &saveptr); ptr; ptr = strtok_r(NULL, ",", &saveptr))
+	{
+		if(lg.nservices == LG_MAX_SERVICES)
+			{ return -1; }
+		srv = &lg.services[lg.nservices];
+		if(!(c = strchr(ptr, ':')))
+			{ return -1; }
+		srv->srvid = a2i(c + 1, 2);
+		*c = '\0';
+		srv->prid = 0;
+		if((c = strchr(ptr, '@')))
+		{
+			srv->prid = a2i(c + 1, 4);
+			*c = '\0';
+		}
+		srv->caid = a2i(ptr, 2);
+		lg.nservices++;
+	}
+	return lg.nservices ? 0 : -1;
+}
+
+static int32_t lg_resolve(void)
+{
+	struct addrinfo hints, *res = NULL;
+	char port[8];
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = lg.proto->is_udp ? SOCK_DGRAM : SOCK_STREAM;
+	snprintf(port, sizeof(port), "%d", lg.port);
+	if(getaddrinfo(lg.host, port, &hints, &res) || !res)
+		{ return -1; }
+	memcpy(&lg.addr, res->ai_addr, res->ai_addrlen);
+	lg.addr_len = res->ai_addrlen;
+	freeaddrinfo(res);
+	return 0;
+}
+
+static void lg_usage(const char *prog)
+{
+	const struct lg_proto *p;
+
+	fprintf(stderr, "Usage: %s -p <protocol> -P <port> -u <user> -w <password> [options]\n\n", prog);
+	fprintf(stderr, " -p <protocol>   One of:");
+	for(p = lg_protos; p->name; p++)
+		{ fprintf(stderr, " %s", p->name); }
+	fprintf(stderr, "\n");
+	fprintf(stderr, " -H <host>       Server address (default: 127.0.0.1)\n");
+	fprintf(stderr, " -P <port>       Server port\n");
+	fprintf(stderr, " -u <user>       Account name\n");
+	fprintf(stderr, " -w <password>   Account password\n");
+	fprintf(stderr, " -k <deskey>     newcamd DES key, 28 hex digits (default: 0102030405060708091011121314)\n");
+	fprintf(stderr, " -n <sessions>   Number of parallel client sessions (default: 1)\n");
+	fprintf(stderr, " -r <rate>       ECMs per second and session (default: 10)\n");
+	fprintf(stderr, " -d <seconds>    Test duration (default: 10)\n");
+	fprintf(stderr, " -m <services>   Service mix caid[@prid]:srvid[,...] in hex (default: 0100@000000:0001)\n");
+	fprintf(stderr, " -D <percent>    Share of ECMs repeated from recent ones to produce cache hits (default: 0)\n");
+	fprintf(stderr, " -l <length>     ECM length in bytes (default: 100)\n");
+	fprintf(stderr, " -t <ms>         Answer timeout (default: 2000)\n");
+	fprintf(stderr, " -s <seed>       Seed for the ECM generator (default: 1)\n");
+}
+
+int32_t run_loadgen(int32_t argc, char *argv[])
+{
+	char mix[256] = "0100@000000:0001";
+	struct lg_session *sessions;
+	const struct lg_proto *p;
+	uint32_t *lat, lat_cnt = 0, i, j, total[LG_RESULTS];
+	uint64_t lat_sum = 0, requests = 0;
+	int64_t started;
+	double elapsed;
+	int32_t opt, connected = 0;
+
+	memset(&lg, 0, sizeof(lg));
+	cs_strncpy(lg.host, "127.0.0.1", sizeof(lg.host));
+	key_atob_l("0102030405060708091011121314", lg.ncd_key, 28);
+	lg.sessions = 1;
+	lg.rate = 10;
+	lg.duration = 10;
+	lg.ecm_len = 100;
+	lg.timeout = 2000;
+	lg.seed = 1;
+
+	while((opt = getopt(argc, argv, "p:H:P:u:w:k:n:r:d:m:D:l:t:s:h")) != -1)
+	{
+		switch(opt)
+		{
+		case 'p':
+			for(p = lg_protos; p->name; p++)
+			{
+				if(!strcmp(p->name, optarg))
+					{ lg.proto = p; }
+			}
+			break;
+		case 'H': cs_strncpy(lg.host, optarg, sizeof(lg.host)); break;
+		case 'P': lg.port = atoi(optarg); break;
+		case 'u': cs_strncpy(lg.user, optarg, sizeof(lg.user)); break;
+		case 'w': cs_strncpy(lg.pwd, optarg, sizeof(lg.pwd)); break;
+		case 'k':
+			if(strlen(optarg) != 28 || key_atob_l(optarg, lg.ncd_key, 28) < 0)
+			{
+				fprintf(stderr, "Invalid DES key: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'n': lg.sessions = atoi(optarg); break;
+		case 'r': lg.rate = atoi(optarg); break;
+		case 'd': lg.duration = atoi(optarg); break;
+		case 'm': cs_strncpy(mix, optarg, sizeof(mix)); break;
+		case 'D': lg.dup_ratio = atoi(optarg); break;
+		case 'l': lg.ecm_len = atoi(optarg); break;
+		case 't': lg.timeout = atoi(optarg); break;
+		case 's': lg.seed = strtoul(optarg, NULL, 0); break;
+		default:
+			lg_usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(!lg.proto || !lg.port || !lg.user[0] || lg.sessions < 1 || lg.rate < 1 || lg.duration < 1
+			|| lg.timeout < 1 || lg.dup_ratio < 0 || lg.dup_ratio > 100 || lg.ecm_len < 8 || lg.ecm_len > 255)
+	{
+		lg_usage(argv[0]);
+		return 1;
+	}
+	if(lg_parse_services(mix) < 0)
+	{
+		fprintf(stderr, "Invalid service mix: %s\n", mix);
+		return 1;
+	}
+	if(lg_resolve() < 0)
+	{
+		fprintf(stderr, "Can not resolve %s:%d\n", lg.host, lg.port);
+		return 1;
+	}
+	if(!cs_malloc(&sessions, lg.sessions * sizeof(struct lg_session)))
+		{ return 1; }
+
+	signal(SIGPIPE, SIG_IGN);
+	started = lg_now_us();
+	lg.stop_at = started + (int64_t)lg.duration * 1000000;
+	for(opt = 0; opt < lg.sessions; opt++)
+	{
+		struct lg_session *s = &sessions[opt];
+		s->id = opt;
+		s->fd = -1;
+		s->rnd = lg.seed * 2654435761u + opt + 1;
+#ifdef MODULE_CCCAM
+		i2b_buf(4, 0x4c47454e, s->node_id); // "LGEN"
+		i2b_buf(4, (uint32_t)opt, s->node_id + 4);
+#endif
+		if(pthread_create(&s->thread, NULL, lg_session_thread, s))
+		{
+			fprintf(stderr, "Can not start session %d\n", opt);
+			lg.sessions = opt;
+			break;
+		}
+	}
+
+	memset(total, 0, sizeof(total));
+	for(opt = 0; opt < lg.sessions; opt++)
+	{
+		pthread_join(sessions[opt].thread, NULL);
+		for(j = 0; j < LG_RESULTS; j++)
+			{ total[j] += sessions[opt].count[j]; }
+		lat_cnt += sessions[opt].lat_cnt;
+		if(sessions[opt].lat_cnt)
+			{ connected++; }
+	}
+	elapsed = (lg_now_us() - started) / 1000000.0;
+
+	lat = NULL;
+	if(lat_cnt && !cs_malloc(&lat, lat_cnt * sizeof(uint32_t)))
+		{ lat_cnt = 0; }
+	for(opt = 0, i = 0; opt < lg.sessions && lat; opt++)
+	{
+		memcpy(lat + i, sessions[opt].lat, sessions[opt].lat_cnt * sizeof(uint32_t));
+		i += sessions[opt].lat_cnt;
+		NULLFREE(sessions[opt].lat);
+	}
+	for(i = 0; i < lat_cnt; i++)
+		{ lat_sum += lat[i]; }
+	if(lat_cnt)
+		{ qsort(lat, lat_cnt, sizeof(uint32_t), lg_cmp_u32); }
+	for(j = 0; j < LG_RESULTS; j++)
+		{ requests += total[j]; }
+
+	printf("{\n\t\"version\": \"%s\",\n\t\"revision\": \"%s\",\n\t\"protocol\": \"%s\",\n",
+		   CS_VERSION, CS_SVN_VERSION, lg.proto->name);
+	printf("\t\"sessions\": %d,\n\t\"sessions_answered\": %d,\n\t\"duration_s\": %.2f,\n\t\"requests\": %"PRIu64",\n\t\"requests_per_sec\": %.1f,\n",
+		   lg.sessions, connected, elapsed, requests, elapsed > 0 ? requests / elapsed : 0.0);
+	printf("\t\"results\": {");
+	for(j = 0; j < LG_RESULTS; j++)
+		{ printf("%s \"%s\": %u", j ? "," : "", lg_result_txt[j], total[j]); }
+	printf(" },\n");
+	printf("\t\"latency_us\": { \"count\": %u, \"min\": %u, \"avg\": %.0f, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"p999\": %u, \"max\": %u }\n}\n",
+		   lat_cnt, lat_cnt ? lat[0] : 0, lat_cnt ? (double)lat_sum / lat_cnt : 0.0,
+		   lg_percentile(lat, lat_cnt, 50), lg_percentile(lat, lat_cnt, 90), lg_percentile(lat, lat_cnt, 99),
+		   lg_percentile(lat, lat_cnt, 99.9), lat_cnt ? lat[lat_cnt - 1] : 0);
+	fflush(stdout);
+
+	NULLFREE(lat);
+	NULLFREE(sessions);
+	return 0;
+}
@@ -382,6 +382,7 @@ void cacheex_clear_account_stats(struct s_auth *account)
 	account->cwcacheexgot = 0;
 	account->cwcacheexpush = 0;
 	account->cwcacheexhit = 0;
+	account->cwcacheexdrop = 0;
 }
 
 void cacheex_clear_client_stats(struct s_client *client)
@@ -389,6 +390,7 @@ void cacheex_clear_client_stats(struct s_client *client)
 	client->cwcacheexgot = 0;
 	client->cwcacheexpush = 0;
 	client->cwcacheexhit = 0;
+	client->cwcacheexdrop = 0;
 }
 
 int32_t cacheex_add_stats(struct s_client *cl, uint16_t caid, uint16_t srvid, uint32_t prid, uint8_t direction)
@@ -445,9 +447,92 @@ int8_t cacheex_maxhop(struct s_client *cl)
 	return maxhop;
 }
 
+/*
+ * Every peer has a ring of ECMs waiting to be pushed. Only one push job is
+ * queued per peer at a time, it sends everything that piled up until then.
+ * When a peer can not keep up, the ring fills and further ECMs are counted
+ * as dropped instead of flooding the job queue.
+ * The ring holds pointers into the ECM cache, which frees an ECM a few
+ * seconds after ctimeout. Entries that old are dropped unsent, and a push
+ * job that is still pending after that long is assumed lost (work_thread
+ * drops old jobs) and queued again.
+ */
+#define CACHEEX_PUSH_QUEUE  2048
+#define CACHEEX_PUSH_BATCH  64
+
+struct s_cacheex_push
+{
+	ECM_REQUEST     *er;
+	time_t          tps;    // er->tps.time, er must not be touched once it is too old
+};
+
+static pthread_mutex_t cacheex_push_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline time_t cacheex_push_timeout(void)
+{
+	return time(NULL) - ((cfg.ctimeout + 500) / 1000 + 1);
+}
+
+static void cacheex_count_drop(struct s_client *cl)
+{
+	cl->cwcacheexdrop++;
+	if(cl->account)
+		{ cl->account->cwcacheexdrop++; }
+	first_client->cwcacheexdrop++;
+}
+
 static void cacheex_cache_push_to_client(struct s_client *cl, ECM_REQUEST *er)
 {
-	add_job(cl, ACTION_CACHE_PUSH_OUT, er, 0);
+	int8_t add = 0, full = 0;
+	int32_t dropped = 0;
+
+	SAFE_MUTEX_LOCK(&cacheex_push_lock);
+	if(!cl->cacheex_push_queue && !cs_malloc(&cl->cacheex_push_queue, CACHEEX_PUSH_QUEUE * sizeof(struct s_cacheex_push)))
+	{
+		SAFE_MUTEX_UNLOCK(&cacheex_push_lock);
+		return;
+	}
+	if(cl->cacheex_push_pending && cl->cacheex_push_since < cacheex_push_timeout())
+		{ cl->cacheex_push_pending = 0; }
+	if(cl->cacheex_push_count >= CACHEEX_PUSH_QUEUE)
+	{
+		cacheex_count_drop(cl);
+		dropped = cl->cwcacheexdrop;
+		if(!cl->cacheex_push_full)
+			{ cl->cacheex_push_full = full = 1; }
+	}
+	else
+	{
+		struct s_cacheex_push *push = &cl->cacheex_push_queue[(cl->cacheex_push_head + cl->cacheex_push_count) % CACHEEX_PUSH_QUEUE];
+		push->er = er;
+		push->tps = er->tps.time;
+		cl->cacheex_push_count++;
+	}
+	// also re-arms a job that got lost while the ring was full
+	if(cl->cacheex_push_count && !cl->cacheex_push_pending)
+	{
+		cl->cacheex_push_pending = add = 1;
+		cl->cacheex_push_since = time(NULL);
+	}
+	SAFE_MUTEX_UNLOCK(&cacheex_push_lock);
+
+	if(full)
+	{
+		cs_log("WARNING: cacheex push queue of %s %s is full, dropping (%d dropped so far)",
+			   cl->typ == 'c' ? "client" : "reader", username(cl), dropped);
+	}
+	else if(dropped)
+	{
+		cs_log_dbg(D_CACHEEX, "push queue of %s full, ECM dropped", username(cl));
+	}
+
+	// the queued ECMs are picked up by the next job if this one can not be added
+	if(add && !add_job(cl, ACTION_CACHE_PUSH_OUT, NULL, 0))
+	{
+		SAFE_MUTEX_LOCK(&cacheex_push_lock);
+		cl->cacheex_push_pending = 0;
+		SAFE_MUTEX_UNLOCK(&cacheex_push_lock);
+	}
 }
 
 /**
@@ -1014,7 +1099,7 @@ int32_t chk_csp_ctab(ECM_REQUEST *er, CECSPVALUETAB *tab)
 	return 0;
 }
 
-void cacheex_push_out(struct s_client *cl, ECM_REQUEST *er) {
+static void cacheex_push_out(struct s_client *cl, ECM_REQUEST *er) {
 	int32_t res = 0, stats = -1;
 	struct s_reader *reader = cl->reader;
 	struct s_module *module = get_module(cl);
@@ -1039,6 +1124,72 @@ void cacheex_push_out(struct s_client *cl, ECM_REQUEST *er) {
 	first_client->cwcacheexpush++;
 }
 
+static int32_t cacheex_push_cork(struct s_client *cl, int32_t on)
+{
+#ifdef TCP_CORK
+	struct s_module *module = cl->reader ? &cl->reader->ph : get_module(cl);
+
+	// hold back partial frames so a batch of pushes goes out in full segments
+	if(module->type == MOD_CONN_TCP && cl->udp_fd > 0)
+		{ return setsockopt(cl->udp_fd, IPPROTO_TCP, TCP_CORK, (void *)&on, sizeof(on)) == 0; }
+#else
+	(void)cl;
+	(void)on;
+#endif
+	return 0;
+}
+
+void cacheex_push_queue_out(struct s_client *cl)
+{
+	ECM_REQUEST *batch[CACHEEX_PUSH_BATCH];
+	int32_t i, n, m, stale, corked = 0;
+	time_t timeout;
+
+	while(!cl->kill)
+	{
+		timeout = cacheex_push_timeout();
+		stale = 0;
+		SAFE_MUTEX_LOCK(&cacheex_push_lock);
+		n = cl->cacheex_push_count < CACHEEX_PUSH_BATCH ? cl->cacheex_push_count : CACHEEX_PUSH_BATCH;
+		for(i = 0, m = 0; i < n; i++)
+		{
+			struct s_cacheex_push *push = &cl->cacheex_push_queue[cl->cacheex_push_head];
+			if(push->tps < timeout)
+			{
+				cacheex_count_drop(cl);
+				stale++;
+			}
+			else
+				{ batch[m++] = push->er; }
+			cl->cacheex_push_head = (cl->cacheex_push_head + 1) % CACHEEX_PUSH_QUEUE;
+		}
+		cl->cacheex_push_count -= n;
+		if(!n)
+		{
+			cl->cacheex_push_pending = 0;
+			cl->cacheex_push_full = 0;
+		}
+		SAFE_MUTEX_UNLOCK(&cacheex_push_lock);
+
+		if(!n)
+			{ break; }
+
+		if(stale)
+			{ cs_log_dbg(D_CACHEEX, "push queue of %s: %d ECMs too old, dropped", username(cl), stale); }
+
+		n = m;
+
+		if(n > 1 && !corked)
+			{ corked = cacheex_push_cork(cl, 1); }
+
+		for(i = 0; i < n; i++)
+			{ cacheex_push_out(cl, batch[i]); }
+	}
+
+	if(corked)
+		{ cacheex_push_cork(cl, 0); }
+}
+
 bool cacheex_check_queue_length(struct s_client *cl)
 {
 	// Avoid full running queues:
@@ -61,7 +61,7 @@ static int32_t __camd35_send(struct s_client *cl, uchar *buf, int32_t buflen, in
 	int32_t status;
 	if(cl->is_udp)
 	{
-		status = sendto(cl->udp_fd, rbuf, l + 4, 0, (struct sockaddr *)&cl->udp_sa, cl->udp_sa_len);
+		status = net_udp_send(cl, rbuf, l + 4);
 		if(status == -1) { set_null_ip(&SIN_GET_ADDR(cl->udp_sa)); }
 	}
 	else
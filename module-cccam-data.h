@@ -34,6 +34,8 @@
 
 #define HOP_RATING 5
 
+#define CC_CARD_INDEX_SIZE 64
+
 typedef enum
 {
 	DECRYPT, ENCRYPT
@@ -125,6 +127,9 @@ struct cc_card
 	time_t timeout;
 	uint8_t is_ext;
 	int8_t rating;
+	uint32_t seq; // order in cc->cards, used to merge the caid index lists
+	struct cc_sid_set *goodsid_set; // hashed copies of goodsids/badsids, rebuilt when the list changes
+	struct cc_sid_set *badsid_set;
 };
 
 typedef enum
@@ -191,6 +196,8 @@ struct cc_data
 	uint8_t send_buffer[CC_MAXMSGSIZE];
 
 	LLIST *cards; // cards list
+	LLIST *card_index[CC_CARD_INDEX_SIZE]; // cards by caid, each list in the order of cc->cards
+	uint32_t card_seq;
 
 	int32_t max_ecms;
 	int32_t ecm_counter;
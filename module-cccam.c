@@ -21,6 +21,7 @@
 #include "oscam-lock.h"
 #include "oscam-net.h"
 #include "oscam-reader.h"
+#include "oscam-rules.h"
 #include "oscam-string.h"
 #include "oscam-time.h"
 #include "oscam-work.h"
@@ -299,8 +300,101 @@ int32_t sid_eq_bb(struct cc_srvid_block *srvid1, struct cc_srvid_block *srvid2)
 				&& (srvid1->blocked_till == srvid2->blocked_till || !srvid1->blocked_till || !srvid2->blocked_till));
 }
 
+/*
+ * Cards with many good or blocked sids get a hash on the sid next to the list.
+ * The list stays the master copy: a set that no longer matches its version and
+ * count is rebuilt on the next lookup, so changes made anywhere are picked up.
+ */
+#define CC_SID_SET_MIN 8
+
+struct cc_sid_set
+{
+	uint32_t version;
+	int32_t count;
+	void **entry; // list elements in list order
+	struct s_rule_index idx;
+};
+
+static void cc_sid_set_free(struct cc_sid_set *set)
+{
+	if(!set)
+		{ return; }
+	rule_index_free(&set->idx);
+	add_garbage(set->entry);
+	add_garbage(set);
+}
+
+static struct cc_sid_set *cc_sid_set_get(struct cc_sid_set **pset, LLIST *sids)
+{
+	struct cc_sid_set *set = *pset, *new_set;
+	struct s_rule_key *keys;
+	struct cc_srvid *srvid;
+	uint32_t version = sids->version;
+	int32_t n = 0, count = ll_count(sids);
+
+	if(set && set->version == version && set->count == count)
+		{ return set; }
+
+	if(!cs_malloc(&new_set, sizeof(struct cc_sid_set)))
+		{ return NULL; }
+	if(!cs_malloc(&new_set->entry, count * sizeof(void *)) || !cs_malloc(&keys, count * sizeof(struct s_rule_key)))
+	{
+		NULLFREE(new_set->entry);
+		NULLFREE(new_set);
+		return NULL;
+	}
+
+	LL_ITER it = ll_iter_create(sids);
+	while(n < count && (srvid = ll_iter_next(&it)))
+	{
+		new_set->entry[n] = srvid;
+		keys[n].key = srvid->sid;
+		keys[n].rule = n;
+		n++;
+	}
+	new_set->version = version;
+	new_set->count = count;
+
+	if(!rule_index_build(&new_set->idx, keys, n))
+	{
+		NULLFREE(keys);
+		NULLFREE(new_set->entry);
+		NULLFREE(new_set);
+		return NULL;
+	}
+	NULLFREE(keys);
+
+	// another lookup may have replaced the set meanwhile, then the lists are walked this time
+	if(!__sync_bool_compare_and_swap(pset, set, new_set))
+	{
+		cc_sid_set_free(new_set);
+		return NULL;
+	}
+	cc_sid_set_free(set);
+	return new_set;
+}
+
+static void *cc_sid_set_find(struct cc_sid_set *set, struct cc_srvid *srvid)
+{
+	const uint32_t *rule;
+	uint32_t i, count;
+
+	rule = rule_index_find(&set->idx, srvid->sid, &count);
+	for(i = 0; i < count; i++)
+	{
+		if(sid_eq(set->entry[rule[i]], srvid))
+			{ return set->entry[rule[i]]; }
+	}
+	return NULL;
+}
+
 struct cc_srvid_block *is_sid_blocked(struct cc_card *card, struct cc_srvid *srvid_blocked)
 {
+	struct cc_sid_set *set;
+
+	if(ll_count(card->badsids) >= CC_SID_SET_MIN && (set = cc_sid_set_get(&card->badsid_set, card->badsids)))
+		{ return cc_sid_set_find(set, srvid_blocked); }
+
 	LL_ITER it = ll_iter_create(card->badsids);
 	struct cc_srvid_block *srvid;
 	while((srvid = ll_iter_next(&it)))
@@ -329,6 +423,11 @@ uint32_t has_perm_blocked_sid(struct cc_card *card)
 
 struct cc_srvid *is_good_sid(struct cc_card *card, struct cc_srvid *srvid_good)
 {
+	struct cc_sid_set *set;
+
+	if(ll_count(card->goodsids) >= CC_SID_SET_MIN && (set = cc_sid_set_get(&card->goodsid_set, card->goodsids)))
+		{ return cc_sid_set_find(set, srvid_good); }
+
 	LL_ITER it = ll_iter_create(card->goodsids);
 	struct cc_srvid *srvid;
 	while((srvid = ll_iter_next(&it)))
@@ -1259,115 +1358,190 @@ int32_t same_card(struct cc_card *card1, struct cc_card *card2)
 			same_first_node(card1, card2));
 }
 
-struct cc_card *get_matching_card(struct s_client *cl, ECM_REQUEST *cur_er, int8_t chk_only)
+static uint32_t cc_card_index_hash(uint16_t caid)
 {
-	struct cc_data *cc = cl->cc;
-	struct s_reader *rdr = cl->reader;
-	if(cl->kill || !rdr || !cc)
-		{ return NULL; }
+	return (caid * 2654435761U) >> 26;
+}
 
-	struct cc_srvid cur_srvid;
-	cur_srvid.sid = cur_er->srvid;
-	cur_srvid.chid = cur_er->chid;
-	cur_srvid.ecmlen = cur_er->ecmlen;
+static void cc_card_index_add(struct cc_data *cc, struct cc_card *card)
+{
+	LLIST **l = &cc->card_index[cc_card_index_hash(card->caid)];
 
-	int32_t best_rating = MIN_RATING - 1, rating;
+	if(!*l)
+		{ *l = ll_create("card_index"); }
+	card->seq = ++cc->card_seq;
+	ll_append(*l, card);
+}
 
-	LL_ITER it = ll_iter_create(cc->cards);
-	struct cc_card *card = NULL, *ncard, *xcard = NULL;
-	while((ncard = ll_iter_next(&it)))
-	{
-		int lb_match = 0;
-		if (config_enabled(WITH_LB)) {
-			//accept beta card when beta-tunnel is on
-			lb_match = chk_only && cfg.lb_mode && cfg.lb_auto_betatunnel &&
-				(
-					(caid_is_nagra(cur_er->caid) && caid_is_betacrypt(ncard->caid) && cfg.lb_auto_betatunnel_mode <= 3) ||
-					(caid_is_betacrypt(cur_er->caid) && caid_is_nagra(ncard->caid) && cfg.lb_auto_betatunnel_mode >= 1)
-				);
-		}
+static void cc_card_index_remove(struct cc_data *cc, struct cc_card *card)
+{
+	ll_remove(cc->card_index[cc_card_index_hash(card->caid)], card);
+}
 
-		if((ncard->caid == cur_er->caid  // caid matches
-				|| (rdr->cc_want_emu && (ncard->caid == (cur_er->caid & 0xFF00))))
-				// or system matches if caid ends with 00
-				// needed for wantemu
-				|| lb_match
-		  )
-		{		
-			int32_t goodSidCount = ll_count(ncard->goodsids);
-			int32_t badSidCount = ll_count(ncard->badsids);
-			struct cc_srvid *good_sid;
-			struct cc_srvid_block *blocked_sid;
+static void cc_card_index_clear(struct cc_data *cc, int8_t destroy)
+{
+	int32_t i;
+	for(i = 0; i < CC_CARD_INDEX_SIZE; i++)
+	{
+		if(destroy)
+			{ ll_destroy(&cc->card_index[i]); }
+		else
+			{ ll_clear(cc->card_index[i]); }
+	}
+}
+
+struct cc_card_match
+{
+	struct cc_card *card;
+	struct cc_card *xcard;
+	int32_t best_rating;
+};
+
+static void rate_matching_card(struct s_reader *rdr, ECM_REQUEST *cur_er, struct cc_srvid *cur_srvid, int8_t chk_only,
+							   struct cc_card *ncard, struct cc_card_match *match)
+{
+	int32_t rating;
+	int lb_match = 0;
+	if (config_enabled(WITH_LB)) {
+		//accept beta card when beta-tunnel is on
+		lb_match = chk_only && cfg.lb_mode && cfg.lb_auto_betatunnel &&
+			(
+				(caid_is_nagra(cur_er->caid) && caid_is_betacrypt(ncard->caid) && cfg.lb_auto_betatunnel_mode <= 3) ||
+				(caid_is_betacrypt(cur_er->caid) && caid_is_nagra(ncard->caid) && cfg.lb_auto_betatunnel_mode >= 1)
+			);
+	}
+
+	if((ncard->caid == cur_er->caid  // caid matches
+			|| (rdr->cc_want_emu && (ncard->caid == (cur_er->caid & 0xFF00))))
+			// or system matches if caid ends with 00
+			// needed for wantemu
+			|| lb_match
+	  )
+	{		
+		int32_t goodSidCount = ll_count(ncard->goodsids);
+		int32_t badSidCount = ll_count(ncard->badsids);
+		struct cc_srvid *good_sid;
+		struct cc_srvid_block *blocked_sid;
+		
+		// only good sids -> check if sid is good
+		if(goodSidCount && !badSidCount)
+		{			
+			good_sid = is_good_sid(ncard, cur_srvid);
+			if(!good_sid)
+				{ return; }
+		}
+		// only bad sids -> check if sid is bad
+		else if(!goodSidCount && badSidCount)
+		{
+			blocked_sid = is_sid_blocked(ncard, cur_srvid);
+			if(blocked_sid && (!chk_only || blocked_sid->blocked_till == 0))
+				{ return; }
+		}			
+		// bad and good sids -> check not blocked and good
+		else if (goodSidCount && badSidCount)
+		{
+			blocked_sid = is_sid_blocked(ncard, cur_srvid);				
+			good_sid = is_good_sid(ncard, cur_srvid);
 			
-			// only good sids -> check if sid is good
-			if(goodSidCount && !badSidCount)
-			{			
-				good_sid = is_good_sid(ncard, &cur_srvid);
-				if(!good_sid)
-					{ continue; }
-			}
-			// only bad sids -> check if sid is bad
-			else if(!goodSidCount && badSidCount)
-			{
-				blocked_sid = is_sid_blocked(ncard, &cur_srvid);
-				if(blocked_sid && (!chk_only || blocked_sid->blocked_till == 0))
-					{ continue; }
-			}			
-			// bad and good sids -> check not blocked and good
-			else if (goodSidCount && badSidCount)
-			{
-				blocked_sid = is_sid_blocked(ncard, &cur_srvid);				
-				good_sid = is_good_sid(ncard, &cur_srvid);
-				
-				if(blocked_sid && (!chk_only || blocked_sid->blocked_till == 0))
-					{ continue; }
-				if(!good_sid)
-					{ continue; }
-			}
+			if(blocked_sid && (!chk_only || blocked_sid->blocked_till == 0))
+				{ return; }
+			if(!good_sid)
+				{ return; }
+		}
 
 
-			if(!(rdr->cc_want_emu) && caid_is_nagra(ncard->caid) && (!xcard || ncard->hop < xcard->hop))
-				{ xcard = ncard; } //remember card (D+ / 1810 fix) if request has no provider, but card has
+		if(!(rdr->cc_want_emu) && caid_is_nagra(ncard->caid) && (!match->xcard || ncard->hop < match->xcard->hop))
+			{ match->xcard = ncard; } //remember card (D+ / 1810 fix) if request has no provider, but card has
 
-			rating = ncard->rating - ncard->hop * HOP_RATING;
-			if(rating < MIN_RATING)
-				{ rating = MIN_RATING; }
-			else if(rating > MAX_RATING)
-				{ rating = MAX_RATING; }
+		rating = ncard->rating - ncard->hop * HOP_RATING;
+		if(rating < MIN_RATING)
+			{ rating = MIN_RATING; }
+		else if(rating > MAX_RATING)
+			{ rating = MAX_RATING; }
 
-			if(!ll_count(ncard->providers))    //card has no providers:
+		if(!ll_count(ncard->providers))    //card has no providers:
+		{
+			if(rating > match->best_rating)
 			{
-				if(rating > best_rating)
-				{
-					// ncard is closer
-					card = ncard;
-					best_rating = rating; // ncard has been matched
-				}
-
+				// ncard is closer
+				match->card = ncard;
+				match->best_rating = rating; // ncard has been matched
 			}
-			else   //card has providers
+
+		}
+		else   //card has providers
+		{
+			LL_ITER it2 = ll_iter_create(ncard->providers);
+			struct cc_provider *provider;
+			while((provider = ll_iter_next(&it2)))
 			{
-				LL_ITER it2 = ll_iter_create(ncard->providers);
-				struct cc_provider *provider;
-				while((provider = ll_iter_next(&it2)))
+				if(!cur_er->prid || (provider->prov == cur_er->prid))    // provid matches
 				{
-					if(!cur_er->prid || (provider->prov == cur_er->prid))    // provid matches
+					if(rating  > match->best_rating)
 					{
-						if(rating  > best_rating)
-						{
-							// ncard is closer
-							card = ncard;
-							best_rating = rating; // ncard has been matched
-						}
+						// ncard is closer
+						match->card = ncard;
+						match->best_rating = rating; // ncard has been matched
 					}
 				}
 			}
 		}
 	}
-	if(!card)
-		{ card = xcard; } //18xx: if request has no provider and we have no card, we try this card
+}
 
-	return card;
+struct cc_card *get_matching_card(struct s_client *cl, ECM_REQUEST *cur_er, int8_t chk_only)
+{
+	struct cc_data *cc = cl->cc;
+	struct s_reader *rdr = cl->reader;
+	if(cl->kill || !rdr || !cc)
+		{ return NULL; }
+
+	struct cc_srvid cur_srvid;
+	cur_srvid.sid = cur_er->srvid;
+	cur_srvid.chid = cur_er->chid;
+	cur_srvid.ecmlen = cur_er->ecmlen;
+
+	struct cc_card_match match;
+	match.card = NULL;
+	match.xcard = NULL;
+	match.best_rating = MIN_RATING - 1;
+
+	struct cc_card *ncard;
+	if(config_enabled(WITH_LB) && chk_only && cfg.lb_mode && cfg.lb_auto_betatunnel)
+	{
+		// beta-tunnel may match cards of any nagra/betacrypt caid
+		LL_ITER it = ll_iter_create(cc->cards);
+		while((ncard = ll_iter_next(&it)))
+			{ rate_matching_card(rdr, cur_er, &cur_srvid, chk_only, ncard, &match); }
+	}
+	else
+	{
+		// only the cards of the caid (and the system caid for wantemu) in the order of cc->cards
+		uint16_t emu_caid = cur_er->caid & 0xFF00;
+		uint32_t h1 = cc_card_index_hash(cur_er->caid), h2 = cc_card_index_hash(emu_caid);
+		LL_ITER it1 = ll_iter_create(cc->card_index[h1]);
+		LL_ITER it2 = ll_iter_create(rdr->cc_want_emu && h2 != h1 ? cc->card_index[h2] : NULL);
+		struct cc_card *card1 = ll_iter_next(&it1), *card2 = ll_iter_next(&it2);
+		while(card1 || card2)
+		{
+			if(card1 && (!card2 || card1->seq < card2->seq))
+			{
+				ncard = card1;
+				card1 = ll_iter_next(&it1);
+			}
+			else
+			{
+				ncard = card2;
+				card2 = ll_iter_next(&it2);
+			}
+			rate_matching_card(rdr, cur_er, &cur_srvid, chk_only, ncard, &match);
+		}
+	}
+
+	if(!match.card)
+		{ match.card = match.xcard; } //18xx: if request has no provider and we have no card, we try this card
+
+	return match.card;
 }
 
 //reopen all blocked sids for this srvid:
@@ -1375,7 +1549,7 @@ static void reopen_sids(struct cc_data *cc, int8_t ignore_time, ECM_REQUEST *cur
 {
 	time_t utime = time(NULL);
 	struct cc_card *card;
-	LL_ITER it = ll_iter_create(cc->cards);
+	LL_ITER it = ll_iter_create(cc->card_index[cc_card_index_hash(cur_er->caid)]);
 	while((card = ll_iter_next(&it)))
 	{
 		if(card->caid == cur_er->caid)    // caid matches
@@ -1870,6 +2044,8 @@ void cc_free_card(struct cc_card *card)
 	ll_destroy_data(&card->badsids);
 	ll_destroy_data(&card->goodsids);
 	ll_destroy_data(&card->remote_nodes);
+	cc_sid_set_free(card->badsid_set);
+	cc_sid_set_free(card->goodsid_set);
 
 	add_garbage(card);
 }
@@ -1919,6 +2095,7 @@ void cc_free(struct s_client *cl)
 
 	cs_log_dbg(D_TRACE, "exit cccam1/3");
 	cc_free_cardlist(cc->cards, 1);
+	cc_card_index_clear(cc, 1);
 	ll_destroy_data(&cc->pending_emms);
 	free_extended_ecm_idx(cc);
 	ll_destroy_data(&cc->extended_ecm_idx);
@@ -2195,6 +2372,7 @@ void cc_card_removed(struct s_client *cl, uint32_t shareid)
 			//cs_log_dbg(D_CLIENT, "cccam: card %08x removed, caid %04X, count %d",
 			//      card->id, card->caid, ll_count(cc->cards));
 			ll_iter_remove(&it);
+			cc_card_index_remove(cc, card);
 			if(cc->last_emm_card == card)
 			{
 				cc->last_emm_card = NULL;
@@ -2241,6 +2419,8 @@ void move_card_to_end(struct s_client *cl, struct cc_card *card_to_move)
 		cs_log_dbg(D_READER, "%s Moving card %08X to the end...", getprefix(), card_to_move->id);
 		free_extended_ecm_idx_by_card(cl, card, 0);
 		ll_append(cc->cards, card_to_move);
+		cc_card_index_remove(cc, card_to_move);
+		cc_card_index_add(cc, card_to_move);
 	}
 }
 
@@ -2332,6 +2512,7 @@ int32_t cc_parse_msg(struct s_client *cl, uint8_t *buf, int32_t l)
 		{
 			cs_writelock(__func__, &cc->cards_busy);
 			cc_free_cardlist(cc->cards, 0);
+			cc_card_index_clear(cc, 0);
 			free_extended_ecm_idx(cc);
 			cc->last_emm_card = NULL;
 			cc->num_hop1 = 0;
@@ -2531,6 +2712,7 @@ int32_t cc_parse_msg(struct s_client *cl, uint8_t *buf, int32_t l)
 			{
 				card->card_type = CT_REMOTECARD;
 				ll_append(cc->cards, card);
+				cc_card_index_add(cc, card);
 				set_au_data(cl, rdr, card, NULL);
 				cc->card_added_count++;
 				card->hop++;
@@ -2564,6 +2746,10 @@ int32_t cc_parse_msg(struct s_client *cl, uint8_t *buf, int32_t l)
 		cs_writelock(__func__, &cc->cards_busy);
 		cc_card_removed(cl, b2i(4, buf + 4));
 		cs_writeunlock(__func__, &cc->cards_busy);
+
+#ifdef MODULE_CCCSHARE
+		cccam_refresh_share();
+#endif
 		break;
 	}
 
@@ -3831,6 +4017,7 @@ int32_t cc_cli_connect(struct s_client *cl)
 	else
 	{
 		cc_free_cardlist(cc->cards, 0);
+		cc_card_index_clear(cc, 0);
 		free_extended_ecm_idx(cc);
 	}
 	if(!cc->prefix)
@@ -18,6 +18,7 @@ extern uint32_t cfg_sidtab_generation;
 
 static uint32_t cc_share_id = 0x64;
 static LLIST *reported_carddatas_list[CAID_KEY];
+static uint32_t reported_generation; // changes with every rebuild of reported_carddatas_list
 static CS_MUTEX_LOCK cc_shares_lock;
 
 static int32_t card_added_count;
@@ -291,13 +292,12 @@ static int32_t is_client_au_allowed(struct cc_card *card, struct s_client *cl)
 	return 0;
 }
 
-static int32_t send_card_to_client(struct cc_card *card, struct s_client *cl)
+/**
+ * writes the card message as this client gets it
+ * returns the message length or 0 if the card is not reshared to the client
+ */
+static int32_t write_card_for_client(struct cc_card *card, struct s_client *cl, uint8_t *buf, int32_t *cmd)
 {
-	uint8_t buf[CC_MAXMSGSIZE];
-
-	if(!card_valid_for_client(cl, card))
-		{ return 0; }
-
 	int8_t usr_reshare = cl->account->cccreshare;
 	if(usr_reshare == -1)
 		{ usr_reshare = cfg.cc_reshare; }
@@ -340,12 +340,27 @@ static int32_t send_card_to_client(struct cc_card *card, struct s_client *cl)
 	//buf[10] = card->hop-1;
 	buf[11] = new_reshare;
 
+	*cmd = is_ext ? MSG_NEW_CARD_SIDINFO : MSG_NEW_CARD;
+	return len;
+}
+
+static int32_t send_card_to_client(struct cc_card *card, struct s_client *cl)
+{
+	uint8_t buf[CC_MAXMSGSIZE];
+	int32_t len, cmd;
+
+	if(!card_valid_for_client(cl, card))
+		{ return 0; }
+
+	if(!(len = write_card_for_client(card, cl, buf, &cmd)))
+		{ return 0; }
+
 	struct s_clientmsg *clientmsg;
 	if(cs_malloc(&clientmsg, sizeof(struct s_clientmsg)))
 	{
 		memcpy(clientmsg->msg, buf, len);
 		clientmsg->len = len;
-		clientmsg->cmd = is_ext ? MSG_NEW_CARD_SIDINFO : MSG_NEW_CARD;
+		clientmsg->cmd = cmd;
 		add_job(cl, ACTION_CLIENT_SEND_MSG, clientmsg, sizeof(struct s_clientmsg));
 	}
 	return 1;
@@ -498,7 +513,12 @@ int32_t cc_free_reported_carddata(LLIST *reported_carddatas, LLIST *except,
 	return i;
 }
 
-int32_t card_valid_for_client(struct s_client *cl, struct cc_card *card)
+/**
+ * checks the card against the filters of the client account. Unlike
+ * card_valid_for_client() the result is the same for all clients with
+ * the same filters.
+ */
+static int32_t card_valid_for_filter(struct s_client *cl, struct cc_card *card)
 {
 
 	//Check group:
@@ -526,22 +546,10 @@ int32_t card_valid_for_client(struct s_client *cl, struct cc_card *card)
 	if(cl->account->cccmaxhops < card->hop)
 		{ return 0; }
 
-	//Check remote node id, if card is from there, ignore it!
-	LL_ITER it = ll_iter_create(card->remote_nodes);
-	uint8_t *node;
-	struct cc_data *cc = cl->cc;
-	while((node = ll_iter_next(&it)))
-	{
-		if(!memcmp(node, cc->peer_node_id, 8))
-		{
-			return 0;
-		}
-	}
-
 	//Check Services:
 	if(ll_count(card->providers))
 	{
-		it = ll_iter_create(card->providers);
+		LL_ITER it = ll_iter_create(card->providers);
 		struct cc_provider *prov;
 		int8_t found = 0;
 		while((prov = ll_iter_next(&it)))
@@ -591,6 +599,25 @@ int32_t card_valid_for_client(struct s_client *cl, struct cc_card *card)
 	return 1;
 }
 
+int32_t card_valid_for_client(struct s_client *cl, struct cc_card *card)
+{
+	if(!card_valid_for_filter(cl, card))
+		{ return 0; }
+
+	//Check remote node id, if card is from there, ignore it!
+	LL_ITER it = ll_iter_create(card->remote_nodes);
+	uint8_t *node;
+	struct cc_data *cc = cl->cc;
+	while((node = ll_iter_next(&it)))
+	{
+		if(!memcmp(node, cc->peer_node_id, 8))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
 uint32_t get_reader_prid(struct s_reader *rdr, int32_t j)
 {
 	return b2i(3, &rdr->prid[j][1]);
@@ -730,7 +757,11 @@ struct cc_card *create_card(struct cc_card *card)
 	if(!cs_malloc(&card2, sizeof(struct cc_card)))
 		{ return NULL; }
 	if(card)
-		{ memcpy(card2, card, sizeof(struct cc_card)); }
+	{
+		memcpy(card2, card, sizeof(struct cc_card));
+		card2->goodsid_set = NULL;
+		card2->badsid_set = NULL;
+	}
 	else
 		{ memset(card2, 0, sizeof(struct cc_card)); }
 	card2->providers = ll_create("providers");
@@ -893,24 +924,196 @@ void merge_sids(struct cc_card *carddst, struct cc_card *cardsrc)
 	
 }
 
+/*
+ * A share refresh compares every collected card with the cards already in the
+ * new share list and with the cards reported last time. Both searches go
+ * through a chained hash over the fields the compare functions look at, so a
+ * refresh stays linear in the number of cards. Chains keep insertion order,
+ * so the first match is the card a walk over the list would have found.
+ */
+#define SHARE_KEY_CAID      0 // same_card2() without group
+#define SHARE_KEY_PROVIDERS 1 // same_card2() without group + equal_providers()
+#define SHARE_KEY_CARD      2 // same_card()
+
+struct cc_share_entry
+{
+	uint32_t        hash;
+	uint32_t        next; // index + 1 of the next entry in the chain
+	void            *ptr;
+};
+
+struct cc_share_hash
+{
+	uint32_t        *head; // index + 1 of the first entry of every chain
+	struct cc_share_entry *entry;
+	uint32_t        mask;
+	uint32_t        count;
+	uint32_t        size;
+};
+
+static uint32_t share_hash_data(uint32_t h, const void *data, int32_t len)
+{
+	const uint8_t *p = data;
+	while(len-- > 0)
+		{ h = (h ^ *p++) * 16777619U; }
+	return h;
+}
+
+static uint32_t share_card_hash(struct cc_card *card, int8_t key)
+{
+	uint32_t h = 2166136261U;
+
+	h = share_hash_data(h, &card->caid, sizeof(card->caid));
+	h = share_hash_data(h, &card->card_type, sizeof(card->card_type));
+	h = share_hash_data(h, &card->sidtab, sizeof(card->sidtab));
+	h = share_hash_data(h, card->hexserial, sizeof(card->hexserial));
+
+	if(key == SHARE_KEY_PROVIDERS)
+	{
+		// providers are compared regardless of their order
+		uint32_t sum = ll_count(card->providers);
+		struct cc_provider *prov;
+		LL_ITER it = ll_iter_create(card->providers);
+		while((prov = ll_iter_next(&it)))
+			{ sum += share_hash_data(2166136261U, &prov->prov, sizeof(prov->prov)); }
+		h = share_hash_data(h, &sum, sizeof(sum));
+	}
+	else if(key == SHARE_KEY_CARD)
+	{
+		uint8_t *node = ll_has_elements(card->remote_nodes);
+		h = share_hash_data(h, &card->remote_id, sizeof(card->remote_id));
+		h = share_hash_data(h, &card->grp, sizeof(card->grp));
+		if(node)
+			{ h = share_hash_data(h, node, 8); }
+	}
+	return h;
+}
+
+static void share_hash_link(struct cc_share_hash *sh, uint32_t i)
+{
+	uint32_t *link = &sh->head[sh->entry[i].hash & sh->mask];
+	while(*link)
+		{ link = &sh->entry[*link - 1].next; }
+	sh->entry[i].next = 0;
+	*link = i + 1;
+}
+
+static void share_hash_clear(struct cc_share_hash *sh)
+{
+	if(sh->head)
+		{ memset(sh->head, 0, (sh->mask + 1) * sizeof(uint32_t)); }
+	sh->count = 0;
+}
+
+static void share_hash_free(struct cc_share_hash *sh)
+{
+	NULLFREE(sh->head);
+	NULLFREE(sh->entry);
+	memset(sh, 0, sizeof(struct cc_share_hash));
+}
+
+static void share_hash_add(struct cc_share_hash *sh, uint32_t hash, void *ptr)
+{
+	uint32_t i, *head;
+	struct cc_share_entry *entry;
+
+	if(!ptr)
+		{ return; }
+
+	if(sh->count == sh->size)
+	{
+		uint32_t size = sh->size ? sh->size * 2 : 256;
+		// on failure the table keeps what it has, only this entry is missing
+		if(!cs_malloc(&head, size * sizeof(uint32_t)))
+			{ return; }
+		if(!(entry = realloc(sh->entry, size * sizeof(struct cc_share_entry))))
+		{
+			NULLFREE(head);
+			return;
+		}
+		NULLFREE(sh->head);
+		sh->head = head;
+		sh->entry = entry;
+		sh->size = size;
+		sh->mask = size - 1;
+		for(i = 0; i < sh->count; i++)
+			{ share_hash_link(sh, i); }
+	}
+
+	i = sh->count++;
+	sh->entry[i].hash = hash;
+	sh->entry[i].ptr = ptr;
+	share_hash_link(sh, i);
+}
+
+// returns the next entry after *pos with this hash, *pos = 0 starts the chain
+static void *share_hash_next(struct cc_share_hash *sh, uint32_t hash, uint32_t *pos)
+{
+	uint32_t i;
+
+	if(!sh->head)
+		{ return NULL; }
+
+	for(i = *pos ? sh->entry[*pos - 1].next : sh->head[hash & sh->mask]; i; i = sh->entry[i - 1].next)
+	{
+		if(sh->entry[i - 1].hash == hash && sh->entry[i - 1].ptr)
+		{
+			*pos = i;
+			return sh->entry[i - 1].ptr;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Puts card (or a copy of it if the card is not ours) into the server list.
+ * If node is given, its card is replaced and freed, otherwise the card is appended.
+ * returns the card in the list or NULL
+ */
+static struct cc_card *put_server_card(LLIST *cardlist, struct cc_share_hash *sh, uint32_t hash,
+									   LL_NODE *node, struct cc_card *card, int8_t free_card)
+{
+	struct cc_card *card2 = card;
+
+	if(!free_card)
+	{
+		card2 = create_card(card); //copy card
+		if(!card2)
+			{ return NULL; }
+		add_card_providers(card2, card, 1); //copy providers to new card. Copy remote nodes to new card
+	}
+
+	if(node)
+	{
+		cc_free_card(node->obj);
+		node->obj = card2;
+	}
+	else
+		{ share_hash_add(sh, hash, ll_append(cardlist, card2)); }
+	return card2;
+}
+
 /**
  * Adds a new card to a cardlist.
  */
-int32_t add_card_to_serverlist(LLIST *cardlist, struct cc_card *card, int8_t free_card)
+int32_t add_card_to_serverlist(LLIST *cardlist, struct cc_share_hash *sh, struct cc_card *card, int8_t free_card)
 {
 
 	int32_t modified = 0;
 	if(!card)
 		{ return modified; }
 
-	LL_ITER it = ll_iter_create(cardlist);
-	struct cc_card *card2;
+	LL_NODE *node;
+	struct cc_card *card2 = NULL;
+	uint32_t hash, pos = 0;
 
 	//Minimize all, transmit just CAID, merge providers:
 	if(cfg.cc_minimize_cards == MINIMIZE_CAID && !cfg.cc_forward_origin_card)
 	{
-		while((card2 = ll_iter_next(&it)))
+		hash = share_card_hash(card, SHARE_KEY_CAID);
+		while((node = share_hash_next(sh, hash, &pos)))
 		{
+			card2 = node->obj;
 			//compare caid, hexserial, cardtype and sidtab (if any):
 			if(same_card2(card, card2, 0))
 			{
@@ -926,31 +1129,20 @@ int32_t add_card_to_serverlist(LLIST *cardlist, struct cc_card *card, int8_t fre
 			}
 		}
 
-		if(!card2)    //Not found->add it:
+		if(!node)    //Not found->add it:
 		{
-			if(free_card)    //Use this card
-			{
-				free_card = 0;
-				ll_iter_insert(&it, card);
-			}
-			else
-			{
-				card2 = create_card(card); //Copy card
-				if(!card2)
-					{ return modified; }
-				card2->hop = 0;
-				ll_iter_insert(&it, card2);
-				add_card_providers(card2, card, 1); //copy providers to new card. Copy remote nodes to new card
-			}
-			modified = 1;
-
+			card2 = put_server_card(cardlist, sh, hash, NULL, card, free_card);
+			if(card2 && !free_card)
+				{ card2->hop = 0; }
+			free_card = 0;
+			modified = card2 != NULL;
 		}
 		else     //found, merge providers:
 		{
 			card_dup_count++;
 			card2->grp |= card->grp; //add group to the card
 			add_card_providers(card2, card, 0); //merge all providers
-			ll_clear_data(card2->remote_nodes); //clear remote nodes		
+			ll_clear_data(card2->remote_nodes); //clear remote nodes
 			merge_sids(card2, card);
 		}
 	}
@@ -958,39 +1150,21 @@ int32_t add_card_to_serverlist(LLIST *cardlist, struct cc_card *card, int8_t fre
 	//Removed duplicate cards, keeping card with lower hop:
 	else if(cfg.cc_minimize_cards == MINIMIZE_HOPS && !cfg.cc_forward_origin_card)
 	{
-		while((card2 = ll_iter_next(&it)))
+		hash = share_card_hash(card, SHARE_KEY_PROVIDERS);
+		while((node = share_hash_next(sh, hash, &pos)))
 		{
+			card2 = node->obj;
 			//compare caid, hexserial, cardtype, sidtab (if any), providers:
 			if(same_card2(card, card2, 0) && equal_providers(card, card2))
-			{
-				break;
-			}
-		}
-
-		if(card2 && card2->hop > card->hop)    //hop is smaller, drop old card
-		{
-			ll_iter_remove(&it);
-			cc_free_card(card2);
-			card2 = NULL;
-			card_dup_count++;
+				{ break; }
 		}
 
-		if(!card2)    //Not found->add it:
+		if(!node || card2->hop > card->hop)    //Not found or hop is smaller->add it, drop old card
 		{
-			if(free_card)    //use this card
-			{
-				free_card = 0;
-				ll_iter_insert(&it, card);
-			}
-			else
-			{
-				card2 = create_card(card); //copy card
-				if(!card2)
-					{ return modified; }
-				ll_iter_insert(&it, card2);
-				add_card_providers(card2, card, 1); //copy providers to new card. Copy remote nodes to new card
-			}
-			modified = 1;
+			if(node)
+				{ card_dup_count++; }
+			modified = put_server_card(cardlist, sh, hash, node, card, free_card) != NULL;
+			free_card = 0;
 		}
 		else     //found, merge cards (providers are same!)
 		{
@@ -1004,36 +1178,21 @@ int32_t add_card_to_serverlist(LLIST *cardlist, struct cc_card *card, int8_t fre
 	//like cccam:
 	else   //just remove duplicate cards (same ids)
 	{
-		while((card2 = ll_iter_next(&it)))
+		hash = share_card_hash(card, SHARE_KEY_CARD);
+		while((node = share_hash_next(sh, hash, &pos)))
 		{
+			card2 = node->obj;
 			//compare remote_id, first_node, caid, hexserial, cardtype, sidtab (if any), providers:
 			if(same_card(card, card2))
 				{ break; }
 		}
 
-		if(card2 && card2->hop > card->hop)    //same card, if hop greater drop card
+		if(!node || card2->hop > card->hop)    //Not found or same card with greater hop->add it, drop old card
 		{
-			ll_iter_remove(&it);
-			cc_free_card(card2);
-			card2 = NULL;
-			card_dup_count++;
-		}
-		if(!card2)    //Not found, add it:
-		{
-			if(free_card)
-			{
-				free_card = 0;
-				ll_iter_insert(&it, card);
-			}
-			else
-			{
-				card2 = create_card(card);
-				if(!card2)
-					{ return modified; }
-				ll_iter_insert(&it, card2);
-				add_card_providers(card2, card, 1);
-			}
-			modified = 1;
+			if(node)
+				{ card_dup_count++; }
+			modified = put_server_card(cardlist, sh, hash, node, card, free_card) != NULL;
+			free_card = 0;
 		}
 		else     //Found, everything is same (including providers)
 		{
@@ -1067,18 +1226,18 @@ int32_t card_timed_out(struct cc_card *card)
  * if the card1 is already reported, we throw it away, because we build a new sharelist
  * so after finding all reported cards, we have a list of reported cards, which aren't used anymore
  **/
-int32_t find_reported_card(struct cc_card *card1)
+int32_t find_reported_card(struct cc_card *card1, struct cc_share_hash *reported)
 {
-	LL_ITER it = ll_iter_create(get_cardlist(card1->caid, reported_carddatas_list));
 	struct cc_card *card2;
-	while((card2 = ll_iter_next(&it)))
+	uint32_t pos = 0, hash = share_card_hash(card1, SHARE_KEY_CARD);
+	while((card2 = share_hash_next(reported, hash, &pos)))
 	{
 		if(same_card(card1, card2) && !card_timed_out(card2))
 		{
 			card1->id = card2->id; //Set old id !!
 			card1->timeout = card2->timeout;
 			cc_free_card(card2);
-			ll_iter_remove(&it);
+			reported->entry[pos - 1].ptr = NULL;
 			return 1; //Old card and new card are equal!
 		}
 	}
@@ -1100,9 +1259,9 @@ void cc_add_reported_carddata(LLIST *reported_carddatas, struct cc_card *card)
  * if this card is already reported, find_reported_card throws the "origin" card away
  * so the "old" sharelist is reduced
  **/
-void report_card(struct cc_card *card, LLIST *new_reported_carddatas, LLIST *new_cards)
+void report_card(struct cc_card *card, struct cc_share_hash *reported, LLIST *new_reported_carddatas, LLIST *new_cards)
 {
-	if(!find_reported_card(card))    //Add new card:
+	if(!find_reported_card(card, reported))    //Add new card:
 	{
 
 		cs_log_dbg(D_TRACE, "s-card added: id %8X remoteid %8X caid %4X hop %d reshare %d originid %8X cardtype %d",
@@ -1117,32 +1276,16 @@ void report_card(struct cc_card *card, LLIST *new_reported_carddatas, LLIST *new
 
 
 /**
- * Server:
- * Reports all caid/providers to the connected clients
- * returns 1=ok, 0=error
- * cfg.cc_reshare_services  =0 CCCAM reader reshares only received cards + defined reader services
- *              =1 CCCAM reader reshares received cards + defined services
- *              =2 CCCAM reader reshares only defined reader-services as virtual cards
- *              =3 CCCAM reader reshares only defined user-services as virtual cards
- *              =4 CCCAM reader reshares only received cards
+ * collects the cards of all readers (or the user services) into server_cards
+ * returns 0 if memory ran out
  */
-void update_card_list(void)
+static int32_t collect_server_cards(LLIST **server_cards, struct cc_share_hash *sh)
 {
-	int32_t i, j, k, l, flt, card_count = 0;
-
-	LLIST *server_cards[CAID_KEY];
-	LLIST *new_reported_carddatas[CAID_KEY];
+	int32_t j, k, l, flt;
 
 	LL_ITER it, it2;
 	struct cc_card *card;
 
-	memset(server_cards, 0, sizeof(server_cards));
-	memset(new_reported_carddatas, 0, sizeof(new_reported_carddatas));
-
-	card_added_count = 0;
-	card_removed_count = 0;
-	card_dup_count = 0;
-
 	//User-Services:
 	if(cfg.cc_reshare_services == 3 && cfg.sidtab)
 	{
@@ -1153,19 +1296,19 @@ void update_card_list(void)
 			{
 				card = create_card2(NULL, (j << 8) | k, ptr->caid[k], cfg.cc_reshare);
 				if(!card)
-					{ return; }
+					{ return 0; }
 				card->card_type = CT_CARD_BY_SERVICE_USER;
 				card->sidtab = ptr;
 				for(l = 0; l < ptr->num_provid; l++)
 				{
 					struct cc_provider *prov;
 					if(!cs_malloc(&prov, sizeof(struct cc_provider)))
-						{ return; }
+						{ return 0; }
 					prov->prov = ptr->provid[l];
 					ll_append(card->providers, prov);
 				}
 
-				add_card_to_serverlist(get_cardlist(card->caid, server_cards), card, 1);
+				add_card_to_serverlist(get_cardlist(card->caid, server_cards), sh, card, 1);
 			}
 			flt = 1;
 		}
@@ -1211,14 +1354,14 @@ void update_card_list(void)
 						{
 							card = create_card2(rdr, (j << 8) | k, ptr->caid[k], reshare);
 							if(!card)
-								{ return; }
+								{ return 0; }
 							card->card_type = CT_CARD_BY_SERVICE_READER;
 							card->sidtab = ptr;
 							for(l = 0; l < ptr->num_provid; l++)
 							{
 								struct cc_provider *prov;
 								if(!cs_malloc(&prov, sizeof(struct cc_provider)))
-									{ return; }
+									{ return 0; }
 								prov->prov = ptr->provid[l];
 								ll_append(card->providers, prov);
 							}
@@ -1228,7 +1371,7 @@ void update_card_list(void)
 								if(!rdr->audisabled)
 									{ cc_UA_oscam2cccam(rdr->hexserial, card->hexserial, card->caid); }
 
-								add_card_to_serverlist(get_cardlist(card->caid, server_cards), card, 1);
+								add_card_to_serverlist(get_cardlist(card->caid, server_cards), sh, card, 1);
 								flt = 1;
 							}
 							else
@@ -1248,7 +1391,7 @@ void update_card_list(void)
 					{
 						card = create_card2(rdr, j, caid, reshare);
 						if(!card)
-							{ return; }
+							{ return 0; }
 						card->card_type = CT_LOCALCARD;
 
 						//Setting UA: (Unique Address):
@@ -1259,7 +1402,7 @@ void update_card_list(void)
 						{
 							struct cc_provider *prov;
 							if(!cs_malloc(&prov, sizeof(struct cc_provider)))
-								{ return; }
+								{ return 0; }
 							prov->prov = rdr->ftab.filts[j].prids[k];
 
 							//cs_log("Ident CCcam card report provider: %02X%02X%02X", buf[21 + (k*7)]<<16, buf[22 + (k*7)], buf[23 + (k*7)]);
@@ -1277,7 +1420,7 @@ void update_card_list(void)
 						}
 
 						add_good_bad_sids_by_rdr(rdr, card);
-						add_card_to_serverlist(get_cardlist(caid, server_cards), card, 1);
+						add_card_to_serverlist(get_cardlist(caid, server_cards), sh, card, 1);
 						flt = 1;
 					}
 				}
@@ -1298,13 +1441,13 @@ void update_card_list(void)
 					{
 						card = create_card2(rdr, j, lcaid, reshare);
 						if(!card)
-							{ return; }
+							{ return 0; }
 						card->card_type = CT_CARD_BY_CAID1;
 						if(!rdr->audisabled)
 							{ cc_UA_oscam2cccam(rdr->hexserial, card->hexserial, lcaid); }
 
 						add_good_bad_sids_by_rdr(rdr, card);
-						add_card_to_serverlist(get_cardlist(lcaid, server_cards), card, 1);
+						add_card_to_serverlist(get_cardlist(lcaid, server_cards), sh, card, 1);
 						flt = 1;
 					}
 				}
@@ -1334,7 +1477,7 @@ void update_card_list(void)
 							uint32_t prid = get_reader_prid(rdr, j);
 							struct cc_provider *prov;
 							if(!cs_malloc(&prov, sizeof(struct cc_provider)))
-								{ return; }
+								{ return 0; }
 							prov->prov = prid;
 							//cs_log("Ident CCcam card report provider: %02X%02X%02X", buf[21 + (k*7)]<<16, buf[22 + (k*7)], buf[23 + (k*7)]);
 							if(!rdr->audisabled)
@@ -1346,7 +1489,7 @@ void update_card_list(void)
 							//cs_log("Main CCcam card report provider: %02X%02X%02X%02X", buf[21+(j*7)], buf[22+(j*7)], buf[23+(j*7)], buf[24+(j*7)]);
 						}
 						add_good_bad_sids_by_rdr(rdr, card);
-						add_card_to_serverlist(get_cardlist(caid, server_cards), card, 1);
+						add_card_to_serverlist(get_cardlist(caid, server_cards), sh, card, 1);
 						flt = 1;
 					}
 				}
@@ -1361,7 +1504,7 @@ void update_card_list(void)
 					uint16_t caid = rdr->caid;
 					card = create_card2(rdr, 1, caid, reshare);
 					if(!card)
-						{ return; }
+						{ return 0; }
 					card->card_type = CT_CARD_BY_CAID3;
 
 					if(!rdr->audisabled)
@@ -1371,7 +1514,7 @@ void update_card_list(void)
 						uint32_t prid = get_reader_prid(rdr, j);
 						struct cc_provider *prov;
 						if(!cs_malloc(&prov, sizeof(struct cc_provider)))
-							{ return; }
+							{ return 0; }
 						prov->prov = prid;
 						//cs_log("Ident CCcam card report provider: %02X%02X%02X", buf[21 + (k*7)]<<16, buf[22 + (k*7)], buf[23 + (k*7)]);
 						if(!rdr->audisabled)
@@ -1383,7 +1526,7 @@ void update_card_list(void)
 						//cs_log("Main CCcam card report provider: %02X%02X%02X%02X", buf[21+(j*7)], buf[22+(j*7)], buf[23+(j*7)], buf[24+(j*7)]);
 					}
 					add_good_bad_sids_by_rdr(rdr, card);
-					add_card_to_serverlist(get_cardlist(caid, server_cards), card, 1);
+					add_card_to_serverlist(get_cardlist(caid, server_cards), sh, card, 1);
 				}
 			}
 
@@ -1422,7 +1565,7 @@ void update_card_list(void)
 
 							if(dont_ignore)    //Filtered by service
 							{
-								add_card_to_serverlist(get_cardlist(card->caid, server_cards), card, 0);
+								add_card_to_serverlist(get_cardlist(card->caid, server_cards), sh, card, 0);
 								count++;
 							}
 						}
@@ -1436,10 +1579,48 @@ void update_card_list(void)
 		}
 		cs_readunlock(__func__, &readerlist_lock);
 	}
+	return 1;
+}
+
+/**
+ * Server:
+ * Reports all caid/providers to the connected clients
+ * returns 1=ok, 0=error
+ * cfg.cc_reshare_services  =0 CCCAM reader reshares only received cards + defined reader services
+ *              =1 CCCAM reader reshares received cards + defined services
+ *              =2 CCCAM reader reshares only defined reader-services as virtual cards
+ *              =3 CCCAM reader reshares only defined user-services as virtual cards
+ *              =4 CCCAM reader reshares only received cards
+ */
+void update_card_list(void)
+{
+	int32_t i, j, card_count = 0;
+
+	LLIST *server_cards[CAID_KEY];
+	LLIST *new_reported_carddatas[CAID_KEY];
+	struct cc_share_hash sh;
+
+	LL_ITER it;
+	struct cc_card *card;
+
+	memset(server_cards, 0, sizeof(server_cards));
+	memset(new_reported_carddatas, 0, sizeof(new_reported_carddatas));
+	memset(&sh, 0, sizeof(sh));
+
+	card_added_count = 0;
+	card_removed_count = 0;
+	card_dup_count = 0;
+
+	if(!collect_server_cards(server_cards, &sh))
+	{
+		share_hash_free(&sh);
+		return;
+	}
 
 	LLIST *new_cards = ll_create("new_cards"); //List of new (added) cards
 
 	cs_writelock(__func__, &cc_shares_lock);
+	reported_generation++;
 
 	//report reshare cards:
 	//cs_log_dbg(D_TRACE, "%s reporting %d cards", getprefix(), ll_count(server_cards));
@@ -1447,6 +1628,11 @@ void update_card_list(void)
 	{
 		if(server_cards[i])
 		{
+			share_hash_clear(&sh);
+			it = ll_iter_create(reported_carddatas_list[i]);
+			while((card = ll_iter_next(&it)))
+				{ share_hash_add(&sh, share_card_hash(card, SHARE_KEY_CARD), card); }
+
 			it = ll_iter_create(server_cards[i]);
 
 			//we compare every card of our new list (server_cards) with the last list.
@@ -1456,14 +1642,25 @@ void update_card_list(void)
 
 				if(!new_reported_carddatas[i])
 					{ new_reported_carddatas[i] = ll_create("new_cardlist"); }
-				report_card(card, new_reported_carddatas[i], new_cards);
+				report_card(card, &sh, new_reported_carddatas[i], new_cards);
 				ll_iter_remove(&it);
 			}
 			cc_free_cardlist(server_cards[i], 1);
+
+			//reported cards found again are already freed, keep only the others:
+			if(reported_carddatas_list[i])
+			{
+				ll_clear(reported_carddatas_list[i]);
+				for(j = 0; j < (int32_t)sh.count; j++)
+				{
+					if(sh.entry[j].ptr)
+						{ ll_append(reported_carddatas_list[i], sh.entry[j].ptr); }
+				}
+			}
 		}
 
 		//remove unsed, remaining cards:
-		card_removed_count += cc_free_reported_carddata(reported_carddatas_list[i], new_reported_carddatas[i], 1);
+		card_removed_count += cc_free_reported_carddata(reported_carddatas_list[i], NULL, 1);
 		reported_carddatas_list[i] = new_reported_carddatas[i];
 		card_count += ll_count(reported_carddatas_list[i]);
 		//cs_log_dbg(D_TRACE, "CARDS FOR INDEX %d=%d", i, ll_count(reported_carddatas[i]));
@@ -1479,33 +1676,312 @@ void update_card_list(void)
 
 
 	cs_writeunlock(__func__, &cc_shares_lock);
+	share_hash_free(&sh);
 
 	cs_log_dbg(D_TRACE, "reported/updated +%d/-%d/dup %d of %d cards to sharelist",
 				  card_added_count, card_removed_count, card_dup_count, card_count);
 }
 
-int32_t cc_srv_report_cards(struct s_client *cl)
+/*
+ * A client login reports the whole share list. Clients with the same filters
+ * get the same card messages, so they are built once per filter key and kept
+ * until the share list is rebuilt. A login only drops the cards that came
+ * from its own node, copies the messages into a send buffer and writes them
+ * in large blocks.
+ */
+#define CC_REPORT_CACHE_SIZE 16
+#define CC_REPORT_BUFSIZE    0x10000
+
+struct cc_report_msg
+{
+	int32_t         ofs;    // message with header in data
+	int32_t         len;
+	int32_t         nodes;  // remote nodes of the card in data
+	int32_t         nnodes;
+};
+
+struct cc_report
+{
+	uint8_t         *key;
+	int32_t         keylen;
+	uint32_t        generation;
+	int32_t         refs;
+	int8_t          cached;
+	time_t          used;
+	uint8_t         *data;
+	int32_t         len;
+	int32_t         size;
+	struct cc_report_msg *msg;
+	int32_t         count;
+};
+
+static struct cc_report *cc_reports[CC_REPORT_CACHE_SIZE];
+static pthread_mutex_t cc_report_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define REPORT_KEY_PUT(p, v) do { memcpy(p, &(v), sizeof(v)); p += sizeof(v); } while(0)
+
+// everything card_valid_for_filter() and write_card_for_client() look at
+static uint8_t *report_key(struct s_client *cl, int32_t *keylen)
+{
+	struct cc_data *cc = cl->cc;
+	struct s_auth *account = cl->account;
+	struct s_reader *rdr;
+	int32_t i, len, naureaders = ll_count(cl->aureader_list);
+	uint8_t *key, *p;
+
+	len = sizeof(cl->grp) + sizeof(cl->sidtabs) + sizeof(cfg_sidtab_generation)
+		  + sizeof(account->cccmaxhops) + sizeof(account->cccreshare) + sizeof(account->cccignorereshare)
+		  + sizeof(cfg.cc_reshare) + sizeof(cfg.cc_ignore_reshare) + sizeof(cc->cccam220) + sizeof(cc->node_id)
+		  + sizeof(cl->ftab.nfilts) + sizeof(cl->ctab.ctnum) + cl->ctab.ctnum * sizeof(CAIDTAB_DATA)
+		  + sizeof(naureaders) + naureaders * sizeof(rdr);
+	for(i = 0; i < cl->ftab.nfilts; i++)
+		{ len += sizeof(cl->ftab.filts[i].caid) + sizeof(cl->ftab.filts[i].nprids) + cl->ftab.filts[i].nprids * sizeof(uint32_t); }
+
+	if(!cs_malloc(&key, len))
+		{ return NULL; }
+
+	p = key;
+	REPORT_KEY_PUT(p, cl->grp);
+	REPORT_KEY_PUT(p, cl->sidtabs);
+	REPORT_KEY_PUT(p, cfg_sidtab_generation);
+	REPORT_KEY_PUT(p, account->cccmaxhops);
+	REPORT_KEY_PUT(p, account->cccreshare);
+	REPORT_KEY_PUT(p, account->cccignorereshare);
+	REPORT_KEY_PUT(p, cfg.cc_reshare);
+	REPORT_KEY_PUT(p, cfg.cc_ignore_reshare);
+	REPORT_KEY_PUT(p, cc->cccam220);
+	REPORT_KEY_PUT(p, cc->node_id);
+	REPORT_KEY_PUT(p, cl->ftab.nfilts);
+	for(i = 0; i < cl->ftab.nfilts; i++)
+	{
+		REPORT_KEY_PUT(p, cl->ftab.filts[i].caid);
+		REPORT_KEY_PUT(p, cl->ftab.filts[i].nprids);
+		memcpy(p, cl->ftab.filts[i].prids, cl->ftab.filts[i].nprids * sizeof(uint32_t));
+		p += cl->ftab.filts[i].nprids * sizeof(uint32_t);
+	}
+	REPORT_KEY_PUT(p, cl->ctab.ctnum);
+	if(cl->ctab.ctnum)
+	{
+		memcpy(p, cl->ctab.ctdata, cl->ctab.ctnum * sizeof(CAIDTAB_DATA));
+		p += cl->ctab.ctnum * sizeof(CAIDTAB_DATA);
+	}
+	REPORT_KEY_PUT(p, naureaders);
+	LL_ITER it = ll_iter_create(cl->aureader_list);
+	for(i = 0; i < naureaders; i++)
+	{
+		rdr = ll_iter_next(&it);
+		REPORT_KEY_PUT(p, rdr);
+	}
+
+	*keylen = len;
+	return key;
+}
+
+static void free_report(struct cc_report *report)
+{
+	NULLFREE(report->key);
+	NULLFREE(report->data);
+	NULLFREE(report->msg);
+	NULLFREE(report);
+}
+
+static int32_t report_add_card(struct cc_report *report, struct cc_card *card, struct s_client *cl)
 {
+	uint8_t buf[CC_MAXMSGSIZE];
+	int32_t len, cmd;
+	struct cc_report_msg *msg;
+
+	if(!(len = write_card_for_client(card, cl, buf, &cmd)))
+		{ return 1; }
+
+	if(report->len + len + 4 > report->size)
+	{
+		report->size = report->size ? report->size * 2 : CC_REPORT_BUFSIZE;
+		if(!cs_realloc(&report->data, report->size))
+			{ return 0; }
+	}
+	if(!(report->count & 0xFF) && !cs_realloc(&report->msg, (report->count + 0x100) * sizeof(struct cc_report_msg)))
+		{ return 0; }
 
+	msg = &report->msg[report->count++];
+	msg->ofs = report->len;
+	msg->len = len + 4;
+	// the own node id is written behind the remote nodes
+	msg->nnodes = ll_count(card->remote_nodes);
+	msg->nodes = msg->ofs + msg->len - (msg->nnodes + 1) * 8;
+
+	report->data[report->len] = 0; // flag, set per client
+	report->data[report->len + 1] = cmd;
+	report->data[report->len + 2] = len >> 8;
+	report->data[report->len + 3] = len & 0xff;
+	memcpy(report->data + report->len + 4, buf, len);
+	report->len += len + 4;
+	return 1;
+}
+
+// cc_shares_lock has to be held
+static struct cc_report *build_report(struct s_client *cl)
+{
+	struct cc_report *report;
 	struct cc_card *card;
-	int32_t i, count = 0;
 	LL_ITER it;
-	cs_readlock(__func__, &cc_shares_lock);
+	int32_t i;
+
+	if(!cs_malloc(&report, sizeof(struct cc_report)))
+		{ return NULL; }
+
+	report->generation = reported_generation;
 	for(i = 0; i < CAID_KEY; i++)
 	{
-		if(reported_carddatas_list[i])
+		it = ll_iter_create(reported_carddatas_list[i]);
+		while((card = ll_iter_next(&it)))
 		{
-			it = ll_iter_create(reported_carddatas_list[i]);
-			while(cl->cc && !cl->kill && (card = ll_iter_next(&it)))
+			if(card_valid_for_filter(cl, card) && !report_add_card(report, card, cl))
 			{
-				count += send_card_to_client(card, cl);
+				free_report(report);
+				return NULL;
 			}
 		}
 	}
+	return report;
+}
+
+/**
+ * returns the card messages for this client, shared with other clients with the same filters
+ * release it with put_report()
+ */
+static struct cc_report *get_report(struct s_client *cl)
+{
+	struct cc_report *report = NULL;
+	int32_t i, keylen = 0, slot = -1;
+	uint8_t *key = report_key(cl, &keylen);
+
+	cs_readlock(__func__, &cc_shares_lock);
+	SAFE_MUTEX_LOCK(&cc_report_lock);
+
+	for(i = 0; i < CC_REPORT_CACHE_SIZE; i++)
+	{
+		struct cc_report *r = cc_reports[i];
+		if(r && r->generation != reported_generation && !r->refs)
+		{
+			free_report(r);
+			cc_reports[i] = r = NULL;
+		}
+		if(!r)
+		{
+			if(slot < 0 || cc_reports[slot])
+				{ slot = i; }
+			continue;
+		}
+		if(key && r->generation == reported_generation && r->keylen == keylen && !memcmp(r->key, key, keylen))
+		{
+			report = r;
+			break;
+		}
+		// least recently used one is replaced if all are taken
+		if(!r->refs && (slot < 0 || (cc_reports[slot] && r->used < cc_reports[slot]->used)))
+			{ slot = i; }
+	}
+
+	if(report)
+		{ NULLFREE(key); }
+	else if((report = build_report(cl)))
+	{
+		report->key = key;
+		report->keylen = keylen;
+		if(key && slot >= 0)
+		{
+			if(cc_reports[slot])
+				{ free_report(cc_reports[slot]); }
+			cc_reports[slot] = report;
+			report->cached = 1;
+		}
+	}
+	else
+		{ NULLFREE(key); }
+
+	if(report)
+	{
+		report->refs++;
+		report->used = time(NULL);
+	}
+
+	SAFE_MUTEX_UNLOCK(&cc_report_lock);
 	cs_readunlock(__func__, &cc_shares_lock);
+	return report;
+}
+
+static void put_report(struct cc_report *report)
+{
+	SAFE_MUTEX_LOCK(&cc_report_lock);
+	if(!--report->refs && !report->cached)
+		{ free_report(report); }
+	SAFE_MUTEX_UNLOCK(&cc_report_lock);
+}
+
+static void free_reports(void)
+{
+	int32_t i;
+	SAFE_MUTEX_LOCK(&cc_report_lock);
+	for(i = 0; i < CC_REPORT_CACHE_SIZE; i++)
+	{
+		if(cc_reports[i] && !cc_reports[i]->refs)
+		{
+			free_report(cc_reports[i]);
+			cc_reports[i] = NULL;
+		}
+	}
+	SAFE_MUTEX_UNLOCK(&cc_report_lock);
+}
+
+int32_t cc_srv_report_cards(struct s_client *cl)
+{
+	struct cc_data *cc = cl->cc;
+	struct cc_report *report;
+	struct cc_report_msg *msg;
+	uint8_t *buf;
+	int32_t i, k, len = 0, count = 0, ok = 1;
+
+	if(!cs_malloc(&buf, CC_REPORT_BUFSIZE))
+		{ return 0; }
+
+	if(!(report = get_report(cl)))
+	{
+		NULLFREE(buf);
+		return 0;
+	}
+
+	for(i = 0; ok && i < report->count; i++)
+	{
+		msg = &report->msg[i];
+
+		//Check remote node id, if card is from there, ignore it!
+		for(k = 0; k < msg->nnodes; k++)
+		{
+			if(!memcmp(report->data + msg->nodes + k * 8, cc->peer_node_id, 8))
+				{ break; }
+		}
+		if(k < msg->nnodes)
+			{ continue; }
+
+		if(len + msg->len > CC_REPORT_BUFSIZE)
+		{
+			ok = cc_cmd_send(cl, buf, len, MSG_NO_HEADER) > 0;
+			len = 0;
+		}
+		memcpy(buf + len, report->data + msg->ofs, msg->len);
+		buf[len] = cc->g_flag;
+		len += msg->len;
+		count++;
+	}
+	if(ok && len)
+		{ ok = cc_cmd_send(cl, buf, len, MSG_NO_HEADER) > 0; }
+
+	put_report(report);
+	NULLFREE(buf);
 	cs_log_dbg(D_TRACE, "reported %d cards for %s", count, username(cl));
 
-	return cl->cc && !cl->kill;
+	return ok && cl->cc && !cl->kill;
 }
 
 void refresh_shares(void)
@@ -1633,6 +2109,7 @@ void share_updater(void)
 	}
 	for(i = 0; i < CAID_KEY; i++)
 		{ cc_free_reported_carddata(reported_carddatas_list[i], NULL, 0); }
+	free_reports();
 }
 
 int32_t compare_cards_by_hop(struct cc_card **pcard1, struct cc_card **pcard2)
@@ -3,13 +3,87 @@
 //FIXME Not checked on threadsafety yet; after checking please remove this line
 #include "globals.h"
 #ifdef MODULE_CONSTCW
+#include "cscrypt/md5.h"
+#include "oscam-chk.h"
 #include "oscam-client.h"
 #include "oscam-ecm.h"
 #include "oscam-net.h"
 #include "oscam-string.h"
+#include "oscam-time.h"
+
+extern int32_t exit_oscam;
+
+/*
+ * Besides constant CWs the file may contain SIM lines which turn the reader
+ * into a synthetic backend for capacity tests:
+ *
+ *   SIM:CAID:DISTRIBUTION:P1:P2:FAIL%:TIMEOUT%
+ *
+ *   fixed      answer after P1 ms
+ *   uniform    answer after P1..P2 ms
+ *   lognormal  answer after a lognormal delay with median P1 ms and sigma P2
+ *
+ * FAIL% of the ECMs are answered "not found", TIMEOUT% are never answered.
+ * CAID 0000 applies to all caids without an own SIM line. ECMs of a simulated
+ * caid without a matching constant CW get a CW derived from the ECM hash.
+ * Delays and outcomes are derived from the ECM hash too, so the same ECM
+ * stream always produces the same answers.
+ */
+
+#define CONSTCW_RELOAD_CHECK 1 // Seconds between checks for a changed file
+
+enum constcw_dist { CONSTCW_FIXED = 0, CONSTCW_UNIFORM, CONSTCW_LOGNORMAL };
+
+struct constcw_entry
+{
+	uint16_t        caid;
+	uint32_t        provid;
+	uint16_t        sid;
+	uint16_t        pmtpid;
+	uint16_t        ecmpid;
+	uint32_t        vpid;
+	uchar           cw[16];
+};
+
+struct constcw_sim
+{
+	uint16_t        caid;
+	int8_t          dist;
+	float           p1;
+	float           p2;
+	float           fail;       // Percent
+	float           timeout;    // Percent
+};
+
+struct constcw_data
+{
+	time_t          mtime;
+	time_t          last_check;
+	struct constcw_entry *entries;
+	int32_t         entry_count;
+	struct constcw_sim *sims;
+	int32_t         sim_count;
+};
+
+// Answers waiting for their simulated delay, shared by all constcw readers
+struct constcw_answer
+{
+	struct timeb    due;
+	struct s_client *cl;
+	ECM_REQUEST     *er;
+	uint32_t        idx;
+	int8_t          rc;
+	uchar           cw[16];
+};
 
 static int32_t pserver;
 
+static struct constcw_answer *answer_heap;
+static int32_t answer_count, answer_size;
+static int8_t answer_thread_running;
+static pthread_mutex_t answer_mutex;
+static pthread_cond_t answer_cond;
+
 int32_t constcw_file_available(void)
 {
 	FILE *fp;
@@ -24,54 +98,342 @@ int32_t constcw_file_available(void)
 	return (1);
 }
 
-int32_t constcw_analyse_file(uint16_t c_caid, uint32_t c_prid, uint16_t c_sid, uint16_t c_pmtpid, uint32_t c_vpid, uint16_t c_ecmpid, uchar *dcw)
+static int8_t constcw_parse_dist(const char *name)
+{
+	if(!strcmp(name, "uniform"))
+		{ return CONSTCW_UNIFORM; }
+	if(!strcmp(name, "lognormal"))
+		{ return CONSTCW_LOGNORMAL; }
+	if(!strcmp(name, "fixed"))
+		{ return CONSTCW_FIXED; }
+	return -1;
+}
+
+// Parses the file into memory, it is read again only when its mtime changes
+static void constcw_load_file(struct s_client *cl)
 {
-	//CAID:PROVIDER:SID:PMTPID:ECMPID:VPID:XX XX XX XX XX XX XX XX XX XX XX XX XX XX XX XX
+	struct constcw_data *data = cl->module_data;
+	struct stat st;
 	FILE *fp;
-	char token[512];
+	char token[512], dist[16];
 	uint32_t caid, provid, sid, vpid, pmtpid, ecmpid;
-	int32_t cw[16];
+	int32_t cw[16], entries = 0, sims = 0, i, ret;
+	struct constcw_entry *entry;
+	struct constcw_sim *sim;
+	time_t now = time(NULL);
 
-	fp = fopen(cur_client()->reader->device, "r");
+	if(data->last_check && now - data->last_check < CONSTCW_RELOAD_CHECK)
+		{ return; }
+	data->last_check = now;
+	if(stat(cl->reader->device, &st) != 0 || (data->mtime && st.st_mtime == data->mtime))
+		{ return; }
+
+	fp = fopen(cl->reader->device, "r");
 	if(!fp)
 	{
-		cs_log("ERROR: Can't open %s (errno=%d %s)", cur_client()->reader->device, errno, strerror(errno));
-		return (0);
+		cs_log("ERROR: Can't open %s (errno=%d %s)", cl->reader->device, errno, strerror(errno));
+		return;
 	}
 
-	cs_log("Searching CW for CAID %04X PROVID %06X SRVID %04X ECMPID %04X PMTPID %04X VPID %04X", c_caid, c_prid, c_sid, c_ecmpid, c_pmtpid, c_vpid);
+	NULLFREE(data->entries);
+	NULLFREE(data->sims);
+	data->entry_count = data->sim_count = 0;
+	data->mtime = st.st_mtime;
 
 	while(fgets(token, sizeof(token), fp))
 	{
 		if(token[0] == '#') { continue; }
+
+		if(!strncmp(token, "SIM:", 4))
+		{
+			if(!cs_realloc(&data->sims, (sims + 1) * sizeof(struct constcw_sim)))
+				{ break; }
+			sim = &data->sims[sims];
+			memset(sim, 0, sizeof(struct constcw_sim));
+			ret = sscanf(token + 4, "%4x:%15[^:]:%f:%f:%f:%f", &caid, dist, &sim->p1, &sim->p2, &sim->fail, &sim->timeout);
+			if(ret < 3 || (sim->dist = constcw_parse_dist(dist)) < 0)
+			{
+				cs_log("ERROR: invalid SIM line in %s: %s", cl->reader->device, token);
+				continue;
+			}
+			sim->caid = caid;
+			sims++;
+			continue;
+		}
+
+		//CAID:PROVIDER:SID:PMTPID:ECMPID:VPID:XX XX XX XX XX XX XX XX XX XX XX XX XX XX XX XX
 		vpid = 0;
-		int ret = sscanf(token, "%4x:%6x:%4x:%4x:%4x::%2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x", &caid, &provid, &sid, &pmtpid, &ecmpid,
+		ret = sscanf(token, "%4x:%6x:%4x:%4x:%4x::%2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x", &caid, &provid, &sid, &pmtpid, &ecmpid,
 			   &cw[0], &cw[1], &cw[2], &cw[3], &cw[4], &cw[5], &cw[6], &cw[7],
 			   &cw[8], &cw[9], &cw[10], &cw[11], &cw[12], &cw[13], &cw[14], &cw[15]);
-		
-		if(ret != 21){   
+
+		if(ret != 21){
 			ret = sscanf(token, "%4x:%6x:%4x:%4x:%4x:%4x:%2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x %2x", &caid, &provid, &sid, &pmtpid, &ecmpid, &vpid,
 				   &cw[0], &cw[1], &cw[2], &cw[3], &cw[4], &cw[5], &cw[6], &cw[7],
 				   &cw[8], &cw[9], &cw[10], &cw[11], &cw[12], &cw[13], &cw[14], &cw[15]);
 			if(ret != 22) continue;
-		}		
+		}
+
+		if(!cs_realloc(&data->entries, (entries + 1) * sizeof(struct constcw_entry)))
+			{ break; }
+		entry = &data->entries[entries++];
+		entry->caid = caid;
+		entry->provid = provid;
+		entry->sid = sid;
+		entry->pmtpid = pmtpid;
+		entry->ecmpid = ecmpid;
+		entry->vpid = vpid;
+		for(i = 0; i < 16; ++i)
+			{ entry->cw[i] = (uchar) cw[i]; }
+	}
+	fclose(fp);
+
+	data->entry_count = entries;
+	data->sim_count = sims;
+	cs_log("%s loaded: %d constant CWs, %d simulated caids", cl->reader->device, entries, sims);
+}
 
-		//cs_log("Line found: %s", token);
-		if(c_caid == caid && c_sid == sid && (!provid || provid == c_prid) && (!pmtpid || !c_pmtpid || pmtpid == c_pmtpid) && (!vpid || !c_vpid || vpid == c_vpid) 
-				&& (!ecmpid || !c_ecmpid || ecmpid == c_ecmpid))
+int32_t constcw_analyse_file(uint16_t c_caid, uint32_t c_prid, uint16_t c_sid, uint16_t c_pmtpid, uint32_t c_vpid, uint16_t c_ecmpid, uchar *dcw)
+{
+	struct s_client *cl = cur_client();
+	struct constcw_data *data = cl->module_data;
+	struct constcw_entry *entry;
+	char tmp[64];
+	int32_t i;
+
+	constcw_load_file(cl);
+
+	cs_log_dbg(D_TRACE, "Searching CW for CAID %04X PROVID %06X SRVID %04X ECMPID %04X PMTPID %04X VPID %04X", c_caid, c_prid, c_sid, c_ecmpid, c_pmtpid, c_vpid);
+
+	for(i = 0; i < data->entry_count; i++)
+	{
+		entry = &data->entries[i];
+		if(c_caid == entry->caid && c_sid == entry->sid && (!entry->provid || entry->provid == c_prid) && (!entry->pmtpid || !c_pmtpid || entry->pmtpid == c_pmtpid)
+				&& (!entry->vpid || !c_vpid || entry->vpid == c_vpid) && (!entry->ecmpid || !c_ecmpid || entry->ecmpid == c_ecmpid))
 		{
-			fclose(fp);
-			int8_t i;
-			for(i = 0; i < 16; ++i)
-				{ dcw[i] = (uchar) cw[i]; }
-			cs_log("Entry found: %04X@%06X:%04X:%04X:%04X:%04X:%s", caid, provid, sid, pmtpid, ecmpid, vpid, cs_hexdump(1, dcw, 16, token, sizeof(token)));
+			memcpy(dcw, entry->cw, 16);
+			cs_log_dbg(D_TRACE, "Entry found: %04X@%06X:%04X:%04X:%04X:%04X:%s", entry->caid, entry->provid, entry->sid, entry->pmtpid, entry->ecmpid, entry->vpid,
+					   cs_hexdump(1, dcw, 16, tmp, sizeof(tmp)));
 			return 1;
 		}
 	}
-
-	fclose(fp);
 	return 0;
 }
+
+static struct constcw_sim *constcw_get_sim(struct constcw_data *data, uint16_t caid)
+{
+	struct constcw_sim *wildcard = NULL;
+	int32_t i;
+
+	for(i = 0; i < data->sim_count; i++)
+	{
+		if(data->sims[i].caid == caid)
+			{ return &data->sims[i]; }
+		if(!data->sims[i].caid)
+			{ wildcard = &data->sims[i]; }
+	}
+	return wildcard;
+}
+
+//************************************************************************************************************************
+//* simulated answers
+//************************************************************************************************************************
+static uint32_t constcw_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+// Uniform value in (0, 1]
+static double constcw_rand_unit(uint32_t *state)
+{
+	return ((constcw_rand(state) >> 8) + 1) / 16777216.0;
+}
+
+// exp() and log() without libm, precision is plenty for delays in ms
+static double constcw_exp(double x)
+{
+	double sum = 1, term = 1;
+	int32_t i, k = 0;
+
+	while(x > 0.5 || x < -0.5)
+	{
+		x /= 2;
+		k++;
+	}
+	for(i = 1; i < 12; i++)
+	{
+		term *= x / i;
+		sum += term;
+	}
+	while(k--)
+		{ sum *= sum; }
+	return sum;
+}
+
+static double constcw_log(double x)
+{
+	double n = 0, y = 0, z;
+	int32_t i;
+
+	if(x <= 0)
+		{ return -700; }
+	while(x > 2)
+	{
+		x /= 2.718281828459045;
+		n += 1;
+	}
+	while(x < 0.5)
+	{
+		x *= 2.718281828459045;
+		n -= 1;
+	}
+	// Newton iterations on exp(y) = x
+	for(i = 0; i < 8; i++)
+	{
+		z = constcw_exp(y);
+		y += 2 * (x - z) / (x + z);
+	}
+	return n + y;
+}
+
+static int32_t constcw_sim_delay(struct constcw_sim *sim, uint32_t *state)
+{
+	double z, delay;
+	int32_t i;
+
+	switch(sim->dist)
+	{
+	case CONSTCW_UNIFORM:
+		delay = sim->p1 + (sim->p2 - sim->p1) * constcw_rand_unit(state);
+		break;
+	case CONSTCW_LOGNORMAL:
+		// Sum of 12 uniform values approximates a standard normal distribution
+		for(i = 0, z = -6; i < 12; i++)
+			{ z += constcw_rand_unit(state); }
+		delay = (sim->p1 > 0) ? constcw_exp(constcw_log(sim->p1) + sim->p2 * z) : 0;
+		break;
+	default:
+		delay = sim->p1;
+		break;
+	}
+	return (delay > 0) ? (int32_t)(delay + 0.5) : 0;
+}
+
+static void constcw_heap_swap(int32_t a, int32_t b)
+{
+	struct constcw_answer tmp = answer_heap[a];
+	answer_heap[a] = answer_heap[b];
+	answer_heap[b] = tmp;
+}
+
+static void constcw_heap_pop(void)
+{
+	int32_t i = 0, c;
+
+	answer_heap[0] = answer_heap[--answer_count];
+	while((c = 2 * i + 1) < answer_count)
+	{
+		if(c + 1 < answer_count && comp_timeb(&answer_heap[c + 1].due, &answer_heap[c].due) < 0)
+			{ c++; }
+		if(comp_timeb(&answer_heap[c].due, &answer_heap[i].due) >= 0)
+			{ break; }
+		constcw_heap_swap(i, c);
+		i = c;
+	}
+}
+
+static void *constcw_answer_thread(void *UNUSED(arg))
+{
+	struct constcw_answer ans;
+	struct timeb now;
+	struct timespec ts;
+	int64_t wait;
+	ECM_REQUEST *er;
+
+	set_thread_name(__func__);
+	SAFE_MUTEX_LOCK(&answer_mutex);
+	while(!exit_oscam)
+	{
+		cs_ftime(&now);
+		if(!answer_count || (wait = comp_timeb(&answer_heap[0].due, &now)) > 0)
+		{
+			add_ms_to_timespec(&ts, answer_count ? wait : 1000);
+			SAFE_COND_TIMEDWAIT(&answer_cond, &answer_mutex, &ts);
+			continue;
+		}
+		ans = answer_heap[0];
+		constcw_heap_pop();
+		SAFE_MUTEX_UNLOCK(&answer_mutex);
+
+		// The ecmtask slot is still ours when the reader is alive and the request is pending
+		er = ans.er;
+		if(check_client(ans.cl) && ans.cl->reader && ans.cl->ecmtask && er >= ans.cl->ecmtask && er < ans.cl->ecmtask + cfg.max_pending
+				&& er->idx == ans.idx && er->rc >= E_NOCARD)
+		{
+			if(ans.rc == E_FOUND)
+				{ write_ecm_answer(ans.cl->reader, er, E_FOUND, 0, ans.cw, NULL, 0, NULL); }
+			else
+				{ write_ecm_answer(ans.cl->reader, er, E_NOTFOUND, (E1_READER << 4 | E2_SID), NULL, NULL, 0, NULL); }
+		}
+
+		SAFE_MUTEX_LOCK(&answer_mutex);
+	}
+	answer_thread_running = 0;
+	SAFE_MUTEX_UNLOCK(&answer_mutex);
+	return NULL;
+}
+
+static void constcw_queue_answer(struct s_client *cl, ECM_REQUEST *er, int32_t delay, int8_t rc, uchar *cw)
+{
+	struct constcw_answer *ans;
+	int32_t i;
+
+	SAFE_MUTEX_LOCK(&answer_mutex);
+	if(answer_count == answer_size)
+	{
+		int32_t size = answer_size ? answer_size * 2 : 64;
+		if(!cs_realloc(&answer_heap, size * sizeof(struct constcw_answer)))
+		{
+			SAFE_MUTEX_UNLOCK(&answer_mutex);
+			return;
+		}
+		answer_size = size;
+	}
+	i = answer_count++;
+	ans = &answer_heap[i];
+	cs_ftime(&ans->due);
+	add_ms_to_timeb(&ans->due, delay);
+	ans->cl = cl;
+	ans->er = er;
+	ans->idx = er->idx;
+	ans->rc = rc;
+	memcpy(ans->cw, cw, 16);
+	while(i > 0 && comp_timeb(&answer_heap[i].due, &answer_heap[(i - 1) / 2].due) < 0)
+	{
+		constcw_heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	if(!i) // New earliest answer, wake up the thread
+		{ SAFE_COND_SIGNAL(&answer_cond); }
+	SAFE_MUTEX_UNLOCK(&answer_mutex);
+}
+
+// Deterministic CW from the ECM hash with valid checksums
+static void constcw_hash_cw(ECM_REQUEST *er, uchar *cw)
+{
+	uchar md5tmp[MD5_DIGEST_LENGTH];
+	int32_t i;
+
+	MD5(er->ecmd5, CS_ECMSTORESIZE, md5tmp);
+	memcpy(cw, md5tmp, 16);
+	for(i = 0; i < 16; i += 4)
+		{ cw[i + 3] = (cw[i] + cw[i + 1] + cw[i + 2]) & 0xff; }
+}
+
 //************************************************************************************************************************
 //* client/server common functions
 //************************************************************************************************************************
@@ -112,8 +474,19 @@ int32_t constcw_client_init(struct s_client *client)
 
 	client->pfd = client->udp_fd;
 
+	if(!client->module_data && !cs_malloc(&client->module_data, sizeof(struct constcw_data)))
+		{ return 1; }
+
+	SAFE_MUTEX_LOCK(&answer_mutex);
+	if(!answer_thread_running)
+	{
+		answer_thread_running = start_thread("constcw answer", constcw_answer_thread, NULL, NULL, 1, 1) == 0;
+	}
+	SAFE_MUTEX_UNLOCK(&answer_mutex);
+
 	if(constcw_file_available())
 	{
+		constcw_load_file(client);
 		client->reader->tcp_connected = 2;
 		client->reader->card_status = CARD_INSERTED;
 	}
@@ -125,19 +498,38 @@ static int32_t constcw_send_ecm(struct s_client *client, ECM_REQUEST *er)
 {
 	time_t t;
 	struct s_reader *rdr = client->reader;
+	struct constcw_sim *sim;
 	uchar cw[16];
+	uint32_t state;
+	int32_t found, delay;
+	double roll;
 
 	t = time(NULL);
 	// Check if DCW exist in the files
 	//cs_log("Searching ConstCW for ECM: %04X@%06X:%04X (%d)", er->caid, er->prid, er->srvid, er->l);
 
-	if(constcw_analyse_file(er->caid, er->prid, er->srvid, er->pmtpid, er->vpid, er->pid, cw) == 0)
+	found = constcw_analyse_file(er->caid, er->prid, er->srvid, er->pmtpid, er->vpid, er->pid, cw);
+	sim = constcw_get_sim(client->module_data, er->caid);
+
+	if(!sim)
 	{
-		write_ecm_answer(rdr, er, E_NOTFOUND, (E1_READER << 4 | E2_SID), NULL, NULL, 0, NULL);
+		if(!found)
+			{ write_ecm_answer(rdr, er, E_NOTFOUND, (E1_READER << 4 | E2_SID), NULL, NULL, 0, NULL); }
+		else
+			{ write_ecm_answer(rdr, er, E_FOUND, 0, cw, NULL, 0, NULL); }
 	}
 	else
 	{
-		write_ecm_answer(rdr, er, E_FOUND, 0, cw, NULL, 0, NULL);
+		state = b2i(4, er->ecmd5) | 1;
+		if(!found)
+			{ constcw_hash_cw(er, cw); }
+		roll = constcw_rand_unit(&state) * 100;
+		delay = constcw_sim_delay(sim, &state);
+		// Answers after the client timeout are useless and the request may be gone by then
+		if(roll >= sim->fail + sim->timeout && delay < (int32_t)cfg.ctimeout)
+			{ constcw_queue_answer(client, er, delay, E_FOUND, cw); }
+		else if(roll < sim->fail && delay < (int32_t)cfg.ctimeout)
+			{ constcw_queue_answer(client, er, delay, E_NOTFOUND, cw); }
 	}
 
 	client->last = t;
@@ -155,12 +547,27 @@ static int32_t constcw_recv_chk(struct s_client *UNUSED(client), uchar *UNUSED(d
 	return (-1);
 }
 
+static void constcw_cleanup(struct s_client *client)
+{
+	struct constcw_data *data = client->module_data;
+
+	if(data)
+	{
+		NULLFREE(data->entries);
+		NULLFREE(data->sims);
+		NULLFREE(client->module_data);
+	}
+}
+
 void module_constcw(struct s_module *ph)
 {
+	cs_pthread_cond_init(__func__, &answer_mutex, &answer_cond);
+
 	ph->desc = "constcw";
 	ph->type = MOD_NO_CONN;
 	ph->listenertype = LIS_CONSTCW;
 	ph->recv = constcw_recv;
+	ph->cleanup = constcw_cleanup;
 
 	ph->c_init = constcw_client_init;
 	ph->c_recv_chk = constcw_recv_chk;
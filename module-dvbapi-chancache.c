@@ -6,77 +6,230 @@
 
 #include "oscam-config.h"
 #include "oscam-ecm.h"
+#include "oscam-garbage.h"
 #include "oscam-string.h"
 #include "module-dvbapi.h"
 #include "module-dvbapi-chancache.h"
 
 extern DEMUXTYPE demux[MAX_DEMUX];
 
-static LLIST *channel_cache;
+/*
+ * The channel cache is a hash of srvid/caid/pid, entries with the same key
+ * stay in the order they were added. Every entry is also linked into the
+ * group of its caid/provid for the lookups that ignore the service.
+ * oscam.ccache is stored as a binary file, text files of older versions
+ * are still read.
+ */
+#define CHANCACHE_GROUPS    256
+#define CHANCACHE_MAGIC     "OSCC"
+#define CHANCACHE_VERSION   1
+#define CHANCACHE_HDRSIZE   9
+#define CHANCACHE_RECSIZE   14
 
-void dvbapi_save_channel_cache(void)
+struct s_chancache_group
 {
-	if(boxtype_is("dbox2")) return; // dont save channelcache on these boxes, they lack resources and will crash!
-	
-	if (USE_OPENXCAS) // Why?
-		return;
+	uint16_t    caid;
+	uint32_t    prid;
+	struct s_channel_cache *first;
+	struct s_chancache_group *next;
+};
 
-	char fname[256];
-	int32_t result = 0;
-	get_config_filename(fname, sizeof(fname), "oscam.ccache");
-	FILE *file = fopen(fname, "w");
+static struct s_channel_cache **cache_hash;
+static uint32_t cache_mask;
+static uint32_t cache_count;
+static struct s_chancache_group *cache_groups[CHANCACHE_GROUPS]; // by caid
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
-	if(!file)
+static struct s_channel_cache **chancache_bucket(struct s_channel_cache **hash, uint32_t mask, uint16_t srvid, uint16_t caid, uint16_t pid)
+{
+	uint64_t key = (uint64_t)srvid << 32 | (uint32_t)caid << 16 | pid;
+	return &hash[(uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask];
+}
+
+static struct s_chancache_group *chancache_group(uint16_t caid, uint32_t prid, int8_t add)
+{
+	struct s_chancache_group **bucket = &cache_groups[(caid * 2654435761U) >> 24], *g;
+
+	for(g = *bucket; g; g = g->next)
 	{
-		cs_log("dvbapi channelcache can't write to file %s", fname);
-		return;
+		if(g->caid == caid && g->prid == prid)
+			{ return g; }
 	}
+	if(!add || !cs_malloc(&g, sizeof(struct s_chancache_group)))
+		{ return NULL; }
+	g->caid = caid;
+	g->prid = prid;
+	g->next = *bucket;
+	*bucket = g;
+	return g;
+}
 
-	LL_ITER it = ll_iter_create(channel_cache);
-	struct s_channel_cache *c;
-	while((c = ll_iter_next(&it)))
+// moves all entries into a table of twice the size, keeping the order of every chain
+static int32_t chancache_grow(void)
+{
+	uint32_t i, mask = cache_hash ? cache_mask * 2 + 1 : 255;
+	struct s_channel_cache **hash, **tail, *c, *next;
+
+	if(!cs_malloc(&hash, (mask + 1) * sizeof(struct s_channel_cache *)))
+		{ return 0; }
+
+	for(i = 0; cache_hash && i <= cache_mask; i++)
 	{
-		result = fprintf(file, "%04X,%06X,%04X,%04X,%06X\n", c->caid, c->prid, c->srvid, c->pid, c->chid);
-		if(result < 0)
+		for(c = cache_hash[i]; c; c = next)
 		{
-			fclose(file);
-			result = remove(fname);
-			if(!result)
-			{
-				cs_log("error writing cache -> cache file removed!");
-			}
-			else
-			{
-				cs_log("error writing cache -> cache file could not be removed either!");
-			}
-			return;
+			next = c->next;
+			for(tail = chancache_bucket(hash, mask, c->srvid, c->caid, c->pid); *tail; tail = &(*tail)->next) { ; }
+			*tail = c;
+			c->next = NULL;
 		}
 	}
+	NULLFREE(cache_hash);
+	cache_hash = hash;
+	cache_mask = mask;
+	return 1;
+}
 
-	fclose(file);
-	cs_log("dvbapi channelcache saved to %s", fname);
+// cache_lock has to be held, c is freed on failure
+static int32_t chancache_add(struct s_channel_cache *c)
+{
+	struct s_channel_cache **tail;
+	struct s_chancache_group *g;
+
+	if((!cache_hash || cache_count > cache_mask) && !chancache_grow() && !cache_hash)
+	{
+		NULLFREE(c);
+		return 0;
+	}
+	if(!(g = chancache_group(c->caid, c->prid, 1)))
+	{
+		NULLFREE(c);
+		return 0;
+	}
+
+	for(tail = chancache_bucket(cache_hash, cache_mask, c->srvid, c->caid, c->pid); *tail; tail = &(*tail)->next) { ; }
+	*tail = c;
+	c->next = NULL;
+
+	c->group = g;
+	c->group_prev = NULL;
+	c->group_next = g->first;
+	if(g->first)
+		{ g->first->group_prev = c; }
+	g->first = c;
+
+	cache_count++;
+	return 1;
 }
 
-void dvbapi_load_channel_cache(void)
+// cache_lock has to be held, *prev points to c
+static void chancache_remove(struct s_channel_cache **prev, struct s_channel_cache *c)
 {
-	if(boxtype_is("dbox2")) return; // dont load channelcache on these boxes, they lack resources and will crash!
+	*prev = c->next;
+
+	if(c->group_prev)
+		{ c->group_prev->group_next = c->group_next; }
+	else
+		{ c->group->first = c->group_next; }
+	if(c->group_next)
+		{ c->group_next->group_prev = c->group_prev; }
+
+	cache_count--;
+	add_garbage(c); // callers of dvbapi_find_channel_cache() may still read it
+}
+
+static int32_t chancache_add_new(uint16_t caid, uint32_t prid, uint16_t srvid, uint16_t pid, uint32_t chid)
+{
+	struct s_channel_cache *c;
+
+	if(!cs_malloc(&c, sizeof(struct s_channel_cache)))
+		{ return 0; }
+	c->caid = caid;
+	c->prid = prid;
+	c->srvid = srvid;
+	c->pid = pid;
+	c->chid = chid;
+	return chancache_add(c);
+}
+
+void dvbapi_save_channel_cache(void)
+{
+	if(boxtype_is("dbox2")) return; // dont save channelcache on these boxes, they lack resources and will crash!
 	
 	if (USE_OPENXCAS) // Why?
 		return;
 
-	char fname[256];
-	char line[1024];
-	FILE *file;
+	char fname[256], tmpname[256 + 4];
+	uchar *buf, *rec;
+	uint32_t i, len;
 	struct s_channel_cache *c;
+	FILE *file;
 
 	get_config_filename(fname, sizeof(fname), "oscam.ccache");
-	file = fopen(fname, "r");
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", fname);
+
+	// serialize under the lock, write without it
+	SAFE_MUTEX_LOCK(&cache_lock);
+	len = CHANCACHE_HDRSIZE + cache_count * CHANCACHE_RECSIZE;
+	if(!cs_malloc(&buf, len))
+	{
+		SAFE_MUTEX_UNLOCK(&cache_lock);
+		return;
+	}
+	memcpy(buf, CHANCACHE_MAGIC, 4);
+	buf[4] = CHANCACHE_VERSION;
+	i2b_buf(4, cache_count, buf + 5);
+	rec = buf + CHANCACHE_HDRSIZE;
+	for(i = 0; cache_hash && i <= cache_mask; i++)
+	{
+		for(c = cache_hash[i]; c; c = c->next)
+		{
+			i2b_buf(2, c->caid, rec);
+			i2b_buf(4, c->prid, rec + 2);
+			i2b_buf(2, c->srvid, rec + 6);
+			i2b_buf(2, c->pid, rec + 8);
+			i2b_buf(4, c->chid, rec + 10);
+			rec += CHANCACHE_RECSIZE;
+		}
+	}
+	SAFE_MUTEX_UNLOCK(&cache_lock);
+
+	// written to a temp file that replaces the cache, so a crash never leaves a cut file behind
+	file = fopen(tmpname, "wb");
 	if(!file)
 	{
-		cs_log_dbg(D_TRACE, "dvbapi channelcache can't read from file %s", fname);
+		cs_log("dvbapi channelcache can't write to file %s", tmpname);
+		NULLFREE(buf);
 		return;
 	}
-	
+	if(fwrite(buf, 1, len, file) != len || fflush(file) || fsync(fileno(file)))
+	{
+		fclose(file);
+		NULLFREE(buf);
+		if(!remove(tmpname))
+		{
+			cs_log("error writing cache -> cache file removed!");
+		}
+		else
+		{
+			cs_log("error writing cache -> cache file could not be removed either!");
+		}
+		return;
+	}
+	fclose(file);
+	NULLFREE(buf);
+
+	if(rename(tmpname, fname) < 0)
+	{
+		cs_log("dvbapi channelcache can't replace %s (errno=%d %s)", fname, errno, strerror(errno));
+		remove(tmpname);
+		return;
+	}
+	cs_log("dvbapi channelcache saved to %s", fname);
+}
+
+static void dvbapi_load_channel_cache_text(FILE *file)
+{
+	char line[1024];
 	int32_t i = 1;
 	int32_t valid = 0;
 	char *ptr, *saveptr1 = NULL;
@@ -94,54 +247,88 @@ void dvbapi_load_channel_cache(void)
 		}
 
 		valid = (i == 5);
-		if(valid)
+		if(valid && a2i(split[0], 4) != 0)
 		{
-			if(!cs_malloc(&c, sizeof(struct s_channel_cache)))
-			{ continue; }
-			c->caid = a2i(split[0], 4);
-			c->prid = a2i(split[1], 6);
-			c->srvid = a2i(split[2], 4);
-			c->pid = a2i(split[3], 4);
-			c->chid = a2i(split[4], 6);
+			chancache_add_new(a2i(split[0], 4), a2i(split[1], 6), a2i(split[2], 4), a2i(split[3], 4), a2i(split[4], 6));
+		}
+	}
+}
 
-			if(valid && c->caid != 0)
-			{
-				if(!channel_cache)
-				{
-					channel_cache = ll_create("channel cache");
-				}
+void dvbapi_load_channel_cache(void)
+{
+	if(boxtype_is("dbox2")) return; // dont load channelcache on these boxes, they lack resources and will crash!
+	
+	if (USE_OPENXCAS) // Why?
+		return;
 
-				ll_append(channel_cache, c);
-			}
-			else
-			{
-				NULLFREE(c);
-			}
+	char fname[256];
+	uchar hdr[CHANCACHE_HDRSIZE], rec[CHANCACHE_RECSIZE];
+	uint32_t i, count;
+	FILE *file;
+
+	get_config_filename(fname, sizeof(fname), "oscam.ccache");
+	file = fopen(fname, "rb");
+	if(!file)
+	{
+		cs_log_dbg(D_TRACE, "dvbapi channelcache can't read from file %s", fname);
+		return;
+	}
+
+	SAFE_MUTEX_LOCK(&cache_lock);
+	if(fread(hdr, 1, CHANCACHE_HDRSIZE, file) == CHANCACHE_HDRSIZE && !memcmp(hdr, CHANCACHE_MAGIC, 4))
+	{
+		if(hdr[4] != CHANCACHE_VERSION)
+		{
+			cs_log("dvbapi channelcache %s has unknown version %d, ignored", fname, hdr[4]);
+			count = 0;
+		}
+		else
+			{ count = b2i(4, hdr + 5); }
+
+		for(i = 0; i < count && fread(rec, 1, CHANCACHE_RECSIZE, file) == CHANCACHE_RECSIZE; i++)
+		{
+			if(b2i(2, rec) != 0)
+				{ chancache_add_new(b2i(2, rec), b2i(4, rec + 2), b2i(2, rec + 6), b2i(2, rec + 8), b2i(4, rec + 10)); }
 		}
 	}
+	else // oscam.ccache of older versions
+	{
+		rewind(file);
+		dvbapi_load_channel_cache_text(file);
+	}
+	SAFE_MUTEX_UNLOCK(&cache_lock);
+
 	fclose(file);
 	cs_log("dvbapi channelcache loaded from %s", fname);
 }
 
+// with caid_and_prid_only any entry of the caid/provid is returned
 struct s_channel_cache *dvbapi_find_channel_cache(int32_t demux_id, int32_t pidindex, int8_t caid_and_prid_only)
 {
 	struct s_ecmpids *p = &demux[demux_id].ECMpids[pidindex];
-	struct s_channel_cache *c;
-	LL_ITER it;
+	struct s_channel_cache *c = NULL;
+	struct s_chancache_group *g;
 
-	if(!channel_cache)
-		{ channel_cache = ll_create("channel cache"); }
-
-	it = ll_iter_create(channel_cache);
-	while((c = ll_iter_next(&it)))
+	SAFE_MUTEX_LOCK(&cache_lock);
+	if(caid_and_prid_only)
 	{
-
-		if(caid_and_prid_only)
+		if(p->PROVID != 0)
 		{
-			if(p->CAID == c->caid && (p->PROVID == c->prid || p->PROVID == 0))  // PROVID ==0 some provider no provid in PMT table
-				{ return c; }
+			if((g = chancache_group(p->CAID, p->PROVID, 0)))
+				{ c = g->first; }
 		}
-		else
+		else // PROVID ==0 some provider no provid in PMT table
+		{
+			for(g = cache_groups[(p->CAID * 2654435761U) >> 24]; g && !c; g = g->next)
+			{
+				if(g->caid == p->CAID)
+					{ c = g->first; }
+			}
+		}
+	}
+	else if(cache_hash)
+	{
+		for(c = *chancache_bucket(cache_hash, cache_mask, demux[demux_id].program_number, p->CAID, p->ECM_PID); c; c = c->next)
 		{
 			if(demux[demux_id].program_number == c->srvid
 					&& p->CAID == c->caid
@@ -154,25 +341,22 @@ struct s_channel_cache *dvbapi_find_channel_cache(int32_t demux_id, int32_t pidi
 				ecmfmt(buf, ECM_FMT_LEN, c->caid, 0, c->prid, c->chid, c->pid, c->srvid, 0, 0, 0, 0, 0, 0, NULL, NULL);
 				cs_log_dbg(D_DVBAPI, "Demuxer %d found in channel cache: %s", demux_id, buf);
 #endif
-				return c;
+				break;
 			}
 		}
 	}
-	return NULL;
+	SAFE_MUTEX_UNLOCK(&cache_lock);
+	return c;
 }
 
 int32_t dvbapi_edit_channel_cache(int32_t demux_id, int32_t pidindex, uint8_t add)
 {
 	struct s_ecmpids *p = &demux[demux_id].ECMpids[pidindex];
-	struct s_channel_cache *c;
-	LL_ITER it;
+	struct s_channel_cache **prev, *c;
 	int32_t count = 0;
 
-	if(!channel_cache)
-		{ channel_cache = ll_create("channel cache"); }
-
-	it = ll_iter_create(channel_cache);
-	while((c = ll_iter_next(&it)))
+	SAFE_MUTEX_LOCK(&cache_lock);
+	for(prev = cache_hash ? chancache_bucket(cache_hash, cache_mask, demux[demux_id].program_number, p->CAID, p->ECM_PID) : NULL; prev && (c = *prev); )
 	{
 		if(demux[demux_id].program_number == c->srvid
 				&& p->CAID == c->caid
@@ -181,30 +365,26 @@ int32_t dvbapi_edit_channel_cache(int32_t demux_id, int32_t pidindex, uint8_t ad
 		{
 			if(add && p->CHID == c->chid)
 			{
+				SAFE_MUTEX_UNLOCK(&cache_lock);
 				return 0; //already added
 			}
-			ll_iter_remove_data(&it);
+			chancache_remove(prev, c);
 			count++;
+			continue;
 		}
+		prev = &c->next;
 	}
 
-	if(add)
+	if(add && chancache_add_new(p->CAID, p->PROVID, demux[demux_id].program_number, p->ECM_PID, p->CHID))
 	{
-		if(!cs_malloc(&c, sizeof(struct s_channel_cache)))
-			{ return count; }
-		c->srvid = demux[demux_id].program_number;
-		c->caid = p->CAID;
-		c->pid = p->ECM_PID;
-		c->prid = p->PROVID;
-		c->chid = p->CHID;
-		ll_append(channel_cache, c);
 #ifdef WITH_DEBUG
 		char buf[ECM_FMT_LEN];
-		ecmfmt(buf, ECM_FMT_LEN, c->caid, 0, c->prid, c->chid, c->pid, c->srvid, 0, 0, 0, 0, 0, 0, NULL, NULL);
+		ecmfmt(buf, ECM_FMT_LEN, p->CAID, 0, p->PROVID, p->CHID, p->ECM_PID, demux[demux_id].program_number, 0, 0, 0, 0, 0, 0, NULL, NULL);
 		cs_log_dbg(D_DVBAPI, "Demuxer %d added to channel cache: %s", demux_id, buf);
 #endif
 		count++;
 	}
+	SAFE_MUTEX_UNLOCK(&cache_lock);
 
 	return count;
 }
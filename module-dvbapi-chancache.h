@@ -3,6 +3,8 @@
 
 #ifdef HAVE_DVBAPI
 
+struct s_chancache_group;
+
 struct s_channel_cache
 {
 	uint16_t    caid;
@@ -10,6 +12,10 @@ struct s_channel_cache
 	uint16_t    srvid;
 	uint16_t    pid;
 	uint32_t    chid;
+	struct s_channel_cache *next;       // hash chain of srvid/caid/pid
+	struct s_channel_cache *group_next; // entries with the same caid/provid
+	struct s_channel_cache *group_prev;
+	struct s_chancache_group *group;
 };
 
 void dvbapi_save_channel_cache(void);
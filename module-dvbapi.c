@@ -296,6 +296,19 @@ static LLIST * ll_activestreampids; // list of all enabled streampids on ca devi
 
 static int32_t unassoc_fd[MAX_DEMUX];
 
+/* On linux the demux filter fds are watched with epoll: they are added by
+   dvbapi_set_filter() and removed by dvbapi_stop_filternum(), and every event
+   carries the fd, its type (0 = filter, 1 = socket), the demuxer or socket
+   slot and the filter number, so dvbapi_main_local() does not have to rebuild
+   and search the poll list of all demuxers on every round. */
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define DVBAPI_USE_EPOLL
+#define DVBAPI_MAX_SOCKETS (2 * MAX_DEMUX + 1)
+#define DVBAPI_EVENT(fd, type, id, num) ((uint32_t)(fd) | (uint64_t)(type) << 32 | (uint64_t)(id) << 40 | (uint64_t)(num) << 56)
+static int32_t dvbapi_epfd = -1;
+#endif
+
 bool is_dvbapi_usr(char *usr) {
 	return streq(cfg.dvbapi_usr, usr);
 }
@@ -722,6 +735,50 @@ int32_t dvbapi_net_send(uint32_t request, int32_t socket_fd, uint32_t msgid, int
 	return 0;
 }
 
+/*
+ * Filter byte 0 applies to section byte 0, filter bytes 1..15 to section bytes
+ * 3..17 as the two length bytes are skipped. filter & mask are stored in that
+ * layout so a section is matched with two 64 bit compares in filtermatch().
+ */
+static void dvbapi_compile_filter(FILTERTYPE *fd)
+{
+	uchar value[16];
+	int32_t i;
+
+	fd->match_len = -1;
+	for(i = 0; i < 16; i++)
+	{
+		value[i] = fd->filter[i] & fd->mask[i];
+		if(fd->mask[i])
+			{ fd->match_len = i ? i + 2 : 0; }
+	}
+	memcpy(fd->match_value, value, 16);
+	memcpy(fd->match_mask, fd->mask, 16);
+}
+
+static void dvbapi_watch_filter(int32_t demux_id, int32_t num, int8_t add)
+{
+#ifdef DVBAPI_USE_EPOLL
+	struct epoll_event ev;
+	int32_t fd = demux[demux_id].demux_fd[num].fd;
+
+	// same filters as the poll list of dvbapi_main_local() would hold
+	if(dvbapi_epfd < 0 || fd <= 0 || fd == DUMMY_FD || cfg.dvbapi_listenport || cfg.dvbapi_boxtype == BOXTYPE_PC_NODMX
+		|| selected_api == STAPI || selected_api == COOLAPI)
+		{ return; }
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLPRI;
+	ev.data.u64 = DVBAPI_EVENT(fd, 0, demux_id, num);
+	if(epoll_ctl(dvbapi_epfd, add ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, fd, &ev) < 0)
+		{ cs_log_dbg(D_DVBAPI, "Demuxer %d filter %d: epoll_ctl(%d) failed (errno=%d %s)", demux_id, num + 1, fd, errno, strerror(errno)); }
+#else
+	(void)demux_id;
+	(void)num;
+	(void)add;
+#endif
+}
+
 int32_t dvbapi_set_filter(int32_t demux_id, int32_t api, uint16_t pid, uint16_t caid, uint32_t provid, uchar *filt, uchar *mask, int32_t timeout, int32_t pidindex, int32_t type,
 	int8_t add_to_emm_list)
 {
@@ -751,6 +808,8 @@ int32_t dvbapi_set_filter(int32_t demux_id, int32_t api, uint16_t pid, uint16_t
 		demux[demux_id].demux_fd[n].type     = type;
 		memcpy(demux[demux_id].demux_fd[n].filter, filt, 16); // copy filter to check later on if receiver delivered accordingly
 		memcpy(demux[demux_id].demux_fd[n].mask, mask, 16); // copy mask to check later on if receiver delivered accordingly
+		dvbapi_compile_filter(&demux[demux_id].demux_fd[n]);
+		demux[demux_id].demux_fd[n].ring_used = 0;
 		return 1;
 	}
 
@@ -853,6 +912,9 @@ int32_t dvbapi_set_filter(int32_t demux_id, int32_t api, uint16_t pid, uint16_t
 		demux[demux_id].demux_fd[n].type     = type;
 		memcpy(demux[demux_id].demux_fd[n].filter, filt, 16); // copy filter to check later on if receiver delivered accordingly
 		memcpy(demux[demux_id].demux_fd[n].mask, mask, 16); // copy mask to check later on if receiver delivered accordingly
+		dvbapi_compile_filter(&demux[demux_id].demux_fd[n]);
+		demux[demux_id].demux_fd[n].ring_used = 0;
+		dvbapi_watch_filter(demux_id, n, 1);
 		cs_log_dbg(D_DVBAPI, "Demuxer %d Filter %d started successfully (caid %04X provid %06X pid %04X)", demux_id, n + 1, caid, provid, pid);
 		if(type == TYPE_EMM && add_to_emm_list){
 			add_emmfilter_to_list(demux_id, filt, caid, provid, pid, n + 1, true);
@@ -983,43 +1045,96 @@ static int32_t dvbapi_detect_api(void)
 	return 1;
 }
 
-static int32_t dvbapi_read_device(int32_t dmx_fd, unsigned char *buf, uint32_t length)
+/* A filter fd delivers whole sections back to back, so one read() may return
+   several of them and cut the last one at the end of the buffer. Per wakeup
+   all data available on the fd is read into the ring of the filter, then the
+   complete sections are handed to dvbapi_process_input() in order while a cut
+   section waits in the ring for its remaining bytes.
+   ECM sections are hashed DVBAPI_MD5_BATCH at a time with MD5_multi(), the
+   digest of the section being handled is passed on in dvbapi_section_md5 so
+   request_cw() does not hash it again.
+   Returns the number of sections or -1 on a read error. */
+#define DVBAPI_RING_SIZE 0x2000
+#define DVBAPI_MD5_BATCH 8
+
+static const uchar *dvbapi_section_md5; // only set by the dvbapi thread while it handles a section
+
+static int32_t dvbapi_read_sections(int32_t demux_id, int32_t num)
 {
-	int32_t readed;
-	uint32_t count = 0;
-	struct pollfd pfd[1];
+	static uchar work[DVBAPI_RING_SIZE]; // only used by the dvbapi thread
+	FILTERTYPE *f = &demux[demux_id].demux_fd[num];
+	int32_t fd = f->fd, pid = f->pid, readed, sections = 0, hashed = 0, next = 0;
+	uint16_t type = f->type;
+	uint32_t used, len, end = 0;
+	int8_t overflow = 0;
+	uchar *p, *q;
+	const uchar *md5_in[DVBAPI_MD5_BATCH];
+	unsigned long md5_len[DVBAPI_MD5_BATCH];
+	uchar md5[DVBAPI_MD5_BATCH][MD5_DIGEST_LENGTH], *md5_out[DVBAPI_MD5_BATCH];
+
+	if(!f->ring && !cs_malloc(&f->ring, DVBAPI_RING_SIZE))
+		{ return 0; }
+
+	used = f->ring_used;
+	while(used < DVBAPI_RING_SIZE)
+	{
+		readed = read(fd, f->ring + used, DVBAPI_RING_SIZE - used);
+		if(readed < 0) // error occured while reading
+		{
+			if(errno == EINTR) { continue; }  // try again in case of interrupt
+			if(errno == EAGAIN) { break; }  // nothing to read left
+			cs_log("ERROR: Read error on fd %d (errno=%d %s)", fd, errno, strerror(errno));
+			if(errno != EOVERFLOW)
+			{
+				f->ring_used = 0;
+				return -1;
+			}
+			overflow = 1; // receiver internal filterbuffer overflow, the cut section will never be completed
+			break;
+		}
+		if(!readed)
+			{ break; }
+		used += readed;
+		if(cfg.dvbapi_boxtype == BOXTYPE_SAMYGO)
+			{ break; } // blocking socket, only the first read is sure to return
+	}
 
-	pfd[0].fd = dmx_fd;
-	pfd[0].events = (POLLIN | POLLPRI);
+	// take the complete sections out first, dvbapi_process_input() may stop or restart this filter
+	while(end + 3 <= used)
+	{
+		p = f->ring + end;
+		if(end + SCT_LEN(p) > used)
+			{ break; }
+		end += SCT_LEN(p);
+	}
+	memcpy(work, f->ring, end);
+	f->ring_used = overflow ? 0 : used - end;
+	if(f->ring_used)
+		{ memmove(f->ring, f->ring + end, f->ring_used); }
 
-	while (count < length )
+	for(p = work; p < work + end; p += len)
 	{
-		if (poll(pfd,1,0)) // fd ready for reading?
+		if(p > work && ((int32_t)f->fd != fd || f->pid != pid || f->type != type))
+			{ break; } // filter was stopped meanwhile, drop the rest
+		len = SCT_LEN(p);
+		if(type == TYPE_ECM && next == hashed)
 		{
-			if (pfd[0].revents & (POLLIN | POLLPRI)) // is there data to read?
+			for(hashed = 0, q = p; hashed < DVBAPI_MD5_BATCH && q < work + end; q += SCT_LEN(q), hashed++)
 			{
-				readed = read(dmx_fd, &buf[count], length-count);
-				if(readed < 0) // error occured while reading
-				{
-                    if(errno == EINTR || errno == EAGAIN) { continue; }  // try again in case of interrupt
-					cs_log("ERROR: Read error on fd %d (errno=%d %s)", dmx_fd, errno, strerror(errno));
-					return (errno == EOVERFLOW ? 0 : -1);
-				}
-				if(readed > 0) // succesfull read
-				{
-					count += readed;
-				}
-				if(readed == 0 && count > 0) // nothing to read left
-				{
-					break;
-				}
+				md5_in[hashed] = q;
+				md5_len[hashed] = SCT_LEN(q);
+				md5_out[hashed] = md5[hashed];
 			}
-			else return -1; // other events than pollin/pri means bad news -> abort!
-        }
-		else break;
+			MD5_multi(md5_in, md5_len, md5_out, hashed);
+			next = 0;
+		}
+		cs_log_dump_dbg(D_TRACE, p, len, "Received:");
+		dvbapi_section_md5 = type == TYPE_ECM ? md5[next++] : NULL;
+		dvbapi_process_input(demux_id, num, p, len, 0);
+		dvbapi_section_md5 = NULL;
+		sections++;
 	}
-	cs_log_dump_dbg(D_TRACE, buf, count, "Received:");
-	return count;
+	return sections;
 }
 
 int32_t dvbapi_open_device(int32_t type, int32_t num, int32_t adapter)
@@ -1171,6 +1286,7 @@ int32_t dvbapi_stop_filternum(int32_t demux_index, int32_t num, uint32_t msgid)
 
 	if(fd > 0)
 	{
+		dvbapi_watch_filter(demux_index, num, 0);
 		do
 		{
 			errno = 0;
@@ -1355,6 +1471,7 @@ int32_t dvbapi_stop_filternum(int32_t demux_index, int32_t num, uint32_t msgid)
 	}
 	demux[demux_index].demux_fd[num].type = 0;
 	demux[demux_index].demux_fd[num].fd = 0;
+	demux[demux_index].demux_fd[num].ring_used = 0;
 	return 1; // all ok!
 }
 
@@ -1973,6 +2090,7 @@ void dvbapi_stop_all_emm_sdt_filtering(uint32_t msgid)
 void dvbapi_stop_descrambling(int32_t demux_id, uint32_t msgid)
 {
 	int32_t i, j, z;
+	uchar *ring[MAX_FILTER];
 	if(demux[demux_id].program_number == 0) { return; }
 	char channame[CS_SERVICENAME_SIZE];
 	i = demux[demux_id].pidindex;
@@ -2002,9 +2120,14 @@ void dvbapi_stop_descrambling(int32_t demux_id, uint32_t msgid)
 	}
 	dvbapi_stop_filter(demux_id, TYPE_ECM, msgid);
 
+	// the section rings are kept for the next program, they are freed when the dvbapi thread ends
+	for(i = 0; i < MAX_FILTER; i++)
+		{ ring[i] = demux[demux_id].demux_fd[i].ring; }
 	pthread_mutex_destroy(&demux[demux_id].answerlock);
 	memset(&demux[demux_id], 0 , sizeof(DEMUXTYPE));
 	SAFE_MUTEX_INIT(&demux[demux_id].answerlock, NULL);
+	for(i = 0; i < MAX_FILTER; i++)
+		{ demux[demux_id].demux_fd[i].ring = ring[i]; }
 
 	for(i = 0; i < ECM_PIDS; i++)
 	{
@@ -3047,8 +3170,12 @@ void request_cw(struct s_client *client, ECM_REQUEST *er, int32_t demux_id, uint
 	}
 	else
 	{
+		static const unsigned char nullmd5[CS_ECMSTORESIZE];
 		unsigned char md5tmp[MD5_DIGEST_LENGTH];
-		MD5(er->ecm, er->ecmlen, md5tmp);
+		if(memcmp(er->ecmd5, nullmd5, CS_ECMSTORESIZE)) // already hashed by dvbapi_read_sections()
+			{ memcpy(md5tmp, er->ecmd5, CS_ECMSTORESIZE); }
+		else
+			{ MD5(er->ecm, er->ecmlen, md5tmp); }
 		if(!memcmp(demux[demux_id].demux_fd[filternum].prevecmd5, md5tmp, CS_ECMSTORESIZE))
 		{
 			if(demux[demux_id].demux_fd[filternum].prevresult < E_NOTFOUND)
@@ -4352,6 +4479,11 @@ void dvbapi_process_input(int32_t demux_id, int32_t filter_num, uchar *buffer, i
 	if(!filt_match)
 	{
 		cs_log_dbg(D_DVBAPI,"Demuxer %d receiver returned data that was not matching to the filter -> delivered filter data discarded!", demux_id);
+		if(cs_dblevel & D_DVBAPI)
+		{
+			cs_log_dbg(D_DVBAPI, "Demuxer %d filter %d: data matches running filters %08X", demux_id, filter_num + 1,
+				filtermatch_demux(buffer, demux_id, sctlen));
+		}
 			return;
 	}
 
@@ -4471,6 +4603,8 @@ void dvbapi_process_input(int32_t demux_id, int32_t filter_num, uchar *buffer, i
 		er->ecmlen = sctlen;
 		memcpy(er->ecm, buffer, er->ecmlen);
 		er->msgid = msgid;
+		if(dvbapi_section_md5) // full section digest for request_cw(), get_cw() replaces it by the cache hash
+			{ memcpy(er->ecmd5, dvbapi_section_md5, CS_ECMSTORESIZE); }
 
 		chid = get_subid(er); // fetch chid or fake chid
 		uint32_t fixedprovid = chk_provid(er->ecm, er->caid);
@@ -5170,7 +5304,6 @@ static void *dvbapi_main_local(void *cli)
 	int32_t rc, pfdcount, g, connfd, clilen;
 	int32_t ids[maxpfdsize], fdn[maxpfdsize], type[maxpfdsize];
 	struct SOCKADDR servaddr;
-	ssize_t len = 0;
 	static const uint16_t mbuf_size = 2048;
 	uchar *mbuf;
 	uint16_t unhandled_buf_len[maxpfdsize], unhandled_buf_used[maxpfdsize];
@@ -5178,6 +5311,14 @@ static void *dvbapi_main_local(void *cli)
 	struct s_auth *account;
 	int32_t ok = 0;
 	uint16_t client_proto_version[maxpfdsize];
+	int32_t slot[maxpfdsize]; // index into unhandled_buf and client_proto_version
+#ifdef DVBAPI_USE_EPOLL
+	struct epoll_event events[maxpfdsize];
+	int32_t sock_fd[DVBAPI_MAX_SOCKETS];
+	int8_t sock_seen[DVBAPI_MAX_SOCKETS];
+	struct epoll_event ev;
+	int32_t s;
+#endif
 
 	if(!cs_malloc(&mbuf, sizeof(uchar)*mbuf_size))
 	{
@@ -5191,7 +5332,18 @@ static void *dvbapi_main_local(void *cli)
 		unhandled_buf_used[i] = 0;
 
 		client_proto_version[i] = 0;
+		slot[i] = i;
+	}
+
+#ifdef DVBAPI_USE_EPOLL
+	memset(sock_fd, 0, sizeof(sock_fd));
+	if((dvbapi_epfd = epoll_create(maxpfdsize)) < 0)
+	{
+		cs_log("ERROR: epoll_create() failed (errno=%d %s)", errno, strerror(errno));
+		free(mbuf);
+		return NULL;
 	}
+#endif
 
 	for(account = cfg.account; account != NULL; account = account->next)
 	{
@@ -5329,6 +5481,13 @@ static void *dvbapi_main_local(void *cli)
 
 		}
 		pfdcount = (listenfd > -1) ? 1 : 0;
+#ifdef DVBAPI_USE_EPOLL
+		if(listenfd > -1) // the dispatch list of the last round overwrote it
+		{
+			pfd2[0].fd = listenfd;
+			type[0] = 1;
+		}
+#endif
 
 		for(i = 0; i < MAX_DEMUX; i++)
 		{
@@ -5336,7 +5495,9 @@ static void *dvbapi_main_local(void *cli)
 			if (unassoc_fd[i]) {
 				pfd2[pfdcount].fd = unassoc_fd[i];
 				pfd2[pfdcount].events = (POLLIN | POLLPRI);
-				client_proto_version[pfdcount] = last_client_proto_version;
+#ifndef DVBAPI_USE_EPOLL
+				client_proto_version[pfdcount] = last_client_proto_version; // under epoll set per socket slot below
+#endif
 				type[pfdcount++] = 1;
 			}
 
@@ -5347,6 +5508,7 @@ static void *dvbapi_main_local(void *cli)
 			{
 				if(demux[i].demux_fd[g].fd <= 0) continue; // deny obvious invalid fd!
 
+#ifndef DVBAPI_USE_EPOLL
 				if(!cfg.dvbapi_listenport && cfg.dvbapi_boxtype != BOXTYPE_PC_NODMX && selected_api != STAPI && selected_api != COOLAPI)
 				{
 					pfd2[pfdcount].fd = demux[i].demux_fd[g].fd;
@@ -5355,6 +5517,7 @@ static void *dvbapi_main_local(void *cli)
 					fdn[pfdcount] = g;
 					type[pfdcount++] = 0;
 				}
+#endif
 				if(demux[i].demux_fd[g].type == TYPE_ECM) { ecmcounter++; }  // count ecm filters to see if demuxing is possible anyway
 				if(demux[i].demux_fd[g].type == TYPE_EMM) { emmcounter++; }  // count emm filters also
 			}
@@ -5515,10 +5678,62 @@ static void *dvbapi_main_local(void *cli)
 			}
 		}
 
+#ifdef DVBAPI_USE_EPOLL
+		// the poll list only holds the sockets here, they are few and come and go with the pmt connections
+		memset(sock_seen, 0, sizeof(sock_seen));
+		for(i = 0; i < pfdcount; i++)
+		{
+			for(s = 0; s < DVBAPI_MAX_SOCKETS && sock_fd[s] != pfd2[i].fd; s++) { ; }
+			if(s == DVBAPI_MAX_SOCKETS)
+			{
+				for(s = 0; s < DVBAPI_MAX_SOCKETS && sock_fd[s] > 0; s++) { ; }
+				if(s == DVBAPI_MAX_SOCKETS) { continue; }
+			}
+			memset(&ev, 0, sizeof(ev));
+			ev.events = EPOLLIN | EPOLLPRI;
+			ev.data.u64 = DVBAPI_EVENT(pfd2[i].fd, 1, s, 0);
+			// a closed socket leaves the epoll set by itself, so a successful add is always a new connection
+			if(epoll_ctl(dvbapi_epfd, EPOLL_CTL_ADD, pfd2[i].fd, &ev) == 0)
+			{
+				sock_fd[s] = pfd2[i].fd;
+				unhandled_buf_used[s] = 0;
+				client_proto_version[s] = 0;
+			}
+			else if(errno != EEXIST || sock_fd[s] != pfd2[i].fd)
+			{
+				cs_log_dbg(D_DVBAPI, "epoll_ctl(%d) failed (errno=%d %s)", pfd2[i].fd, errno, strerror(errno));
+				continue;
+			}
+			for(j = 0; j < MAX_DEMUX; j++)
+			{
+				if(unassoc_fd[j] == pfd2[i].fd)
+				{
+					client_proto_version[s] = last_client_proto_version;
+					break;
+				}
+			}
+			sock_seen[s] = 1;
+		}
+		for(s = 0; s < DVBAPI_MAX_SOCKETS; s++)
+		{
+			if(sock_fd[s] <= 0 || sock_seen[s]) { continue; }
+			// the fd may be closed and reused by a demux filter meanwhile
+			for(i = 0; i < MAX_DEMUX * MAX_FILTER && (int32_t)demux[i / MAX_FILTER].demux_fd[i % MAX_FILTER].fd != sock_fd[s]; i++) { ; }
+			if(i == MAX_DEMUX * MAX_FILTER)
+				{ epoll_ctl(dvbapi_epfd, EPOLL_CTL_DEL, sock_fd[s], &ev); }
+			sock_fd[s] = 0;
+			unhandled_buf_used[s] = 0;
+		}
+#endif
+
 		rc = 0;
 		while(!(listenfd == -1 && cfg.dvbapi_pmtmode == 6))
 		{
+#ifdef DVBAPI_USE_EPOLL
+			rc = epoll_wait(dvbapi_epfd, events, maxpfdsize, 500);
+#else
 			rc = poll(pfd2, pfdcount, 500);
+#endif
 			if(rc < 0) // error occured while polling for fd's with fresh data
 			{
 				if(errno == EINTR || errno == EAGAIN) // try again in case of interrupt
@@ -5545,6 +5760,19 @@ static void *dvbapi_main_local(void *cli)
 			cs_ftime(&start); // register new start time for next poll
 		}
 
+#ifdef DVBAPI_USE_EPOLL
+		// hand the ready events to the dispatch below as a poll list
+		for(i = 0; i < rc; i++)
+		{
+			pfd2[i].fd = (uint32_t)events[i].data.u64;
+			pfd2[i].revents = events[i].events; // EPOLL* flags have the values of their POLL* counterparts
+			type[i] = (events[i].data.u64 >> 32) & 0xFF;
+			ids[i] = slot[i] = (events[i].data.u64 >> 40) & 0xFFFF;
+			fdn[i] = (events[i].data.u64 >> 56) & 0xFF;
+		}
+		pfdcount = rc > 0 ? rc : 0;
+#endif
+
 		for(i = 0; i < pfdcount && rc > 0; i++)
 		{
 			if(pfd2[i].revents == 0) { continue; }  // skip sockets with no changes
@@ -5593,8 +5821,10 @@ static void *dvbapi_main_local(void *cli)
 						struct dmx_sct_filter_params sFP;
 
 						cs_log_dbg(D_DVBAPI, "re-opening connection to demux socket");
+						dvbapi_watch_filter(demux_index, n, 0);
 						close(demux[demux_index].demux_fd[n].fd);
 						demux[demux_index].demux_fd[n].fd  = -1;
+						demux[demux_index].demux_fd[n].ring_used = 0;
 
 						ret = dvbapi_open_device(0, demux[demux_index].demux_index, demux[demux_index].adapter_index);
 						if(ret != -1)
@@ -5615,6 +5845,8 @@ static void *dvbapi_main_local(void *cli)
 							memcpy(sFP.filter.filter, filter, 16);
 							memcpy(sFP.filter.mask, filter + 16, 16);
 							ret = dvbapi_ioctl(demux[demux_index].demux_fd[n].fd, DMX_SET_FILTER, &sFP);
+							if(ret != -1)
+								{ dvbapi_watch_filter(demux_index, n, 1); }
 						}
 
 						if(ret == -1)
@@ -5662,14 +5894,14 @@ static void *dvbapi_main_local(void *cli)
 					//reading and completing data from socket
 					if (connfd > 0) {
 
-						if(unhandled_buf_used[i])
+						if(unhandled_buf_used[slot[i]])
 						{
-							memcpy(mbuf, unhandled_buf[i], unhandled_buf_used[i]);
+							memcpy(mbuf, unhandled_buf[slot[i]], unhandled_buf_used[slot[i]]);
 						}
 
-						if(!dvbapi_handlesockdata(connfd, mbuf, mbuf_size, unhandled_buf_used[i], &add_to_poll, &unhandled_buf_used[i], &client_proto_version[i]))
+						if(!dvbapi_handlesockdata(connfd, mbuf, mbuf_size, unhandled_buf_used[slot[i]], &add_to_poll, &unhandled_buf_used[slot[i]], &client_proto_version[slot[i]]))
 						{
-							unhandled_buf_used[i] = 0;
+							unhandled_buf_used[slot[i]] = 0;
 
 							//client disconnects, stop all assigned decoding
 							cs_log_dbg(D_DVBAPI, "Socket %d reported connection close", connfd);
@@ -5710,23 +5942,23 @@ static void *dvbapi_main_local(void *cli)
 							continue;
 						}
 
-						if(unhandled_buf_used[i])
+						if(unhandled_buf_used[slot[i]])
 						{
-							if(unhandled_buf_used[i] > unhandled_buf_len[i])
+							if(unhandled_buf_used[slot[i]] > unhandled_buf_len[slot[i]])
 							{
-								NULLFREE(unhandled_buf[i]);
+								NULLFREE(unhandled_buf[slot[i]]);
 
-								unhandled_buf_len[i] = unhandled_buf_used[i] < 128 ? 128 : unhandled_buf_used[i];
+								unhandled_buf_len[slot[i]] = unhandled_buf_used[slot[i]] < 128 ? 128 : unhandled_buf_used[slot[i]];
 
-								if(!cs_malloc(&unhandled_buf[i], sizeof(uchar)*unhandled_buf_len[i]))
+								if(!cs_malloc(&unhandled_buf[slot[i]], sizeof(uchar)*unhandled_buf_len[slot[i]]))
 								{
-									unhandled_buf_len[i] = 0;
-									unhandled_buf_used[i] = 0;
+									unhandled_buf_len[slot[i]] = 0;
+									unhandled_buf_used[slot[i]] = 0;
 									continue;
 								}
 							}
 
-							memcpy(unhandled_buf[i], mbuf, unhandled_buf_used[i]);
+							memcpy(unhandled_buf[slot[i]], mbuf, unhandled_buf_used[slot[i]]);
 						}
 
 						// if the connection is new and we read no PMT data, then add it to the poll,
@@ -5749,19 +5981,12 @@ static void *dvbapi_main_local(void *cli)
 
 					if((int)demux[demux_index].demux_fd[n].fd != pfd2[i].fd) { continue; } // filter already killed, no need to process this data!
 
-					len = dvbapi_read_device(pfd2[i].fd, mbuf, mbuf_size);
-					if(len < 0) // serious filterdata read error
+					if(dvbapi_read_sections(demux_index, n) < 0) // serious filterdata read error
 					{
 						dvbapi_stop_filternum(demux_index, n, 0); // stop filter since its giving errors and wont return anything good.
 						maxfilter--; // lower maxfilters to avoid this with new filter setups!
 						continue;
 					}
-					if(!len) // receiver internal filterbuffer overflow
-					{
-						memset(mbuf, 0, mbuf_size);
-					}
-
-					dvbapi_process_input(demux_index, n, mbuf, len, 0);
 				}
 				continue; // continue with other events!
 			}
@@ -5772,6 +5997,15 @@ static void *dvbapi_main_local(void *cli)
 	{
 		NULLFREE(unhandled_buf[j]);
 	}
+	for(i = 0; i < MAX_DEMUX; i++)
+	{
+		for(j = 0; j < MAX_FILTER; j++)
+			{ NULLFREE(demux[i].demux_fd[j].ring); }
+	}
+#ifdef DVBAPI_USE_EPOLL
+	close(dvbapi_epfd);
+	dvbapi_epfd = -1;
+#endif
 	free(mbuf);
 	return NULL;
 }
@@ -6743,6 +6977,7 @@ int32_t dvbapi_activate_section_filter(int32_t demux_index, int32_t num, int32_t
 	{
 		memcpy(demux[demux_index].demux_fd[num].filter, filter, 16); // copy filter to check later on if receiver delivered accordingly
 		memcpy(demux[demux_index].demux_fd[num].mask, mask, 16); // copy mask to check later on if receiver delivered accordingly
+		dvbapi_compile_filter(&demux[demux_index].demux_fd[num]);
 	}
 	return ret;
 }
@@ -7329,35 +7564,48 @@ void rotate_emmfilter(int32_t demux_id)
 	}
 }
 
+// gathers section bytes 0 and 3..17 as laid out by dvbapi_compile_filter(), bytes past len are zero
+static void filtermatch_section(uchar *buffer, int32_t len, uint64_t *sct)
+{
+	uchar data[16];
+	int32_t n = len >= 17 ? 15 : len - 2;
+
+	memset(data, 0, sizeof(data));
+	if(len >= 0)
+		{ data[0] = buffer[0]; }
+	if(n > 0)
+		{ memcpy(data + 1, buffer + 3, n); }
+	memcpy(sct, data, 16);
+}
+
+static int32_t filtermatch_fd(FILTERTYPE *fd, uint64_t *sct, int32_t len)
+{
+	return (fd->match_len < 0 || fd->match_len <= len) && (sct[0] & fd->match_mask[0]) == fd->match_value[0]
+		&& (sct[1] & fd->match_mask[1]) == fd->match_value[1];
+}
+
 int32_t filtermatch(uchar *buffer, int32_t filter_num, int32_t demux_id, int32_t len)
 {
-	int32_t i, k, match;
-	uint8_t flt, mask;
-	match = 1;
-	for(i = 0, k = 0; i < 16 && match; i++, k++)
+	uint64_t sct[2];
+
+	filtermatch_section(buffer, len, sct);
+	return filtermatch_fd(&demux[demux_id].demux_fd[filter_num], sct, len); // 0 = delivered data does not match with filter, 1 = delivered data matches with filter
+}
+
+// returns the running filters of the demuxer matching the section, filter n is bit n
+uint32_t filtermatch_demux(uchar *buffer, int32_t demux_id, int32_t len)
+{
+	uint64_t sct[2];
+	uint32_t found = 0;
+	int32_t n;
+
+	filtermatch_section(buffer, len, sct);
+	for(n = 0; n < maxfilter; n++)
 	{
-		mask = demux[demux_id].demux_fd[filter_num].mask[i];
-		if(k == 1) //skip len bytes
-		{
-			k += 2;
-		}
-		if(!mask)
-		{
-			continue;
-		}
-		flt = (demux[demux_id].demux_fd[filter_num].filter[i]&mask);
-		//cs_log_dbg(D_DVBAPI,"Demuxer %d filter%d[%d] = %02X, filter mask[%d] = %02X, flt&mask = %02X , buffer[%d] = %02X, buffer[%d] & mask = %02X", demux_id, filter_num+1, i,
-		//	demux[demux_id].demux_fd[filter_num].filter[i], i, mask, flt&mask, k, buffer[k], k, buffer[k] & mask);
-		if(k <= len)
-		{
-			match = (flt == (buffer[k] & mask));
-		}
-		else
-		{
-			match = 0;
-		}
+		if(demux[demux_id].demux_fd[n].fd > 0 && filtermatch_fd(&demux[demux_id].demux_fd[n], sct, len))
+			{ found |= 1U << n; }
 	}
-	return (match && i == 16); // 0 = delivered data does not match with filter, 1 = delivered data matches with filter
+	return found;
 }
 
 /*
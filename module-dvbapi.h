@@ -149,6 +149,11 @@ typedef struct filter_s
 	int32_t count;
 	uchar	filter[16];
 	uchar	mask[16];
+	uint64_t match_value[2]; // filter & mask in section layout, see dvbapi_compile_filter()
+	uint64_t match_mask[2];
+	int32_t match_len; // highest section byte covered by the mask, -1 if none
+	uchar	*ring; // data read from the filter fd, see dvbapi_read_sections()
+	uint16_t ring_used;
 	uchar   lastecmd5[CS_ECMSTORESIZE]; // last requested ecm md5
 	int32_t lastresult;
 	uchar	prevecmd5[CS_ECMSTORESIZE]; // previous requested ecm md5
@@ -370,6 +375,7 @@ uint16_t dvbapi_get_client_proto_version(void);
 const char *dvbapi_get_client_name(void);
 void rotate_emmfilter(int32_t demux_id);
 int32_t filtermatch(uchar *buffer, int32_t filter_num, int32_t demux_id, int32_t len);
+uint32_t filtermatch_demux(uchar *buffer, int32_t demux_id, int32_t len);
 void delayer(ECM_REQUEST *er, uint32_t delay);
 void check_add_emmpid(int32_t demux_index, uchar *filter, int32_t l, int32_t emmtype);
 void *dvbapi_start_handler(struct s_client *cl, uchar *mbuf, int32_t module_idx, void * (*_main_func)(void *));
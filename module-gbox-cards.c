@@ -215,6 +215,104 @@ static void update_checkcode(struct gbox_card *card)
         checkcode[6] ^= (0xFF & (card->id.peer));
 }
 
+/*
+ * Next to the lists the cards are kept in chained hash indexes: by card id
+ * (peer and slot) for hellos and CW results, by origin peer, caid and provid
+ * for ECMs, and by origin peer and by card peer alone for the per peer
+ * counts and deletes. Cards are linked at the end of the id and ecm chains,
+ * so a walk sees them in list order, the order of the peer chains does not
+ * matter. All are protected by gbox_cards_lock.
+ */
+#define GBOX_CARD_INDEX_SIZE 0x1000
+
+#define GBOX_CHAIN_ID           0
+#define GBOX_CHAIN_ECM          1
+#define GBOX_CHAIN_ORIGIN       2
+#define GBOX_CHAIN_PEER         3
+
+static struct gbox_card *gbox_card_ids[GBOX_CARD_INDEX_SIZE];
+static struct gbox_card *gbox_backup_ids[GBOX_CARD_INDEX_SIZE];
+static struct gbox_card *gbox_card_ecms[GBOX_CARD_INDEX_SIZE];
+static struct gbox_card *gbox_card_origins[GBOX_CARD_INDEX_SIZE];
+static struct gbox_card *gbox_card_peers[GBOX_CARD_INDEX_SIZE];
+
+static struct gbox_card **gbox_id_bucket(struct gbox_card **index, uint16_t id_peer, uint8_t slot)
+{
+        return &index[(((uint32_t)id_peer << 8 | slot) * 2654435761U) >> 20];
+}
+
+static struct gbox_card **gbox_ecm_bucket(uint16_t peer_id, uint16_t caid, uint32_t provid)
+{
+        uint32_t h = ((uint32_t)peer_id << 16 | caid) * 2654435761U;
+        return &gbox_card_ecms[((h ^ provid) * 2654435761U) >> 20];
+}
+
+static struct gbox_card **gbox_card_ecm_bucket(struct gbox_card *card)
+{
+        return gbox_ecm_bucket(card->origin_peer->gbox.id, gbox_get_caid(card->caprovid), gbox_get_provid(card->caprovid));
+}
+
+static struct gbox_card **gbox_peer_bucket(struct gbox_card **index, uint16_t peer_id)
+{
+        return &index[((uint32_t)peer_id * 2654435761U) >> 20];
+}
+
+static struct gbox_card **gbox_chain_next(struct gbox_card *card, int8_t chain)
+{
+        switch(chain)
+        {
+        case GBOX_CHAIN_ECM:
+                return &card->next_ecm;
+        case GBOX_CHAIN_ORIGIN:
+                return &card->next_origin;
+        case GBOX_CHAIN_PEER:
+                return &card->next_peer;
+        default:
+                return &card->next_id;
+        }
+}
+
+static void gbox_index_link(struct gbox_card **bucket, struct gbox_card *card, int8_t chain)
+{
+        if (chain == GBOX_CHAIN_ID || chain == GBOX_CHAIN_ECM)
+        {
+                while(*bucket)
+                        { bucket = gbox_chain_next(*bucket, chain); }
+        }
+        *gbox_chain_next(card, chain) = *bucket;
+        *bucket = card;
+}
+
+static void gbox_index_unlink(struct gbox_card **bucket, struct gbox_card *card, int8_t chain)
+{
+        while(*bucket && *bucket != card)
+                { bucket = gbox_chain_next(*bucket, chain); }
+        if (*bucket)
+                { *bucket = *gbox_chain_next(card, chain); }
+}
+
+static void gbox_index_card(struct gbox_card *card)
+{
+        gbox_index_link(gbox_id_bucket(gbox_card_ids, card->id.peer, card->id.slot), card, GBOX_CHAIN_ID);
+        gbox_index_link(gbox_peer_bucket(gbox_card_peers, card->id.peer), card, GBOX_CHAIN_PEER);
+        if (card->origin_peer)
+        {
+                gbox_index_link(gbox_card_ecm_bucket(card), card, GBOX_CHAIN_ECM);
+                gbox_index_link(gbox_peer_bucket(gbox_card_origins, card->origin_peer->gbox.id), card, GBOX_CHAIN_ORIGIN);
+        }
+}
+
+static void gbox_unindex_card(struct gbox_card *card)
+{
+        gbox_index_unlink(gbox_id_bucket(gbox_card_ids, card->id.peer, card->id.slot), card, GBOX_CHAIN_ID);
+        gbox_index_unlink(gbox_peer_bucket(gbox_card_peers, card->id.peer), card, GBOX_CHAIN_PEER);
+        if (card->origin_peer)
+        {
+                gbox_index_unlink(gbox_card_ecm_bucket(card), card, GBOX_CHAIN_ECM);
+                gbox_index_unlink(gbox_peer_bucket(gbox_card_origins, card->origin_peer->gbox.id), card, GBOX_CHAIN_ORIGIN);
+        }
+}
+
 static void gbox_free_card(struct gbox_card *card)
 {
         ll_destroy_data(&card->badsids);
@@ -228,8 +326,7 @@ static uint8_t closer_path_known(uint32_t caprovid, uint16_t id_peer, uint8_t sl
         uint8_t ret = 0;
         struct gbox_card *card;
         cs_readlock(__func__, &gbox_cards_lock);        
-        LL_ITER it = ll_iter_create(gbox_cards);
-        while((card = ll_iter_next(&it)))
+        for(card = *gbox_id_bucket(gbox_card_ids, id_peer, slot); card; card = card->next_id)
         {
                 if (card->caprovid == caprovid && card->id.peer == id_peer && card->id.slot == slot && card->dist <= distance)
                 {
@@ -245,16 +342,18 @@ static uint8_t got_from_backup(uint32_t caprovid, uint16_t id_peer, uint8_t slot
 {
         uint8_t ret = 0;
         struct gbox_card *card;
+        struct gbox_card **bucket = gbox_id_bucket(gbox_backup_ids, id_peer, slot);
         cs_writelock(__func__, &gbox_cards_lock);        
-        LL_ITER it = ll_iter_create(gbox_backup_cards);
-        while((card = ll_iter_next(&it)))
+        for(card = *bucket; card; card = card->next_id)
         {
                 if (card->caprovid == caprovid && card->id.peer == id_peer && card->id.slot == slot)
                 {
                         cs_log_dbg(D_READER, "backup card from peer: %04X %08X", card->id.peer, card->caprovid );
                         ll_remove(gbox_backup_cards, card);
+                        gbox_index_unlink(bucket, card, GBOX_CHAIN_ID);
                         card->origin_peer = origin_peer;
                         ll_append(gbox_cards, card);
+                        gbox_index_card(card);
                         update_checkcode(card);
                         ret = 1;
                         break;
@@ -300,6 +399,7 @@ void gbox_add_card(uint16_t id_peer, uint32_t caprovid, uint8_t slot, uint8_t le
                 card->origin_peer = origin_peer;
                 cs_writelock(__func__, &gbox_cards_lock);
                 ll_append(gbox_cards, card);
+                gbox_index_card(card);
                 update_checkcode(card);
                 cs_writeunlock(__func__, &gbox_cards_lock);
         }
@@ -323,10 +423,9 @@ uint16_t gbox_count_peer_cards(uint16_t peer_id)
         struct gbox_card *card;
 
         cs_readlock(__func__, &gbox_cards_lock);
-        LL_ITER it = ll_iter_create(gbox_cards);
-        while((card = ll_iter_next(&it)))
+        for(card = *gbox_peer_bucket(gbox_card_origins, peer_id); card; card = card->next_origin)
         {
-                if (card->origin_peer && card->origin_peer->gbox.id == peer_id)
+                if (card->origin_peer->gbox.id == peer_id)
                         { counter++; }
         }
         cs_readunlock(__func__, &gbox_cards_lock);
@@ -334,14 +433,32 @@ uint16_t gbox_count_peer_cards(uint16_t peer_id)
         return counter;
 }
 
+static int32_t gbox_count_chain(struct gbox_card *card, uint8_t delete_type, uint16_t criteria)
+{
+        int32_t counter = 0;
+
+        for(; card; card = delete_type == GBOX_DELETE_FROM_PEER ? card->next_origin : card->next_peer)
+        {
+                if (delete_type == GBOX_DELETE_FROM_PEER ? card->origin_peer->gbox.id == criteria : card->id.peer == criteria)
+                        { counter++; }
+        }
+        return counter;
+}
+
 void gbox_delete_cards(uint8_t delete_type, uint16_t criteria)
 {
         struct gbox_card *card;
         uint8_t found;
+        int32_t left = -1; // cards still to delete, -1 if unknown
 
         cs_writelock(__func__, &gbox_cards_lock);
+        // the peer indexes tell how many cards match, the list walk stops after the last one
+        if (delete_type == GBOX_DELETE_FROM_PEER)
+                { left = gbox_count_chain(*gbox_peer_bucket(gbox_card_origins, criteria), delete_type, criteria); }
+        else if (delete_type == GBOX_DELETE_WITH_ID)
+                { left = gbox_count_chain(*gbox_peer_bucket(gbox_card_peers, criteria), delete_type, criteria); }
         LL_ITER it = ll_iter_create(gbox_cards);
-        while((card = ll_iter_next(&it)))
+        while(left && (card = ll_iter_next(&it)))
         {
                 found = 0;
                 switch (delete_type)
@@ -365,9 +482,13 @@ void gbox_delete_cards(uint8_t delete_type, uint16_t criteria)
                 if (found)
                 {
                         cs_log_dbg(D_READER, "remove card from peer: %04X %08X", card->id.peer, card->caprovid);
-                        ll_remove(gbox_cards, card);
+                        ll_iter_remove(&it);
+                        gbox_unindex_card(card);
                         ll_append(gbox_backup_cards, card);
+                        gbox_index_link(gbox_id_bucket(gbox_backup_ids, card->id.peer, card->id.slot), card, GBOX_CHAIN_ID);
                         update_checkcode(card);
+                        if (left > 0)
+                                { left--; }
                 }
         }
         cs_writeunlock(__func__, &gbox_cards_lock);
@@ -392,6 +513,13 @@ static void gbox_free_list(LLIST *card_list)
 
 void gbox_free_cardlist(void)
 {
+        cs_writelock(__func__, &gbox_cards_lock);
+        memset(gbox_card_ids, 0, sizeof(gbox_card_ids));
+        memset(gbox_backup_ids, 0, sizeof(gbox_backup_ids));
+        memset(gbox_card_ecms, 0, sizeof(gbox_card_ecms));
+        memset(gbox_card_origins, 0, sizeof(gbox_card_origins));
+        memset(gbox_card_peers, 0, sizeof(gbox_card_peers));
+        cs_writeunlock(__func__, &gbox_cards_lock);
         gbox_free_list(gbox_cards);
         gbox_free_list(gbox_backup_cards);
         return;
@@ -404,8 +532,7 @@ void gbox_add_good_sid(uint16_t id_card, uint16_t caid, uint8_t slot, uint16_t s
         uint8_t factor = 0;
  
         cs_writelock(__func__, &gbox_cards_lock);
-        LL_ITER it = ll_iter_create(gbox_cards);
-        while((card = ll_iter_next(&it)))
+        for(card = *gbox_id_bucket(gbox_card_ids, id_card, slot); card; card = card->next_id)
         {
                 if(card->id.peer == id_card && gbox_get_caid(card->caprovid) == caid && card->id.slot == slot)
                 {
@@ -441,7 +568,7 @@ void gbox_add_good_sid(uint16_t id_card, uint16_t caid, uint8_t slot, uint16_t s
                         ll_append(card->goodsids, srvid);
                         break;
                 }
-        }//end of ll_iter_next
+        }//end of card loop
         //return dist_c;
         cs_writeunlock(__func__, &gbox_cards_lock);
         return;        
@@ -453,8 +580,7 @@ void gbox_remove_bad_sid(uint16_t id_peer, uint8_t id_slot, uint16_t sid)
         struct gbox_bad_srvid *srvid = NULL;
                 
         cs_writelock(__func__, &gbox_cards_lock);
-        LL_ITER it2 = ll_iter_create(gbox_cards);
-        while((card = ll_iter_next(&it2)))
+        for(card = *gbox_id_bucket(gbox_card_ids, id_peer, id_slot); card; card = card->next_id)
         {
                 if(card->id.peer == id_peer && card->id.slot == id_slot)
                 {
@@ -478,8 +604,7 @@ uint8_t gbox_next_free_slot(uint16_t id)
         uint8_t lastslot = 0;
                         
         cs_readlock(__func__, &gbox_cards_lock);        
-        LL_ITER it = ll_iter_create(gbox_cards);
-        while((c = ll_iter_next(&it)))
+        for(c = *gbox_peer_bucket(gbox_card_peers, id); c; c = c->next_peer)
         {
                 if(id == c->id.peer && c->id.slot > lastslot)
                         { lastslot = c->id.slot; }
@@ -521,12 +646,12 @@ uint8_t gbox_get_cards_for_ecm(uchar *send_buf, int32_t len2, uint8_t max_cards,
 				time_t time_since_lastcw;
 
 				//loop over good only
+				struct gbox_card **bucket = gbox_ecm_bucket(peer_id, er->caid, er->prid);
 				cs_readlock(__func__, &gbox_cards_lock);
-				LL_ITER it = ll_iter_create(gbox_cards);
 				LL_ITER it2;
 				struct gbox_card *card;
 
-				while((card = ll_iter_next(&it)))
+				for(card = *bucket; card; card = card->next_ecm)
 				{
 								if(card->origin_peer && card->origin_peer->gbox.id == peer_id && card->type == GBOX_CARD_TYPE_GBOX &&
 										gbox_get_caid(card->caprovid) == er->caid && gbox_get_provid(card->caprovid) == er->prid && !is_already_pending(er->gbox_cards_pending, card->id.peer, card->id.slot))
@@ -568,8 +693,7 @@ uint8_t gbox_get_cards_for_ecm(uchar *send_buf, int32_t len2, uint8_t max_cards,
                                                                                               
         //loop over bad and unknown cards
         cs_writelock(__func__, &gbox_cards_lock);        
-        it = ll_iter_create(gbox_cards);
-        while((card = ll_iter_next(&it)))
+        for(card = *bucket; card; card = card->next_ecm)
         {
                 if(card->origin_peer && card->origin_peer->gbox.id == peer_id && card->type == GBOX_CARD_TYPE_GBOX &&
                         gbox_get_caid(card->caprovid) == er->caid && gbox_get_provid(card->caprovid) == er->prid && !is_already_pending(er->gbox_cards_pending, card->id.peer, card->id.slot) && !enough)
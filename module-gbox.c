@@ -277,19 +277,23 @@ void gbox_init_ecm_request_ext(struct gbox_ecm_request_ext *ere)
 	ere->gbox_type = 0;
 }
 
+// proxy client by gbox id, an entry is only trusted while the client is still in the client list
+static struct s_client *gbox_proxies[0x10000];
+
+// clientlist_lock has to be held
+static struct s_client *gbox_find_proxy(uint16_t gbox_id)
+{
+	struct s_client *cl = gbox_proxies[gbox_id];
+	if(cl && is_valid_client(cl) && cl->typ == 'p' && cl->gbox && cl->gbox_peer_id == gbox_id)
+		{ return cl; }
+	return NULL;
+}
+
 struct s_client *get_gbox_proxy(uint16_t gbox_id)
 {
-	struct s_client *cl;
-	struct s_client *found = NULL;
+	struct s_client *found;
 	cs_readlock(__func__, &clientlist_lock);
-	for(cl = first_client; cl; cl = cl->next)
-	{
-		if(cl->typ == 'p' && cl->gbox && cl->gbox_peer_id == gbox_id)
-		{
-			found = cl;
-			break;
-		}
-	}
+	found = gbox_find_proxy(gbox_id);
 	cs_readunlock(__func__, &clientlist_lock);
 	return found;
 }
@@ -478,17 +482,14 @@ void gbox_reconnect_client(uint16_t gbox_id)
 {
 	struct s_client *cl;
 	cs_readlock(__func__, &clientlist_lock);
-	for(cl = first_client; cl; cl = cl->next)
+	if((cl = gbox_find_proxy(gbox_id)))
 	{
-		if(cl->gbox && cl->typ == 'p' && cl->gbox_peer_id == gbox_id)
-		{
-			hostname2ip(cl->reader->device, &SIN_GET_ADDR(cl->udp_sa));
-			SIN_GET_FAMILY(cl->udp_sa) = AF_INET;
-			SIN_GET_PORT(cl->udp_sa) = htons((uint16_t)cl->reader->r_port);
-			hostname2ip(cl->reader->device, &(cl->ip));
-			gbox_reinit_proxy(cl);
-			gbox_send_hello(cl, GBOX_STAT_HELLOL); //comment out line,if endless loops occur on LTE/DSL-Hybrid system @IP change
-		}
+		hostname2ip(cl->reader->device, &SIN_GET_ADDR(cl->udp_sa));
+		SIN_GET_FAMILY(cl->udp_sa) = AF_INET;
+		SIN_GET_PORT(cl->udp_sa) = htons((uint16_t)cl->reader->r_port);
+		hostname2ip(cl->reader->device, &(cl->ip));
+		gbox_reinit_proxy(cl);
+		gbox_send_hello(cl, GBOX_STAT_HELLOL); //comment out line,if endless loops occur on LTE/DSL-Hybrid system @IP change
 	}
 	cs_readunlock(__func__, &clientlist_lock);
 }
@@ -1725,6 +1726,7 @@ static int32_t gbox_peer_init(struct s_client *cli)
 	gbox_clear_peer(peer);
 
 	cli->gbox_peer_id = peer->gbox.id;
+	gbox_proxies[peer->gbox.id] = cli;
 
 	cli->pfd = 0;
 	cli->crypted = 1;
@@ -126,6 +126,10 @@ struct gbox_card
     uint32_t no_cws_returned;
     uint32_t average_cw_time;
     struct gbox_peer *origin_peer;
+    struct gbox_card *next_id; // chain of the card id index (peer/slot)
+    struct gbox_card *next_ecm; // chain of the ecm index (origin peer/caid/provid)
+    struct gbox_card *next_origin; // chain of the origin peer index
+    struct gbox_card *next_peer; // chain of the card peer index
 };
                     
 struct gbox_data
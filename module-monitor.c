@@ -587,6 +587,24 @@ static void monitor_login(char *usr)
 	monitor_send_login();
 }
 
+// runs with the log history locked, so the lines are only collected here and sent later
+static void monitor_collect_history(struct s_log_history *hist, void *arg)
+{
+	LLIST *lines = arg;
+	struct s_client *cur_cl = cur_client();
+	char p_usr[32], p_txt[512];
+	size_t pos1 = strcspn(hist->txt, "\t") + 1;
+
+	cs_strncpy(p_usr, hist->txt , pos1 > sizeof(p_usr) ? sizeof(p_usr) : pos1);
+
+	if((p_usr[0]) && ((cur_cl->monlvl > 1) || (cur_cl->account && !strcmp(p_usr, cur_cl->account->usr))))
+	{
+		snprintf(p_txt, sizeof(p_txt), "[LOG%03d]%s", cur_cl->logcounter, hist->txt + pos1);
+		cur_cl->logcounter = (cur_cl->logcounter + 1) % 1000;
+		ll_append(lines, cs_strdup(p_txt));
+	}
+}
+
 static void monitor_logsend(char *flag)
 {
 	if(!flag) { return; }  //no arg
@@ -605,27 +623,16 @@ static void monitor_logsend(char *flag)
 		{ return; }
 	
 	if(!strcmp(flag, "on") && cfg.loghistorylines)
-	{	
-		if(cfg.loghistorylines && log_history)
-		{
-			LL_ITER it = ll_iter_create(log_history);
-			struct s_log_history *hist;
-		
-			while((hist = (struct s_log_history*)ll_iter_next(&it)))
-			{
-				char p_usr[32], p_txt[512];
-				size_t pos1 = strcspn(hist->txt, "\t") + 1;
-				
-				cs_strncpy(p_usr, hist->txt , pos1 > sizeof(p_usr) ? sizeof(p_usr) : pos1);
-				
-				if((p_usr[0]) && ((cur_cl->monlvl > 1) || (cur_cl->account && !strcmp(p_usr, cur_cl->account->usr))))
-				{
-					snprintf(p_txt, sizeof(p_txt), "[LOG%03d]%s", cur_cl->logcounter, hist->txt + pos1);
-					cur_cl->logcounter = (cur_cl->logcounter + 1) % 1000;
-					monitor_send(p_txt);
-				}
-			}   
-		}
+	{
+		LLIST *lines = ll_create("monitor history");
+		char *line;
+		LL_ITER itr;
+
+		cs_log_history(0, monitor_collect_history, lines);
+		itr = ll_iter_create(lines);
+		while((line = ll_iter_next(&itr)))
+			{ monitor_send(line); }
+		ll_destroy_data(&lines);
 	}
 
 	cur_cl->log = 1;
@@ -757,7 +764,7 @@ static void monitor_set_account(char *args)
 	}
 
 	if(write_userdb() == 0)
-		{ cs_reinit_clients(cfg.account); }
+		{ cs_reinit_account_clients(account); }
 
 	snprintf(buf, sizeof(buf), "[S-0000]setuser: %s done - param %s set to %s\n", tmp, argarray[1], argarray[2]);
 	monitor_send_info(buf, 1);
@@ -12,6 +12,12 @@
 #include "oscam-string.h"
 #include "oscam-time.h"
 #include "oscam-net.h"
+#ifdef WITH_ZLIB
+// zlib's crc32() clashes with the one from oscam-string.h
+#define crc32 zlib_crc32
+#include <zlib.h>
+#undef crc32
+#endif
 #if defined(__linux__)
 	#include <sys/sysinfo.h>
 #elif defined(__APPLE__)
@@ -20,6 +26,7 @@
 
 extern int32_t ssl_active;
 extern pthread_key_t getkeepalive;
+extern pthread_key_t getencoding;
 extern pthread_key_t getssl;
 extern CS_MUTEX_LOCK *lock_cs;
 extern char noncekey[33];
@@ -114,6 +121,21 @@ time_t parse_modifiedsince(char *value)
 	return modifiedheader;
 }
 
+/* Returns the content encoding we can use for the client, gzip is preferred over deflate. */
+int8_t parse_acceptencoding(char *value)
+{
+	int8_t encoding = HTTP_ENCODING_NONE;
+	char *ptr, *q, *saveptr1 = NULL;
+	for(ptr = strtok_r(value + 16, ",", &saveptr1); ptr; ptr = strtok_r(NULL, ",", &saveptr1))
+	{
+		while(ptr[0] == ' ') { ++ptr; }
+		if((q = strstr(ptr, "q=")) != NULL && strtod(q + 2, NULL) <= 0) { continue; }
+		if(strncasecmp(ptr, "gzip", 4) == 0) { encoding = HTTP_ENCODING_GZIP; }
+		else if(strncasecmp(ptr, "deflate", 7) == 0 && encoding == HTTP_ENCODING_NONE) { encoding = HTTP_ENCODING_DEFLATE; }
+	}
+	return encoding;
+}
+
 /* Calculates a new opaque value. Please note that opaque needs to be at least (MD5_DIGEST_LENGTH * 2) + 1 large. */
 void calculate_opaque(IN_ADDR_T addr, char *opaque)
 {
@@ -332,7 +354,23 @@ int32_t webif_read(char *buf, int32_t num, FILE *f)
 		return read(fileno(f), buf, num);
 }
 
-void send_headers(FILE *f, int32_t status, char *title, char *extra, char *mime, int32_t cache, int32_t length, char *content, int8_t forcePlain)
+/* Encoded responses get their own ETag, "<crc>" stays the plain one. */
+static const char *webif_etag_suffix(int8_t encoding)
+{
+	if(encoding == HTTP_ENCODING_GZIP) { return "-gzip"; }
+	if(encoding == HTTP_ENCODING_DEFLATE) { return "-deflate"; }
+	return "";
+}
+
+/* Returns the encoding an If-None-Match ETag was sent for, str points behind the crc. */
+int8_t webif_etag_encoding(const char *str)
+{
+	if(!strncmp(str, "-gzip\"", 6)) { return HTTP_ENCODING_GZIP; }
+	if(!strncmp(str, "-deflate\"", 9)) { return HTTP_ENCODING_DEFLATE; }
+	return HTTP_ENCODING_NONE;
+}
+
+static void webif_send_headers(FILE *f, int32_t status, char *title, char *extra, char *mime, int32_t cache, int32_t length, char *content, int32_t contentlen, int8_t encoding, int8_t forcePlain)
 {
 	time_t now;
 	char timebuf[32];
@@ -369,10 +407,17 @@ void send_headers(FILE *f, int32_t status, char *title, char *extra, char *mime,
 		pos += snprintf(pos, sizeof(buf) - (pos - buf), "Last-Modified: %s\r\n", timebuf);
 		if(content)
 		{
-			uint32_t checksum = (uint32_t)crc32(0L, (uchar *)content, length);
-			pos += snprintf(pos, sizeof(buf) - (pos - buf), "ETag: \"%u\"\r\n", checksum == 0 ? 1 : checksum);
+			uint32_t checksum = (uint32_t)crc32(0L, (uchar *)content, contentlen);
+			pos += snprintf(pos, sizeof(buf) - (pos - buf), "ETag: \"%u%s\"\r\n", checksum == 0 ? 1 : checksum, webif_etag_suffix(encoding));
 		}
 	}
+	if(encoding != HTTP_ENCODING_NONE)
+		{ pos += snprintf(pos, sizeof(buf) - (pos - buf), "Content-Encoding: %s\r\n", encoding == HTTP_ENCODING_GZIP ? "gzip" : "deflate"); }
+#ifdef WITH_ZLIB
+	// the plain variant depends on Accept-Encoding as well
+	if(encoding != HTTP_ENCODING_NONE || cfg.http_compress)
+		{ pos += snprintf(pos, sizeof(buf) - (pos - buf), "Vary: Accept-Encoding\r\n"); }
+#endif
 	if(*(int8_t *)pthread_getspecific(getkeepalive))
 		{ pos += snprintf(pos, sizeof(buf) - (pos - buf), "Connection: Keep-Alive\r\n"); }
 	else
@@ -382,6 +427,111 @@ void send_headers(FILE *f, int32_t status, char *title, char *extra, char *mime,
 	else { webif_write(buf, f); }
 }
 
+void send_headers(FILE *f, int32_t status, char *title, char *extra, char *mime, int32_t cache, int32_t length, char *content, int8_t forcePlain)
+{
+	webif_send_headers(f, status, title, extra, mime, cache, length, content, length, HTTP_ENCODING_NONE, forcePlain);
+}
+
+/* Sends the headers for a 200 response whose body of length bytes has been compressed with encoding.
+   The ETag is calculated from the uncompressed content if given and marked with the encoding. */
+void send_headers_encoded(FILE *f, char *extra, char *mime, int32_t cache, int32_t length, char *content, int32_t contentlen, int8_t encoding)
+{
+	webif_send_headers(f, 200, "OK", extra, mime, cache, length, content, contentlen, encoding, 0);
+}
+
+#ifdef WITH_ZLIB
+/* Returns the encoding for a response of length bytes. */
+int8_t webif_encoding(int32_t length)
+{
+	int8_t *encoding = (int8_t *)pthread_getspecific(getencoding);
+	if(!cfg.http_compress || !encoding || length < cfg.http_compress_min)
+		{ return HTTP_ENCODING_NONE; }
+	return *encoding;
+}
+
+/* Compresses the cnt buffers in data into one gzip or deflate stream. Returns the length
+   of the newly allocated result or -1 on error. */
+int32_t webif_compress(int8_t encoding, int32_t level, const char **data, const uint32_t *len, uint32_t cnt, char **result)
+{
+	z_stream zs;
+	uint32_t i, total = 0, alloc;
+	int32_t ret, flush;
+	char *out;
+
+	for(i = 0; i < cnt; i++)
+		{ total += len[i]; }
+	if(level < 1 || level > 9)
+		{ level = Z_DEFAULT_COMPRESSION; }
+	memset(&zs, 0, sizeof(zs));
+	if(deflateInit2(&zs, level, Z_DEFLATED, encoding == HTTP_ENCODING_GZIP ? MAX_WBITS + 16 : MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{ return -1; }
+	alloc = deflateBound(&zs, total);
+	if(!cs_malloc(&out, alloc))
+	{
+		deflateEnd(&zs);
+		return -1;
+	}
+	zs.next_out = (Bytef *)out;
+	zs.avail_out = alloc;
+
+	for(i = 0; i <= cnt; i++)
+	{
+		flush = i == cnt ? Z_FINISH : Z_NO_FLUSH;
+		if(i < cnt)
+		{
+			zs.next_in = (Bytef *)data[i];
+			zs.avail_in = len[i];
+		}
+		while(1)
+		{
+			if(!zs.avail_out)
+			{
+				if(!cs_realloc(&out, alloc * 2))
+				{
+					deflateEnd(&zs);
+					return -1;
+				}
+				zs.next_out = (Bytef *)out + alloc;
+				zs.avail_out = alloc;
+				alloc *= 2;
+			}
+			ret = deflate(&zs, flush);
+			if(ret == Z_STREAM_ERROR)
+			{
+				deflateEnd(&zs);
+				NULLFREE(out);
+				return -1;
+			}
+			if(flush == Z_FINISH ? ret == Z_STREAM_END : !zs.avail_in)
+				{ break; }
+		}
+	}
+	ret = zs.total_out;
+	deflateEnd(&zs);
+	*result = out;
+	return ret;
+}
+#endif
+
+/* Sends a complete 200 response. The content is compressed if the client accepts it and it is big enough. */
+void send_content(FILE *f, char *extra, char *mime, int32_t cache, char *content, int32_t length, int8_t etag)
+{
+#ifdef WITH_ZLIB
+	int8_t encoding = webif_encoding(length);
+	char *out;
+	int32_t outlen;
+	if(encoding != HTTP_ENCODING_NONE && (outlen = webif_compress(encoding, cfg.http_compress_level, (const char **)&content, (uint32_t *)&length, 1, &out)) > 0)
+	{
+		send_headers_encoded(f, extra, mime, cache, outlen, etag ? content : NULL, length, encoding);
+		webif_write_raw(out, f, outlen);
+		NULLFREE(out);
+		return;
+	}
+#endif
+	send_headers(f, 200, "OK", extra, mime, cache, length, etag ? content : NULL, 0);
+	webif_write_raw(content, f, length);
+}
+
 void send_error(FILE *f, int32_t status, char *title, char *extra, char *text, int8_t forcePlain)
 {
 	char buf[(2 * strlen(title)) + strlen(text) + 128];
@@ -408,7 +558,7 @@ void send_header304(FILE *f, char *extraheader)
 /*
  * function for sending files.
  */
-void send_file(FILE *f, char *filename, char *subdir, time_t modifiedheader, uint32_t etagheader, char *extraheader)
+void send_file(FILE *f, char *filename, char *subdir, time_t modifiedheader, uint32_t etagheader, int8_t etagencoding, char *extraheader)
 {
 	int8_t filen = 0;
 	int32_t size = 0;
@@ -527,14 +677,35 @@ void send_file(FILE *f, char *filename, char *subdir, time_t modifiedheader, uin
 
 	size = strlen(result);
 
-	if((etagheader == 0 && moddate < modifiedheader) || (etagheader > 0 && (uint32_t)crc32(0L, (uchar *)result, size) == etagheader))
+	int8_t encoding = HTTP_ENCODING_NONE;
+#ifdef WITH_ZLIB
+	encoding = webif_encoding(size);
+#endif
+	// the ETag only matches the variant the client would get now
+	if((etagheader == 0 && moddate < modifiedheader) || (etagheader > 0 && etagencoding == encoding && (uint32_t)crc32(0L, (uchar *)result, size) == etagheader))
 	{
 		send_header304(f, extraheader);
 	}
 	else
 	{
-		send_headers(f, 200, "OK", NULL, mimetype, 1, size, result, 0);
-		webif_write(result, f);
+#ifdef WITH_ZLIB
+		// built-in files have been compressed at startup
+		int32_t gzlen = 0;
+		const char *gz = NULL, *tplname = NULL;
+		if(result == CSS) { tplname = "CSS"; }
+		else if(result == JSCRIPT) { tplname = "JSCRIPT"; }
+		else if(result == JQUERY) { tplname = "JQUERY"; }
+		else if(result == TOUCH_CSS) { tplname = "TOUCH_CSS"; }
+		else if(result == TOUCH_JSCRIPT) { tplname = "TOUCH_JSCRIPT"; }
+		if(tplname && encoding == HTTP_ENCODING_GZIP) { gz = tpl_getCompressedTpl(tplname, &gzlen); }
+		if(gz)
+		{
+			send_headers_encoded(f, NULL, mimetype, 1, gzlen, result, size, HTTP_ENCODING_GZIP);
+			webif_write_raw((char *)gz, f, gzlen);
+		}
+		else
+#endif
+			{ send_content(f, NULL, mimetype, 1, result, size, 1); }
 	}
 	if(allocated) { NULLFREE(allocated); }
 	NULLFREE(CSS);
@@ -27,6 +27,10 @@
 #define MAXGETPARAMS 100
 /* The refresh delay (in seconds) when stopping OSCam via http. */
 #define SHUTDOWNREFRESH 30
+/* Content encodings that can be negotiated with Accept-Encoding. */
+#define HTTP_ENCODING_NONE 0
+#define HTTP_ENCODING_GZIP 1
+#define HTTP_ENCODING_DEFLATE 2
 
 #define TOUCH_SUBDIR "touch/"
 
@@ -38,6 +42,13 @@ struct s_connection
 #ifdef WITH_SSL
 	SSL *ssl;
 #endif
+	FILE *f;                        // set after the first request, SSL * in ssl mode
+	int8_t keepalive;
+	int8_t encoding;                // Accept-Encoding of the current request
+	int8_t idle;                    // in the idle list of http_server()
+	time_t idle_since;
+	struct s_connection *next;      // work queue or idle list
+	struct s_connection *prev;
 };
 
 struct uriparams
@@ -86,6 +97,7 @@ struct pstat {
 };
 
 extern time_t parse_modifiedsince(char *value);
+extern int8_t parse_acceptencoding(char *value);
 extern void calculate_opaque(IN_ADDR_T addr, char *opaque);
 extern void init_noncelocks(void);
 extern void calculate_nonce(char *nonce, char *result, char *opaque);
@@ -94,10 +106,17 @@ extern int32_t webif_write_raw(char *buf, FILE *f, int32_t len);
 extern int32_t webif_write(char *buf, FILE *f);
 extern int32_t webif_read(char *buf, int32_t num, FILE *f);
 extern void send_headers(FILE *f, int32_t status, char *title, char *extra, char *mime, int32_t cache, int32_t length, char *content, int8_t forcePlain);
+extern void send_headers_encoded(FILE *f, char *extra, char *mime, int32_t cache, int32_t length, char *content, int32_t contentlen, int8_t encoding);
+extern int8_t webif_etag_encoding(const char *str);
+extern void send_content(FILE *f, char *extra, char *mime, int32_t cache, char *content, int32_t length, int8_t etag);
+#ifdef WITH_ZLIB
+extern int8_t webif_encoding(int32_t length);
+extern int32_t webif_compress(int8_t encoding, int32_t level, const char **data, const uint32_t *len, uint32_t cnt, char **result);
+#endif
 extern void send_error(FILE *f, int32_t status, char *title, char *extra, char *text, int8_t forcePlain);
 extern void send_error500(FILE *f);
 extern void send_header304(FILE *f, char *extraheader);
-extern void send_file(FILE *f, char *filename, char *subdir, time_t modifiedheader, uint32_t etagheader, char *extraheader);
+extern void send_file(FILE *f, char *filename, char *subdir, time_t modifiedheader, uint32_t etagheader, int8_t etagencoding, char *extraheader);
 extern void urldecode(char *s);
 extern void parseParams(struct uriparams *params, char *pch);
 extern char *getParam(struct uriparams *params, char *name);
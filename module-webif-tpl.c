@@ -4,6 +4,7 @@
 
 #ifdef WEBIF
 #include "webif/pages.h"
+#include "module-webif-lib.h"
 #include "module-webif-tpl.h"
 #include "oscam-files.h"
 #include "oscam-string.h"
@@ -17,6 +18,31 @@ extern uint8_t cs_http_use_utf8;
    struct tpl tpls[] because we need to add additional fields such as tpl_name_hash
    and possibly preprocess templates[] struct before using it. */
 
+/* Templates are compiled once into a list of parts, so rendering doesn't need to search
+   the text for ##VAR## and ##TPL...## markers again. */
+#define TPL_PART_TEXT 0
+#define TPL_PART_VAR  1
+#define TPL_PART_TPL  2
+
+struct tpl_part
+{
+	const char *data; // the text or the name of the variable/template
+	uint32_t len;
+	uint32_t hash;
+	uint8_t type;
+	uint8_t message; // ##TPLMESSAGE...## is only shown if there are messages
+};
+
+struct tpl_compiled
+{
+	char *text;
+	char *names;
+	struct tpl_part *parts;
+	uint32_t partcnt;
+	int32_t refs; // only used for disk templates which may get replaced while in use
+	int8_t disk;
+};
+
 struct tpl
 {
 	uint32_t tpl_name_hash;
@@ -26,11 +52,176 @@ struct tpl
 	char *extra_data;
 	uint32_t tpl_data_len;
 	uint8_t tpl_type;
+	struct tpl_compiled *compiled;
+#ifdef WITH_ZLIB
+	char *gz_data;
+	int32_t gz_len;
+#endif
 };
 
 static struct tpl *tpls;
 static char *tpls_data;
 static int tpls_count;
+static int32_t *tpls_index;
+static uint32_t tpls_index_size;
+
+/* Compiled disk templates by path. They are recompiled when the file changes. */
+#define TPL_DISK_BUCKETS 64
+
+struct tpl_disk
+{
+	char *path;
+	time_t mtime;
+	off_t size;
+	struct tpl_compiled *tpl;
+	struct tpl_disk *next;
+};
+
+static struct tpl_disk *tpl_disk_cache[TPL_DISK_BUCKETS];
+static pthread_mutex_t tpl_disk_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int8_t tpl_compile_add(struct tpl_compiled *tpl, uint32_t *alloc, uint8_t type, const char *data, uint32_t len)
+{
+	struct tpl_part *part;
+	if(!len && type == TPL_PART_TEXT) { return 1; }
+	if(*alloc <= tpl->partcnt)
+	{
+		if(!cs_realloc(&tpl->parts, *alloc * 2 * sizeof(struct tpl_part))) { return 0; }
+		*alloc *= 2;
+	}
+	part = &tpl->parts[tpl->partcnt++];
+	part->data = data;
+	part->len = len;
+	part->type = type;
+	part->hash = type == TPL_PART_TEXT ? 0 : jhash(data, len);
+	part->message = type == TPL_PART_TPL && strncmp(data, "MESSAGE", 7) == 0;
+	return 1;
+}
+
+static void tpl_free_compiled(struct tpl_compiled *tpl)
+{
+	if(!tpl) { return; }
+	NULLFREE(tpl->text);
+	NULLFREE(tpl->names);
+	NULLFREE(tpl->parts);
+	NULLFREE(tpl);
+}
+
+/* Splits a template into text parts and references to variables or other templates.
+   The text parts point into text, so it must live as long as the result. */
+static struct tpl_compiled *tpl_compile(const char *text, uint32_t len)
+{
+	struct tpl_compiled *tpl;
+	const char *pos = text, *end = text + len, *literal = text, *pch;
+	char *names;
+	uint32_t alloc = 16, namelen;
+
+	if(!cs_malloc(&tpl, sizeof(struct tpl_compiled))) { return NULL; }
+	if(!cs_malloc(&tpl->parts, alloc * sizeof(struct tpl_part)) || !cs_malloc(&tpl->names, len + 1))
+	{
+		tpl_free_compiled(tpl);
+		return NULL;
+	}
+	names = tpl->names;
+
+	while(pos < end && (pos = memchr(pos, '#', end - pos)) != NULL)
+	{
+		if(pos + 1 < end && pos[1] == '#' && (pos + 2 == end || pos[2] != '#'))
+		{
+			pch = pos + 2;
+			while(pch + 1 < end && (pch[0] != '#' || pch[1] != '#')) { ++pch; }
+			if(pch - pos < 32 && pch + 1 < end)
+			{
+				namelen = pch - pos - 2;
+				memcpy(names, pos + 2, namelen);
+				names[namelen] = '\0';
+				if(!tpl_compile_add(tpl, &alloc, TPL_PART_TEXT, literal, pos - literal)
+						|| (strncmp(names, "TPL", 3) == 0 && !tpl_compile_add(tpl, &alloc, TPL_PART_TPL, names + 3, namelen - 3))
+						|| (strncmp(names, "TPL", 3) != 0 && !tpl_compile_add(tpl, &alloc, TPL_PART_VAR, names, namelen)))
+				{
+					tpl_free_compiled(tpl);
+					return NULL;
+				}
+				names += namelen + 1;
+				pos = literal = pch + 2;
+				continue;
+			}
+		}
+		++pos;
+	}
+	if(!tpl_compile_add(tpl, &alloc, TPL_PART_TEXT, literal, end - literal))
+	{
+		tpl_free_compiled(tpl);
+		return NULL;
+	}
+	return tpl;
+}
+
+static void tpl_release(struct tpl_compiled *tpl)
+{
+	if(tpl && tpl->disk && __sync_sub_and_fetch(&tpl->refs, 1) == 0)
+		{ tpl_free_compiled(tpl); }
+}
+
+static int32_t tpl_find(const char *name, uint32_t hash)
+{
+	uint32_t i, n;
+	int32_t idx;
+	if(!tpls_index_size) { return -1; }
+	for(n = 0, i = hash & (tpls_index_size - 1); n < tpls_index_size; n++, i = (i + 1) & (tpls_index_size - 1))
+	{
+		if((idx = tpls_index[i]) < 0)
+			{ break; }
+		if(tpls[idx].tpl_name_hash == hash && strcmp(tpls[idx].tpl_name, name) == 0)
+			{ return idx; }
+	}
+	return -1;
+}
+
+#ifdef WITH_ZLIB
+/* Static files that are sent with send_file(). Their gzip form is built once at startup. */
+static const char *tpl_static_files[] = { "CSS", "JSCRIPT", "JQUERY", "TOUCH_CSS", "TOUCH_JSCRIPT", NULL };
+
+static void tpl_init_compressed(void)
+{
+	int32_t i, idx;
+	uint32_t len;
+	const char *data;
+	if(!cfg.http_compress) { return; }
+	for(i = 0; tpl_static_files[i]; i++)
+	{
+		if((idx = tpl_find(tpl_static_files[i], jhash(tpl_static_files[i], strlen(tpl_static_files[i])))) < 0)
+			{ continue; }
+		data = tpls[idx].tpl_data;
+		len = tpls[idx].tpl_data_len;
+		tpls[idx].gz_len = webif_compress(HTTP_ENCODING_GZIP, 9, &data, &len, 1, &tpls[idx].gz_data);
+		if(tpls[idx].gz_len <= 0)
+		{
+			tpls[idx].gz_len = 0;
+			tpls[idx].gz_data = NULL;
+		}
+	}
+}
+#endif
+
+static void tpl_init_compiled(void)
+{
+	int32_t i;
+	uint32_t j;
+	for(tpls_index_size = 64; tpls_index_size < (uint32_t)tpls_count * 2; tpls_index_size *= 2) { ; }
+	if(!cs_malloc(&tpls_index, tpls_index_size * sizeof(int32_t)))
+	{
+		tpls_index_size = 0;
+		return;
+	}
+	memset(tpls_index, -1, tpls_index_size * sizeof(int32_t));
+	for(i = 0; i < tpls_count; i++)
+	{
+		tpls[i].compiled = tpl_compile(tpls[i].tpl_data, tpls[i].tpl_data_len);
+		for(j = tpls[i].tpl_name_hash & (tpls_index_size - 1); tpls_index[j] >= 0; j = (j + 1) & (tpls_index_size - 1)) { ; }
+		tpls_index[j] = i;
+	}
+}
 
 static void tpl_init_base64(struct tpl *tpl)
 {
@@ -106,6 +297,10 @@ void webif_tpls_prepare(void)
 		tpls[i].tpl_type      = templates[i].tpl_type;
 		tpl_init_base64(&tpls[i]);
 	}
+#endif
+	tpl_init_compiled();
+#ifdef WITH_ZLIB
+	tpl_init_compressed();
 #endif
 }
 
@@ -116,63 +311,135 @@ void webif_tpls_free(void)
 	tmp = tpls_count;
 	tpls_count = 0;
 	
+	tpls_index_size = 0;
+	NULLFREE(tpls_index);
 	for(i = 0; i < tmp; ++i)
 	{
 		NULLFREE(tpls[i].extra_data);
+		tpl_free_compiled(tpls[i].compiled);
+#ifdef WITH_ZLIB
+		NULLFREE(tpls[i].gz_data);
+#endif
 	}
 	NULLFREE(tpls_data);
 	NULLFREE(tpls);
+
+	SAFE_MUTEX_LOCK(&tpl_disk_lock);
+	for(i = 0; i < TPL_DISK_BUCKETS; i++)
+	{
+		struct tpl_disk *disk, *next;
+		for(disk = tpl_disk_cache[i]; disk; disk = next)
+		{
+			next = disk->next;
+			tpl_release(disk->tpl);
+			NULLFREE(disk->path);
+			NULLFREE(disk);
+		}
+		tpl_disk_cache[i] = NULL;
+	}
+	SAFE_MUTEX_UNLOCK(&tpl_disk_lock);
 }
 
-/* Adds a name->value-mapping or appends to it. You will get a reference back which you may freely
-   use (but you should not call free/realloc on this!)*/
-void tpl_addVar(struct templatevars *vars, uint8_t addmode, const char *name, const char *value)
+/* Template output as a list of pointers into template texts and variable values. Pages are
+   only copied into one buffer when a caller needs the string. */
+struct tpl_seg
+{
+	const char *data;
+	uint32_t len;
+};
+
+struct tpl_out
+{
+	struct tpl_seg *seg;
+	uint32_t segcnt;
+	uint32_t segalloc;
+	struct tpl_compiled **held;
+	uint32_t heldcnt;
+	uint32_t heldalloc;
+	uint32_t len;
+};
+
+/* Size of the buffer used to merge small segments before they are written to the client. */
+#define TPL_WRITEBUF 8192
+
+static int32_t tpl_findVar(struct templatevars *vars, const char *name, uint32_t hash)
 {
-	if(name == NULL) { return; }
-	if(value == NULL) { value = ""; }
 	int32_t i;
-	char *tmp = NULL, *result = NULL;
-	for(i = (*vars).varscnt - 1; i >= 0; --i)
+	for(i = vars->hash[hash & (TPL_HASH_SIZE - 1)]; i >= 0; i = vars->vars[i].next)
 	{
-		if(strcmp((*vars).names[i], name) == 0)
-		{
-			result = (*vars).values[i];
-			break;
-		}
+		if(vars->vars[i].hash == hash && strcmp(vars->vars[i].name, name) == 0)
+			{ return i; }
 	}
-	if(result == NULL)
+	return -1;
+}
+
+/* Makes sure the value of a variable can hold size bytes. Grows geometrically so appending rows
+   to a variable doesn't copy the whole value every time. */
+static int8_t tpl_reserveVar(struct templatevar *var, uint32_t size)
+{
+	uint32_t alloc;
+	if(size <= var->alloc) { return 1; }
+	alloc = var->alloc < 32 ? 32 : var->alloc;
+	while(alloc < size) { alloc *= 2; }
+	if(!cs_realloc(&var->value, alloc))
 	{
-		if((*vars).varsalloc <= (*vars).varscnt)
-		{
-			if(!cs_realloc(&(*vars).names, (*vars).varsalloc * 2 * sizeof(char **))) { return; }
-			if(!cs_realloc(&(*vars).values, (*vars).varsalloc * 2 * sizeof(char **))) { return; }
-			if(!cs_realloc(&(*vars).vartypes, (*vars).varsalloc * 2 * sizeof(uint8_t *))) { return; }
-			(*vars).varsalloc = (*vars).varscnt * 2;
-		}
-		int32_t len = strlen(name) + 1;
-		if(!cs_malloc(&tmp, len)) { return; }
-		memcpy(tmp, name, len);
-		(*vars).names[(*vars).varscnt] = tmp;
-		len = strlen(value) + 1;
-		if(!cs_malloc(&tmp, len))
+		var->len = 0;
+		var->alloc = 0;
+		return 0;
+	}
+	var->alloc = alloc;
+	return 1;
+}
+
+/* Returns the variable with the given name. It gets created if it doesn't exist yet. */
+static struct templatevar *tpl_getVarRef(struct templatevars *vars, const char *name)
+{
+	uint32_t len = strlen(name), hash = jhash(name, len);
+	int32_t i = tpl_findVar(vars, name, hash);
+	struct templatevar *var;
+	if(i >= 0) { return &vars->vars[i]; }
+	if(vars->varsalloc <= vars->varscnt)
+	{
+		if(!cs_realloc(&vars->vars, vars->varsalloc * 2 * sizeof(struct templatevar)))
 		{
-			NULLFREE((*vars).names[(*vars).varscnt]);
-			return;
+			vars->varscnt = 0;
+			vars->varsalloc = 0;
+			memset(vars->hash, -1, sizeof(vars->hash));
+			return NULL;
 		}
-		memcpy(tmp, value, len);
-		(*vars).values[(*vars).varscnt] = tmp;
-		(*vars).vartypes[(*vars).varscnt] = addmode;
-		(*vars).varscnt++;
+		vars->varsalloc *= 2;
 	}
-	else
+	var = &vars->vars[vars->varscnt];
+	memset(var, 0, sizeof(struct templatevar));
+	if(!cs_malloc(&var->name, len + 1)) { return NULL; }
+	memcpy(var->name, name, len + 1);
+	if(!tpl_reserveVar(var, 1))
 	{
-		int32_t oldlen = 0, newlen = strlen(value);
-		if(addmode == TPLAPPEND || addmode == TPLAPPENDONCE) { oldlen = strlen((*vars).values[i]); }
-		if(!cs_realloc(&((*vars).values[i]), oldlen + newlen + 1)) { return; }
-		memcpy((*vars).values[i] + oldlen, value, newlen + 1);
-		(*vars).vartypes[i] = addmode;
+		NULLFREE(var->name);
+		return NULL;
 	}
-	return;
+	var->hash = hash;
+	var->next = vars->hash[hash & (TPL_HASH_SIZE - 1)];
+	vars->hash[hash & (TPL_HASH_SIZE - 1)] = vars->varscnt;
+	vars->varscnt++;
+	return var;
+}
+
+/* Adds a name->value-mapping or appends to it. You will get a reference back which you may freely
+   use (but you should not call free/realloc on this!)*/
+void tpl_addVar(struct templatevars *vars, uint8_t addmode, const char *name, const char *value)
+{
+	struct templatevar *var;
+	uint32_t len, pos = 0;
+	if(name == NULL) { return; }
+	if(value == NULL) { value = ""; }
+	if(!(var = tpl_getVarRef(vars, name))) { return; }
+	len = strlen(value);
+	if(addmode == TPLAPPEND || addmode == TPLAPPENDONCE) { pos = var->len; }
+	if(!tpl_reserveVar(var, pos + len + 1)) { return; }
+	memmove(var->value + pos, value, len + 1);
+	var->len = pos + len;
+	var->type = addmode;
 }
 
 /* Adds a message to be output on the page using the TPLMESSAGE template. */
@@ -205,62 +472,63 @@ static char *tpl_addTmp(struct templatevars *vars, char *value)
    free/realloc on this as it will be automatically cleaned!)*/
 void tpl_printf(struct templatevars *vars, uint8_t addmode, const char *varname, const char *fmtstring, ...)
 {
-	uint32_t needed;
+	uint32_t needed, pos = 0;
 	char test[1];
 	va_list argptr;
+	struct templatevar *var;
 
 	va_start(argptr, fmtstring);
 	needed = vsnprintf(test, 1, fmtstring, argptr);
 	va_end(argptr);
 
-	char *result;
-	if(!cs_malloc(&result, needed + 1)) { return; }
+	if(varname == NULL)
+	{
+		char *result;
+		if(!cs_malloc(&result, needed + 1)) { return; }
+		va_start(argptr, fmtstring);
+		vsnprintf(result, needed + 1, fmtstring, argptr);
+		va_end(argptr);
+		tpl_addTmp(vars, result);
+		return;
+	}
+
+	// print directly into the value of the variable
+	if(!(var = tpl_getVarRef(vars, varname))) { return; }
+	if(addmode == TPLAPPEND || addmode == TPLAPPENDONCE) { pos = var->len; }
+	if(!tpl_reserveVar(var, pos + needed + 1)) { return; }
 	va_start(argptr, fmtstring);
-	vsnprintf(result, needed + 1, fmtstring, argptr);
+	vsnprintf(var->value + pos, needed + 1, fmtstring, argptr);
 	va_end(argptr);
+	var->len = pos + needed;
+	var->type = addmode;
+}
 
-	if(varname == NULL) { tpl_addTmp(vars, result); }
-	else
+static char *tpl_fetchVar(struct templatevars *vars, const char *name, uint32_t hash, uint32_t *len)
+{
+	int32_t i = tpl_findVar(vars, name, hash);
+	struct templatevar *var;
+	char *result;
+	*len = 0;
+	if(i < 0 || !vars->vars[i].value) { return ""; }
+	var = &vars->vars[i];
+	*len = var->len;
+	if(var->type == TPLADDONCE || var->type == TPLAPPENDONCE)
 	{
-		tpl_addVar(vars, addmode, varname, result);
-		free(result);
+		// This is a one-time-use variable which gets cleaned up automatically after retrieving it
+		result = var->value;
+		var->value = NULL;
+		var->len = 0;
+		var->alloc = 0;
+		return tpl_addTmp(vars, result);
 	}
-	return;
+	return var->value;
 }
 
 /* Returns the value for a name or an empty string if nothing was found. */
 char *tpl_getVar(struct templatevars *vars, const char *name)
 {
-	int32_t i;
-	char *result = NULL;
-	for(i = (*vars).varscnt - 1; i >= 0; --i)
-	{
-		if(strcmp((*vars).names[i], name) == 0)
-		{
-			result = (*vars).values[i];
-			break;
-		}
-	}
-	if(result == NULL) { return ""; }
-	else
-	{
-		if((*vars).vartypes[i] == TPLADDONCE || (*vars).vartypes[i] == TPLAPPENDONCE)
-		{
-			// This is a one-time-use variable which gets cleaned up automatically after retrieving it
-			if(!cs_malloc(&(*vars).values[i], 1))
-			{
-				(*vars).values[i] = result;
-				result[0] = '\0';
-				return result;
-			}
-			else
-			{
-				(*vars).values[i][0] = '\0';
-				return tpl_addTmp(vars, result);
-			}
-		}
-		else { return result; }
-	}
+	uint32_t len;
+	return tpl_fetchVar(vars, name, jhash(name, strlen(name)), &len);
 }
 
 /* Initializes all variables for a templatevar-structure and returns a pointer to it. Make
@@ -273,52 +541,53 @@ struct templatevars *tpl_create(void)
 	(*vars).varscnt = 0;
 	(*vars).tmpalloc = 64;
 	(*vars).tmpcnt = 0;
-	if(!cs_malloc(&(*vars).names, (*vars).varsalloc * sizeof(char **)))
+	memset((*vars).hash, -1, sizeof((*vars).hash));
+	if(!cs_malloc(&(*vars).vars, (*vars).varsalloc * sizeof(struct templatevar)))
 	{
 		NULLFREE(vars);
 		return NULL;
 	}
-	if(!cs_malloc(&(*vars).values, (*vars).varsalloc * sizeof(char **)))
-	{
-		NULLFREE((*vars).names);
-		NULLFREE(vars);
-		return NULL;
-	}
-	if(!cs_malloc(&(*vars).vartypes, (*vars).varsalloc * sizeof(uint8_t *)))
-	{
-		NULLFREE((*vars).names);
-		NULLFREE((*vars).values);
-		NULLFREE(vars);
-		return NULL;
-	}
 	if(!cs_malloc(&(*vars).tmp, (*vars).tmpalloc * sizeof(char **)))
 	{
-		NULLFREE((*vars).names);
-		NULLFREE((*vars).values);
-		NULLFREE((*vars).vartypes);
+		NULLFREE((*vars).vars);
 		NULLFREE(vars);
 		return NULL;
 	}
 	return vars;
 }
 
+static void tpl_out_free(struct tpl_out *out)
+{
+	uint32_t i;
+	for(i = 0; i < out->heldcnt; i++)
+	{
+		tpl_release(out->held[i]);
+	}
+	NULLFREE(out->held);
+	NULLFREE(out->seg);
+	memset(out, 0, sizeof(struct tpl_out));
+}
+
 /* Clears all allocated memory for the specified templatevar-structure. */
 void tpl_clear(struct templatevars *vars)
 {
 	int32_t i;
 	for(i = (*vars).varscnt - 1; i >= 0; --i)
 	{
-		NULLFREE((*vars).names[i]);
-		NULLFREE((*vars).values[i]);
+		NULLFREE((*vars).vars[i].name);
+		NULLFREE((*vars).vars[i].value);
 	}
-	NULLFREE((*vars).names);
-	NULLFREE((*vars).values);
-	NULLFREE((*vars).vartypes);
+	NULLFREE((*vars).vars);
 	for(i = (*vars).tmpcnt - 1; i >= 0; --i)
 	{
 		NULLFREE((*vars).tmp[i]);
 	}
 	NULLFREE((*vars).tmp);
+	if((*vars).out)
+	{
+		tpl_out_free((*vars).out);
+		NULLFREE((*vars).out);
+	}
 	NULLFREE(vars);
 }
 
@@ -488,16 +757,8 @@ char *tpl_getUnparsedTpl(const char *name, int8_t removeHeader, const char *subd
 		} // if
 	} // if
 
-	bool found = 0;
-	uint32_t name_hash = jhash(name, strlen(name));
-	for(i = 0; i < tpls_count; i++)
-	{
-		if(tpls[i].tpl_name_hash == name_hash)
-		{
-			found = 1;
-			break;
-		}
-	}
+	i = tpl_find(name, jhash(name, strlen(name)));
+	bool found = i >= 0;
 
 	if(found)
 	{
@@ -512,71 +773,287 @@ char *tpl_getUnparsedTpl(const char *name, int8_t removeHeader, const char *subd
 	return result;
 }
 
+static void tpl_out_add(struct tpl_out *out, const char *data, uint32_t len)
+{
+	if(!len) { return; }
+	if(out->segcnt && out->seg[out->segcnt - 1].data + out->seg[out->segcnt - 1].len == data)
+	{
+		out->seg[out->segcnt - 1].len += len;
+		out->len += len;
+		return;
+	}
+	if(out->segalloc <= out->segcnt)
+	{
+		uint32_t alloc = out->segalloc ? out->segalloc * 2 : 64;
+		if(!cs_realloc(&out->seg, alloc * sizeof(struct tpl_seg)))
+		{
+			out->segcnt = out->segalloc = out->len = 0;
+			return;
+		}
+		out->segalloc = alloc;
+	}
+	out->seg[out->segcnt].data = data;
+	out->seg[out->segcnt].len = len;
+	out->segcnt++;
+	out->len += len;
+}
+
+/* Looks for a disk template. Returns 1 and the path if there is one. */
+static int8_t tpl_getDiskPath(const char *name, const char *subdir, char *path, uint32_t pathsize)
+{
+	char *tpl_path = (cfg.http_piconpath && strlen(name) > 3 && name[0] == 'I' && name[1] == 'C' && name[2] == '_') ? cfg.http_piconpath : cfg.http_tpl;
+
+	return tpl_path && ((strlen(tpl_getFilePathInSubdir(tpl_path, subdir, name, ".tpl", path, pathsize)) > 0 && file_exists(path))
+			|| (strlen(subdir) > 0
+#ifdef TOUCH
+				&& strcmp(subdir, TOUCH_SUBDIR)
+#endif
+				&& strlen(tpl_getFilePathInSubdir(tpl_path, ""    , name, ".tpl", path, pathsize)) > 0 && file_exists(path)));
+}
+
+/* Returns the compiled disk template, it gets (re)compiled if the file is new or has changed.
+   The caller must tpl_release() the result. */
+static struct tpl_compiled *tpl_getDiskTpl(const char *name, const char *subdir, const char *path)
+{
+	struct tpl_disk *disk;
+	struct tpl_compiled *tpl = NULL, *old = NULL;
+	struct stat st;
+	uint32_t bucket = jhash(path, strlen(path)) % TPL_DISK_BUCKETS;
+	char *text;
+
+	if(stat(path, &st) != 0) { return NULL; }
+
+	SAFE_MUTEX_LOCK(&tpl_disk_lock);
+	for(disk = tpl_disk_cache[bucket]; disk; disk = disk->next)
+	{
+		if(strcmp(disk->path, path) == 0)
+			{ break; }
+	}
+	if(disk && disk->tpl && disk->mtime == st.st_mtime && disk->size == st.st_size)
+	{
+		tpl = disk->tpl;
+		__sync_add_and_fetch(&tpl->refs, 1);
+	}
+	SAFE_MUTEX_UNLOCK(&tpl_disk_lock);
+	if(tpl) { return tpl; }
+
+	if(!(text = tpl_getUnparsedTpl(name, 1, subdir))) { return NULL; }
+	if(!(tpl = tpl_compile(text, strlen(text))))
+	{
+		NULLFREE(text);
+		return NULL;
+	}
+	tpl->text = text;
+	tpl->disk = 1;
+	tpl->refs = 2; // one for the cache, one for the caller
+
+	SAFE_MUTEX_LOCK(&tpl_disk_lock);
+	for(disk = tpl_disk_cache[bucket]; disk; disk = disk->next)
+	{
+		if(strcmp(disk->path, path) == 0)
+			{ break; }
+	}
+	if(!disk && cs_malloc(&disk, sizeof(struct tpl_disk)))
+	{
+		if((disk->path = cs_strdup(path)))
+		{
+			disk->next = tpl_disk_cache[bucket];
+			tpl_disk_cache[bucket] = disk;
+		}
+		else { NULLFREE(disk); }
+	}
+	if(disk)
+	{
+		old = disk->tpl;
+		disk->tpl = tpl;
+		disk->mtime = st.st_mtime;
+		disk->size = st.st_size;
+	}
+	else { tpl->refs = 1; }
+	SAFE_MUTEX_UNLOCK(&tpl_disk_lock);
+
+	tpl_release(old);
+	cs_log_dbg(D_TRACE, "WebIf: compiled disk template %s", path);
+	return tpl;
+}
+
+/* Disk templates in use are kept until the output doesn't point into them anymore. */
+static int8_t tpl_out_hold(struct tpl_out *out, struct tpl_compiled *tpl)
+{
+	if(out->heldalloc <= out->heldcnt)
+	{
+		uint32_t alloc = out->heldalloc ? out->heldalloc * 2 : 16;
+		if(!cs_realloc(&out->held, alloc * sizeof(struct tpl_compiled *)))
+		{
+			out->heldcnt = out->heldalloc = 0;
+			return 0;
+		}
+		out->heldalloc = alloc;
+	}
+	out->held[out->heldcnt++] = tpl;
+	return 1;
+}
+
+/* Replaces all variables/other templates in the specified template and adds the result to out. */
+static void tpl_render(struct templatevars *vars, const char *name, uint32_t hash, struct tpl_out *out)
+{
+	struct tpl_compiled *tpl = NULL;
+	struct tpl_part *part;
+	char path[255], *value;
+	uint32_t i, len;
+	int32_t idx;
+
+	if(tpl_getDiskPath(name, tpl_getVar(vars, "SUBDIR"), path, sizeof(path)))
+	{
+		if(!(tpl = tpl_getDiskTpl(name, tpl_getVar(vars, "SUBDIR"), path))) { return; }
+		if(!tpl_out_hold(out, tpl))
+		{
+			tpl_release(tpl);
+			return;
+		}
+	}
+	else if((idx = tpl_find(name, hash)) >= 0)
+		{ tpl = tpls[idx].compiled; }
+	if(!tpl) { return; }
+
+	for(i = 0; i < tpl->partcnt; i++)
+	{
+		part = &tpl->parts[i];
+		switch(part->type)
+		{
+		case TPL_PART_TEXT:
+			tpl_out_add(out, part->data, part->len);
+			break;
+		case TPL_PART_VAR:
+			value = tpl_fetchVar(vars, part->data, part->hash, &len);
+			tpl_out_add(out, value, len);
+			break;
+		case TPL_PART_TPL:
+			if((*vars).messages > 0 || !part->message)
+				{ tpl_render(vars, part->data, part->hash, out); }
+			break;
+		}
+	}
+}
+
 /* Returns the specified template with all variables/other templates replaced or an
    empty string if the template doesn't exist. Do not free the result yourself, it
    will get automatically cleaned up! */
 char *tpl_getTpl(struct templatevars *vars, const char *name)
 {
-	char *tplorg = tpl_getUnparsedTpl(name, 1, tpl_getVar(vars, "SUBDIR"));
-	if(!tplorg) { return ""; }
-	char *tplend = tplorg + strlen(tplorg);
-	char *pch, *pch2, *tpl = tplorg;
-	char varname[33];
+	struct tpl_out out;
+	char *result, *pos;
+	uint32_t i;
 
-	int32_t tmp, respos = 0;
-	int32_t allocated = 2 * strlen(tpl) + 1;
-	char *result;
-	if(!cs_malloc(&result, allocated)) { return ""; }
+	memset(&out, 0, sizeof(struct tpl_out));
+	tpl_render(vars, name, jhash(name, strlen(name)), &out);
+	if(!cs_malloc(&result, out.len + 1))
+	{
+		tpl_out_free(&out);
+		return "";
+	}
+	for(i = 0, pos = result; i < out.segcnt; i++)
+	{
+		memcpy(pos, out.seg[i].data, out.seg[i].len);
+		pos += out.seg[i].len;
+	}
+	*pos = '\0';
+	tpl_out_free(&out);
+	return tpl_addTmp(vars, result);
+}
+
+/* Use instead of tpl_getTpl() for the template that makes up the page returned by a request handler.
+   Nothing gets rendered here, process_request() calls tpl_renderDeferred() and tpl_writeDeferred()
+   so the page is written to the client straight from the variables and is never copied as a whole. */
+char *tpl_deferTpl(struct templatevars *vars, const char *name)
+{
+	char *page;
+	uint32_t len = strlen(name);
+	if((*vars).page || !cs_malloc(&page, len + 1)) { return tpl_getTpl(vars, name); }
+	memcpy(page, name, len + 1);
+	(*vars).page = tpl_addTmp(vars, page);
+	return (*vars).page;
+}
+
+/* Renders the deferred page and returns its length or -1 on error. */
+int32_t tpl_renderDeferred(struct templatevars *vars)
+{
+	if(!(*vars).page || (*vars).out || !cs_malloc(&(*vars).out, sizeof(struct tpl_out))) { return -1; }
+	tpl_render(vars, (*vars).page, jhash((*vars).page, strlen((*vars).page)), (*vars).out);
+	return (*vars).out->len;
+}
+
+/* Writes the page rendered by tpl_renderDeferred() to the client. Small segments are merged
+   so that we don't do a write (or create an SSL record) for every variable. */
+void tpl_writeDeferred(struct templatevars *vars, FILE *f)
+{
+	struct tpl_out *out = (*vars).out;
+	char *buf = NULL;
+	uint32_t i, pos = 0;
 
-	while(tpl < tplend)
+	if(!out) { return; }
+	if(!cs_malloc(&buf, TPL_WRITEBUF)) { buf = NULL; }
+	for(i = 0; i < out->segcnt; i++)
 	{
-		if(tpl[0] == '#' && tpl[1] == '#' && tpl[2] != '#')
+		struct tpl_seg *seg = &out->seg[i];
+		if(buf && seg->len < TPL_WRITEBUF)
 		{
-			pch2 = tpl;
-			pch = tpl + 2;
-			while(pch[0] != '\0' && (pch[0] != '#' || pch[1] != '#')) { ++pch; }
-			if(pch - pch2 < 32 && pch[0] == '#' && pch[1] == '#')
+			if(pos + seg->len > TPL_WRITEBUF)
 			{
-				memcpy(varname, pch2 + 2, pch - pch2 - 2);
-				varname[pch - pch2 - 2] = '\0';
-				if(strncmp(varname, "TPL", 3) == 0)
-				{
-					if((*vars).messages > 0 || strncmp(varname, "TPLMESSAGE", 10) != 0)
-						{ pch2 = tpl_getTpl(vars, varname + 3); }
-					else { pch2 = ""; }
-				}
-				else
-				{
-					pch2 = tpl_getVar(vars, varname);
-				}
-				tmp = strlen(pch2);
-				if(tmp + respos + 2 >= allocated)
-				{
-					allocated = tmp + respos + 256;
-					if(!cs_realloc(&result, allocated)) { return ""; }
-				}
-				memcpy(result + respos, pch2, tmp);
-				respos += tmp;
-				tpl = pch + 2;
+				if(webif_write_raw(buf, f, pos) <= 0) { break; }
+				pos = 0;
 			}
+			memcpy(buf + pos, seg->data, seg->len);
+			pos += seg->len;
+			continue;
 		}
-		else
+		if(pos)
 		{
-			if(respos + 2 >= allocated)
-			{
-				allocated = respos + 256;
-				if(!cs_realloc(&result, allocated)) { return ""; }
-			}
-			result[respos] = tpl[0];
-			++respos;
-			++tpl;
+			if(webif_write_raw(buf, f, pos) <= 0) { break; }
+			pos = 0;
 		}
+		if(webif_write_raw((char *)seg->data, f, seg->len) <= 0) { break; }
 	}
-	NULLFREE(tplorg);
-	result[respos] = '\0';
-	tpl_addTmp(vars, result);
-	return result;
+	if(pos) { webif_write_raw(buf, f, pos); }
+	NULLFREE(buf);
+}
+
+#ifdef WITH_ZLIB
+/* Returns the gzip compressed form of a built-in static file or NULL if there is none
+   or it is overridden by a disk template. */
+const char *tpl_getCompressedTpl(const char *name, int32_t *len)
+{
+	char path[255];
+	int32_t idx;
+	if(tpl_getDiskPath(name, "", path, sizeof(path)) || (idx = tpl_find(name, jhash(name, strlen(name)))) < 0 || !tpls[idx].gz_data)
+		{ return NULL; }
+	*len = tpls[idx].gz_len;
+	return tpls[idx].gz_data;
+}
+
+/* Compresses the page rendered by tpl_renderDeferred(). Returns the length of the newly allocated result or -1. */
+int32_t tpl_compressDeferred(struct templatevars *vars, int8_t encoding, char **result)
+{
+	struct tpl_out *out = (*vars).out;
+	const char **data;
+	uint32_t i, *len;
+	int32_t ret = -1;
+
+	if(!out || !cs_malloc(&data, (out->segcnt + 1) * sizeof(char *))) { return -1; }
+	if(cs_malloc(&len, (out->segcnt + 1) * sizeof(uint32_t)))
+	{
+		for(i = 0; i < out->segcnt; i++)
+		{
+			data[i] = out->seg[i].data;
+			len[i] = out->seg[i].len;
+		}
+		ret = webif_compress(encoding, cfg.http_compress_level, data, len, out->segcnt, result);
+		NULLFREE(len);
+	}
+	NULLFREE(data);
+	return ret;
 }
+#endif
 
 /* Saves all templates to the specified paths. Existing files will be overwritten! */
 int32_t tpl_saveIncludedTpls(const char *path)
@@ -15,17 +15,34 @@
 
 #define TOUCH_SUBDIR "touch/"
 
+/* Amount of hash buckets used to find template variables by name. */
+#define TPL_HASH_SIZE 128
+
+struct templatevar
+{
+	char *name;
+	char *value;
+	uint32_t hash;
+	uint32_t len;
+	uint32_t alloc;
+	int32_t next;
+	uint8_t type;
+};
+
+struct tpl_out;
+
 struct templatevars
 {
 	uint32_t varscnt;
 	uint32_t varsalloc;
 	uint32_t tmpcnt;
 	uint32_t tmpalloc;
-	char **names;
-	char **values;
-	uint8_t *vartypes;
+	struct templatevar *vars;
+	int32_t hash[TPL_HASH_SIZE];
 	char **tmp;
 	uint8_t messages;
+	char *page;
+	struct tpl_out *out;
 };
 
 void    webif_tpls_prepare(void);
@@ -43,6 +60,13 @@ char    *tpl_getFilePathInSubdir(const char *path, const char *subdir, const cha
 char    *tpl_getTplPath(const char *name, const char *path, char *result, uint32_t resultsize);
 char    *tpl_getTpl(struct templatevars *vars, const char *name);
 char    *tpl_getUnparsedTpl(const char *name, int8_t removeHeader, const char *subdir);
+char    *tpl_deferTpl(struct templatevars *vars, const char *name);
+int32_t tpl_renderDeferred(struct templatevars *vars);
+void    tpl_writeDeferred(struct templatevars *vars, FILE *f);
+#ifdef WITH_ZLIB
+const char *tpl_getCompressedTpl(const char *name, int32_t *len);
+int32_t tpl_compressDeferred(struct templatevars *vars, int8_t encoding, char **result);
+#endif
 
 int32_t tpl_saveIncludedTpls(const char *path);
 
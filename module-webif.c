@@ -23,6 +23,7 @@
 #include "oscam-files.h"
 #include "oscam-garbage.h"
 #include "oscam-cache.h"
+#include "oscam-latency.h"
 #include "oscam-client.h"
 #include "oscam-lock.h"
 #include "oscam-net.h"
@@ -48,6 +49,7 @@ extern char *RDR_CD_TXT[];
 int32_t ssl_active = 0;
 char noncekey[33];
 pthread_key_t getkeepalive;
+pthread_key_t getencoding;
 static pthread_key_t getip;
 pthread_key_t getssl;
 static CS_MUTEX_LOCK http_lock;
@@ -69,6 +71,8 @@ static struct pstat p_stat_old;
 
 static bool use_srvid2 = false;
 
+static void webif_pool_counts(int32_t *threads, int32_t *queued, int32_t *idle);
+
 /* constants for menuactivating */
 #define MNU_STATUS 		0
 #define MNU_LIVELOG 		1
@@ -206,6 +210,7 @@ static void clear_account_stats(struct s_auth *account)
 	account->cwcyclednok = 0;
 	account->cwcycledign = 0;
 #endif
+	latency_clear(&account->latency);
 	cacheex_clear_account_stats(account);
 }
 
@@ -276,6 +281,80 @@ static void clear_info_readers_stats(void)
 	cs_writeunlock(__func__, &readerlist_lock);
 }
 
+/* Fills var with the latency percentiles of lat: a tooltip text for html,
+   <latency> elements for xml and an array of objects for json */
+static void set_latency_info(struct templatevars *vars, char *var, struct s_latency *lat, int32_t apicall)
+{
+	struct s_latency_summary sum;
+	int8_t kind, n = 0;
+
+	tpl_addVar(vars, TPLADD, var, "");
+	for(kind = 0; kind < LATENCY_KINDS; kind++)
+	{
+		if(!latency_get_summary(lat, kind, &sum))
+			{ continue; }
+
+		if(apicall == 1)
+		{
+			tpl_printf(vars, TPLAPPEND, var, "<latency kind=\"%s\" count=\"%u\" p50=\"%u\" p90=\"%u\" p99=\"%u\" p999=\"%u\"></latency>",
+					   latency_kind_txt(kind), sum.count, sum.p50, sum.p90, sum.p99, sum.p999);
+		}
+		else if(apicall == 2)
+		{
+			tpl_printf(vars, TPLAPPEND, var, "%s{\"kind\":\"%s\",\"count\":\"%u\",\"p50\":\"%u\",\"p90\":\"%u\",\"p99\":\"%u\",\"p999\":\"%u\"}",
+					   n ? "," : "", latency_kind_txt(kind), sum.count, sum.p50, sum.p90, sum.p99, sum.p999);
+		}
+		else
+		{
+			tpl_printf(vars, TPLAPPEND, var, "%s%s: p50 %u ms, p90 %u ms, p99 %u ms, p99.9 %u ms (%u ECM)",
+					   n ? "&#013;" : "", latency_kind_txt(kind), sum.p50, sum.p90, sum.p99, sum.p999, sum.count);
+		}
+		n++;
+	}
+}
+
+static void set_caid_latency_info(struct templatevars *vars, int32_t apicall)
+{
+	struct s_latency_summary sum;
+	struct s_latency *lat;
+	uint16_t caid;
+	int32_t i, n = 0;
+	int8_t kind;
+
+	tpl_addVar(vars, TPLADD, "CAIDLATENCY", "");
+	for(i = 0; (lat = latency_get_caid(i, &caid)); i++)
+	{
+		for(kind = 0; kind < LATENCY_KINDS; kind++)
+		{
+			if(!latency_get_summary(lat, kind, &sum))
+				{ continue; }
+
+			if(apicall == 1)
+			{
+				tpl_printf(vars, TPLAPPEND, "CAIDLATENCY", "<latency caid=\"%04X\" kind=\"%s\" count=\"%u\" p50=\"%u\" p90=\"%u\" p99=\"%u\" p999=\"%u\"></latency>\n",
+						   caid, latency_kind_txt(kind), sum.count, sum.p50, sum.p90, sum.p99, sum.p999);
+			}
+			else if(apicall == 2)
+			{
+				tpl_printf(vars, TPLAPPEND, "CAIDLATENCY", "%s{\"caid\":\"%04X\",\"kind\":\"%s\",\"count\":\"%u\",\"p50\":\"%u\",\"p90\":\"%u\",\"p99\":\"%u\",\"p999\":\"%u\"}",
+						   n ? "," : "", caid, latency_kind_txt(kind), sum.count, sum.p50, sum.p90, sum.p99, sum.p999);
+			}
+			else
+			{
+				tpl_printf(vars, TPLADD, "LATENCYCAID", "%04X", caid);
+				tpl_addVar(vars, TPLADD, "LATENCYKIND", (char *)latency_kind_txt(kind));
+				tpl_printf(vars, TPLADD, "LATENCYCOUNT", "%u", sum.count);
+				tpl_printf(vars, TPLADD, "LATENCYP50", "%u", sum.p50);
+				tpl_printf(vars, TPLADD, "LATENCYP90", "%u", sum.p90);
+				tpl_printf(vars, TPLADD, "LATENCYP99", "%u", sum.p99);
+				tpl_printf(vars, TPLADD, "LATENCYP999", "%u", sum.p999);
+				tpl_addVar(vars, TPLAPPEND, "CAIDLATENCY", tpl_getTpl(vars, "LATENCYINFOBIT"));
+			}
+			n++;
+		}
+	}
+}
+
 static void set_ecm_info(struct templatevars * vars)
 {
 	//if one of the stats overloaded, reset all stats!
@@ -1388,6 +1467,10 @@ static char *send_oscam_config_webif(struct templatevars *vars, struct uriparams
 	tpl_printf(vars, TPLADD, "HTTPEMMSCLEAN", "%d", cfg.http_emms_clean);
 	tpl_printf(vars, TPLADD, "HTTPEMMGCLEAN", "%d", cfg.http_emmg_clean);
 	tpl_printf(vars, TPLADD, "HTTPREFRESH", "%d", cfg.http_refresh);
+	tpl_printf(vars, TPLADD, "HTTPTHREADS", "%d", cfg.http_threads);
+	tpl_addVar(vars, TPLADD, "HTTPCOMPRESSCHECKED", (cfg.http_compress == 1) ? "checked" : "");
+	tpl_printf(vars, TPLADD, "HTTPCOMPRESSLEVEL", "%d", cfg.http_compress_level);
+	tpl_printf(vars, TPLADD, "HTTPCOMPRESSMIN", "%d", cfg.http_compress_min);
 	tpl_printf(vars, TPLADD, "HTTPPOLLREFRESH", "%d", cfg.poll_refresh);
 	tpl_addVar(vars, TPLADD, "HTTPTPL", cfg.http_tpl);
 	tpl_addVar(vars, TPLADD, "HTTPPICONPATH", cfg.http_piconpath);
@@ -1699,6 +1782,7 @@ static void clear_rdr_stats(struct s_reader *rdr)
 	rdr->ecmshealthtout = 0;
 	rdr->ecmsfilteredhead = 0;
 	rdr->ecmsfilteredlen = 0;
+	latency_clear(&rdr->latency);
 }
 
 static void clear_all_rdr_stats(void)
@@ -1915,6 +1999,7 @@ static char *send_oscam_reader(struct templatevars *vars, struct uriparams *para
 			tpl_printf(vars, TPLADD, "ECMSTOUTREL", " (%.2f %%)",rdr->ecmshealthtout);
 			tpl_printf(vars, TPLADD, "ECMSFILTEREDHEAD", PRINTF_LOCAL_D, rdr->ecmsfilteredhead);
 			tpl_printf(vars, TPLADD, "ECMSFILTEREDLEN", PRINTF_LOCAL_D, rdr->ecmsfilteredlen);
+			set_latency_info(vars, "READERLATENCY", &rdr->latency, apicall);
 #ifdef WITH_LB
 			tpl_printf(vars, TPLADD, "LBWEIGHT", "%d", rdr->lb_weight);
 #endif
@@ -3143,7 +3228,7 @@ static char *send_oscam_user_config_edit(struct templatevars *vars, struct uripa
 		}
 		chk_account("services", servicelabels, account);
 
-		refresh_oscam(REFR_CLIENTS);
+		cs_reinit_account_clients(account);
 
 		if(write_userdb() != 0) { tpl_addMsg(vars, "Write Config failed!"); }
 		else if(strcmp(getParam(params, "action"), "Save As") != 0) { tpl_addMsg(vars, "User Account updated and saved"); }
@@ -3700,6 +3785,7 @@ static char *send_oscam_user_config(struct templatevars *vars, struct uriparams
 		account = get_account_by_name(getParam(params, "user"));
 		if(account)
 		{
+			account->cfg_crc = 0;
 			if(strcmp(getParam(params, "action"), "disable") == 0)
 			{
 				account->disabled = 1;
@@ -3996,6 +4082,7 @@ static char *send_oscam_user_config(struct templatevars *vars, struct uriparams
 #endif
 		tpl_printf(vars, TPLADD, "CWOK", PRINTF_LOCAL_D, account->cwfound);
 		tpl_printf(vars, TPLADD, "CWNOK", PRINTF_LOCAL_D, account->cwnot);
+		set_latency_info(vars, "USERLATENCY", &account->latency, apicall);
 		tpl_printf(vars, TPLADD, "CWIGN", PRINTF_LOCAL_D, account->cwignored);
 		tpl_printf(vars, TPLADD, "CWTOUT", PRINTF_LOCAL_D, account->cwtout);
 #ifdef CW_CYCLE_CHECK
@@ -4118,12 +4205,12 @@ static char *send_oscam_user_config(struct templatevars *vars, struct uriparams
 	set_ecm_info(vars);
 
 	if(!apicall)
-		{ return tpl_getTpl(vars, "USERCONFIGLIST"); }
+		{ return tpl_deferTpl(vars, "USERCONFIGLIST"); }
 	else
 	{
 		if(!filter || clientcount > 0)
 		{
-			return tpl_getTpl(vars, (apicall==1)?"APIUSERCONFIGLIST":"JSONUSER");
+			return tpl_deferTpl(vars, (apicall==1)?"APIUSERCONFIGLIST":"JSONUSER");
 		}
 		else
 		{
@@ -4626,7 +4713,53 @@ static char *send_oscam_entitlement(struct templatevars *vars, struct uriparams
 	}
 }
 
+struct log_history_arg
+{
+	struct templatevars *vars;
+	int32_t apicall;
+	int32_t count;
+};
+
 #ifdef WEBIF_LIVELOG
+/* The json record of a line is made on its first poll and kept in the log
+   history, later polls only copy it. */
+static void logpoll_add_line(struct s_log_history *hist, void *arg)
+{
+	struct log_history_arg *a = arg;
+	struct templatevars *vars = a->vars;
+	char *json;
+
+	if(!hist->json)
+	{
+		char p_usr[32];
+		size_t pos1 = strcspn(hist->txt, "\t") + 1;
+		cs_strncpy(p_usr, hist->txt , pos1 > sizeof(p_usr) ? sizeof(p_usr) : pos1);
+
+		char *p_txt = hist->txt + pos1;
+
+		pos1 = strcspn(p_txt, "\n") + 1;
+		char str_out[pos1];
+		cs_strncpy(str_out, p_txt, pos1);
+
+		char *line = xml_encode(vars, str_out);
+		char *usr = urlencode(vars, xml_encode(vars, p_usr));
+		size_t b64_str_in = strlen(line);
+		int32_t n, len = 64 + strlen(usr) + BASE64_LENGTH(b64_str_in);
+		if(!cs_malloc(&json, len))
+			{ return; }
+		n = snprintf(json, len, "{\"id\":\"%" PRIu64 "\",\"usr\":\"%s\",\"line\":\"", hist->counter, usr);
+		json[n] = '\0';
+		base64_encode(line, b64_str_in, json + n, len - n);
+		n += strlen(json + n);
+		snprintf(json + n, len - n, "\"}");
+		if(!__sync_bool_compare_and_swap(&hist->json, NULL, json))
+			{ NULLFREE(json); }
+	}
+	if(a->count++)
+		{ tpl_addVar(vars, TPLAPPEND, "DATA", ","); }
+	tpl_addVar(vars, TPLAPPEND, "DATA", hist->json);
+}
+
 static char *send_oscam_logpoll(struct templatevars * vars, struct uriparams * params)
 {
 
@@ -4668,52 +4801,133 @@ static char *send_oscam_logpoll(struct templatevars * vars, struct uriparams * p
 		return tpl_getTpl(vars, "POLL");
 	}
 		
-	if(log_history)
-	{
-		LL_ITER it = ll_iter_create(log_history);
-		struct s_log_history *hist;
-		
-		tpl_printf(vars, TPLAPPEND, "DATA", "%s\"lines\":[", dot);
-    	
-		dot = "";
-		
-		while((hist = (struct s_log_history*)ll_iter_next(&it)))
-		{
-			char p_usr[32];
-			size_t pos1 = strcspn(hist->txt, "\t") + 1;
-			cs_strncpy(p_usr, hist->txt , pos1 > sizeof(p_usr) ? sizeof(p_usr) : pos1);
-			
-			char *p_txt = hist->txt + pos1;
-    	
-			pos1 = strcspn(p_txt, "\n") + 1;
-			char str_out[pos1];
-			cs_strncpy(str_out, p_txt, pos1);
-			uint64_t id = hist->counter;
-    	
-			size_t b64_str_in = strlen(xml_encode(vars, str_out));
-			size_t b64_str_out = 32 + BASE64_LENGTH(b64_str_in);
-			char *b64_str_out_buf;
-			if(!cs_malloc(&b64_str_out_buf, b64_str_out))
-				{ continue; }
-			base64_encode(xml_encode(vars, str_out), b64_str_in, b64_str_out_buf, b64_str_out);
-    	
-			if(id > lastid){
-				tpl_printf(vars, TPLAPPEND, "DATA","%s{\"id\":\"%" PRIu64 "\",\"usr\":\"%s\",\"line\":\"%s\"}",
-										dot,
-										id,
-										urlencode(vars, xml_encode(vars, p_usr)),
-										b64_str_out_buf);
-				dot = ","; // next in Array with leading delimiter
-			}
-			NULLFREE(b64_str_out_buf);
-		}
-	}
+	struct log_history_arg arg = { vars, 0, 0 };
+	tpl_printf(vars, TPLAPPEND, "DATA", "%s\"lines\":[", dot);
+	cs_log_history(lastid, logpoll_add_line, &arg);
 	
 	tpl_addVar(vars, TPLAPPEND, "DATA", "]");
 	return tpl_getTpl(vars, "POLL");
 }
 #endif
 
+/* Change feed of oscamapi.json?part=status. Every json status scan compares a
+   checksum of each shown row with the one of the scan before and gives changed
+   rows a new sequence number. Rows which are gone are kept in a ring, so a caller
+   presenting since=<seq> of an earlier answer gets only the rows changed after it
+   plus the removed ones. Unknown or too old tokens get the full list. */
+#define STATUS_REMOVED_MAX 1024
+
+struct status_removed
+{
+	struct s_client *cl;
+	uint64_t seq;
+};
+
+static uint64_t status_seq;                         // last sequence number handed out
+static uint64_t status_horizon;                     // older removals have been overwritten
+static struct status_removed status_removed[STATUS_REMOVED_MAX];
+static int32_t status_removed_next;
+static struct s_client **status_rows;               // rows of the last scan, sorted
+static int32_t status_rowcnt;
+
+// everything shown in a status row except the running times
+static uint32_t status_row_hash(struct s_client *cl, int32_t isec, int32_t con, time_t now)
+{
+	struct s_reader *rdr = cl->reader;
+	uint32_t v[32], h;
+	int32_t n = 0;
+
+	v[n++] = cl->typ;
+	v[n++] = cl->login;
+	v[n++] = cl->logout;
+	v[n++] = cl->lastecm;
+	v[n++] = cl->lastemm;
+	v[n++] = cl->lastswitch;
+	v[n++] = cl->last_caid;
+	v[n++] = cl->last_provid;
+	v[n++] = cl->last_srvid;
+	v[n++] = cl->cwlastresptime;
+	v[n++] = cl->cwfound + cl->cwnot + cl->cwcache + cl->cwtout + cl->cwignored;
+	v[n++] = cl->emmok + cl->emmnok;
+	v[n++] = cl->crypted;
+	v[n++] = cl->port;
+	v[n++] = con;
+	v[n++] = (isec < cfg.hideclient_to) | ((now - cl->lastemm) / 60 > cfg.aulow) << 1;
+	v[n++] = ll_count(cl->aureader_list);
+	v[n++] = (uintptr_t)cl->account;
+	if(rdr)
+	{
+		v[n++] = rdr->card_status;
+		v[n++] = rdr->tcp_connected;
+		v[n++] = rdr->lbvalue;
+		v[n++] = rdr->ecmsok + rdr->ecmsnok + rdr->ecmstout;
+		v[n++] = ll_count(rdr->ll_entitlements);
+		v[n++] = rdr->audisabled;
+		v[n++] = rdr->currenthops;
+#ifdef MODULE_CCCAM
+		if(cl->cc && !strncmp(client_get_proto(cl), "cccam", 5))
+			{ v[n++] = ll_count(((struct cc_data *)cl->cc)->cards); }
+#endif
+	}
+	h = crc32(0, (uint8_t *)v, n * sizeof(uint32_t));
+	return crc32(h, (uint8_t *)&cl->ip, sizeof(cl->ip));
+}
+
+static int status_row_cmp(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t)*(struct s_client * const *)a, y = (uintptr_t)*(struct s_client * const *)b;
+	return x < y ? -1 : x > y;
+}
+
+static int8_t status_row_known(struct s_client **rows, int32_t cnt, struct s_client *cl)
+{
+	return bsearch(&cl, rows, cnt, sizeof(struct s_client *), status_row_cmp) != NULL;
+}
+
+/* Takes over the rows of the current scan and puts the rows of the last scan
+   which are gone into the removed ring. */
+static void status_update_rows(struct s_client **rows, int32_t cnt)
+{
+	struct status_removed *r;
+	int32_t i;
+
+	qsort(rows, cnt, sizeof(struct s_client *), status_row_cmp);
+	for(i = 0; i < status_rowcnt; i++)
+	{
+		if(status_row_known(rows, cnt, status_rows[i]))
+			{ continue; }
+		r = &status_removed[status_removed_next];
+		if(r->seq)
+			{ status_horizon = r->seq; }
+		r->cl = status_rows[i];
+		r->seq = ++status_seq;
+		status_removed_next = (status_removed_next + 1) % STATUS_REMOVED_MAX;
+	}
+	NULLFREE(status_rows);
+	status_rows = rows;
+	status_rowcnt = cnt;
+}
+
+static void status_add_log_line(struct s_log_history *hist, void *arg)
+{
+	struct log_history_arg *a = arg;
+	struct templatevars *vars = a->vars;
+	char p_usr[32];
+	size_t pos1 = strcspn(hist->txt, "\t") + 1;
+	cs_strncpy(p_usr, hist->txt , pos1 > sizeof(p_usr) ? sizeof(p_usr) : pos1);
+
+	char *p_txt = hist->txt + pos1;
+
+	if(!a->apicall)
+	{
+		if(p_txt[0]) tpl_printf(vars, TPLAPPEND, "LOGHISTORY","\t\t<SPAN CLASS=\"%s\">%s\t\t</SPAN><BR>\n", xml_encode(vars, p_usr), xml_encode(vars, p_txt));
+	}
+	else
+	{
+		tpl_addVar(vars, TPLAPPEND, "LOGHISTORY", p_txt);
+	}
+}
+
 static char *send_oscam_status(struct templatevars * vars, struct uriparams * params, int32_t apicall)
 {
 	int32_t i;
@@ -4864,6 +5078,18 @@ static char *send_oscam_status(struct templatevars * vars, struct uriparams * pa
 	struct s_client *cl;
 	int8_t filtered;
 
+	struct s_client **rows = NULL;
+	int32_t rowcnt = 0, rowalloc = 0;
+	uint64_t since = 0;
+	int8_t feed = (apicall == 2), full = 1;
+	if(feed)
+	{
+		if(!status_seq)
+			{ status_seq = status_horizon = (uint64_t)now << 20; }
+		since = strtoull(getParam(params, "since"), NULL, 10);
+		full = since < status_horizon || since > status_seq;
+	}
+
 	cs_readlock(__func__, &readerlist_lock);
 	cs_readlock(__func__, &clientlist_lock);
 	for(i = 0, cl = first_client; cl ; cl = cl->next, i++)
@@ -4884,6 +5110,7 @@ static char *send_oscam_status(struct templatevars * vars, struct uriparams * pa
 			tpl_addVar(vars, TPLADD, "CLIENTLASTRESPONSETIMEHIST", "");
 			tpl_addVar(vars, TPLADD, "UPICMISSING" , "");
 			tpl_addVar(vars, TPLADD, "ENTITLEMENTS", "");
+			tpl_addVar(vars, TPLADD, "CLIENTLATENCY", "");
 
 			if(cl->typ == 'c')
 				{ user_count_all++; }
@@ -4960,6 +5187,35 @@ static char *send_oscam_status(struct templatevars * vars, struct uriparams * pa
 					else if((cl->tosleep) && (now - cl->lastswitch > cl->tosleep)) { con = 1; }
 					else { con = 0; }
 
+					if(feed)
+					{
+						uint32_t hash = status_row_hash(cl, isec, con, now);
+						if(!cl->webif_status_seq || hash != cl->webif_status_hash || !status_row_known(status_rows, status_rowcnt, cl))
+						{
+							cl->webif_status_hash = hash;
+							cl->webif_status_seq = ++status_seq;
+						}
+						if(rowcnt == rowalloc)
+						{
+							rowalloc = rowalloc ? rowalloc * 2 : 256;
+							if(!cs_realloc(&rows, rowalloc * sizeof(struct s_client *)))
+								{ rowcnt = rowalloc = 0; }
+						}
+						if(rows)
+							{ rows[rowcnt++] = cl; }
+						// only the rows changed after the token of the caller
+						if(!full && cl->webif_status_seq <= since)
+							{ shown = 0; }
+					}
+				}
+
+				if(shown)
+				{
+					if(cl->typ == 'c' && cl->account)
+						{ set_latency_info(vars, "CLIENTLATENCY", &cl->account->latency, apicall); }
+					else if((cl->typ == 'r' || cl->typ == 'p') && cl->reader)
+						{ set_latency_info(vars, "CLIENTLATENCY", &cl->reader->latency, apicall); }
+
 					// no AU reader == 0 / AU ok == 1 / Last EMM > aulow == -1
 					if(cl->typ == 'c' || cl->typ == 'p' || cl->typ == 'r')
 					{
@@ -5528,6 +5784,7 @@ static char *send_oscam_status(struct templatevars * vars, struct uriparams * pa
 					{ tpl_addVar(vars, TPLAPPEND, "APISTATUSBITS", tpl_getTpl(vars, "APISTATUSBIT")); }
 					if(apicall == 2)
 					{
+						tpl_printf(vars, TPLADD, "CLIENTSEQ", "%" PRIu64, cl->webif_status_seq);
 						tpl_addVar(vars, TPLADD, "JSONARRAYDELIMITER", delimiter?",":"");
 						tpl_addVar(vars, TPLAPPEND, "JSONSTATUSBITS", tpl_getTpl(vars, "JSONSTATUSBIT"));
 						delimiter++;
@@ -5556,6 +5813,24 @@ static char *send_oscam_status(struct templatevars * vars, struct uriparams * pa
 		}
 	}
 
+	if(feed)
+	{
+		status_update_rows(rows, rowcnt);
+		if(!full)
+		{
+			int32_t n = 0;
+			tpl_addVar(vars, TPLADD, "STATUSREMOVED", "");
+			for(i = 0; i < STATUS_REMOVED_MAX; i++)
+			{
+				struct status_removed *r = &status_removed[i];
+				if(r->seq > since && !status_row_known(status_rows, status_rowcnt, r->cl))
+					{ tpl_printf(vars, TPLAPPEND, "STATUSREMOVED", "%s\"id_%p\"", n++ ? "," : "", r->cl); }
+			}
+		}
+		tpl_printf(vars, TPLADD, "STATUSSEQ", "%" PRIu64, status_seq);
+		tpl_addVar(vars, TPLADD, "STATUSFULL", full ? "1" : "0");
+	}
+
 	cs_readunlock(__func__, &clientlist_lock);
 	cs_readunlock(__func__, &readerlist_lock);
 
@@ -5565,28 +5840,10 @@ static char *send_oscam_status(struct templatevars * vars, struct uriparams * pa
 
 	if(cfg.http_status_log || (apicall == 1 && strcmp(getParam(params, "appendlog"), "1") == 0) || is_touch)
 	{
-		if(cfg.loghistorylines && log_history)
+		if(cfg.loghistorylines)
 		{
-			LL_ITER it = ll_iter_create(log_history);
-			struct s_log_history *hist;
-		
-			while((hist = (struct s_log_history*)ll_iter_next(&it)))
-			{
-				char p_usr[32];
-				size_t pos1 = strcspn(hist->txt, "\t") + 1;
-				cs_strncpy(p_usr, hist->txt , pos1 > sizeof(p_usr) ? sizeof(p_usr) : pos1);
-					
-				char *p_txt = hist->txt + pos1;
-				
-				if(!apicall)
-				{	
-					if(p_txt[0]) tpl_printf(vars, TPLAPPEND, "LOGHISTORY","\t\t<SPAN CLASS=\"%s\">%s\t\t</SPAN><BR>\n", xml_encode(vars, p_usr), xml_encode(vars, p_txt));
-				}
-				else
-				{
-					tpl_addVar(vars, TPLAPPEND, "LOGHISTORY", p_txt);
-				}
-			}
+			struct log_history_arg arg = { vars, apicall, 0 };
+			cs_log_history(0, status_add_log_line, &arg);
 		}
 		else
 		{
@@ -5681,6 +5938,7 @@ static char *send_oscam_status(struct templatevars * vars, struct uriparams * pa
 
 	//CM info
 	set_ecm_info(vars);
+	set_caid_latency_info(vars, apicall);
 
 	//copy struct to p_stat_old for cpu_usage calculation
 	p_stat_old = p_stat_cur;
@@ -5772,7 +6030,7 @@ static char *send_oscam_status(struct templatevars * vars, struct uriparams * pa
 	if(apicall)
 	{
 		if(apicall == 1)
-		{ return tpl_getTpl(vars, "APISTATUS"); }
+		{ return tpl_deferTpl(vars, "APISTATUS"); }
 		if(apicall == 2)
 		{
 			tpl_printf(vars, TPLADD, "UCS", "%d", user_count_shown);
@@ -5794,14 +6052,14 @@ static char *send_oscam_status(struct templatevars * vars, struct uriparams * pa
 			tpl_printf(vars, TPLADD, "PCA", "%d", proxy_count_all);
 			tpl_printf(vars, TPLADD, "PICONENABLED", "%d", cfg.http_showpicons?1:0);
 			tpl_printf(vars, TPLADD, "SRVIDFILE", "%s", use_srvid2 ? "oscam.srvid2" : "oscam.srvid");
-			return tpl_getTpl(vars, "JSONSTATUS");
+			return tpl_deferTpl(vars, "JSONSTATUS");
 		}
 	}
 
 	if(is_touch)
 		{ return tpl_getTpl(vars, "TOUCH_STATUS"); }
 	else
-		{ return tpl_getTpl(vars, "STATUS"); }
+		{ return tpl_deferTpl(vars, "STATUS"); }
 }
 
 static char *send_oscam_services_edit(struct templatevars * vars, struct uriparams * params)
@@ -7841,6 +8099,10 @@ static int32_t readRequest(FILE * f, IN_ADDR_T in, char **result, int8_t forcePl
 			return -1;
 		}
 
+		// don't wait for more data once the request is complete
+		if(check_request(*result, bufsize))
+			{ break; }
+
 #ifdef WITH_SSL
 		if(ssl_active && !forcePlain)
 		{
@@ -7859,18 +8121,339 @@ static int32_t readRequest(FILE * f, IN_ADDR_T in, char **result, int8_t forcePl
 
 		pfd2[0].events = (POLLIN | POLLPRI);
 
-		int32_t rc = poll(pfd2, 1, 100);
-		if(rc > 0 || !check_request(*result, bufsize))
+		poll(pfd2, 1, 100);
+	}
+	return bufsize;
+}
+/* OpenMetrics text exposition of the live counters for Prometheus and other scrapers.
+   The text is printed straight into a buffer, the template engine is not used. */
+struct metrics_buf
+{
+	char *data;
+	int32_t len;
+	int32_t alloc;
+};
+
+static void metrics_printf(struct metrics_buf *mb, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void metrics_printf(struct metrics_buf *mb, const char *fmt, ...)
+{
+	va_list ap;
+	int32_t n, alloc;
+
+	if(!mb->data)
+		{ return; }
+
+	va_start(ap, fmt);
+	n = vsnprintf(mb->data + mb->len, mb->alloc - mb->len, fmt, ap);
+	va_end(ap);
+	if(n < 0)
+		{ return; }
+
+	if(mb->len + n >= mb->alloc)
+	{
+		for(alloc = mb->alloc * 2; mb->len + n >= alloc; alloc *= 2) { ; }
+		if(!cs_realloc(&mb->data, alloc))
+			{ return; }
+		mb->alloc = alloc;
+		va_start(ap, fmt);
+		vsnprintf(mb->data + mb->len, mb->alloc - mb->len, fmt, ap);
+		va_end(ap);
+	}
+	mb->len += n;
+}
+
+static void metrics_family(struct metrics_buf *mb, const char *name, const char *type, const char *help)
+{
+	metrics_printf(mb, "# TYPE oscam_%s %s\n# HELP oscam_%s %s\n", name, type, name, help);
+}
+
+// label values may contain anything, escape backslash, quote and newline
+static char *metrics_label(const char *in, char *out, int32_t size)
+{
+	int32_t i = 0;
+
+	for(; in && *in && i < size - 2; in++)
+	{
+		if(*in == '\\' || *in == '"' || *in == '\n')
+		{
+			out[i++] = '\\';
+			out[i++] = *in == '\n' ? 'n' : *in;
+		}
+		else
+			{ out[i++] = *in; }
+	}
+	out[i] = '\0';
+	return out;
+}
+
+static void metrics_latency(struct metrics_buf *mb, const char *name, const char *labels, struct s_latency *lat)
+{
+	static const char *quantile[4] = { "0.5", "0.9", "0.99", "0.999" };
+	struct s_latency_summary sum;
+	uint32_t value[4];
+	int8_t kind, q;
+
+	for(kind = 0; kind < LATENCY_KINDS; kind++)
+	{
+		if(!latency_get_summary(lat, kind, &sum))
 			{ continue; }
+
+		value[0] = sum.p50;
+		value[1] = sum.p90;
+		value[2] = sum.p99;
+		value[3] = sum.p999;
+		for(q = 0; q < 4; q++)
+		{
+			metrics_printf(mb, "oscam_%s{%s,kind=\"%s\",quantile=\"%s\"} %u.%03u\n",
+						   name, labels, latency_kind_txt(kind), quantile[q], value[q] / 1000, value[q] % 1000);
+		}
+		metrics_printf(mb, "oscam_%s_count{%s,kind=\"%s\"} %u\n", name, labels, latency_kind_txt(kind), sum.count);
+	}
+}
+
+#ifdef WITH_LB
+// sums up the loadbalancer statistics of rdr, avg is -1 without found entries
+static int8_t metrics_reader_stat(struct s_reader *rdr, int32_t *entries, int64_t *ecms, int64_t *avg)
+{
+	READER_STAT *s;
+	int64_t found_ecms = 0, time_sum = 0;
+
+	if(!rdr->lb_stat)
+		{ return 0; }
+
+	entries[0] = entries[1] = 0;
+	*ecms = 0;
+	cs_readlock(__func__, &rdr->lb_stat_lock);
+	LL_ITER it = ll_iter_create(rdr->lb_stat);
+	while((s = ll_iter_next(&it)))
+	{
+		*ecms += s->ecm_count;
+		if(s->rc == E_FOUND && s->ecm_count > 0)
+		{
+			entries[0]++;
+			found_ecms += s->ecm_count;
+			time_sum += (int64_t)s->time_avg * s->ecm_count;
+		}
 		else
-			{ break; }
+			{ entries[1]++; }
 	}
-	return bufsize;
+	cs_readunlock(__func__, &rdr->lb_stat_lock);
+	*avg = found_ecms ? time_sum / found_ecms : -1;
+	return 1;
 }
+#endif
+
+static void send_oscam_metrics(FILE *f, char *extraheader)
+{
+	struct metrics_buf mb;
+	struct s_client *cl;
+	struct s_reader *rdr;
+	LL_ITER itr;
+	char label[128], labels[160];
+	int32_t i, threads, queued, idle;
+	int32_t clients[26], jobs[26], workers[26];
+
+	mb.len = 0;
+	mb.alloc = 16384;
+	if(!cs_malloc(&mb.data, mb.alloc))
+	{
+		send_error500(f);
+		return;
+	}
+
+	metrics_family(&mb, "build", "info", "OSCam version.");
+	metrics_printf(&mb, "oscam_build_info{version=\"%s\",revision=\"%s\",target=\"%s\"} 1\n", CS_VERSION, CS_SVN_VERSION, CS_TARGET);
+	metrics_family(&mb, "start_time_seconds", "gauge", "Time OSCam was started.");
+	metrics_printf(&mb, "oscam_start_time_seconds %ld\n", (long)first_client->login);
+
+	cs_readlock(__func__, &readerlist_lock);
+
+	metrics_family(&mb, "reader_ecm", "counter", "ECM answers per reader and result.");
+	itr = ll_iter_create(configured_readers);
+	while((rdr = ll_iter_next(&itr)))
+	{
+		metrics_label(rdr->label, label, sizeof(label));
+		metrics_printf(&mb, "oscam_reader_ecm_total{reader=\"%s\",result=\"ok\"} %u\n", label, rdr->ecmsok);
+		metrics_printf(&mb, "oscam_reader_ecm_total{reader=\"%s\",result=\"nok\"} %u\n", label, rdr->ecmsnok);
+		metrics_printf(&mb, "oscam_reader_ecm_total{reader=\"%s\",result=\"timeout\"} %u\n", label, rdr->ecmstout);
+	}
+
+	metrics_family(&mb, "reader_enabled", "gauge", "Reader is enabled.");
+	itr = ll_iter_create(configured_readers);
+	while((rdr = ll_iter_next(&itr)))
+	{
+		metrics_printf(&mb, "oscam_reader_enabled{reader=\"%s\"} %d\n", metrics_label(rdr->label, label, sizeof(label)), rdr->enable == 1);
+	}
+
+	metrics_family(&mb, "reader_job_queue_length", "gauge", "Jobs waiting for the reader thread.");
+	itr = ll_iter_create(configured_readers);
+	while((rdr = ll_iter_next(&itr)))
+	{
+		metrics_printf(&mb, "oscam_reader_job_queue_length{reader=\"%s\"} %d\n", metrics_label(rdr->label, label, sizeof(label)),
+					   rdr->client ? ll_count(rdr->client->joblist) : 0);
+	}
+
+#ifdef WITH_LB
+	int32_t entries[2];
+	int64_t ecms, avg;
+
+	metrics_family(&mb, "reader_stat_entries", "gauge", "Loadbalancer statistics entries per reader.");
+	itr = ll_iter_create(configured_readers);
+	while((rdr = ll_iter_next(&itr)))
+	{
+		if(metrics_reader_stat(rdr, entries, &ecms, &avg))
+		{
+			metrics_label(rdr->label, label, sizeof(label));
+			metrics_printf(&mb, "oscam_reader_stat_entries{reader=\"%s\",rc=\"found\"} %d\n", label, entries[0]);
+			metrics_printf(&mb, "oscam_reader_stat_entries{reader=\"%s\",rc=\"other\"} %d\n", label, entries[1]);
+		}
+	}
+	metrics_family(&mb, "reader_stat_ecms", "gauge", "ECMs counted in the loadbalancer statistics.");
+	itr = ll_iter_create(configured_readers);
+	while((rdr = ll_iter_next(&itr)))
+	{
+		if(metrics_reader_stat(rdr, entries, &ecms, &avg))
+			{ metrics_printf(&mb, "oscam_reader_stat_ecms{reader=\"%s\"} %lld\n", metrics_label(rdr->label, label, sizeof(label)), (long long)ecms); }
+	}
+	metrics_family(&mb, "reader_stat_found_seconds", "gauge", "Average answer time of the found statistics entries, weighted by their ECM count.");
+	itr = ll_iter_create(configured_readers);
+	while((rdr = ll_iter_next(&itr)))
+	{
+		if(metrics_reader_stat(rdr, entries, &ecms, &avg) && avg >= 0)
+		{
+			metrics_printf(&mb, "oscam_reader_stat_found_seconds{reader=\"%s\"} %lld.%03lld\n", metrics_label(rdr->label, label, sizeof(label)),
+						   (long long)(avg / 1000), (long long)(avg % 1000));
+		}
+	}
+#endif
+
+	metrics_family(&mb, "reader_latency_seconds", "summary", "Reader answer time percentiles.");
+	itr = ll_iter_create(configured_readers);
+	while((rdr = ll_iter_next(&itr)))
+	{
+		snprintf(labels, sizeof(labels), "reader=\"%s\"", metrics_label(rdr->label, label, sizeof(label)));
+		metrics_latency(&mb, "reader_latency_seconds", labels, &rdr->latency);
+	}
+
+#ifdef CS_CACHEEX
+	metrics_family(&mb, "reader_cacheex", "counter", "Cacheex ECMs per cacheex reader.");
+	itr = ll_iter_create(configured_readers);
+	while((rdr = ll_iter_next(&itr)))
+	{
+		if(!rdr->cacheex.mode || !(cl = rdr->client))
+			{ continue; }
+		metrics_label(rdr->label, label, sizeof(label));
+		metrics_printf(&mb, "oscam_reader_cacheex_total{reader=\"%s\",event=\"push\"} %d\n", label, cl->cwcacheexpush);
+		metrics_printf(&mb, "oscam_reader_cacheex_total{reader=\"%s\",event=\"got\"} %d\n", label, cl->cwcacheexgot);
+		metrics_printf(&mb, "oscam_reader_cacheex_total{reader=\"%s\",event=\"hit\"} %d\n", label, cl->cwcacheexhit);
+		metrics_printf(&mb, "oscam_reader_cacheex_total{reader=\"%s\",event=\"drop\"} %d\n", label, cl->cwcacheexdrop);
+	}
+#endif
+	cs_readunlock(__func__, &readerlist_lock);
+
+	metrics_family(&mb, "caid_latency_seconds", "summary", "Answer time percentiles per caid.");
+	struct s_latency *lat;
+	uint16_t caid;
+	for(i = 0; (lat = latency_get_caid(i, &caid)); i++)
+	{
+		snprintf(labels, sizeof(labels), "caid=\"%04X\"", caid);
+		metrics_latency(&mb, "caid_latency_seconds", labels, lat);
+	}
+
+	memset(clients, 0, sizeof(clients));
+	memset(jobs, 0, sizeof(jobs));
+	memset(workers, 0, sizeof(workers));
+	cs_readlock(__func__, &clientlist_lock);
+	for(cl = first_client; cl; cl = cl->next)
+	{
+		if(cl->kill || cl->typ < 'a' || cl->typ > 'z')
+			{ continue; }
+		i = cl->typ - 'a';
+		clients[i]++;
+		jobs[i] += ll_count(cl->joblist);
+		if(cl->thread_active)
+			{ workers[i]++; }
+	}
+	cs_readunlock(__func__, &clientlist_lock);
+
+	metrics_family(&mb, "clients", "gauge", "Connected clients by type (c=client, r=reader, p=proxy, h=http, m=monitor, s=master, a=anticascader).");
+	for(i = 0; i < 26; i++)
+	{
+		if(clients[i])
+			{ metrics_printf(&mb, "oscam_clients{type=\"%c\"} %d\n", 'a' + i, clients[i]); }
+	}
+	metrics_family(&mb, "job_queue_length", "gauge", "Jobs waiting for the client threads, by client type.");
+	for(i = 0; i < 26; i++)
+	{
+		if(clients[i])
+			{ metrics_printf(&mb, "oscam_job_queue_length{type=\"%c\"} %d\n", 'a' + i, jobs[i]); }
+	}
+	webif_pool_counts(&threads, &queued, &idle);
+	metrics_family(&mb, "threads", "gauge", "Running work threads.");
+	for(i = 0; i < 26; i++)
+	{
+		if(clients[i])
+			{ metrics_printf(&mb, "oscam_threads{pool=\"client\",type=\"%c\"} %d\n", 'a' + i, workers[i]); }
+	}
+	metrics_printf(&mb, "oscam_threads{pool=\"webif\"} %d\n", threads);
+	metrics_family(&mb, "webif_queue_length", "gauge", "Webif connections waiting for a worker.");
+	metrics_printf(&mb, "oscam_webif_queue_length %d\n", queued);
+	metrics_family(&mb, "webif_idle_connections", "gauge", "Keep-alive webif connections waiting for the next request.");
+	metrics_printf(&mb, "oscam_webif_idle_connections %d\n", idle);
+
+	metrics_family(&mb, "cache_entries", "gauge", "Entries in the ECM cache.");
+	metrics_printf(&mb, "oscam_cache_entries %u\n", cache_size());
+	metrics_family(&mb, "ecmcwcache_entries", "gauge", "Entries in the ECM request cache.");
+	metrics_printf(&mb, "oscam_ecmcwcache_entries %u\n", ecmcwcache_size);
+	metrics_family(&mb, "failban_entries", "gauge", "Banned IPs.");
+	metrics_printf(&mb, "oscam_failban_entries %d\n", ll_count(cfg.v_list));
+	metrics_family(&mb, "log_backlog", "gauge", "Log messages waiting to be written.");
+	metrics_printf(&mb, "oscam_log_backlog %d\n", cs_log_backlog());
+	metrics_family(&mb, "log_dropped", "counter", "Log messages dropped because of a full backlog.");
+	metrics_printf(&mb, "oscam_log_dropped_total %u\n", cs_log_dropped());
+
+#ifdef CS_CACHEEX
+	metrics_family(&mb, "cacheex", "counter", "Cacheex ECMs of all peers.");
+	metrics_printf(&mb, "oscam_cacheex_total{event=\"push\"} %d\n", first_client->cwcacheexpush);
+	metrics_printf(&mb, "oscam_cacheex_total{event=\"got\"} %d\n", first_client->cwcacheexgot);
+	metrics_printf(&mb, "oscam_cacheex_total{event=\"hit\"} %d\n", first_client->cwcacheexhit);
+	metrics_printf(&mb, "oscam_cacheex_total{event=\"error\"} %d\n", first_client->cwcacheexerr);
+	metrics_printf(&mb, "oscam_cacheex_total{event=\"drop\"} %d\n", first_client->cwcacheexdrop);
+#endif
+
+	metrics_printf(&mb, "# EOF\n");
+	if(!mb.data)
+	{
+		send_error500(f);
+		return;
+	}
+	send_content(f, extraheader, "application/openmetrics-text; version=1.0.0; charset=utf-8", 0, mb.data, mb.len, 0);
+	NULLFREE(mb.data);
+}
+
+// next request already received, e.g. pipelined or buffered by SSL
+static int8_t webif_request_pending(FILE *f)
+{
+	struct pollfd pfd;
+#ifdef WITH_SSL
+	if(ssl_active)
+	{
+		if(SSL_pending((SSL *)f) > 0)
+			{ return 1; }
+		pfd.fd = SSL_get_fd((SSL *)f);
+	}
+	else
+#endif
+		pfd.fd = fileno(f);
+	pfd.events = POLLIN | POLLPRI;
+	return poll(&pfd, 1, 0) > 0;
+}
+
 static int32_t process_request(FILE * f, IN_ADDR_T in)
 {
 	int32_t ok = 0;
 	int8_t *keepalive = (int8_t *)pthread_getspecific(getkeepalive);
+	int8_t *encoding = (int8_t *)pthread_getspecific(getencoding);
 	IN_ADDR_T addr = GET_IP();
 
 	do
@@ -7932,11 +8515,13 @@ static int32_t process_request(FILE * f, IN_ADDR_T in)
 			"/ghttp.html",
 			"/logpoll.html",
 			"/jquery.js",
+			"/metrics",
 		};
 
 		int32_t pagescnt = sizeof(pages) / sizeof(char *); // Calculate the amount of items in array
 		int32_t i, bufsize, len, pgidx = -1;
 		uint32_t etagheader = 0;
+		int8_t etagencoding = HTTP_ENCODING_NONE;
 		struct uriparams params;
 		params.paramcount = 0;
 		time_t modifiedheader = 0;
@@ -8029,6 +8614,7 @@ static int32_t process_request(FILE * f, IN_ADDR_T in)
 		if(!cfg.http_user || !cfg.http_pwd)
 			{ authok = 1; }
 
+		*encoding = HTTP_ENCODING_NONE;
 		for(str1 = strtok_r(tmp, "\n", &saveptr1); str1; str1 = strtok_r(NULL, "\n", &saveptr1))
 		{
 			len = strlen(str1);
@@ -8061,12 +8647,20 @@ static int32_t process_request(FILE * f, IN_ADDR_T in)
 			else if(len > 20 && strncasecmp(str1, "If-None-Match:", 14) == 0)
 			{
 				for(pch = str1 + 14; pch[0] != '"' && pch[0] != '\0'; ++pch) { ; }
-				if(strlen(pch) > 5) { etagheader = (uint32_t)strtoul(++pch, NULL, 10); }
+				if(strlen(pch) > 5)
+				{
+					etagheader = (uint32_t)strtoul(++pch, &pch, 10);
+					etagencoding = webif_etag_encoding(pch);
+				}
 			}
 			else if(len > 12 && strncasecmp(str1, "Connection: Keep-Alive", 22) == 0 && strcmp(method, "POST"))
 			{
 				*keepalive = 1;
 			}
+			else if(len > 16 && strncasecmp(str1, "Accept-Encoding:", 16) == 0)
+			{
+				*encoding = parse_acceptencoding(str1);
+			}
 		}
 
 		if(cfg.http_user && cfg.http_pwd)
@@ -8110,15 +8704,19 @@ static int32_t process_request(FILE * f, IN_ADDR_T in)
 		/*build page*/
 		if(pgidx == 8)
 		{
-			send_file(f, "CSS", subdir, modifiedheader, etagheader, extraheader);
+			send_file(f, "CSS", subdir, modifiedheader, etagheader, etagencoding, extraheader);
 		}
 		else if(pgidx == 17)
 		{
-			send_file(f, "JS", subdir, modifiedheader, etagheader, extraheader);
+			send_file(f, "JS", subdir, modifiedheader, etagheader, etagencoding, extraheader);
 		}
 		else if(pgidx == 30)
 		{
-			send_file(f, "JQ", subdir, modifiedheader, etagheader, extraheader);
+			send_file(f, "JQ", subdir, modifiedheader, etagheader, etagencoding, extraheader);
+		}
+		else if(pgidx == 31)
+		{
+			send_oscam_metrics(f, extraheader);
 		}
 		else
 		{
@@ -8338,151 +8936,514 @@ static int32_t process_request(FILE * f, IN_ADDR_T in)
 				result = send_oscam_status(vars, &params, 0);
 				break;
 			}
+			// a deferred page is rendered while we still hold the lock but written after releasing it
+			int32_t pagelen = -1;
+			if(result && result == vars->page) { pagelen = tpl_renderDeferred(vars); }
 			if(pgidx != 19 && pgidx != 20 && pgidx != 21 && pgidx != 27) { cs_writeunlock(__func__, &http_lock); }
 
-			if(result == NULL || !strcmp(result, "0") || strlen(result) == 0) { send_error500(f); }
+			char *mime = "text/html";
+			if(pgidx == 18)
+				{ mime = "text/xml"; }
+			else if(pgidx == 21)
+				{ mime = "image/svg+xml"; }
+			else if(pgidx == 24)
+				{ mime = "text/javascript"; }
+
+			if(result && result == vars->page)
+			{
+#ifdef WITH_ZLIB
+				char *compressed = NULL;
+				int32_t clen = -1;
+				int8_t cenc = pagelen > 0 ? webif_encoding(pagelen) : HTTP_ENCODING_NONE;
+				if(cenc != HTTP_ENCODING_NONE) { clen = tpl_compressDeferred(vars, cenc, &compressed); }
+				if(clen > 0)
+				{
+					send_headers_encoded(f, extraheader, mime, 0, clen, NULL, 0, cenc);
+					webif_write_raw(compressed, f, clen);
+					NULLFREE(compressed);
+				}
+				else
+#endif
+				if(pagelen <= 0) { send_error500(f); }
+				else
+				{
+					send_headers(f, 200, "OK", extraheader, mime, 0, pagelen, NULL, 0);
+					tpl_writeDeferred(vars, f);
+				}
+			}
+			else if(result == NULL || !strcmp(result, "0") || strlen(result) == 0) { send_error500(f); }
 			else if(strcmp(result, "1"))
 			{
 				//it doesn't make sense to check for modified etagheader here as standard template has timestamp in output and so site changes on every request
-				if(pgidx == 18)
-					{ send_headers(f, 200, "OK", extraheader, "text/xml", 0, strlen(result), NULL, 0); }
-				else if(pgidx == 21)
-					{ send_headers(f, 200, "OK", extraheader, "image/svg+xml", 0, strlen(result), NULL, 0); }
-				else if(pgidx == 24)
-					{ send_headers(f, 200, "OK", extraheader, "text/javascript", 0, strlen(result), NULL, 0); }
-				else
-					{ send_headers(f, 200, "OK", extraheader, "text/html", 0, strlen(result), NULL, 0); }
-				webif_write(result, f);
+				send_content(f, extraheader, mime, 0, result, strlen(result), 0);
 			}
 			tpl_clear(vars);
 		}
 		NULLFREE(filebuf);
 	}
-	while(*keepalive == 1 && !exit_oscam);
+	while(*keepalive == 1 && !exit_oscam && webif_request_pending(f));
 	return 0;
 }
 
-static void *serve_process(void *conn)
-{
-	struct s_connection *myconn = (struct s_connection *)conn;
-	int32_t s = myconn->socket;
-	struct s_client *cl = myconn->cl;
-	IN_ADDR_T in;
-	IP_ASSIGN(in, myconn->remote);
+/* Webif connections are served by a fixed pool of worker threads. http_server()
+   watches accepted connections (epoll on linux) and puts one into the work queue
+   only once it has data. After a keep-alive request the worker hands the
+   connection back and it is watched again until the next request arrives or it
+   was idle for too long, so idle browsers and API pollers don't hold a thread.
+   Reads and the SSL handshake time out, so a stalled client can't hold one either. */
+#define WEBIF_MAX_QUEUED		1024
+#define WEBIF_MAX_IDLE			512
+#define WEBIF_IDLE_TIMEOUT		60
+#define WEBIF_READ_TIMEOUT		10
 
-	set_thread_name(__func__);
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define WEBIF_USE_EPOLL
+static int32_t webif_epfd = -1;
+#endif
+
+static pthread_mutex_t webif_pool_lock;
+static pthread_cond_t webif_pool_cond;
+static struct s_connection *webif_queue_head, *webif_queue_tail;
+static int32_t webif_queue_count;
+static struct s_connection *webif_parked;           // back from the workers, not yet watched
+static struct s_connection *webif_idle_head, *webif_idle_tail;
+static int32_t webif_idle_count;
+static struct s_connection *webif_evicted;          // closed once the current batch of ready[] is done
+static int32_t webif_wakeup[2] = { -1, -1 };
+static int32_t webif_threads_running;
+
+static void webif_pool_counts(int32_t *threads, int32_t *queued, int32_t *idle)
+{
+	SAFE_MUTEX_LOCK(&webif_pool_lock);
+	*threads = webif_threads_running;
+	*queued = webif_queue_count;
+	SAFE_MUTEX_UNLOCK(&webif_pool_lock);
+	*idle = webif_idle_count;
+}
 
+static void webif_close_connection(struct s_connection *conn)
+{
 #ifdef WITH_SSL
-	SSL *ssl = myconn->ssl;
-	SAFE_SETSPECIFIC(getssl, ssl);
+	if(conn->ssl)
+	{
+		SSL_shutdown(conn->ssl);
+		close(conn->socket);
+		SSL_free(conn->ssl);
+	}
+	else
 #endif
-	NULLFREE(myconn);
+	if(conn->f)
+	{
+		fflush(conn->f);
+		shutdown(conn->socket, SHUT_WR);
+		fclose(conn->f);
+	}
+	else
+	{
+		close(conn->socket);
+	}
+	NULLFREE(conn);
+}
 
-	SAFE_SETSPECIFIC(getip, &in);
-	SAFE_SETSPECIFIC(getclient, cl);
+static int8_t webif_queue_push(struct s_connection *conn)
+{
+	int8_t ok = 0;
+
+	SAFE_MUTEX_LOCK(&webif_pool_lock);
+	if(webif_queue_count < WEBIF_MAX_QUEUED)
+	{
+		conn->next = NULL;
+		if(webif_queue_tail)
+			{ webif_queue_tail->next = conn; }
+		else
+			{ webif_queue_head = conn; }
+		webif_queue_tail = conn;
+		webif_queue_count++;
+		ok = 1;
+		SAFE_COND_SIGNAL(&webif_pool_cond);
+	}
+	SAFE_MUTEX_UNLOCK(&webif_pool_lock);
+	return ok;
+}
+
+static struct s_connection *webif_queue_pop(void)
+{
+	struct s_connection *conn;
+	struct timespec ts;
+
+	SAFE_MUTEX_LOCK(&webif_pool_lock);
+	while(!webif_queue_head && !exit_oscam)
+	{
+		add_ms_to_timespec(&ts, 1000);
+		SAFE_COND_TIMEDWAIT(&webif_pool_cond, &webif_pool_lock, &ts);
+	}
+	conn = webif_queue_head;
+	if(conn)
+	{
+		webif_queue_head = conn->next;
+		if(!webif_queue_head)
+			{ webif_queue_tail = NULL; }
+		webif_queue_count--;
+		conn->next = NULL;
+	}
+	SAFE_MUTEX_UNLOCK(&webif_pool_lock);
+	return conn;
+}
+
+// called by the workers, the connection is watched again by http_server()
+static void webif_park_connection(struct s_connection *conn)
+{
+	SAFE_MUTEX_LOCK(&webif_pool_lock);
+	conn->next = webif_parked;
+	webif_parked = conn;
+	SAFE_MUTEX_UNLOCK(&webif_pool_lock);
+	if(write(webif_wakeup[1], "", 1) < 0 && errno != EAGAIN)
+		{ cs_log_dbg(D_TRACE, "WebIf: wakeup failed (errno=%d %s)", errno, strerror(errno)); }
+}
 
-	int8_t keepalive = 0;
-	SAFE_SETSPECIFIC(getkeepalive, &keepalive);
+static void webif_idle_unlink(struct s_connection *conn)
+{
+	if(conn->prev)
+		{ conn->prev->next = conn->next; }
+	else
+		{ webif_idle_head = conn->next; }
+	if(conn->next)
+		{ conn->next->prev = conn->prev; }
+	else
+		{ webif_idle_tail = conn->prev; }
+	conn->next = conn->prev = NULL;
+	conn->idle = 0;
+	webif_idle_count--;
+#ifdef WEBIF_USE_EPOLL
+	epoll_ctl(webif_epfd, EPOLL_CTL_DEL, conn->socket, NULL);
+#endif
+}
+
+static void webif_idle_add(struct s_connection *conn)
+{
+	if(webif_idle_count >= WEBIF_MAX_IDLE)
+	{
+		// it may still be in ready[], so it is only freed after the batch
+		struct s_connection *oldest = webif_idle_head;
+		webif_idle_unlink(oldest);
+		oldest->next = webif_evicted;
+		webif_evicted = oldest;
+	}
+#ifdef WEBIF_USE_EPOLL
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLPRI;
+	ev.data.ptr = conn;
+	if(epoll_ctl(webif_epfd, EPOLL_CTL_ADD, conn->socket, &ev) < 0)
+	{
+		cs_log_dbg(D_TRACE, "WebIf: epoll_ctl(%d) failed (errno=%d %s)", conn->socket, errno, strerror(errno));
+		webif_close_connection(conn);
+		return;
+	}
+#endif
+	conn->idle = 1;
+	conn->idle_since = time(NULL);
+	conn->next = NULL;
+	conn->prev = webif_idle_tail;
+	if(webif_idle_tail)
+		{ webif_idle_tail->next = conn; }
+	else
+		{ webif_idle_head = conn; }
+	webif_idle_tail = conn;
+	webif_idle_count++;
+}
+
+static void webif_idle_expire(time_t now)
+{
+	// oldest first, so stop at the first one that is still fresh
+	while(webif_idle_head && (exit_oscam || now - webif_idle_head->idle_since >= WEBIF_IDLE_TIMEOUT))
+	{
+		struct s_connection *conn = webif_idle_head;
+		webif_idle_unlink(conn);
+		webif_close_connection(conn);
+	}
+}
+
+/* Waits for the listening socket, the wakeup pipe and the idle connections.
+   Returns the number of ready entries stored in ready[], &sock and
+   &webif_wakeup[0] stand for the listening socket and the pipe. */
+static int32_t webif_wait(void **ready, int32_t max, int32_t timeout)
+{
+	int32_t i, n = 0, rc;
+#ifdef WEBIF_USE_EPOLL
+	struct epoll_event ev[64];
+	if(max > 64)
+		{ max = 64; }
+	rc = epoll_wait(webif_epfd, ev, max, timeout);
+	for(i = 0; i < rc; i++)
+		{ ready[n++] = ev[i].data.ptr; }
+#else
+	struct pollfd pfd[WEBIF_MAX_IDLE + 2];
+	void *ptr[WEBIF_MAX_IDLE + 2];
+	struct s_connection *conn;
+	int32_t cnt = 0;
+
+	pfd[cnt].fd = sock;
+	ptr[cnt++] = &sock;
+	pfd[cnt].fd = webif_wakeup[0];
+	ptr[cnt++] = &webif_wakeup[0];
+	for(conn = webif_idle_head; conn && cnt < WEBIF_MAX_IDLE + 2; conn = conn->next)
+	{
+		pfd[cnt].fd = conn->socket;
+		ptr[cnt++] = conn;
+	}
+	for(i = 0; i < cnt; i++)
+	{
+		pfd[i].events = POLLIN | POLLPRI;
+		pfd[i].revents = 0;
+	}
+	rc = poll(pfd, cnt, timeout);
+	for(i = 0; i < cnt && rc > 0 && n < max; i++)
+	{
+		if(pfd[i].revents)
+			{ ready[n++] = ptr[i]; }
+	}
+#endif
+	if(rc < 0 && errno != EINTR)
+	{
+		cs_log("HTTP Server: Error waiting for connections (errno=%d %s)", errno, strerror(errno));
+		cs_sleepms(100);
+	}
+	return n;
+}
 
 #ifdef WITH_SSL
-	if(ssl_active)
+static int8_t webif_ssl_accept(struct s_connection *conn)
+{
+	SSL *ssl = conn->ssl;
+	int32_t s = conn->socket;
+
+	if(!SSL_set_fd(ssl, s))
+	{
+		cs_log("WebIf: Error calling SSL_set_fd().");
+		return 0;
+	}
+
+	int32_t ok = (SSL_accept(ssl) != -1);
+	if(!ok)
 	{
-		if(SSL_set_fd(ssl, s))
+		int8_t tries = 100;
+		time_t deadline = time(NULL) + WEBIF_READ_TIMEOUT;
+		while(!ok && tries-- && time(NULL) < deadline)
 		{
-			int32_t ok = (SSL_accept(ssl) != -1);
-			if(!ok)
+			int32_t err = SSL_get_error(ssl, -1);
+			if(err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
+				{ break; }
+			else
 			{
-				int8_t tries = 100;
-				while(!ok && tries--)
+				struct pollfd pfd;
+				pfd.fd = s;
+				pfd.events = POLLIN | POLLPRI;
+				int32_t rc = poll(&pfd, 1, 1000);
+				if(rc < 0)
 				{
-					int32_t err = SSL_get_error(ssl, -1);
-					if(err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE)
-						{ break; }
-					else
-					{
-						struct pollfd pfd;
-						pfd.fd = s;
-						pfd.events = POLLIN | POLLPRI;
-						int32_t rc = poll(&pfd, 1, -1);
-						if(rc < 0)
-						{
-							if(errno == EINTR || errno == EAGAIN) { continue; }
-							break;
-						}
-						if(rc == 1)
-							{ ok = (SSL_accept(ssl) != -1); }
-					}
+					if(errno == EINTR || errno == EAGAIN) { continue; }
+					break;
 				}
+				if(rc == 1)
+					{ ok = (SSL_accept(ssl) != -1); }
 			}
-			if(ok)
-			{
-				process_request((FILE *)ssl, in);
-			}
-			else
-			{
-				FILE *f;
-				f = fdopen(s, "r+");
-				if(f != NULL)
-				{
-					char *ptr, *filebuf = NULL, *host = NULL;
-					int32_t bufsize = readRequest(f, in, &filebuf, 1);
+		}
+	}
+	if(ok)
+	{
+		conn->f = (FILE *)ssl;
+		return 1;
+	}
 
-					if(filebuf)
-					{
-						filebuf[bufsize] = '\0';
-						host = strstr(filebuf, "Host: ");
-						if(host)
-						{
-							host += 6;
-							ptr = strchr(host, '\r');
-							if(ptr) { ptr[0] = '\0'; }
-						}
-					}
-					if(host)
-					{
-						char extra[strlen(host) + 20];
-						snprintf(extra, sizeof(extra), "Location: https://%s", host);
-						send_error(f, 301, "Moved Permanently", extra, "This web server is running in SSL mode.", 1);
-					}
-					else
-						{ send_error(f, 200, "Bad Request", NULL, "This web server is running in SSL mode.", 1); }
-					fflush(f);
-					fclose(f);
-					NULLFREE(filebuf);
-				}
-				else
-				{
-					cs_log_dbg(D_TRACE, "WebIf: fdopen(%d) failed. (errno=%d %s)", s, errno, strerror(errno));
-				}
+	// plain http request on the ssl port
+	FILE *f;
+	f = fdopen(dup(s), "r+");
+	if(f != NULL)
+	{
+		char *ptr, *filebuf = NULL, *host = NULL;
+		int32_t bufsize = readRequest(f, conn->remote, &filebuf, 1);
+
+		if(filebuf)
+		{
+			filebuf[bufsize] = '\0';
+			host = strstr(filebuf, "Host: ");
+			if(host)
+			{
+				host += 6;
+				ptr = strchr(host, '\r');
+				if(ptr) { ptr[0] = '\0'; }
 			}
 		}
-		else { cs_log("WebIf: Error calling SSL_set_fd()."); }
-		SSL_shutdown(ssl);
-		close(s);
-		SSL_free(ssl);
+		if(host)
+		{
+			char extra[strlen(host) + 20];
+			snprintf(extra, sizeof(extra), "Location: https://%s", host);
+			send_error(f, 301, "Moved Permanently", extra, "This web server is running in SSL mode.", 1);
+		}
+		else
+			{ send_error(f, 200, "Bad Request", NULL, "This web server is running in SSL mode.", 1); }
+		fflush(f);
+		fclose(f);
+		NULLFREE(filebuf);
 	}
 	else
+	{
+		cs_log_dbg(D_TRACE, "WebIf: fdopen(%d) failed. (errno=%d %s)", s, errno, strerror(errno));
+	}
+	return 0;
+}
 #endif
+
+static void serve_process(struct s_connection *conn)
+{
+	SAFE_SETSPECIFIC(getip, &conn->remote);
+	SAFE_SETSPECIFIC(getclient, conn->cl);
+	SAFE_SETSPECIFIC(getkeepalive, &conn->keepalive);
+	SAFE_SETSPECIFIC(getencoding, &conn->encoding);
+#ifdef WITH_SSL
+	SAFE_SETSPECIFIC(getssl, conn->ssl);
+#endif
+
+	if(!conn->f)
 	{
-		FILE *f;
-		f = fdopen(s, "r+");
-		if(f != NULL)
+#ifdef WITH_SSL
+		if(ssl_active)
 		{
-			process_request(f, in);
-			fflush(f);
-			fclose(f);
+			if(!webif_ssl_accept(conn))
+			{
+				webif_close_connection(conn);
+				return;
+			}
 		}
 		else
+#endif
+		if(!(conn->f = fdopen(conn->socket, "r+")))
 		{
-			cs_log_dbg(D_TRACE, "WebIf: fdopen(%d) failed. (errno=%d %s)", s, errno, strerror(errno));
+			cs_log_dbg(D_TRACE, "WebIf: fdopen(%d) failed. (errno=%d %s)", conn->socket, errno, strerror(errno));
+			webif_close_connection(conn);
+			return;
 		}
-		shutdown(s, SHUT_WR);
-		close(s);
 	}
 
+	if(process_request(conn->f, conn->remote) == 0 && conn->keepalive == 1 && !exit_oscam)
+	{
+#ifdef WITH_SSL
+		if(!ssl_active)
+#endif
+			{ fflush(conn->f); }
+		webif_park_connection(conn);
+	}
+	else
+	{
+		webif_close_connection(conn);
+	}
+}
+
+static void *webif_worker(void *UNUSED(d))
+{
+	struct s_connection *conn;
+
+	set_thread_name(__func__);
+	while((conn = webif_queue_pop()))
+	{
+		serve_process(conn);
+	}
+	SAFE_MUTEX_LOCK(&webif_pool_lock);
+	webif_threads_running--;
+	SAFE_MUTEX_UNLOCK(&webif_pool_lock);
 	return NULL;
 }
 
+static int8_t webif_pool_start(void)
+{
+	int32_t i, threads = cfg.http_threads;
+
+	if(threads < 1)
+		{ threads = 1; }
+	if(threads > 64)
+		{ threads = 64; }
+
+	cs_pthread_cond_init(__func__, &webif_pool_lock, &webif_pool_cond);
+	if(pipe(webif_wakeup) < 0)
+	{
+		cs_log("HTTP Server: pipe() failed (errno=%d %s)", errno, strerror(errno));
+		return 0;
+	}
+	set_nonblock(webif_wakeup[0], true);
+	set_nonblock(webif_wakeup[1], true);
+
+#ifdef WEBIF_USE_EPOLL
+	struct epoll_event ev;
+	if((webif_epfd = epoll_create(WEBIF_MAX_IDLE)) < 0)
+	{
+		cs_log("HTTP Server: epoll_create() failed (errno=%d %s)", errno, strerror(errno));
+		return 0;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = &sock;
+	epoll_ctl(webif_epfd, EPOLL_CTL_ADD, sock, &ev);
+	ev.data.ptr = &webif_wakeup[0];
+	epoll_ctl(webif_epfd, EPOLL_CTL_ADD, webif_wakeup[0], &ev);
+#endif
+
+	for(i = 0; i < threads; i++)
+	{
+		if(start_thread("webif worker", webif_worker, NULL, NULL, 1, 1) == 0)
+		{
+			SAFE_MUTEX_LOCK(&webif_pool_lock);
+			webif_threads_running++;
+			SAFE_MUTEX_UNLOCK(&webif_pool_lock);
+		}
+	}
+	return webif_threads_running > 0;
+}
+
+static void webif_pool_stop(void)
+{
+	struct s_connection *conn;
+	int32_t i, running = 1;
+
+	SAFE_MUTEX_LOCK(&webif_pool_lock);
+	SAFE_COND_BROADCAST(&webif_pool_cond);
+	SAFE_MUTEX_UNLOCK(&webif_pool_lock);
+
+	// give the workers some time to finish their requests
+	for(i = 0; i < 30 && running; i++)
+	{
+		cs_sleepms(100);
+		SAFE_MUTEX_LOCK(&webif_pool_lock);
+		running = webif_threads_running;
+		SAFE_MUTEX_UNLOCK(&webif_pool_lock);
+	}
+
+	webif_idle_expire(time(NULL));
+	SAFE_MUTEX_LOCK(&webif_pool_lock);
+	while((conn = webif_parked))
+	{
+		webif_parked = conn->next;
+		webif_close_connection(conn);
+	}
+	while((conn = webif_queue_head))
+	{
+		webif_queue_head = conn->next;
+		webif_close_connection(conn);
+	}
+	webif_queue_tail = NULL;
+	webif_queue_count = 0;
+	SAFE_MUTEX_UNLOCK(&webif_pool_lock);
+
+#ifdef WEBIF_USE_EPOLL
+	close(webif_epfd);
+	webif_epfd = -1;
+#endif
+	close(webif_wakeup[0]);
+	close(webif_wakeup[1]);
+	webif_wakeup[0] = webif_wakeup[1] = -1;
+}
+
 /* Creates a random string with specified length. Note that dst must be one larger than size to hold the trailing \0*/
 static void create_rand_str(char *dst, int32_t size)
 {
@@ -8529,6 +9490,11 @@ static void *http_server(void *UNUSED(d))
 		cs_log("Could not create getkeepalive");
 		return NULL;
 	}
+	if(pthread_key_create(&getencoding, NULL))
+	{
+		cs_log("Could not create getencoding");
+		return NULL;
+	}
 
 	struct SOCKADDR sin;
 	socklen_t len = 0;
@@ -8610,25 +9576,69 @@ static void *http_server(void *UNUSED(d))
 	cs_log("HTTP Server running. ip=%s port=%d", cs_inet_ntoa(SIN_GET_ADDR(sin)), cfg.http_port);
 #endif
 
+	if(!webif_pool_start())
+	{
+		cs_log("HTTP Server: Could not start worker threads. Not starting HTTP!");
+		close(sock);
+		return NULL;
+	}
+
 	struct SOCKADDR remote;
 	memset(&remote, 0, sizeof(remote));
+	void *ready[64];
+	time_t last_expire = time(NULL);
 
 	while(!exit_oscam)
 	{
-		if((s = accept(sock, (struct sockaddr *) &remote, &len)) < 0)
+		int32_t i, n = webif_wait(ready, 64, 1000);
+
+		for(i = 0; i < n && !exit_oscam; i++)
 		{
-			if(exit_oscam)
-				{ break; }
-			if(errno != EAGAIN && errno != EINTR)
+			if(ready[i] == &webif_wakeup[0])
 			{
-				cs_log("HTTP Server: Error calling accept() (errno=%d %s)", errno, strerror(errno));
-				cs_sleepms(100);
+				char buf[64];
+				while(read(webif_wakeup[0], buf, sizeof(buf)) > 0) { ; }
+
+				SAFE_MUTEX_LOCK(&webif_pool_lock);
+				conn = webif_parked;
+				webif_parked = NULL;
+				SAFE_MUTEX_UNLOCK(&webif_pool_lock);
+				while(conn)
+				{
+					struct s_connection *next = conn->next;
+					webif_idle_add(conn);
+					conn = next;
+				}
+				continue;
 			}
-			else { cs_sleepms(5); }
-			continue;
-		}
-		else
-		{
+
+			if(ready[i] != &sock)
+			{
+				// next request on a keep-alive connection
+				conn = ready[i];
+				if(!conn->idle)
+					{ continue; } // evicted by an earlier entry of this batch
+				webif_idle_unlink(conn);
+				if(!webif_queue_push(conn))
+				{
+					cs_log_dbg(D_TRACE, "WebIf: request queue full, closing connection from %s", cs_inet_ntoa(conn->remote));
+					webif_close_connection(conn);
+				}
+				continue;
+			}
+
+			if((s = accept(sock, (struct sockaddr *) &remote, &len)) < 0)
+			{
+				if(exit_oscam)
+					{ break; }
+				if(errno != EAGAIN && errno != EINTR)
+				{
+					cs_log("HTTP Server: Error calling accept() (errno=%d %s)", errno, strerror(errno));
+					cs_sleepms(100);
+				}
+				continue;
+			}
+
 			getpeername(s, (struct sockaddr *) &remote, &len);
 			if(!cs_malloc(&conn, sizeof(struct s_connection)))
 			{
@@ -8636,6 +9646,9 @@ static void *http_server(void *UNUSED(d))
 				continue;
 			}
 			setTCPTimeouts(s);
+			struct timeval tv = { WEBIF_READ_TIMEOUT, 0 };
+			if(setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+				{ cs_log_dbg(D_TRACE, "WebIf: setting SO_RCVTIMEO failed (errno=%d %s)", errno, strerror(errno)); }
 			cur_client()->last = time((time_t *)0); //reset last busy time
 			conn->cl = cur_client();
 #ifdef IPV6SUPPORT
@@ -8664,21 +9677,31 @@ static void *http_server(void *UNUSED(d))
 				if(conn->ssl == NULL)
 				{
 					close(s);
+					NULLFREE(conn);
 					cs_log("WebIf: Error calling SSL_new().");
 					continue;
 				}
 			}
 #endif
+			// a worker gets it once the first request arrives
+			webif_idle_add(conn);
+		}
 
-			int32_t ret = start_thread("webif workthread", serve_process, (void *)conn, NULL, 1, 1);
-			if(ret)
-			{
-				NULLFREE(conn);
-			}
+		while((conn = webif_evicted))
+		{
+			webif_evicted = conn->next;
+			webif_close_connection(conn);
+		}
+
+		time_t now = time(NULL);
+		if(now != last_expire)
+		{
+			webif_idle_expire(now);
+			last_expire = now;
 		}
 	}
-	// Wait a bit so that we don't close ressources while http threads are active
-	cs_sleepms(300);
+	webif_pool_stop();
+
 #ifdef WITH_SSL
 	SSL_CTX_free(ctx);
 	CRYPTO_set_dynlock_create_callback(NULL);
@@ -5,8 +5,10 @@
 #include "oscam-chk.h"
 #include "oscam-ecm.h"
 #include "oscam-client.h"
+#include "oscam-garbage.h"
 #include "oscam-lock.h"
 #include "oscam-net.h"
+#include "oscam-rules.h"
 #include "oscam-string.h"
 #include "module-stat.h"
 #include "oscam-reader.h"
@@ -15,6 +17,8 @@
 #define OK      1
 #define ERROR   0
 
+extern uint32_t cfg_sidtab_generation;
+
 uint32_t get_fallbacktimeout(uint16_t   caid)
 {
 	uint32_t ftimeout = caidvaluetab_get_value(&cfg.ftimeouttab, caid, 0);
@@ -147,62 +151,6 @@ int32_t chk_srvid_match(ECM_REQUEST *er, SIDTAB *sidtab)
 	return (rc == 7);
 }
 
-int32_t chk_srvid(struct s_client *cl, ECM_REQUEST *er)
-{
-	int32_t nr, rc = 0;
-	SIDTAB *sidtab;
-
-	if(!cl->sidtabs.ok)
-	{
-		if(!cl->sidtabs.no) { return (1); }
-		rc = 1;
-	}
-	for(nr = 0, sidtab = cfg.sidtab; sidtab; sidtab = sidtab->next, nr++)
-		if(sidtab->num_caid | sidtab->num_provid | sidtab->num_srvid)
-		{
-			if((cl->sidtabs.no & ((SIDTABBITS)1 << nr)) &&
-					(chk_srvid_match(er, sidtab)))
-				{ return (0); }
-			if((cl->sidtabs.ok & ((SIDTABBITS)1 << nr)) &&
-					(chk_srvid_match(er, sidtab)))
-				{ rc = 1; }
-		}
-	return (rc);
-}
-
-int32_t has_srvid(struct s_client *cl, ECM_REQUEST *er)
-{
-	if(!cl->sidtabs.ok)
-		{ return 0; }
-
-	int32_t nr;
-	SIDTAB *sidtab;
-
-	for(nr = 0, sidtab = cfg.sidtab; sidtab; sidtab = sidtab->next, nr++)
-		if(sidtab->num_srvid)
-		{
-			if((cl->sidtabs.ok & ((SIDTABBITS)1 << nr)) &&
-					(chk_srvid_match(er, sidtab)))
-				{ return 1; }
-		}
-	return 0;
-}
-
-int32_t has_lb_srvid(struct s_client *cl, ECM_REQUEST *er)
-{
-	if(!cl->lb_sidtabs.ok)
-		{ return 0; }
-
-	int32_t nr;
-	SIDTAB *sidtab;
-
-	for(nr = 0, sidtab = cfg.sidtab; sidtab; sidtab = sidtab->next, nr++)
-		if((cl->lb_sidtabs.ok & ((SIDTABBITS)1 << nr)) &&
-				(chk_srvid_match(er, sidtab)))
-			{ return 1; }
-	return 0;
-}
-
 int32_t chk_srvid_match_by_caid_prov(uint16_t caid, uint32_t provid, SIDTAB *sidtab)
 {
 	int32_t i, rc = 0;
@@ -222,50 +170,242 @@ int32_t chk_srvid_match_by_caid_prov(uint16_t caid, uint32_t provid, SIDTAB *sid
 	return (rc == 3);
 }
 
-int32_t chk_srvid_by_caid_prov(struct s_client *cl, uint16_t caid, uint32_t provid)
+/*
+ * cfg.sidtab compiled into a lookup from caid, provid and srvid to the bitmask
+ * of services listing it. A check then costs three lookups instead of a walk
+ * over every list of every service. Rebuilt when cfg_sidtab_generation changes.
+ */
+#define SIDTAB_KEY(type, value) (((uint64_t)(type) << 32) | (value))
+#define SIDTAB_CAID     1
+#define SIDTAB_PROVID   2
+#define SIDTAB_SRVID    3
+#define SIDTAB_BITS     ((int32_t)sizeof(SIDTABBITS) * 8)
+
+struct s_sidtab_index
 {
-	int32_t nr, rc = 0;
-	SIDTAB *sidtab;
+	uint32_t        generation;
+	int8_t          compiled;       // idx is usable, otherwise cfg.sidtab is walked
+	SIDTABBITS      used;           // services with any caid, provid or srvid
+	SIDTABBITS      with_caid_prov; // services with caids or provids
+	SIDTABBITS      with_srvid;     // services with srvids
+	SIDTABBITS      any_caid;       // services without caids match every caid, same for provid/srvid
+	SIDTABBITS      any_provid;
+	SIDTABBITS      any_srvid;
+	struct s_rule_index idx;        // rules are service numbers
+};
+
+static struct s_sidtab_index *sidtab_index;
+static pthread_mutex_t sidtab_index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void sidtab_compile(struct s_sidtab_index *si, int8_t build_index)
+{
+	struct s_sidtab *sidtab;
+	struct s_rule_key *keys = NULL;
+	uint32_t n = 0, k = 0;
+	int32_t i, nr;
+	SIDTABBITS bit;
 
-	if(!cl->sidtabs.ok)
+	memset(si, 0, sizeof(struct s_sidtab_index));
+	si->generation = cfg_sidtab_generation;
+
+	for(nr = 0, sidtab = cfg.sidtab; sidtab && nr < SIDTAB_BITS; sidtab = sidtab->next, nr++)
 	{
-		if(!cl->sidtabs.no) { return (1); }
-		rc = 1;
+		bit = (SIDTABBITS)1 << nr;
+		if(sidtab->num_caid | sidtab->num_provid | sidtab->num_srvid) { si->used |= bit; }
+		if(sidtab->num_caid | sidtab->num_provid) { si->with_caid_prov |= bit; }
+		if(sidtab->num_srvid) { si->with_srvid |= bit; }
+		if(!sidtab->num_caid) { si->any_caid |= bit; }
+		if(!sidtab->num_provid) { si->any_provid |= bit; }
+		if(!sidtab->num_srvid) { si->any_srvid |= bit; }
+		n += sidtab->num_caid + sidtab->num_provid + sidtab->num_srvid;
 	}
-	for(nr = 0, sidtab = cfg.sidtab; sidtab; sidtab = sidtab->next, nr++)
-		if(sidtab->num_caid | sidtab->num_provid)
+
+	if(!build_index || (n && !cs_malloc(&keys, n * sizeof(struct s_rule_key))))
+		{ return; }
+
+	for(nr = 0, sidtab = cfg.sidtab; sidtab && nr < SIDTAB_BITS; sidtab = sidtab->next, nr++)
+	{
+		for(i = 0; i < sidtab->num_caid && k < n; i++, k++)
 		{
-			if((cl->sidtabs.no & ((SIDTABBITS)1 << nr)) && !sidtab->num_srvid &&
-					(chk_srvid_match_by_caid_prov(caid, provid, sidtab)))
-				{ return (0); }
-			if((cl->sidtabs.ok & ((SIDTABBITS)1 << nr)) &&
-					(chk_srvid_match_by_caid_prov(caid, provid, sidtab)))
-				{ rc = 1; }
+			keys[k].key = SIDTAB_KEY(SIDTAB_CAID, sidtab->caid[i]);
+			keys[k].rule = nr;
 		}
-	return (rc);
+		for(i = 0; i < sidtab->num_provid && k < n; i++, k++)
+		{
+			keys[k].key = SIDTAB_KEY(SIDTAB_PROVID, sidtab->provid[i]);
+			keys[k].rule = nr;
+		}
+		for(i = 0; i < sidtab->num_srvid && k < n; i++, k++)
+		{
+			keys[k].key = SIDTAB_KEY(SIDTAB_SRVID, sidtab->srvid[i]);
+			keys[k].rule = nr;
+		}
+	}
+	si->compiled = rule_index_build(&si->idx, keys, k);
+	NULLFREE(keys);
 }
 
-int32_t chk_srvid_by_caid_prov_rdr(struct s_reader *rdr, uint16_t caid, uint32_t provid)
+// tmp is filled without the index when there is no memory for it
+static struct s_sidtab_index *get_sidtab_index(struct s_sidtab_index *tmp)
+{
+	struct s_sidtab_index *si = sidtab_index, *old;
+
+	if(si && si->generation == cfg_sidtab_generation)
+		{ return si; }
+
+	SAFE_MUTEX_LOCK(&sidtab_index_lock);
+	si = sidtab_index;
+	if(!si || si->generation != cfg_sidtab_generation)
+	{
+		if(cs_malloc(&si, sizeof(struct s_sidtab_index)))
+		{
+			sidtab_compile(si, 1);
+			__sync_synchronize();
+			old = sidtab_index;
+			sidtab_index = si;
+			if(old)
+			{
+				rule_index_free(&old->idx);
+				add_garbage(old);
+			}
+		}
+		else
+		{
+			sidtab_compile(tmp, 0);
+			si = tmp;
+		}
+	}
+	SAFE_MUTEX_UNLOCK(&sidtab_index_lock);
+	return si;
+}
+
+static SIDTABBITS sidtab_lookup(struct s_sidtab_index *si, uint32_t type, uint32_t value)
 {
-	int32_t nr, rc = 0;
-	SIDTAB *sidtab;
+	const uint32_t *nr;
+	uint32_t i, count;
+	SIDTABBITS mask = 0;
+
+	nr = rule_index_find(&si->idx, SIDTAB_KEY(type, value), &count);
+	for(i = 0; i < count; i++)
+		{ mask |= (SIDTABBITS)1 << nr[i]; }
+	return mask;
+}
+
+// services for which chk_srvid_match() is true
+static SIDTABBITS sidtab_match_ecm(struct s_sidtab_index *si, ECM_REQUEST *er)
+{
+	SIDTABBITS mask = 0;
 
-	if(!rdr->sidtabs.ok)
+	if(!si->compiled)
 	{
-		if(!rdr->sidtabs.no) { return (1); }
-		rc = 1;
+		SIDTAB *sidtab;
+		int32_t nr;
+
+		for(nr = 0, sidtab = cfg.sidtab; sidtab && nr < SIDTAB_BITS; sidtab = sidtab->next, nr++)
+		{
+			if(chk_srvid_match(er, sidtab))
+				{ mask |= (SIDTABBITS)1 << nr; }
+		}
+		return mask;
 	}
-	for(nr = 0, sidtab = cfg.sidtab; sidtab; sidtab = sidtab->next, nr++)
-		if(sidtab->num_caid | sidtab->num_provid)
+
+	mask = si->any_caid | sidtab_lookup(si, SIDTAB_CAID, er->caid);
+	if(mask && er->prid)
+		{ mask &= si->any_provid | sidtab_lookup(si, SIDTAB_PROVID, er->prid); }
+	if(mask)
+		{ mask &= si->any_srvid | sidtab_lookup(si, SIDTAB_SRVID, er->srvid); }
+	return mask;
+}
+
+// services for which chk_srvid_match_by_caid_prov() is true
+static SIDTABBITS sidtab_match_caid_prov(struct s_sidtab_index *si, uint16_t caid, uint32_t provid)
+{
+	SIDTABBITS mask = 0;
+
+	if(!si->compiled)
+	{
+		SIDTAB *sidtab;
+		int32_t nr;
+
+		for(nr = 0, sidtab = cfg.sidtab; sidtab && nr < SIDTAB_BITS; sidtab = sidtab->next, nr++)
 		{
-			if((rdr->sidtabs.no & ((SIDTABBITS)1 << nr)) && !sidtab->num_srvid &&
-					(chk_srvid_match_by_caid_prov(caid, provid, sidtab)))
-				{ return (0); }
-			if((rdr->sidtabs.ok & ((SIDTABBITS)1 << nr)) &&
-					(chk_srvid_match_by_caid_prov(caid, provid, sidtab)))
-				{ rc = 1; }
+			if(chk_srvid_match_by_caid_prov(caid, provid, sidtab))
+				{ mask |= (SIDTABBITS)1 << nr; }
 		}
-	return (rc);
+		return mask;
+	}
+
+	mask = si->any_caid | sidtab_lookup(si, SIDTAB_CAID, caid);
+	if(mask)
+		{ mask &= si->any_provid | sidtab_lookup(si, SIDTAB_PROVID, provid); }
+	return mask;
+}
+
+int32_t chk_srvid(struct s_client *cl, ECM_REQUEST *er)
+{
+	struct s_sidtab_index tmp, *si;
+	SIDTABBITS match;
+
+	if(!cl->sidtabs.ok && !cl->sidtabs.no)
+		{ return (1); }
+
+	si = get_sidtab_index(&tmp);
+	match = sidtab_match_ecm(si, er) & si->used;
+	if(cl->sidtabs.no & match)
+		{ return (0); }
+	if(!cl->sidtabs.ok)
+		{ return (1); }
+	return (cl->sidtabs.ok & match) ? 1 : 0;
+}
+
+int32_t has_srvid(struct s_client *cl, ECM_REQUEST *er)
+{
+	struct s_sidtab_index tmp, *si;
+
+	if(!cl->sidtabs.ok)
+		{ return 0; }
+
+	si = get_sidtab_index(&tmp);
+	return (cl->sidtabs.ok & si->with_srvid & sidtab_match_ecm(si, er)) ? 1 : 0;
+}
+
+int32_t has_lb_srvid(struct s_client *cl, ECM_REQUEST *er)
+{
+	struct s_sidtab_index tmp, *si;
+
+	if(!cl->lb_sidtabs.ok)
+		{ return 0; }
+
+	si = get_sidtab_index(&tmp);
+	return (cl->lb_sidtabs.ok & sidtab_match_ecm(si, er)) ? 1 : 0;
+}
+
+static int32_t chk_sidtabs_by_caid_prov(SIDTABS *sidtabs, uint16_t caid, uint32_t provid)
+{
+	struct s_sidtab_index tmp, *si;
+	SIDTABBITS match;
+
+	if(!sidtabs->ok && !sidtabs->no)
+		{ return (1); }
+
+	si = get_sidtab_index(&tmp);
+	match = sidtab_match_caid_prov(si, caid, provid) & si->with_caid_prov;
+	// services with srvids can't be excluded by caid and provid alone
+	if(sidtabs->no & match & ~si->with_srvid)
+		{ return (0); }
+	if(!sidtabs->ok)
+		{ return (1); }
+	return (sidtabs->ok & match) ? 1 : 0;
+}
+
+int32_t chk_srvid_by_caid_prov(struct s_client *cl, uint16_t caid, uint32_t provid)
+{
+	return chk_sidtabs_by_caid_prov(&cl->sidtabs, caid, provid);
+}
+
+int32_t chk_srvid_by_caid_prov_rdr(struct s_reader *rdr, uint16_t caid, uint32_t provid)
+{
+	return chk_sidtabs_by_caid_prov(&rdr->sidtabs, caid, provid);
 }
 
 int32_t chk_is_betatunnel_caid(uint16_t caid)
@@ -53,6 +53,72 @@ struct s_auth *get_account_by_name(char *name)
 	return NULL;
 }
 
+static uint32_t account_index_hash(const char *usr)
+{
+	return crc32(0L, (const uint8_t *)usr, strlen(usr));
+}
+
+static int32_t account_index_grow(struct s_auth_index *idx)
+{
+	struct s_auth **slot;
+	uint32_t i, h, size = idx->slot ? (idx->mask + 1) * 2 : 64;
+
+	if(!cs_malloc(&slot, size * sizeof(struct s_auth *)))
+		{ return 0; }
+
+	for(i = 0; idx->slot && i <= idx->mask; i++)
+	{
+		if(!idx->slot[i])
+			{ continue; }
+		for(h = account_index_hash(idx->slot[i]->usr) & (size - 1); slot[h]; h = (h + 1) & (size - 1)) { ; }
+		slot[h] = idx->slot[i];
+	}
+	NULLFREE(idx->slot);
+	idx->slot = slot;
+	idx->mask = size - 1;
+	return 1;
+}
+
+// the first account added for a username wins, like a walk of the list would
+int32_t account_index_add(struct s_auth_index *idx, struct s_auth *account)
+{
+	uint32_t h;
+
+	if((!idx->slot || (idx->count + 1) * 2 > idx->mask + 1) && !account_index_grow(idx))
+		{ return 0; }
+
+	for(h = account_index_hash(account->usr) & idx->mask; idx->slot[h]; h = (h + 1) & idx->mask)
+	{
+		if(streq(idx->slot[h]->usr, account->usr))
+			{ return 0; }
+	}
+	idx->slot[h] = account;
+	idx->count++;
+	return 1;
+}
+
+struct s_auth *account_index_find(struct s_auth_index *idx, const char *usr)
+{
+	uint32_t h;
+
+	if(!idx->slot)
+		{ return NULL; }
+
+	for(h = account_index_hash(usr) & idx->mask; idx->slot[h]; h = (h + 1) & idx->mask)
+	{
+		if(streq(idx->slot[h]->usr, usr))
+			{ return idx->slot[h]; }
+	}
+	return NULL;
+}
+
+void account_index_free(struct s_auth_index *idx)
+{
+	NULLFREE(idx->slot);
+	idx->mask = 0;
+	idx->count = 0;
+}
+
 int8_t is_valid_client(struct s_client *client)
 {
 	struct s_client *cl;
@@ -503,87 +569,123 @@ void kill_all_clients(void)
 	NULLFREE(processUsername);
 }
 
-void cs_reinit_clients(struct s_auth *new_accounts)
+// applies the (new) settings of account to cl, kills cl if account is gone
+static void reinit_client(struct s_client *cl, struct s_auth *account)
 {
-	struct s_auth *account;
 	unsigned char md5tmp[MD5_DIGEST_LENGTH];
 	uint8_t i;
 	uint8_t j;
 
-	struct s_client *cl;
-	for(cl = first_client->next; cl; cl = cl->next)
+	if(account && !account->disabled && cl->pcrc == crc32(0L, MD5((uchar *)ESTR(account->pwd), strlen(ESTR(account->pwd)), md5tmp), MD5_DIGEST_LENGTH))
 	{
-		if((cl->typ == 'c' || cl->typ == 'm') && cl->account)
+		cl->account = account;
+		if(cl->typ == 'c')
 		{
-			for(account = new_accounts; (account) ; account = account->next)
+			cl->grp = account->grp;
+			cl->aureader_list   = account->aureader_list;
+			cl->autoau = account->autoau;
+			cl->expirationdate = account->expirationdate;
+			cl->allowedtimeframe_set=account->allowedtimeframe_set;
+			for(i=0;i<SIZE_SHORTDAY;i++)
 			{
-				if(!strcmp(cl->account->usr, account->usr))
-					{ break; }
+				for(j=0;j<24;j++)
+				{
+					cl->allowedtimeframe[i][j][0]=account->allowedtimeframe[i][j][0];
+					cl->allowedtimeframe[i][j][1]=account->allowedtimeframe[i][j][1];
+				}
 			}
-			if(account && !account->disabled && cl->pcrc == crc32(0L, MD5((uchar *)ESTR(account->pwd), strlen(ESTR(account->pwd)), md5tmp), MD5_DIGEST_LENGTH))
+			cl->ncd_keepalive = account->ncd_keepalive;
+			cl->c35_suppresscmd08 = account->c35_suppresscmd08;
+			cl->tosleep = (60 * account->tosleep);
+			cl->c35_sleepsend = account->c35_sleepsend;
+			cl->monlvl = account->monlvl;
+			cl->disabled    = account->disabled;
+			cl->cltab   = account->cltab;  // Class
+			// newcamd module doesn't like ident reloading
+			if(!cl->ncd_server)
 			{
-				cl->account = account;
-				if(cl->typ == 'c')
-				{
-					cl->grp = account->grp;
-					cl->aureader_list   = account->aureader_list;
-					cl->autoau = account->autoau;
-					cl->expirationdate = account->expirationdate;
-					cl->allowedtimeframe_set=account->allowedtimeframe_set;
-					for(i=0;i<SIZE_SHORTDAY;i++)
-					{
-						for(j=0;j<24;j++)
-						{
-							cl->allowedtimeframe[i][j][0]=account->allowedtimeframe[i][j][0];
-							cl->allowedtimeframe[i][j][1]=account->allowedtimeframe[i][j][1];
-						}
-					}
-					cl->ncd_keepalive = account->ncd_keepalive;
-					cl->c35_suppresscmd08 = account->c35_suppresscmd08;
-					cl->tosleep = (60 * account->tosleep);
-					cl->c35_sleepsend = account->c35_sleepsend;
-					cl->monlvl = account->monlvl;
-					cl->disabled    = account->disabled;
-					cl->cltab   = account->cltab;  // Class
-					// newcamd module doesn't like ident reloading
-					if(!cl->ncd_server)
-					{
-						ftab_clone(&account->ftab, &cl->ftab);   // IDENT filter
-						ftab_clone(&account->fchid, &cl->fchid);  // CHID filter
-					}
+				ftab_clone(&account->ftab, &cl->ftab);   // IDENT filter
+				ftab_clone(&account->fchid, &cl->fchid);  // CHID filter
+			}
 
-					cl->sidtabs.ok = account->sidtabs.ok;   // services
-					cl->sidtabs.no = account->sidtabs.no;   // services
-					cl->failban = account->failban;
+			cl->sidtabs.ok = account->sidtabs.ok;   // services
+			cl->sidtabs.no = account->sidtabs.no;   // services
+			cl->failban = account->failban;
 
-					caidtab_clone(&account->ctab, &cl->ctab);
+			caidtab_clone(&account->ctab, &cl->ctab);
 
-					tuntab_clone(&account->ttab, &cl->ttab);
+			tuntab_clone(&account->ttab, &cl->ttab);
 
-					webif_client_reset_lastresponsetime(cl);
-					if(account->uniq)
-						{ cs_fake_client(cl, account->usr, (account->uniq == 1 || account->uniq == 2) ? account->uniq + 2 : account->uniq, cl->ip); }
-					ac_init_client(cl, account);
-				}
-			}
-			else
-			{
-				if(get_module(cl)->type & MOD_CONN_NET)
-				{
-					cs_log_dbg(D_TRACE, "client '%s', thread=%8lX not found in db (or password changed)", cl->account->usr, (unsigned long)cl->thread);
-					kill_thread(cl);
-				}
-				else
-				{
-					cl->account = first_client->account;
-				}
-			}
+			webif_client_reset_lastresponsetime(cl);
+			if(account->uniq)
+				{ cs_fake_client(cl, account->usr, (account->uniq == 1 || account->uniq == 2) ? account->uniq + 2 : account->uniq, cl->ip); }
+			ac_init_client(cl, account);
+		}
+	}
+	else
+	{
+		if(get_module(cl)->type & MOD_CONN_NET)
+		{
+			cs_log_dbg(D_TRACE, "client '%s', thread=%8lX not found in db (or password changed)", cl->account->usr, (unsigned long)cl->thread);
+			kill_thread(cl);
+		}
+		else
+		{
+			cl->account = first_client->account;
+		}
+	}
+}
+
+static void reinit_clients(struct s_auth *new_accounts, int8_t changed_only)
+{
+	struct s_auth_index idx;
+	struct s_auth *account;
+	struct s_client *cl;
+
+	memset(&idx, 0, sizeof(idx));
+	for(account = new_accounts; account; account = account->next)
+		{ account_index_add(&idx, account); }
+
+	for(cl = first_client->next; cl; cl = cl->next)
+	{
+		if((cl->typ == 'c' || cl->typ == 'm') && cl->account)
+		{
+			account = account_index_find(&idx, cl->account->usr);
+			// same object means the account was kept unchanged
+			if(changed_only && account == cl->account)
+				{ continue; }
+			reinit_client(cl, account);
 		}
 		else
 		{
 			cl->account = NULL;
 		}
 	}
+	account_index_free(&idx);
+}
+
+void cs_reinit_clients(struct s_auth *new_accounts)
+{
+	reinit_clients(new_accounts, 0);
+}
+
+/* Only touches clients whose account is not part of new_accounts anymore,
+   that is accounts which were changed or removed. */
+void cs_reinit_changed_clients(struct s_auth *new_accounts)
+{
+	reinit_clients(new_accounts, 1);
+}
+
+/* Reapplies an account that was edited in place. */
+void cs_reinit_account_clients(struct s_auth *account)
+{
+	struct s_client *cl;
+
+	for(cl = first_client->next; cl; cl = cl->next)
+	{
+		if((cl->typ == 'c' || cl->typ == 'm') && cl->account == account)
+			{ reinit_client(cl, account); }
+	}
 }
 
 void client_check_status(struct s_client *cl)
@@ -698,6 +800,8 @@ void free_client(struct s_client *cl)
 	}
 	cs_writeunlock(__func__, &clientlist_lock);
 
+	// send the batched replies while the socket is still open
+	net_udp_flush(cl);
 	cleanup_ecmtasks(cl);
 
 	// Clean reader. The cleaned structures should be only used by the reader thread, so we should be save without waiting
@@ -760,10 +864,14 @@ void free_client(struct s_client *cl)
 	NULLFREE(cl->cw_rass);
 	ll_destroy_data(&cl->ra_buf);
 	NULLFREE(cl->aes_keys);
+	NULLFREE(cl->udp_batch);
 
 #ifdef MODULE_CCCAM
 	add_garbage(cl->cc);
 #endif
+#ifdef CS_CACHEEX
+	add_garbage(cl->cacheex_push_queue);
+#endif
 #ifdef MODULE_SERIAL
 	add_garbage(cl->serialdata);
 #endif
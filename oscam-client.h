@@ -6,8 +6,19 @@ static inline struct s_client *cur_client(void)
 {
 	return (struct s_client *)pthread_getspecific(getclient);
 }
+/* Open addressing table of accounts keyed by username. */
+struct s_auth_index
+{
+	struct s_auth   **slot;
+	uint32_t        mask;
+	uint32_t        count;
+};
+
 int32_t get_threadnum(struct s_client *client);
 struct s_auth *get_account_by_name(char *name);
+int32_t account_index_add(struct s_auth_index *idx, struct s_auth *account);
+struct s_auth *account_index_find(struct s_auth_index *idx, const char *usr);
+void account_index_free(struct s_auth_index *idx);
 int8_t is_valid_client(struct s_client *client);
 const char *remote_txt(void);
 const char *client_get_proto(struct s_client *cl);
@@ -17,6 +28,8 @@ struct s_client *create_client(IN_ADDR_T ip);
 int32_t cs_auth_client(struct s_client *client, struct s_auth *account, const char *e_txt);
 void cs_disconnect_client(struct s_client *client);
 void cs_reinit_clients(struct s_auth *new_accounts);
+void cs_reinit_changed_clients(struct s_auth *new_accounts);
+void cs_reinit_account_clients(struct s_auth *account);
 void kill_all_clients(void);
 void client_check_status(struct s_client *cl);
 void free_client(struct s_client *cl);
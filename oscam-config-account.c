@@ -9,11 +9,14 @@
 #include "oscam-conf-mk.h"
 #include "oscam-config.h"
 #include "oscam-garbage.h"
+#include "oscam-latency.h"
 #include "oscam-lock.h"
 #include "oscam-string.h"
 
 #define cs_user "oscam.user"
 
+extern uint32_t cfg_sidtab_generation;
+
 static void account_tosleep_fn(const char *token, char *value, void *setting, FILE *f)
 {
 	int32_t *tosleep = setting;
@@ -481,6 +484,7 @@ static const struct config_list account_opts[] =
 
 void chk_account(const char *token, char *value, struct s_auth *account)
 {
+	account->cfg_crc = 0;
 	if(config_list_parse(account_opts, token, value, account))
 		{ return; }
 	else if(token[0] != '#')
@@ -500,12 +504,15 @@ struct s_auth *init_userdb(void)
 
 	struct s_auth *authptr = NULL;
 	int32_t tag = 0, nr = 0, expired = 0, disabled = 0;
+	uint32_t crc = 0;
 	char *token;
 	struct s_auth *account = NULL;
-	struct s_auth *probe = NULL;
+	struct s_auth_index idx;
 	if(!cs_malloc(&token, MAXLINESIZE))
 		{ return NULL; }
 
+	memset(&idx, 0, sizeof(idx));
+
 	while(fgets(token, MAXLINESIZE, fp))
 	{
 		int32_t l;
@@ -526,6 +533,7 @@ struct s_auth *init_userdb(void)
 
 			account = ptr;
 			account_set_defaults(account);
+			crc = 0;
 			nr++;
 
 			continue;
@@ -540,21 +548,30 @@ struct s_auth *init_userdb(void)
 		*value++ = '\0';
 
 		// check for duplicate useraccounts and make the name unique
-		if(streq(trim(strtolower(token)), "user"))
+		int8_t is_user = streq(trim(strtolower(token)), "user");
+		trim(value);
+		if(is_user)
 		{
-			for(probe = authptr; probe; probe = probe->next)
+			while(account_index_find(&idx, value) && strlen(value) + 3 <= sizeof(account->usr))
 			{
-				if(!strcmp(probe->usr, trim(value)))
-				{
-					fprintf(stderr, "Warning: duplicate account '%s'\n", value);
-					strncat(value, "_x", sizeof(probe->usr) - strlen(value) - 1);
-				}
+				fprintf(stderr, "Warning: duplicate account '%s'\n", value);
+				strncat(value, "_x", sizeof(account->usr) - strlen(value) - 1);
 			}
 		}
-		chk_account(trim(strtolower(token)), trim(value), account);
+		// remember what the account was built from, cs_accounts_chk() keeps unchanged ones
+		crc = crc32(crc, (uint8_t *)token, strlen(token) + 1);
+		crc = crc32(crc, (uint8_t *)value, strlen(value) + 1);
+
+		chk_account(token, value, account);
+		account->cfg_crc = crc ? crc : 1;
+		account->readerdb_gen = cfg.readerdb_gen;
+		account->sidtab_gen = cfg_sidtab_generation;
+		if(is_user)
+			{ account_index_add(&idx, account); }
 	}
 	NULLFREE(token);
 	fclose(fp);
+	account_index_free(&idx);
 
 	for(account = authptr; account; account = account->next)
 	{
@@ -589,6 +606,7 @@ int32_t init_free_userdb(struct s_auth *ptr)
 #ifdef WITH_LB
 		caidvaluetab_clear(&ptr->lb_nbest_readers_tab);
 #endif
+		latency_free(&ptr->latency);
 		add_garbage(ptr);
 		ptr = ptr_next;
 	}
@@ -614,32 +632,85 @@ int32_t write_userdb(void)
 
 void cs_accounts_chk(void)
 {
-	struct s_auth *account1, *account2;
+	struct s_auth *account1, *account2, *next, *prev = NULL, *drop = NULL;
+	struct s_auth_index old_index, kept_index;
+	int32_t added = 0, changed = 0, removed = 0;
 	struct s_auth *new_accounts = init_userdb();
 	cs_writelock(__func__, &config_lock);
 	struct s_auth *old_accounts = cfg.account;
-	for(account1 = cfg.account; account1; account1 = account1->next)
+
+	memset(&old_index, 0, sizeof(old_index));
+	memset(&kept_index, 0, sizeof(kept_index));
+	for(account1 = old_accounts; account1; account1 = account1->next)
+		{ account_index_add(&old_index, account1); }
+
+	// diff by username: unchanged accounts keep their running object, changed ones inherit the stats
+	for(account2 = new_accounts; account2; account2 = account2->next)
 	{
-		for(account2 = new_accounts; account2; account2 = account2->next)
+		account1 = account_index_find(&old_index, account2->usr);
+		if(!account1)
 		{
-			if(!strcmp(account1->usr, account2->usr))
-			{
-				account2->cwfound    = account1->cwfound;
-				account2->cwcache    = account1->cwcache;
-				account2->cwnot      = account1->cwnot;
-				account2->cwtun      = account1->cwtun;
-				account2->cwignored  = account1->cwignored;
-				account2->cwtout     = account1->cwtout;
-				account2->emmok      = account1->emmok;
-				account2->emmnok     = account1->emmnok;
-				account2->firstlogin = account1->firstlogin;
-				ac_copy_vars(account1, account2);
-			}
+			added++;
+			continue;
+		}
+		// au and services point into the reader and sidtab lists, keep only if those were not reloaded since
+		if(account1->cfg_crc && account1->cfg_crc == account2->cfg_crc && account1->readerdb_gen == account2->readerdb_gen
+				&& account1->sidtab_gen == account2->sidtab_gen && account_index_add(&kept_index, account1))
+			{ continue; }
+
+		changed++;
+		account2->cwfound    = account1->cwfound;
+		account2->cwcache    = account1->cwcache;
+		account2->cwnot      = account1->cwnot;
+		account2->cwtun      = account1->cwtun;
+		account2->cwignored  = account1->cwignored;
+		account2->cwtout     = account1->cwtout;
+		account2->emmok      = account1->emmok;
+		account2->emmnok     = account1->emmnok;
+		account2->firstlogin = account1->firstlogin;
+		latency_move(&account2->latency, &account1->latency);
+		ac_copy_vars(account1, account2);
+	}
+
+	// old accounts that were not kept get freed
+	for(account1 = old_accounts; account1; account1 = next)
+	{
+		next = account1->next;
+		if(account_index_find(&kept_index, account1->usr) == account1)
+			{ continue; }
+		account1->next = drop;
+		drop = account1;
+	}
+
+	// swap the kept ones into the new list in place of their fresh copies
+	for(account2 = new_accounts; account2; account2 = next)
+	{
+		next = account2->next;
+		account1 = account_index_find(&kept_index, account2->usr);
+		if(account1)
+		{
+			account1->next = next;
+			account2->next = drop;
+			drop = account2;
+			account2 = account1;
 		}
+		if(prev)
+			{ prev->next = account2; }
+		else
+			{ new_accounts = account2; }
+		prev = account2;
 	}
-	cs_reinit_clients(new_accounts);
+
+	removed = old_index.count - kept_index.count - changed;
+	cs_log("userdb diff: %d added, %d changed, %d removed, %u unchanged", added, changed, removed, kept_index.count);
+
+	cs_reinit_changed_clients(new_accounts);
 	cfg.account = new_accounts;
-	init_free_userdb(old_accounts);
 	ac_clear();
 	cs_writeunlock(__func__, &config_lock);
+
+	// not reachable from cfg.account anymore, no need to hold the lock
+	init_free_userdb(drop);
+	account_index_free(&old_index);
+	account_index_free(&kept_index);
 }
@@ -544,6 +544,10 @@ static const struct config_list webif_opts[] =
 	DEF_OPT_STR("httplocale"		 , OFS(http_locale)			, NULL),
 	DEF_OPT_INT8("http_prepend_embedded_css" , OFS(http_prepend_embedded_css)	, 0),
 	DEF_OPT_INT32("httprefresh"		 , OFS(http_refresh)			, 0),
+	DEF_OPT_INT32("httpthreads"		 , OFS(http_threads)			, 8),
+	DEF_OPT_INT8("httpcompress"		 , OFS(http_compress)			, 1),
+	DEF_OPT_INT8("httpcompresslevel"	 , OFS(http_compress_level)		, 6),
+	DEF_OPT_INT32("httpcompressmin"		 , OFS(http_compress_min)		, 1024),
 	DEF_OPT_INT32("httppollrefresh"		 , OFS(poll_refresh)			, 60),
 	DEF_OPT_INT8("httphideidleclients"	 , OFS(http_hide_idle_clients)		, 1),
 	DEF_OPT_STR("httphidetype"		 , OFS(http_hide_type)			, NULL),
@@ -10,6 +10,7 @@
 #include "oscam-conf-mk.h"
 #include "oscam-config.h"
 #include "oscam-garbage.h"
+#include "oscam-latency.h"
 #include "oscam-lock.h"
 #include "oscam-reader.h"
 #include "oscam-string.h"
@@ -1047,6 +1048,7 @@ void reader_set_defaults(struct s_reader *rdr)
 int32_t init_readerdb(void)
 {
 	configured_readers = ll_create("configured_readers");
+	cfg.readerdb_gen++;
 
 	FILE *fp = open_config_file(cs_srvr);
 	if(!fp)
@@ -1126,6 +1128,7 @@ void free_reader(struct s_reader *rdr)
 	cecspvaluetab_clear(&rdr->cacheex.filter_caidtab);
 #endif
 	lb_destroy_stats(rdr);
+	latency_free(&rdr->latency);
 
 	cs_clear_entitlement(rdr);
 	ll_destroy(&rdr->ll_entitlements);
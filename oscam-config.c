@@ -10,6 +10,7 @@
 #include "oscam-files.h"
 #include "oscam-garbage.h"
 #include "oscam-lock.h"
+#include "oscam-rules.h"
 #include "oscam-string.h"
 #include "oscam-time.h"
 
@@ -27,6 +28,63 @@ extern uint16_t len4caid[256];
 
 uint32_t cfg_sidtab_generation = 1;
 
+// exact caid/provid/srvid key of oscam.ratelimit and oscam.twin entries
+#define RULE_KEY_CPS(caid, provid, srvid)   (((uint64_t)(caid) << 48) | ((uint64_t)(provid) << 16) | (srvid))
+// oscam.whitelist entries are keyed by caid and srvid, 0 is a wildcard in both
+#define RULE_KEY_CS(caid, srvid)            (((uint64_t)(caid) << 16) | (srvid))
+
+/* The compiled index of a rule list, replaced as a whole on reload. */
+struct s_rule_table
+{
+	void            **entry;
+	uint32_t        count;
+	struct s_rule_index idx;
+};
+
+static struct s_rule_table *ratelimit_rules;
+
+static void rule_table_free(struct s_rule_table *rules)
+{
+	if(!rules)
+		{ return; }
+	rule_index_free(&rules->idx);
+	add_garbage(rules->entry);
+	add_garbage(rules);
+}
+
+/* Compiles a linked rule list, next_fn steps through it and key_fn gives the key of an entry. */
+static struct s_rule_table *rule_table_compile(void *list, void *(*next_fn)(void *), uint64_t (*key_fn)(void *))
+{
+	struct s_rule_table *rules;
+	struct s_rule_key *keys;
+	void *entry;
+	uint32_t n = 0;
+
+	for(entry = list; entry; entry = next_fn(entry))
+		{ n++; }
+	if(!n || !cs_malloc(&rules, sizeof(struct s_rule_table)))
+		{ return NULL; }
+	if(!cs_malloc(&rules->entry, n * sizeof(void *)) || !cs_malloc(&keys, n * sizeof(struct s_rule_key)))
+	{
+		rule_table_free(rules);
+		return NULL;
+	}
+
+	for(entry = list; entry; entry = next_fn(entry), rules->count++)
+	{
+		rules->entry[rules->count] = entry;
+		keys[rules->count].key = key_fn(entry);
+		keys[rules->count].rule = rules->count;
+	}
+	if(!rule_index_build(&rules->idx, keys, n))
+	{
+		rule_table_free(rules);
+		rules = NULL;
+	}
+	NULLFREE(keys);
+	return rules;
+}
+
 extern char cs_confdir[];
 
 char *get_config_filename(char *dest, size_t destlen, const char *filename)
@@ -390,6 +448,8 @@ int32_t init_provid(void)
 		}		
 	}
 	
+	provid_index_build(new_cfg_provid);
+
 	cs_writelock(__func__, &config_lock);
 	
 	//this allows reloading of provids, so cleanup of old data is needed:
@@ -691,6 +751,8 @@ int32_t init_srvid(void)
 		}
 	}
 
+	srvid_index_build(new_cfg_srvid);
+
 	cs_writelock(__func__, &config_lock);
 	//this allows reloading of srvids, so cleanup of old data is needed:
 	memcpy(last_srvid, cfg.srvid, sizeof(last_srvid));  //old data
@@ -957,40 +1019,61 @@ static struct s_rlimit *ratelimit_read_int(void)
 	return new_rlimit;
 }
 
-void ratelimit_read(void)
+static void *ratelimit_next(void *entry)
+{
+	return ((struct s_rlimit *)entry)->next;
+}
+
+static uint64_t ratelimit_key(void *entry)
 {
+	struct ecmrl *rl = &((struct s_rlimit *)entry)->rl;
+	return RULE_KEY_CPS(rl->caid, rl->provid, rl->srvid);
+}
 
-	struct s_rlimit *entry, *old_list;
+void ratelimit_set(struct s_rlimit *list)
+{
+	struct s_rule_table *old_rules = ratelimit_rules;
+	struct s_rlimit *entry, *old_list = cfg.ratelimit_list;
 
-	old_list = cfg.ratelimit_list;
-	cfg.ratelimit_list = ratelimit_read_int();
+	ratelimit_rules = rule_table_compile(list, ratelimit_next, ratelimit_key);
+	cfg.ratelimit_list = list;
 
+	rule_table_free(old_rules);
 	while(old_list)
 	{
 		entry = old_list->next;
-		NULLFREE(old_list);
+		add_garbage(old_list);
 		old_list = entry;
 	}
 }
 
+void ratelimit_read(void)
+{
+	ratelimit_set(ratelimit_read_int());
+}
+
 struct ecmrl get_ratelimit(ECM_REQUEST *er)
 {
+	struct s_rule_table *rules = ratelimit_rules;
+	struct s_rlimit *entry;
+	const uint32_t *rule;
+	uint32_t i, count;
 
 	struct ecmrl tmp;
 	memset(&tmp, 0, sizeof(tmp));
-	if(!cfg.ratelimit_list) { return tmp; }
-	struct s_rlimit *entry = cfg.ratelimit_list;
-	while(entry)
+	if(!rules) { return tmp; }
+
+	rule = rule_index_find(&rules->idx, RULE_KEY_CPS(er->caid, er->prid, er->srvid), &count);
+	for(i = 0; i < count; i++)
 	{
-		if(entry->rl.caid == er->caid && entry->rl.provid == er->prid && entry->rl.srvid == er->srvid && (!entry->rl.chid || entry->rl.chid == er->chid))
+		entry = rules->entry[rule[i]];
+		if(!entry->rl.chid || entry->rl.chid == er->chid)
 		{
+			tmp = entry->rl;
 			break;
 		}
-		entry = entry->next;
 	}
 
-	if(entry) { tmp = entry->rl; }
-
 	return (tmp);
 }
 
@@ -1004,7 +1087,7 @@ int32_t init_tierid(void)
 	char *payload, *saveptr1 = NULL, *token;
 	if(!cs_malloc(&token, MAXLINESIZE))
 		{ return 0; }
-	static struct s_tierid *tierid = NULL, *new_cfg_tierid = NULL;
+	struct s_tierid *tierid = NULL, *new_cfg_tierid = NULL;
 
 	nr = 0;
 	while(fgets(token, MAXLINESIZE, fp))
@@ -1056,6 +1139,7 @@ int32_t init_tierid(void)
 	fclose(fp);
 	if(nr > 0)
 		{ cs_log("%d tier-id's loaded", nr); }
+	tierid_index_build(new_cfg_tierid);
 	cs_writelock(__func__, &config_lock);
 	//reload function:
 	tierid = cfg.tierid;
@@ -1064,7 +1148,7 @@ int32_t init_tierid(void)
 	while(tierid)
 	{
 		ptr = tierid->next;
-		NULLFREE(tierid);
+		add_garbage(tierid);
 		tierid = ptr;
 	}
 	cs_writeunlock(__func__, &config_lock);
@@ -1082,66 +1166,130 @@ int32_t match_whitelist(ECM_REQUEST *er, struct s_global_whitelist *entry)
 			&& (!entry->ecmlen || entry->ecmlen == er->ecmlen));
 }
 
+struct s_whitelist_rules
+{
+	struct s_global_whitelist **entry;
+	struct s_rule_index map;    // 'm' entries
+	struct s_rule_index len;    // 'l' entries
+	struct s_rule_index all;
+};
+
+static struct s_whitelist_rules *whitelist_rules;
+
+static void global_whitelist_free_rules(struct s_whitelist_rules *rules)
+{
+	if(!rules)
+		{ return; }
+	rule_index_free(&rules->map);
+	rule_index_free(&rules->len);
+	rule_index_free(&rules->all);
+	add_garbage(rules->entry);
+	add_garbage(rules);
+}
+
+static struct s_whitelist_rules *global_whitelist_compile(struct s_global_whitelist *list)
+{
+	struct s_whitelist_rules *rules;
+	struct s_global_whitelist *entry;
+	struct s_rule_key *keys;
+	uint32_t i, n = 0, nm = 0, nl = 0;
+	int32_t ok;
+
+	for(entry = list; entry; entry = entry->next)
+		{ n++; }
+	if(!n || !cs_malloc(&rules, sizeof(struct s_whitelist_rules)))
+		{ return NULL; }
+	if(!cs_malloc(&rules->entry, n * sizeof(struct s_global_whitelist *)) || !cs_malloc(&keys, 3 * n * sizeof(struct s_rule_key)))
+	{
+		global_whitelist_free_rules(rules);
+		return NULL;
+	}
+
+	// keys: all entries, then the 'm' ones, then the 'l' ones
+	for(i = 0, entry = list; entry; entry = entry->next, i++)
+	{
+		rules->entry[i] = entry;
+		keys[i].key = RULE_KEY_CS(entry->caid, entry->srvid);
+		keys[i].rule = i;
+		if(entry->type == 'm')
+			{ keys[n + nm++] = keys[i]; }
+		else if(entry->type == 'l')
+			{ keys[2 * n + nl++] = keys[i]; }
+	}
+	ok = rule_index_build(&rules->all, keys, n)
+		 && rule_index_build(&rules->map, keys + n, nm)
+		 && rule_index_build(&rules->len, keys + 2 * n, nl);
+	NULLFREE(keys);
+	if(!ok)
+	{
+		global_whitelist_free_rules(rules);
+		return NULL;
+	}
+	return rules;
+}
+
+static void global_whitelist_iter(struct s_rule_iter *it, struct s_rule_index *idx, ECM_REQUEST *er)
+{
+	rule_iter_init(it);
+	rule_iter_add(it, idx, RULE_KEY_CS(er->caid, er->srvid));
+	rule_iter_add(it, idx, RULE_KEY_CS(er->caid, 0));
+	rule_iter_add(it, idx, RULE_KEY_CS(0, er->srvid));
+	rule_iter_add(it, idx, RULE_KEY_CS(0, 0));
+}
+
 int32_t chk_global_whitelist(ECM_REQUEST *er, uint32_t *line)
 {
 	*line = -1;
-	if(!cfg.global_whitelist)
+	struct s_whitelist_rules *rules = whitelist_rules;
+	if(!rules)
 		{ return 1; }
 
 	struct s_global_whitelist *entry;
+	struct s_rule_iter it;
+	uint32_t n;
 
 	//check mapping:
-	if(cfg.global_whitelist_use_m)
+	global_whitelist_iter(&it, &rules->map, er);
+	while(rule_iter_next(&it, &n))
 	{
-		entry = cfg.global_whitelist;
-		while(entry)
+		entry = rules->entry[n];
+		if(match_whitelist(er, entry))
 		{
-			if(entry->type == 'm')
-			{
-				if(match_whitelist(er, entry))
-				{
-					er->caid = entry->mapcaid;
-					er->prid = entry->mapprovid;
-					cs_log_dbg(D_TRACE, "whitelist: mapped %04X@%06X to %04X@%06X", er->caid, er->prid, entry->mapcaid, entry->mapprovid);
-					break;
-				}
-			}
-			entry = entry->next;
+			er->caid = entry->mapcaid;
+			er->prid = entry->mapprovid;
+			cs_log_dbg(D_TRACE, "whitelist: mapped %04X@%06X to %04X@%06X", er->caid, er->prid, entry->mapcaid, entry->mapprovid);
+			break;
 		}
 	}
 
-	if(cfg.global_whitelist_use_l)    //Check caid/prov/srvid etc matching, except ecm-len:
+	//Check caid/prov/srvid etc matching, except ecm-len:
+	int8_t caidprov_matches = 0;
+	global_whitelist_iter(&it, &rules->len, er);
+	while(rule_iter_next(&it, &n))
 	{
-		entry = cfg.global_whitelist;
-		int8_t caidprov_matches = 0;
-		while(entry)
+		entry = rules->entry[n];
+		if(match_whitelist(er, entry))
 		{
-			if(entry->type == 'l')
-			{
-				if(match_whitelist(er, entry))
-				{
-					*line = entry->line;
-					return 1;
-				}
-				if((!entry->caid || entry->caid == er->caid)
-						&& (!entry->provid || entry->provid == er->prid)
-						&& (!entry->srvid || entry->srvid == er->srvid)
-						&& (!entry->chid || entry->chid == er->chid)
-						&& (!entry->pid || entry->pid == er->pid))
-				{
-					caidprov_matches = 1;
-					*line = entry->line;
-				}
-			}
-			entry = entry->next;
+			*line = entry->line;
+			return 1;
+		}
+		if((!entry->caid || entry->caid == er->caid)
+				&& (!entry->provid || entry->provid == er->prid)
+				&& (!entry->srvid || entry->srvid == er->srvid)
+				&& (!entry->chid || entry->chid == er->chid)
+				&& (!entry->pid || entry->pid == er->pid))
+		{
+			caidprov_matches = 1;
+			*line = entry->line;
 		}
-		if(caidprov_matches)  //...but not ecm-len!
-			{ return 0; }
 	}
+	if(caidprov_matches)  //...but not ecm-len!
+		{ return 0; }
 
-	entry = cfg.global_whitelist;
-	while(entry)
+	global_whitelist_iter(&it, &rules->all, er);
+	while(rule_iter_next(&it, &n))
 	{
+		entry = rules->entry[n];
 		if(match_whitelist(er, entry))
 		{
 			*line = entry->line;
@@ -1150,7 +1298,6 @@ int32_t chk_global_whitelist(ECM_REQUEST *er, uint32_t *line)
 			else if(entry->type == 'i')
 				{ return 0; }
 		}
-		entry = entry->next;
 	}
 	return 0;
 }
@@ -1178,9 +1325,6 @@ static struct s_global_whitelist *global_whitelist_read_int(void)
 	struct s_global_whitelist *new_whitelist = NULL, *entry, *last = NULL;
 	uint32_t line = 0;
 
-	cfg.global_whitelist_use_l = 0;
-	cfg.global_whitelist_use_m = 0;
-
 	while(fgets(token, sizeof(token), fp))
 	{
 		line++;
@@ -1226,7 +1370,6 @@ static struct s_global_whitelist *global_whitelist_read_int(void)
 				continue;
 			}
 			str1[0] = 0;
-			cfg.global_whitelist_use_m = 1;
 		}
 		strncat(str1, ",", sizeof(str1) - strlen(str1) - 1);
 		char *p = str1, *p2 = str1;
@@ -1255,8 +1398,6 @@ static struct s_global_whitelist *global_whitelist_read_int(void)
 				entry->ecmlen = ecmlen;
 				entry->mapcaid = mapcaid;
 				entry->mapprovid = mapprovid;
-				if(entry->type == 'l')
-					{ cfg.global_whitelist_use_l = 1; }
 
 				if(type == 'm')
 					cs_log_dbg(D_TRACE,
@@ -1290,22 +1431,28 @@ static struct s_global_whitelist *global_whitelist_read_int(void)
 	return new_whitelist;
 }
 
-void global_whitelist_read(void)
+void global_whitelist_set(struct s_global_whitelist *list)
 {
+	struct s_whitelist_rules *old_rules = whitelist_rules;
+	struct s_global_whitelist *entry, *old_list = cfg.global_whitelist;
 
-	struct s_global_whitelist *entry, *old_list;
-
-	old_list = cfg.global_whitelist;
-	cfg.global_whitelist = global_whitelist_read_int();
+	whitelist_rules = global_whitelist_compile(list);
+	cfg.global_whitelist = list;
 
+	global_whitelist_free_rules(old_rules);
 	while(old_list)
 	{
 		entry = old_list->next;
-		NULLFREE(old_list);
+		add_garbage(old_list);
 		old_list = entry;
 	}
 }
 
+void global_whitelist_read(void)
+{
+	global_whitelist_set(global_whitelist_read_int());
+}
+
 void init_len4caid(void)
 {
 	FILE *fp = open_config_file(cs_l4ca);
@@ -1427,42 +1574,54 @@ static struct s_twin *twin_read_int(void)
 	return new_twin;
 }
 
-void twin_read(void)
+static struct s_rule_table *twin_rules;
+
+static void *twin_next(void *entry)
 {
+	return ((struct s_twin *)entry)->next;
+}
+
+static uint64_t twin_key(void *entry)
+{
+	struct ecmtw *tw = &((struct s_twin *)entry)->tw;
+	return RULE_KEY_CPS(tw->caid, tw->provid, tw->srvid);
+}
 
-	struct s_twin *entry, *old_list;
+void twin_read(void)
+{
+	struct s_rule_table *old_rules = twin_rules;
+	struct s_twin *entry, *old_list = cfg.twin_list;
+	struct s_twin *list = twin_read_int();
 
-	old_list = cfg.twin_list;
-	cfg.twin_list = twin_read_int();
+	twin_rules = rule_table_compile(list, twin_next, twin_key);
+	cfg.twin_list = list;
 
+	rule_table_free(old_rules);
 	while(old_list)
 	{
 		entry = old_list->next;
-		free(old_list);
+		add_garbage(old_list);
 		old_list = entry;
 	}
 }
 
 struct ecmtw get_twin(ECM_REQUEST *er)
 {
+	struct s_rule_table *rules = twin_rules;
+	const uint32_t *rule;
+	uint32_t count;
+
 	struct ecmtw tmp;
 	memset(&tmp, 0, sizeof(tmp));
-	if(!cfg.twin_list)
+	if(!rules)
 	{
 		cs_log("twin_list not found!");
 		return tmp;
 	}
-	struct s_twin *entry = cfg.twin_list;
-	while(entry)
-	{
-		if(entry->tw.caid == er->caid && entry->tw.provid == er->prid && entry->tw.srvid == er->srvid)
-		{
-			break;
-		}
-		entry = entry->next;
-	}
 
-	if(entry) { tmp = entry->tw; }
+	// the first entry for caid/provid/srvid wins
+	rule = rule_index_find(&rules->idx, RULE_KEY_CPS(er->caid, er->prid, er->srvid), &count);
+	if(count) { tmp = ((struct s_twin *)rules->entry[rule[0]])->tw; }
 
 	return (tmp);
 }
@@ -29,9 +29,12 @@ void    init_free_sidtab(void);
 void    free_sidtab(struct s_sidtab *sidtab);
 int32_t write_services(void);
 
+int32_t match_whitelist(ECM_REQUEST *er, struct s_global_whitelist *entry);
 int32_t chk_global_whitelist(ECM_REQUEST *er, uint32_t *line);
+void    global_whitelist_set(struct s_global_whitelist *list);
 void    global_whitelist_read(void);
 struct ecmrl get_ratelimit(ECM_REQUEST *er); // get ratelimits for ecm request (if available)
+void ratelimit_set(struct s_rlimit *list);
 void ratelimit_read(void);
 int32_t init_provid(void);
 int32_t init_srvid(void);
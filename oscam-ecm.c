@@ -17,6 +17,7 @@
 #include "oscam-ecm.h"
 #include "oscam-garbage.h"
 #include "oscam-failban.h"
+#include "oscam-latency.h"
 #include "oscam-net.h"
 #include "oscam-time.h"
 #include "oscam-lock.h"
@@ -815,6 +816,17 @@ int32_t send_dcw(struct s_client *client, ECM_REQUEST *er)
 
 	client->cwlastresptime = comp_timeb(&tpe, &er->tps);
 
+	if(er->rc <= E_TIMEOUT)
+	{
+		if(er->rc >= E_CACHE1 && er->rc <= E_CACHEEX)
+		{
+			latency_add(client->account ? &client->account->latency : NULL, LATENCY_CACHE, client->cwlastresptime);
+			latency_add_caid(er->caid, LATENCY_CACHE, client->cwlastresptime);
+		}
+		latency_add(client->account ? &client->account->latency : NULL, LATENCY_TOTAL, client->cwlastresptime);
+		latency_add_caid(er->caid, LATENCY_TOTAL, client->cwlastresptime);
+	}
+
 	time_t now = time(NULL);
 	webif_client_add_lastresponsetime(client, client->cwlastresptime, now, er->rc); // add to ringbuffer
 
@@ -1701,6 +1713,12 @@ int32_t write_ecm_answer(struct s_reader *reader, ECM_REQUEST *er, int8_t rc, ui
 		//readers stats for LB
 		send_reader_stat(reader, er, ea, ea->rc);
 
+		if(ea->rc <= E_TIMEOUT)
+		{
+			latency_add(&reader->latency, LATENCY_READER, ea->ecm_time);
+			latency_add_caid(er->caid, LATENCY_READER, ea->ecm_time);
+		}
+
 		//reader checks
 		char ecmd5[17 * 3];
 		cs_hexdump(0, er->ecmd5, 16, ecmd5, sizeof(ecmd5));
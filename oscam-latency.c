@@ -0,0 +1,243 @@
+#define MODULE_LOG_PREFIX "latency"
+
+#include "globals.h"
+#include "oscam-client.h"
+#include "oscam-garbage.h"
+#include "oscam-latency.h"
+#include "oscam-string.h"
+
+/*
+ * Log-linear (HDR style) ECM latency histograms in ms.
+ * Values below LATENCY_SUB are counted exactly, above that every power of two
+ * is split into LATENCY_SUB linear buckets, so the error stays below 12.5%.
+ * 128 buckets cover 0..262143 ms.
+ *
+ * Every histogram has LATENCY_SHARDS rows of counters. A thread always counts
+ * into the row picked by its client, so threads rarely share a cache line and
+ * no lock is needed. The rows are merged when a summary is read.
+ */
+
+#define LATENCY_SUB_BITS    3
+#define LATENCY_SUB         (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS     128
+#define LATENCY_MAX         ((1 << (LATENCY_BUCKETS / LATENCY_SUB + LATENCY_SUB_BITS - 1)) - 1)
+#define LATENCY_SHARDS      4
+
+#define LATENCY_MAX_CAIDS   256
+
+struct s_latency_hist
+{
+	uint32_t        bucket[LATENCY_SHARDS][LATENCY_BUCKETS];
+};
+
+struct s_latency_caid
+{
+	uint16_t        caid;
+	int8_t          used;
+	struct s_latency lat;
+};
+
+static struct s_latency_caid latency_caids[LATENCY_MAX_CAIDS];
+static struct s_latency_caid *latency_caid_list[LATENCY_MAX_CAIDS];
+static int32_t latency_caid_count;
+static pthread_mutex_t latency_caid_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int32_t latency_bucket(uint32_t v)
+{
+	int32_t e = LATENCY_SUB_BITS;
+
+	if(v < LATENCY_SUB)
+		{ return v; }
+	if(v > LATENCY_MAX)
+		{ v = LATENCY_MAX; }
+
+	while(v >> (e + 1))
+		{ e++; }
+
+	return LATENCY_SUB + (e - LATENCY_SUB_BITS) * LATENCY_SUB + ((v >> (e - LATENCY_SUB_BITS)) & (LATENCY_SUB - 1));
+}
+
+// highest value counted in bucket b
+static uint32_t latency_bucket_value(int32_t b)
+{
+	int32_t shift;
+
+	if(b < LATENCY_SUB)
+		{ return b; }
+
+	shift = (b - LATENCY_SUB) / LATENCY_SUB;
+	return ((uint32_t)(LATENCY_SUB + (b & (LATENCY_SUB - 1))) << shift) + (1 << shift) - 1;
+}
+
+static int32_t latency_shard(void)
+{
+	uintptr_t p = (uintptr_t)cur_client();
+	return ((p >> 6) ^ (p >> 12)) & (LATENCY_SHARDS - 1);
+}
+
+static struct s_latency_hist *latency_hist(struct s_latency *lat, int8_t kind)
+{
+	struct s_latency_hist *hist = lat->hist[kind];
+
+	if(hist)
+		{ return hist; }
+
+	if(!cs_malloc(&hist, sizeof(struct s_latency_hist)))
+		{ return NULL; }
+
+	// another thread may have been faster
+	if(!__sync_bool_compare_and_swap(&lat->hist[kind], NULL, hist))
+	{
+		NULLFREE(hist);
+		hist = lat->hist[kind];
+	}
+	return hist;
+}
+
+void latency_add(struct s_latency *lat, int8_t kind, int32_t ms)
+{
+	struct s_latency_hist *hist;
+
+	if(!lat || kind < 0 || kind >= LATENCY_KINDS)
+		{ return; }
+
+	if(!(hist = latency_hist(lat, kind)))
+		{ return; }
+
+	__sync_fetch_and_add(&hist->bucket[latency_shard()][latency_bucket(ms < 0 ? 0 : ms)], 1);
+}
+
+static struct s_latency *latency_find_caid(uint16_t caid, int8_t add)
+{
+	uint32_t i, n, h = (caid * 2654435761U) >> 24;
+	struct s_latency *lat = NULL;
+
+	for(n = 0; n < LATENCY_MAX_CAIDS; n++)
+	{
+		i = (h + n) & (LATENCY_MAX_CAIDS - 1);
+		if(!latency_caids[i].used)
+			{ break; }
+		__sync_synchronize();
+		if(latency_caids[i].caid == caid)
+			{ return &latency_caids[i].lat; }
+	}
+
+	if(!add || n == LATENCY_MAX_CAIDS)
+		{ return NULL; }
+
+	SAFE_MUTEX_LOCK(&latency_caid_lock);
+	for(; n < LATENCY_MAX_CAIDS; n++)
+	{
+		i = (h + n) & (LATENCY_MAX_CAIDS - 1);
+		if(latency_caids[i].used)
+		{
+			if(latency_caids[i].caid == caid)
+			{
+				lat = &latency_caids[i].lat;
+				break;
+			}
+			continue;
+		}
+		latency_caids[i].caid = caid;
+		__sync_synchronize();
+		latency_caids[i].used = 1;
+		latency_caid_list[latency_caid_count] = &latency_caids[i];
+		__sync_synchronize();
+		latency_caid_count++;
+		lat = &latency_caids[i].lat;
+		break;
+	}
+	SAFE_MUTEX_UNLOCK(&latency_caid_lock);
+	return lat;
+}
+
+void latency_add_caid(uint16_t caid, int8_t kind, int32_t ms)
+{
+	latency_add(latency_find_caid(caid, 1), kind, ms);
+}
+
+struct s_latency *latency_get_caid(int32_t idx, uint16_t *caid)
+{
+	if(idx < 0 || idx >= latency_caid_count)
+		{ return NULL; }
+
+	__sync_synchronize();
+	if(caid)
+		{ *caid = latency_caid_list[idx]->caid; }
+	return &latency_caid_list[idx]->lat;
+}
+
+uint32_t latency_get_summary(struct s_latency *lat, int8_t kind, struct s_latency_summary *sum)
+{
+	struct s_latency_hist *hist;
+	uint32_t merged[LATENCY_BUCKETS];
+	uint32_t count = 0, seen = 0;
+	int32_t b, s, q = 0;
+	static const uint32_t permille[4] = { 500, 900, 990, 999 };
+	uint32_t *result[4] = { &sum->p50, &sum->p90, &sum->p99, &sum->p999 };
+
+	memset(sum, 0, sizeof(struct s_latency_summary));
+	if(!lat || kind < 0 || kind >= LATENCY_KINDS || !(hist = lat->hist[kind]))
+		{ return 0; }
+
+	for(b = 0; b < LATENCY_BUCKETS; b++)
+	{
+		merged[b] = 0;
+		for(s = 0; s < LATENCY_SHARDS; s++)
+			{ merged[b] += hist->bucket[s][b]; }
+		count += merged[b];
+	}
+	if(!count)
+		{ return 0; }
+
+	for(b = 0; b < LATENCY_BUCKETS && q < 4; b++)
+	{
+		seen += merged[b];
+		// smallest bucket holding at least permille of all samples
+		while(q < 4 && (uint64_t)seen * 1000 >= (uint64_t)count * permille[q])
+		{
+			*result[q] = latency_bucket_value(b);
+			q++;
+		}
+	}
+	sum->count = count;
+	return count;
+}
+
+void latency_move(struct s_latency *dst, struct s_latency *src)
+{
+	int8_t kind;
+	for(kind = 0; kind < LATENCY_KINDS; kind++)
+	{
+		if(dst->hist[kind])
+			{ add_garbage(dst->hist[kind]); }
+		dst->hist[kind] = src->hist[kind];
+		src->hist[kind] = NULL;
+	}
+}
+
+void latency_clear(struct s_latency *lat)
+{
+	int8_t kind;
+	for(kind = 0; kind < LATENCY_KINDS; kind++)
+	{
+		if(lat->hist[kind])
+			{ memset(lat->hist[kind], 0, sizeof(struct s_latency_hist)); }
+	}
+}
+
+void latency_free(struct s_latency *lat)
+{
+	int8_t kind;
+	for(kind = 0; kind < LATENCY_KINDS; kind++)
+	{
+		add_garbage(lat->hist[kind]);
+		lat->hist[kind] = NULL;
+	}
+}
+
+const char *latency_kind_txt(int8_t kind)
+{
+	static const char *txt[LATENCY_KINDS] = { "cache", "reader", "total" };
+	return (kind >= 0 && kind < LATENCY_KINDS) ? txt[kind] : "unknown";
+}
@@ -0,0 +1,22 @@
+#ifndef OSCAM_LATENCY_H_
+#define OSCAM_LATENCY_H_
+
+struct s_latency_summary
+{
+	uint32_t        count;
+	uint32_t        p50;
+	uint32_t        p90;
+	uint32_t        p99;
+	uint32_t        p999;
+};
+
+void latency_add(struct s_latency *lat, int8_t kind, int32_t ms);
+void latency_add_caid(uint16_t caid, int8_t kind, int32_t ms);
+uint32_t latency_get_summary(struct s_latency *lat, int8_t kind, struct s_latency_summary *sum);
+struct s_latency *latency_get_caid(int32_t idx, uint16_t *caid);
+void latency_move(struct s_latency *dst, struct s_latency *src);
+void latency_clear(struct s_latency *lat);
+void latency_free(struct s_latency *lat);
+const char *latency_kind_txt(int8_t kind);
+
+#endif
@@ -3,7 +3,6 @@
 #include "module-anticasc.h"
 #include "module-monitor.h"
 #include "oscam-client.h"
-#include "oscam-garbage.h"
 #include "oscam-lock.h"
 #include "oscam-log.h"
 #include "oscam-net.h"
@@ -24,6 +23,7 @@ static FILE *fps;
 static LLIST *log_list;
 static bool log_running;
 static int log_list_queued;
+static uint32_t log_list_dropped;
 static pthread_t log_thread;
 static pthread_cond_t log_thread_sleep_cond;
 static pthread_mutex_t log_thread_sleep_cond_mutex;
@@ -174,11 +174,22 @@ static void log_list_add(struct s_log *log)
 	{
 		NULLFREE(log->txt);
 		NULLFREE(log);
+		__sync_fetch_and_add(&log_list_dropped, 1);
 		cs_write_log("-------------> Too much data in log_list, dropping log message.\n", 1, 0, 0);
 	}
 	SAFE_COND_SIGNAL_NOLOG(&log_thread_sleep_cond);
 }
 
+int32_t cs_log_backlog(void)
+{
+	return ll_count(log_list);
+}
+
+uint32_t cs_log_dropped(void)
+{
+	return log_list_dropped;
+}
+
 static void cs_write_log_int(char *txt)
 {
 	if(exit_oscam == 1)
@@ -239,8 +250,13 @@ int32_t cs_open_logfiles(void)
 
 #if defined(WEBIF) || defined(MODULE_MONITOR)
 
-static uint64_t counter = 0;
-LLIST *log_history = NULL;
+/* The log history is a ring of cfg.loghistorylines lines. The line with counter c
+   is kept in log_history[c % log_history_size], so a reader can start right at the
+   first line it has not seen yet. */
+static struct s_log_history *log_history;
+static uint32_t log_history_size;
+static uint64_t log_history_next = 1;              // counter of the next line
+static CS_MUTEX_LOCK log_history_lock;
 
 /*
  This function allows to reinit the in-memory loghistory with a new size.
@@ -252,6 +268,88 @@ void cs_reinit_loghist(uint32_t size)
 		cfg.loghistorylines = size;
 	}
 }
+
+static void log_history_free_line(struct s_log_history *hist)
+{
+	NULLFREE(hist->txt);
+	NULLFREE(hist->json);
+	hist->counter = 0;
+}
+
+// must be called with log_history_lock held for writing
+static void log_history_resize(uint32_t size)
+{
+	struct s_log_history *new_history = NULL;
+	uint64_t c;
+	uint32_t i;
+
+	if(size && !cs_malloc(&new_history, size * sizeof(struct s_log_history)))
+		{ return; }
+
+	for(i = 0; i < log_history_size; i++)
+	{
+		c = log_history[i].counter;
+		if(c && c + size >= log_history_next)
+			{ new_history[c % size] = log_history[i]; }
+		else
+			{ log_history_free_line(&log_history[i]); }
+	}
+	NULLFREE(log_history);
+	log_history = new_history;
+	log_history_size = size;
+}
+
+static void log_history_add(const char *usr, const char *txt)
+{
+	struct s_log_history *hist;
+	int32_t len;
+
+	if(!log_history_lock.name)
+		{ return; }
+
+	cs_writelock(__func__, &log_history_lock);
+	if(log_history_size != cfg.loghistorylines)
+		{ log_history_resize(cfg.loghistorylines); }
+	if(log_history_size)
+	{
+		hist = &log_history[log_history_next % log_history_size];
+		log_history_free_line(hist);
+		len = strlen(usr) + strlen(txt) + 2;
+		if(cs_malloc(&hist->txt, len))
+		{
+			snprintf(hist->txt, len, "%s\t%s", usr, txt);
+			hist->counter = log_history_next++;
+		}
+	}
+	cs_writeunlock(__func__, &log_history_lock);
+}
+
+/* Calls fn for every line in the history with a counter above lastid, oldest first.
+   The lines can't change while fn runs, fn may only fill in hist->json. New lines
+   wait for fn, so it must not block (e.g. on network sends). */
+void cs_log_history(uint64_t lastid, void (*fn)(struct s_log_history *hist, void *arg), void *arg)
+{
+	struct s_log_history *hist;
+	uint64_t c;
+
+	if(!log_history_lock.name)
+		{ return; }
+
+	cs_readlock(__func__, &log_history_lock);
+	if(log_history_size)
+	{
+		c = log_history_next > log_history_size ? log_history_next - log_history_size : 1;
+		if(c <= lastid)
+			{ c = lastid + 1; }
+		for(; c < log_history_next; c++)
+		{
+			hist = &log_history[c % log_history_size];
+			if(hist->counter == c)
+				{ fn(hist, arg); }
+		}
+	}
+	cs_readunlock(__func__, &log_history_lock);
+}
 #endif
 
 static struct timeb log_ts;
@@ -375,38 +473,8 @@ static void write_to_log(char *txt, struct s_log *log, int8_t do_flush)
 	cs_write_log(txt, do_flush, log->header_date_offset, log->header_time_offset);
 
 #if defined(WEBIF) || defined(MODULE_MONITOR)
-	if(!exit_oscam && cfg.loghistorylines && log_history)
-	{
-		struct s_log_history *hist;
-		
-		while((uint32_t)ll_count(log_history) >= cfg.loghistorylines)
-		{
-			hist = ll_remove_first(log_history);
-			if(hist)
-			{
-				add_garbage(hist->txt);
-				add_garbage(hist);
-				hist = NULL;
-			}
-		}
-		
-		if(cs_malloc(&hist, sizeof(struct s_log_history)))
-		{
-			int32_t target_len = strlen(log->cl_text) + strlen(txt+log->header_date_offset) + 1;
-			
-			if(cs_malloc(&hist->txt, sizeof(char) * (target_len + 1)))
-			{
-				hist->counter = counter++;
-				snprintf(hist->txt, target_len + 1, "%s\t%s", log->cl_text, txt + log->header_date_offset);
-				
-				ll_append(log_history, hist);
-			}
-			else
-			{
-				NULLFREE(hist);	
-			}
-		}
-	}
+	if(!exit_oscam)
+		{ log_history_add(log->cl_text, txt + log->header_date_offset); }
 #endif
 
 #if defined(MODULE_MONITOR)
@@ -754,7 +822,7 @@ int32_t cs_init_log(void)
 		cs_pthread_cond_init_nolog(__func__, &log_thread_sleep_cond_mutex, &log_thread_sleep_cond);
 
 #if defined(WEBIF) || defined(MODULE_MONITOR)
-		log_history = ll_create("log history");
+		cs_lock_create_nolog(__func__, &log_history_lock, "log_history_lock", 5000);
 #endif
 
 		log_list = ll_create(LOG_LIST);
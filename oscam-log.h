@@ -10,6 +10,8 @@ void cs_reopen_log(void);
 int32_t cs_open_logfiles(void);
 void cs_disable_log(int8_t disabled);
 void cs_reinit_loghist(uint32_t size);
+int32_t cs_log_backlog(void);
+uint32_t cs_log_dropped(void);
 
 void cs_log_txt(const char *log_prefix, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 void cs_log_hex(const char *log_prefix, const uint8_t *buf, int32_t n, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
@@ -36,14 +38,15 @@ void log_free(void);
 
 #if defined(WEBIF) || defined(MODULE_MONITOR)
 
-extern LLIST *log_history;
-
 struct s_log_history
 {
-	char *txt;
+	char *txt;                  // user \t line
+	char *json;                 // logpoll record, made by the webif on first use
 	uint64_t counter;
 };
 
+void cs_log_history(uint64_t lastid, void (*fn)(struct s_log_history *hist, void *arg), void *arg);
+
 #endif
 
 #endif
@@ -12,6 +12,25 @@
 extern CS_MUTEX_LOCK gethostbyname_lock;
 extern int32_t exit_oscam;
 
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define NET_USE_MMSG
+#endif
+
+#define UDP_BATCH_MAX       16
+#define UDP_BATCH_BUFSIZE   1024
+
+#ifdef NET_USE_MMSG
+struct s_udp_batch
+{
+	int32_t         fd;
+	int32_t         count;
+	struct mmsghdr  msg[UDP_BATCH_MAX];
+	struct iovec    iov[UDP_BATCH_MAX];
+	struct SOCKADDR sa[UDP_BATCH_MAX];
+	uint8_t         buf[UDP_BATCH_MAX][UDP_BATCH_BUFSIZE];
+};
+#endif
+
 #ifndef IPV6SUPPORT
 static int32_t inet_byteorder = 0;
 
@@ -459,6 +478,73 @@ int32_t recv_from_udpipe(uint8_t *buf)
 	return n;
 }
 
+/*
+ * UDP replies a client thread sends while working off its jobs are collected
+ * and written with a single sendmmsg() once the thread runs out of work.
+ * Other threads sending to the client are not delayed. A send error can not
+ * be returned to the caller then, so the flush clears the client address
+ * like callers do after a failed sendto().
+ */
+void net_udp_flush(struct s_client *cl)
+{
+#ifdef NET_USE_MMSG
+	struct s_udp_batch *b = cl->udp_batch;
+	int32_t i, rc, sent = 0;
+
+	if(!b || !b->count)
+		{ return; }
+
+	for(i = 0; i < b->count; i++)
+	{
+		b->msg[i].msg_hdr.msg_iov = &b->iov[i];
+		b->msg[i].msg_hdr.msg_iovlen = 1;
+		b->msg[i].msg_hdr.msg_name = &b->sa[i];
+	}
+	while(sent < b->count)
+	{
+		rc = sendmmsg(b->fd, b->msg + sent, b->count - sent, 0);
+		if(rc < 0 && errno == EINTR)
+			{ continue; }
+		if(rc <= 0)
+		{
+			cs_log_dbg(D_TRACE, "sendmmsg to %s failed, %d of %d datagrams dropped (errno=%d %s)",
+						  username(cl), b->count - sent, b->count, errno, strerror(errno));
+			set_null_ip(&SIN_GET_ADDR(cl->udp_sa));
+			break;
+		}
+		sent += rc;
+	}
+	b->count = 0;
+#else
+	(void)cl;
+#endif
+}
+
+int32_t net_udp_send(struct s_client *cl, uint8_t *buf, int32_t len)
+{
+#ifdef NET_USE_MMSG
+	struct s_udp_batch *b = cl->udp_batch;
+
+	if(cl->typ == 'c' && cur_client() == cl && len <= UDP_BATCH_BUFSIZE
+			&& (b || cs_malloc(&cl->udp_batch, sizeof(struct s_udp_batch))))
+	{
+		b = cl->udp_batch;
+		if(b->count && (b->count == UDP_BATCH_MAX || b->fd != cl->udp_fd))
+			{ net_udp_flush(cl); }
+
+		memcpy(b->buf[b->count], buf, len);
+		memcpy(&b->sa[b->count], &cl->udp_sa, sizeof(struct SOCKADDR));
+		b->iov[b->count].iov_base = b->buf[b->count];
+		b->iov[b->count].iov_len = len;
+		b->msg[b->count].msg_hdr.msg_namelen = cl->udp_sa_len;
+		b->fd = cl->udp_fd;
+		b->count++;
+		return len;
+	}
+#endif
+	return sendto(cl->udp_fd, buf, len, 0, (struct sockaddr *)&cl->udp_sa, cl->udp_sa_len);
+}
+
 int32_t process_input(uint8_t *buf, int32_t buflen, int32_t timeout)
 {
 	int32_t rc, i, pfdcount;
@@ -468,6 +554,9 @@ int32_t process_input(uint8_t *buf, int32_t buflen, int32_t timeout)
 
 	struct timeb starttime;
 	struct timeb currenttime;
+
+	// replies must be out before waiting for the next request
+	net_udp_flush(cl);
 	timeoutms = 1000 * timeout;
 	cs_ftime(&starttime);
 	polltime = timeoutms; // initial polltime = timeoutms
@@ -533,6 +622,51 @@ static struct s_client *find_client_by_ip(IN_ADDR_T ip, in_port_t port)
 	return NULL;
 }
 
+// buf is handed over to the client job
+static void udp_dispatch(struct s_port *port, int8_t module_idx, int8_t port_idx, uchar *buf, int32_t n, struct SOCKADDR cad)
+{
+	struct s_client *cl;
+	uint16_t rl;
+
+	cl = find_client_by_ip(SIN_GET_ADDR(cad), ntohs(SIN_GET_PORT(cad)));
+	rl = n;
+	buf[0] = 'U';
+	memcpy(buf + 1, &rl, 2);
+
+	if(cs_check_violation(SIN_GET_ADDR(cad), port->s_port))
+	{
+		NULLFREE(buf);
+		return;
+	}
+
+	cs_log_dbg(D_TRACE, "got %d bytes on port %d from ip %s:%d client %s",
+				  n, port->s_port,
+				  cs_inet_ntoa(SIN_GET_ADDR(cad)), SIN_GET_PORT(cad),
+				  username(cl));
+
+	if(!cl)
+	{
+		cl = create_client(SIN_GET_ADDR(cad));
+		if(!cl)
+		{
+			NULLFREE(buf);
+			return;
+		}
+
+		cl->module_idx = module_idx;
+		cl->port_idx = port_idx;
+		cl->udp_fd = port->fd;
+		cl->udp_sa = cad;
+		cl->udp_sa_len = sizeof(cl->udp_sa);
+
+		cl->port = ntohs(SIN_GET_PORT(cad));
+		cl->typ = 'c';
+
+		add_job(cl, ACTION_CLIENT_INIT, NULL, 0);
+	}
+	add_job(cl, ACTION_CLIENT_UDP, buf, n + 3);
+}
+
 int32_t accept_connection(struct s_module *module, int8_t module_idx, int8_t port_idx)
 {
 	struct SOCKADDR cad;
@@ -543,48 +677,47 @@ int32_t accept_connection(struct s_module *module, int8_t module_idx, int8_t por
 	memset(&cad, 0, sizeof(struct SOCKADDR));
 	if(module->type == MOD_CONN_UDP)
 	{
-		uchar *buf;
-		if(!cs_malloc(&buf, 1024))
-			{ return -1; }
-		if((n = recvfrom(port->fd, buf + 3, 1024 - 3, 0, (struct sockaddr *)&cad, (socklen_t *)&scad)) > 0)
+#ifdef NET_USE_MMSG
+		// only called by the main thread, buffers not taken by a job are kept for the next call
+		static uchar *rbuf[UDP_BATCH_MAX];
+		struct SOCKADDR rsa[UDP_BATCH_MAX];
+		struct mmsghdr msg[UDP_BATCH_MAX];
+		struct iovec iov[UDP_BATCH_MAX];
+		int32_t i;
+
+		memset(msg, 0, sizeof(msg));
+		memset(rsa, 0, sizeof(rsa));
+		for(i = 0; i < UDP_BATCH_MAX; i++)
 		{
-			uint16_t rl;
-			cl = find_client_by_ip(SIN_GET_ADDR(cad), ntohs(SIN_GET_PORT(cad)));
-			rl = n;
-			buf[0] = 'U';
-			memcpy(buf + 1, &rl, 2);
-
-			if(cs_check_violation(SIN_GET_ADDR(cad), port->s_port))
-			{
-				NULLFREE(buf);
-				return 0;
-			}
-
-			cs_log_dbg(D_TRACE, "got %d bytes on port %d from ip %s:%d client %s",
-						  n, port->s_port,
-						  cs_inet_ntoa(SIN_GET_ADDR(cad)), SIN_GET_PORT(cad),
-						  username(cl));
-
-			if(!cl)
-			{
-				cl = create_client(SIN_GET_ADDR(cad));
-				if(!cl) { return 0; }
-
-				cl->module_idx = module_idx;
-				cl->port_idx = port_idx;
-				cl->udp_fd = port->fd;
-				cl->udp_sa = cad;
-				cl->udp_sa_len = sizeof(cl->udp_sa);
-
-				cl->port = ntohs(SIN_GET_PORT(cad));
-				cl->typ = 'c';
+			if(!rbuf[i] && !cs_malloc(&rbuf[i], UDP_BATCH_BUFSIZE))
+				{ break; }
+			iov[i].iov_base = rbuf[i] + 3;
+			iov[i].iov_len = UDP_BATCH_BUFSIZE - 3;
+			msg[i].msg_hdr.msg_iov = &iov[i];
+			msg[i].msg_hdr.msg_iovlen = 1;
+			msg[i].msg_hdr.msg_name = &rsa[i];
+			msg[i].msg_hdr.msg_namelen = sizeof(rsa[i]);
+		}
+		// the socket is readable, take all datagrams queued so far with one call
+		if(!i || (n = recvmmsg(port->fd, msg, i, MSG_DONTWAIT, NULL)) <= 0)
+			{ return 0; }
 
-				add_job(cl, ACTION_CLIENT_INIT, NULL, 0);
-			}
-			add_job(cl, ACTION_CLIENT_UDP, buf, n + 3);
+		for(i = 0; i < n; i++)
+		{
+			if(!msg[i].msg_len)
+				{ continue; }
+			udp_dispatch(port, module_idx, port_idx, rbuf[i], msg[i].msg_len, rsa[i]);
+			rbuf[i] = NULL;
 		}
+#else
+		uchar *buf;
+		if(!cs_malloc(&buf, UDP_BATCH_BUFSIZE))
+			{ return -1; }
+		if((n = recvfrom(port->fd, buf + 3, UDP_BATCH_BUFSIZE - 3, 0, (struct sockaddr *)&cad, (socklen_t *)&scad)) > 0)
+			{ udp_dispatch(port, module_idx, port_idx, buf, n, cad); }
 		else
 			{ NULLFREE(buf); }
+#endif
 	}
 	else     //TCP
 	{
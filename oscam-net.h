@@ -39,6 +39,8 @@ int set_nonblock(int32_t fd, bool nonblock);
 void set_so_reuseport(int fd);
 int8_t check_fd_for_data(int32_t fd);
 int32_t recv_from_udpipe(uchar *);
+void net_udp_flush(struct s_client *cl);
+int32_t net_udp_send(struct s_client *cl, uint8_t *buf, int32_t len);
 int32_t process_input(uint8_t *buf, int32_t buflen, int32_t timeout);
 int32_t accept_connection(struct s_module *module, int8_t module_idx, int8_t port_idx);
 int32_t start_listener(struct s_module *module, struct s_port *port);
@@ -0,0 +1,147 @@
+#define MODULE_LOG_PREFIX "rules"
+
+#include "globals.h"
+#include "oscam-garbage.h"
+#include "oscam-rules.h"
+#include "oscam-string.h"
+
+/*
+ * Config files like oscam.whitelist or oscam.services are lists of rules that
+ * are checked in file order for every ECM. They are compiled once at load time
+ * into an open addressing table: every key owns a slice of the rules array
+ * holding its rule numbers in ascending order. A lookup then only walks the
+ * rules that can match, and merging the slices of a few keys (exact value and
+ * wildcard) in rule order still yields the first match of the file.
+ */
+
+static uint32_t rule_hash(uint64_t key)
+{
+	return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+static int rule_key_cmp(const void *a, const void *b)
+{
+	const struct s_rule_key *ka = a, *kb = b;
+
+	if(ka->key != kb->key)
+		{ return ka->key < kb->key ? -1 : 1; }
+	if(ka->rule != kb->rule)
+		{ return ka->rule < kb->rule ? -1 : 1; }
+	return 0;
+}
+
+// keys is sorted in place
+int32_t rule_index_build(struct s_rule_index *idx, struct s_rule_key *keys, uint32_t n)
+{
+	uint32_t i, h, distinct = 0, size = 16;
+	struct s_rule_slot *slot = NULL;
+
+	memset(idx, 0, sizeof(struct s_rule_index));
+	if(!n)
+		{ return 1; }
+
+	qsort(keys, n, sizeof(struct s_rule_key), rule_key_cmp);
+	for(i = 0; i < n; i++)
+	{
+		if(!i || keys[i].key != keys[i - 1].key)
+			{ distinct++; }
+	}
+	while(size < distinct * 2)
+		{ size <<= 1; }
+
+	if(!cs_malloc(&idx->slot, size * sizeof(struct s_rule_slot)) || !cs_malloc(&idx->rules, n * sizeof(uint32_t)))
+	{
+		// not published yet, and the caller still frees idx
+		NULLFREE(idx->slot);
+		NULLFREE(idx->rules);
+		return 0;
+	}
+	idx->mask = size - 1;
+
+	for(i = 0; i < n; i++)
+	{
+		idx->rules[i] = keys[i].rule;
+		if(i && keys[i].key == keys[i - 1].key)
+		{
+			slot->count++;
+			continue;
+		}
+		for(h = rule_hash(keys[i].key) & idx->mask; idx->slot[h].count; h = (h + 1) & idx->mask) { ; }
+		slot = &idx->slot[h];
+		slot->key = keys[i].key;
+		slot->start = i;
+		slot->count = 1;
+	}
+	return 1;
+}
+
+const uint32_t *rule_index_find(const struct s_rule_index *idx, uint64_t key, uint32_t *count)
+{
+	uint32_t h;
+
+	*count = 0;
+	if(!idx->slot)
+		{ return NULL; }
+
+	for(h = rule_hash(key) & idx->mask; idx->slot[h].count; h = (h + 1) & idx->mask)
+	{
+		if(idx->slot[h].key == key)
+		{
+			*count = idx->slot[h].count;
+			return idx->rules + idx->slot[h].start;
+		}
+	}
+	return NULL;
+}
+
+/* Lookups may still be running on a replaced index, so the free is deferred
+   and the fields are left as they are. The struct holding idx has to go
+   through add_garbage() as well and must not be used again. */
+void rule_index_free(struct s_rule_index *idx)
+{
+	add_garbage(idx->slot);
+	add_garbage(idx->rules);
+}
+
+void rule_iter_init(struct s_rule_iter *it)
+{
+	it->num = 0;
+}
+
+void rule_iter_add(struct s_rule_iter *it, const struct s_rule_index *idx, uint64_t key)
+{
+	const uint32_t *list;
+	uint32_t count;
+	int32_t i;
+
+	for(i = 0; i < it->num; i++)
+	{
+		if(it->key[i] == key)
+			{ return; }
+	}
+	if(it->num >= RULE_ITER_MAX || !(list = rule_index_find(idx, key, &count)))
+		{ return; }
+
+	it->key[it->num] = key;
+	it->list[it->num] = list;
+	it->count[it->num] = count;
+	it->num++;
+}
+
+int32_t rule_iter_next(struct s_rule_iter *it, uint32_t *rule)
+{
+	int32_t i, best = -1;
+
+	for(i = 0; i < it->num; i++)
+	{
+		if(it->count[i] && (best < 0 || it->list[i][0] < it->list[best][0]))
+			{ best = i; }
+	}
+	if(best < 0)
+		{ return 0; }
+
+	*rule = it->list[best][0];
+	it->list[best]++;
+	it->count[best]--;
+	return 1;
+}
@@ -0,0 +1,47 @@
+#ifndef OSCAM_RULES_H_
+#define OSCAM_RULES_H_
+
+/* Compiled rule lookup: maps a 64 bit key to the ascending list of rule
+   numbers (positions in the config file) that were added for it. */
+
+struct s_rule_key
+{
+	uint64_t        key;
+	uint32_t        rule;
+};
+
+struct s_rule_slot
+{
+	uint64_t        key;
+	uint32_t        start;
+	uint32_t        count;
+};
+
+struct s_rule_index
+{
+	struct s_rule_slot *slot;
+	uint32_t        *rules;
+	uint32_t        mask;
+};
+
+#define RULE_ITER_MAX 4
+
+/* Walks the rules of up to RULE_ITER_MAX keys merged in ascending order,
+   so first-match semantics of the config file are kept. */
+struct s_rule_iter
+{
+	uint64_t        key[RULE_ITER_MAX];
+	const uint32_t  *list[RULE_ITER_MAX];
+	uint32_t        count[RULE_ITER_MAX];
+	int32_t         num;
+};
+
+int32_t rule_index_build(struct s_rule_index *idx, struct s_rule_key *keys, uint32_t n);
+const uint32_t *rule_index_find(const struct s_rule_index *idx, uint64_t key, uint32_t *count);
+void rule_index_free(struct s_rule_index *idx);
+
+void rule_iter_init(struct s_rule_iter *it);
+void rule_iter_add(struct s_rule_iter *it, const struct s_rule_index *idx, uint64_t key);
+int32_t rule_iter_next(struct s_rule_iter *it, uint32_t *rule);
+
+#endif
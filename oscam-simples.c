@@ -1,47 +1,214 @@
 #include "globals.h"
+#include "oscam-garbage.h"
+#include "oscam-rules.h"
 #include "oscam-string.h"
 
-static void cl_set_last_providptr(struct s_client *cl, uint32_t provid, uint16_t caid)
+/*
+ * oscam.srvid, oscam.provid and oscam.tiers are indexed when they are loaded.
+ * A key maps to the entries that can match it in list order, so the lookups
+ * below pick the same entry a walk of the whole list would have picked.
+ */
+
+#define SRVID_KEY(srvid, caid)      ((uint64_t)(srvid) << 16 | (caid))
+#define PROVID_KEY(caid, provid)    ((uint64_t)(caid) << 33 | (provid))
+#define PROVID_ZERO_KEY(caid)       ((uint64_t)(caid) << 33 | 1ULL << 32)
+#define TIERID_KEY(tierid, caid)    ((uint64_t)(tierid) << 16 | (caid))
+
+struct s_name_ref
 {
-	int32_t i;
-	struct s_provid *this = cfg.provid;
-	struct s_provid *zero_match = NULL;
+	void            *entry;
+	int32_t         caid_idx;
+};
 
-	cl->last_providptr = NULL;
+struct s_name_index
+{
+	struct s_name_ref   *ref;
+	struct s_rule_index idx;
+};
 
-	if(!caid) {
+static struct s_name_index *srvid_index, *provid_index, *tierid_index;
+static pthread_mutex_t name_index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// takes over ref, lookups may still run on the old index so it is freed deferred
+static void name_index_publish(struct s_name_index **index, struct s_name_ref *ref, struct s_rule_key *keys, uint32_t nkeys)
+{
+	struct s_name_index *new_index, *old_index;
+
+	if(!cs_malloc(&new_index, sizeof(struct s_name_index)))
+	{
+		NULLFREE(ref);
 		return;
 	}
+	if(!rule_index_build(&new_index->idx, keys, nkeys))
+	{
+		NULLFREE(new_index);
+		NULLFREE(ref);
+		return;
+	}
+	new_index->ref = ref;
+
+	SAFE_MUTEX_LOCK(&name_index_lock);
+	old_index = *index;
+	*index = new_index;
+	SAFE_MUTEX_UNLOCK(&name_index_lock);
+
+	if(old_index)
+	{
+		rule_index_free(&old_index->idx);
+		add_garbage(old_index->ref);
+		add_garbage(old_index);
+	}
+}
 
-	for(; this; this = this->next)
+static const uint32_t *name_index_find(const struct s_name_index *index, uint64_t key, uint32_t *count)
+{
+	*count = 0;
+	return index ? rule_index_find(&index->idx, key, count) : NULL;
+}
+
+void srvid_index_build(struct s_srvid **srvid)
+{
+	struct s_srvid *this;
+	struct s_name_ref *ref = NULL;
+	struct s_rule_key *keys = NULL;
+	uint32_t n = 0;
+	int32_t i, j;
+
+	for(i = 0; i < 16; i++)
+		for(this = srvid[i]; this; this = this->next)
+			{ n += this->ncaid; }
+
+	if(n && (!cs_malloc(&ref, n * sizeof(struct s_name_ref)) || !cs_malloc(&keys, n * sizeof(struct s_rule_key))))
 	{
-		if(this->caid == caid)
+		NULLFREE(ref);
+		return;
+	}
+
+	// bucket order does not matter, a srvid only ever lives in one of them
+	n = 0;
+	for(i = 0; i < 16; i++)
+		for(this = srvid[i]; this; this = this->next)
 		{
-			if(this->nprovid == 0 )
-				{ zero_match = this; }
-					
-			for(i=0; i < this->nprovid; i++)
+			if(!this->name)
+				{ continue; }
+			for(j = 0; j < this->ncaid; j++)
 			{
-				if(this->provid[i] == 0 )
-					{ zero_match = this; }
-				
-				if(this->provid[i] == provid)
-				{
-					cl->last_providptr = this;
-					return;
-				}
+				ref[n].entry = this;
+				ref[n].caid_idx = j;
+				keys[n].key = SRVID_KEY(this->srvid, this->caid[j].caid);
+				keys[n].rule = n;
+				n++;
 			}
 		}
+
+	name_index_publish(&srvid_index, ref, keys, n);
+	NULLFREE(keys);
+}
+
+void provid_index_build(struct s_provid *provid)
+{
+	struct s_provid *this;
+	struct s_name_ref *ref = NULL;
+	struct s_rule_key *keys = NULL;
+	uint32_t n = 0, nkeys = 0;
+	int32_t i, zero;
+
+	for(this = provid; this; this = this->next)
+		{ nkeys += this->nprovid + 1; n++; }
+
+	if(n && (!cs_malloc(&ref, n * sizeof(struct s_name_ref)) || !cs_malloc(&keys, nkeys * sizeof(struct s_rule_key))))
+	{
+		NULLFREE(ref);
+		return;
 	}
-	
-	if(zero_match != NULL)
-		{ cl->last_providptr = zero_match; }
+
+	n = nkeys = 0;
+	for(this = provid; this; this = this->next, n++)
+	{
+		ref[n].entry = this;
+		zero = !this->nprovid;
+		for(i = 0; i < this->nprovid; i++)
+		{
+			if(!this->provid[i])
+				{ zero = 1; }
+			keys[nkeys].key = PROVID_KEY(this->caid, this->provid[i]);
+			keys[nkeys++].rule = n;
+		}
+		if(zero)
+		{
+			keys[nkeys].key = PROVID_ZERO_KEY(this->caid);
+			keys[nkeys++].rule = n;
+		}
+	}
+
+	name_index_publish(&provid_index, ref, keys, nkeys);
+	NULLFREE(keys);
+}
+
+void tierid_index_build(struct s_tierid *tierid)
+{
+	struct s_tierid *this;
+	struct s_name_ref *ref = NULL;
+	struct s_rule_key *keys = NULL;
+	uint32_t n = 0, nkeys = 0;
+	int32_t i;
+
+	for(this = tierid; this; this = this->next)
+		{ nkeys += this->ncaid; n++; }
+
+	if(n && (!cs_malloc(&ref, n * sizeof(struct s_name_ref)) || !cs_malloc(&keys, nkeys * sizeof(struct s_rule_key))))
+	{
+		NULLFREE(ref);
+		return;
+	}
+
+	n = nkeys = 0;
+	for(this = tierid; this; this = this->next, n++)
+	{
+		ref[n].entry = this;
+		for(i = 0; i < this->ncaid; i++)
+		{
+			keys[nkeys].key = TIERID_KEY(this->tierid, this->caid[i]);
+			keys[nkeys++].rule = n;
+		}
+	}
+
+	name_index_publish(&tierid_index, ref, keys, nkeys);
+	NULLFREE(keys);
+}
+
+// first entry with an exact (caid, provid) match, else the last one matching any provid
+static struct s_provid *find_provid(uint32_t provid, uint16_t caid, int8_t zero_match)
+{
+	struct s_name_index *index = provid_index;
+	const uint32_t *rule;
+	uint32_t count;
+
+	if((rule = name_index_find(index, PROVID_KEY(caid, provid), &count)))
+		{ return index->ref[rule[0]].entry; }
+	if(zero_match && (rule = name_index_find(index, PROVID_ZERO_KEY(caid), &count)))
+		{ return index->ref[rule[count - 1]].entry; }
+	return NULL;
+}
+
+static void cl_set_last_providptr(struct s_client *cl, uint32_t provid, uint16_t caid)
+{
+	cl->last_providptr = NULL;
+
+	if(!caid) {
+		return;
+	}
+
+	cl->last_providptr = find_provid(provid, caid, 1);
 }
 
 /* Gets the servicename. */
 static char *__get_servicename(struct s_client *cl, uint16_t srvid, uint32_t provid, uint16_t caid, char *buf, uint32_t buflen, bool return_unknown)
 {
 	int32_t i, j;
+	uint32_t k, count;
+	const uint32_t *rule;
+	struct s_name_index *index;
 	struct s_srvid *this, *provid_zero_match = NULL, *provid_any_match = NULL;
 	buf[0] = '\0';
 
@@ -60,50 +227,50 @@ static char *__get_servicename(struct s_client *cl, uint16_t srvid, uint32_t pro
 				return (buf);
 			}
 
-	for(this = cfg.srvid[srvid >> 12]; this; this = this->next)
-		if(this->srvid == srvid)
-			for(i = 0; i < this->ncaid; i++)
-			{			
-				if(this->caid[i].caid == caid && this->name)
+	index = srvid_index;
+	rule = name_index_find(index, SRVID_KEY(srvid, caid), &count);
+	for(k = 0; k < count; k++)
+	{
+		this = index->ref[rule[k]].entry;
+		i = index->ref[rule[k]].caid_idx;
+
+		provid_any_match = this;
+
+		if(this->caid[i].nprovid == 0)
+		{
+			provid_zero_match = this;
+
+			if(0 == provid)
+			{
+				if(cl)
+				{
+					cl_set_last_providptr(cl, provid, caid);
+					cl->last_srvidptr = this;
+					cl->last_srvidptr_search_provid = provid;
+				}
+				cs_strncpy(buf, this->name, buflen);
+				return (buf);
+			}
+		}
+
+		for(j = 0; j < this->caid[i].nprovid; j++)
+		{
+			if(this->caid[i].provid[j] == 0)
+				{ provid_zero_match = this; }
+
+			if(this->caid[i].provid[j] == provid)
+			{
+				if(cl)
 				{
-					provid_any_match = this;
-
-					if(this->caid[i].nprovid == 0)
-					{
-						provid_zero_match = this;
-						
-						if(0 == provid)
-						{
-							if(cl)
-							{
-								cl_set_last_providptr(cl, provid, caid);
-								cl->last_srvidptr = this;
-								cl->last_srvidptr_search_provid = provid;
-							}
-							cs_strncpy(buf, this->name, buflen);
-							return (buf);
-						}					
-					}
-											
-					for(j = 0; j < this->caid[i].nprovid; j++)
-					{
-						if(this->caid[i].provid[j] == 0)
-							{ provid_zero_match = this; }
-						
-						if(this->caid[i].provid[j] == provid)
-						{
-							if(cl)
-							{
-								cl_set_last_providptr(cl, provid, caid);
-								cl->last_srvidptr = this;
-								cl->last_srvidptr_search_provid = provid;
-							}
-							cs_strncpy(buf, this->name, buflen);
-							return (buf);
-						}
-					}
+					cl_set_last_providptr(cl, provid, caid);
+					cl->last_srvidptr = this;
+					cl->last_srvidptr_search_provid = provid;
 				}
+				cs_strncpy(buf, this->name, buflen);
+				return (buf);
 			}
+		}
+	}
 
 	if(!buf[0])
 	{
@@ -230,18 +397,25 @@ int32_t picon_servicename_remve_hd(char *buf, uint32_t UNUSED(buflen))
 	return 0;
 }
 
+static struct s_tierid *find_tierid(uint16_t tierid, uint16_t caid)
+{
+	struct s_name_index *index = tierid_index;
+	const uint32_t *rule;
+	uint32_t count;
+
+	if((rule = name_index_find(index, TIERID_KEY(tierid, caid), &count)))
+		{ return index->ref[rule[0]].entry; }
+	return NULL;
+}
+
 /* Gets the tier name. Make sure that buf is at least 83 bytes long. */
 char *get_tiername(uint16_t tierid, uint16_t caid, char *buf)
 {
-	uint8_t found = 0;
-	int32_t i;
-	struct s_tierid *this = cfg.tierid;
+	struct s_tierid *this = find_tierid(tierid, caid);
 
-	for(buf[0] = 0; this && !found; this = this->next)
-		if(this->tierid == tierid)
-			for(i = 0; i < this->ncaid && !found; i++)
-				if(this->caid[i] == caid)
-					{ cs_strncpy(buf, this->name, 32); found = 1; }
+	buf[0] = 0;
+	if(this)
+		{ cs_strncpy(buf, this->name, 32); }
 
 	if(!tierid) { buf[0] = '\0'; }
 	return (buf);
@@ -250,15 +424,11 @@ char *get_tiername(uint16_t tierid, uint16_t caid, char *buf)
 /* Gets the tier name. Make sure that buf is at least 83 bytes long. */
 char *get_tiername_defaultid(uint16_t tierid, uint16_t caid, char *buf)
 {
-	uint8_t found = 0;
-	int32_t i;
-	struct s_tierid *this = cfg.tierid;
+	struct s_tierid *this = find_tierid(tierid, caid);
 
-	for(buf[0] = 0; this && !found; this = this->next)
-		if(this->tierid == tierid)
-			for(i = 0; i < this->ncaid && !found; i++)
-				if(this->caid[i] == caid)
-					{ cs_strncpy(buf, this->name, 32); found = 1; }
+	buf[0] = 0;
+	if(this)
+		{ cs_strncpy(buf, this->name, 32); }
 
 	if(!tierid)
 	{
@@ -271,30 +441,19 @@ char *get_tiername_defaultid(uint16_t tierid, uint16_t caid, char *buf)
 /* Gets the provider name. */
 char *get_provider(uint32_t provid, uint16_t caid, char *buf, uint32_t buflen)
 {
-	uint8_t found = 0;
-	int32_t i;
-	struct s_provid *this = cfg.provid;
+	struct s_provid *this;
 
 	if(!caid) {
 		buf[0] = '\0';
 		return (buf);
 	}
 
-	for(buf[0] = 0; this && !found; this = this->next)
+	buf[0] = 0;
+	if((this = find_provid(provid, caid, 0)))
 	{
-		if(this->caid == caid)
-		{
-			for(i=0; i<this->nprovid && !found; i++)
-			{
-				if(this->provid[i] == provid)
-				{
-					snprintf(buf, buflen, "%s%s%s%s%s", this->prov,
-							 *this->sat && this->sat[0] ? " / " : "", this->sat,
-							 this->lang[0] ? " / " : "", this->lang);
-					found = 1;
-				}
-			}
-		}
+		snprintf(buf, buflen, "%s%s%s%s%s", this->prov,
+				 *this->sat && this->sat[0] ? " / " : "", this->sat,
+				 this->lang[0] ? " / " : "", this->lang);
 	}
 
 	if(!buf[0]) { snprintf(buf, buflen, "%04X@%06X unknown", caid, provid); }
@@ -304,42 +463,16 @@ char *get_provider(uint32_t provid, uint16_t caid, char *buf, uint32_t buflen)
 
 char *__get_providername(uint32_t provid, uint16_t caid, char *buf, uint32_t buflen, bool return_unknown)
 {
-	uint8_t found = 0;
-	int32_t i;
-	struct s_provid *this = cfg.provid;
-	struct s_provid *zero_match = NULL;
+	struct s_provid *this;
 
 	if(!caid) {
 		buf[0] = '\0';
 		return (buf);
 	}
 
-	for(buf[0] = 0; this && !found; this = this->next)
-	{
-		if(this->caid == caid)
-		{
-			if(this->nprovid == 0 )
-				{ zero_match = this; }
-			
-			for(i=0; i<this->nprovid && !found; i++)
-			{
-				if(this->provid[i] == 0 )
-					{ zero_match = this; }
-				
-				if(this->provid[i] == provid)
-				{
-					cs_strncpy(buf, this->prov, buflen);
-					found = 1;
-				}
-			}
-		}
-	}
-	
-	if(!found && zero_match != NULL)
-	{
-		cs_strncpy(buf, zero_match->prov, buflen);
-		found = 1;		
-	}
+	buf[0] = 0;
+	if((this = find_provid(provid, caid, 1)))
+		{ cs_strncpy(buf, this->prov, buflen); }
 
 	if(!buf[0] && return_unknown) { snprintf(buf, buflen, "%04X@%06X unknown", caid, provid); }
 
@@ -408,6 +541,7 @@ void add_provider(uint16_t caid, uint32_t provid, const char *name, const char *
 	cs_strncpy(prov->sat, sat, sizeof(prov->sat));
 	cs_strncpy(prov->lang, lang, sizeof(prov->lang));
 	*ptr = prov;
+	provid_index_build(cfg.provid);
 }
 
 // Get a cardsystem name based on caid
@@ -166,6 +166,7 @@ void *work_thread(void *ptr)
 
 			if(!data)
 			{
+				net_udp_flush(cl);
 				/* for serial client cl->pfd is file descriptor for serial port not socket
 				   for example: pfd=open("/dev/ttyUSB0"); */
 				if(!cl->pfd || module->listenertype == LIS_SERIAL)
@@ -358,7 +359,7 @@ void *work_thread(void *ptr)
 				break;
 			case ACTION_CACHE_PUSH_OUT:
 			{
-				cacheex_push_out(cl, data->ptr);
+				cacheex_push_queue_out(cl);
 				break;
 			}
 			case ACTION_CLIENT_KILL:
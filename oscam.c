@@ -677,14 +677,15 @@ static void cs_reload_config(void)
 		return;
 	}
 
-	if(cfg.reload_useraccounts)
+	// readers first, the accounts resolve au against them
+	if(cfg.reload_readers)
 	{
-		cs_accounts_chk();
+		reload_readerdb();
 	}
 
-	if(cfg.reload_readers)
+	if(cfg.reload_useraccounts)
 	{
-		reload_readerdb();
+		cs_accounts_chk();
 	}
 
 	if(cfg.reload_provid)
@@ -1543,13 +1544,26 @@ static void detect_valgrind(void)
 
 #ifdef BUILD_TESTS
 extern void run_all_tests(void);
-__attribute__ ((noreturn)) static void run_tests(void)
+__attribute__ ((noreturn)) static void run_tests(int32_t UNUSED(argc), char *UNUSED(argv[]))
 {
 	run_all_tests();
 	exit(0);
 }
+#elif defined(BUILD_BENCH)
+extern void run_all_benchmarks(void);
+__attribute__ ((noreturn)) static void run_tests(int32_t UNUSED(argc), char *UNUSED(argv[]))
+{
+	run_all_benchmarks();
+	exit(0);
+}
+#elif defined(BUILD_LOADGEN)
+extern int32_t run_loadgen(int32_t argc, char *argv[]);
+__attribute__ ((noreturn)) static void run_tests(int32_t argc, char *argv[])
+{
+	exit(run_loadgen(argc, argv));
+}
 #else
-static void run_tests(void) { }
+static void run_tests(int32_t UNUSED(argc), char *UNUSED(argv[])) { }
 #endif
 
 const struct s_cardsystem *cardsystems[] =
@@ -1686,7 +1700,7 @@ int32_t main(int32_t argc, char *argv[])
 {
 	fix_stacksize();
 
-	run_tests();
+	run_tests(argc, argv);
 	int32_t i, j;
 	prog_name = argv[0];
 	struct timespec start_ts;
@@ -6,9 +6,13 @@
 #include "globals.h"
 
 #include "oscam-array.h"
+#include "oscam-chk.h"
 #include "oscam-string.h"
 #include "oscam-conf-chk.h"
 #include "oscam-conf-mk.h"
+#include "oscam-config.h"
+#include "oscam-latency.h"
+#include "cscrypt/md5.h"
 
 struct test_vec
 {
@@ -72,6 +76,239 @@ static void run_parser_test(struct test_type *t)
 	t->clear_fn(t->data_c);
 }
 
+static void run_md5_multi_test(void)
+{
+	unsigned char data[17][300];
+	unsigned char digest[17][MD5_DIGEST_LENGTH], expected[MD5_DIGEST_LENGTH];
+	const unsigned char *input[17];
+	unsigned char *output[17];
+	unsigned long len[17];
+	int32_t i, j, round, failed = 0;
+
+	printf("MD5 multi-buffer digest (MD5_multi)\n");
+	for(round = 0; round < 20; round++)
+	{
+		// Mix lengths around the 55/56/64 byte padding boundaries
+		for(i = 0; i < 17; i++)
+		{
+			len[i] = (round * 17 + i * 13) % sizeof(data[i]);
+			for(j = 0; j < (int32_t)sizeof(data[i]); j++)
+				{ data[i][j] = (uint8_t)(round * 31 + i * 7 + j); }
+			input[i] = data[i];
+			output[i] = digest[i];
+		}
+		MD5_multi(input, len, output, 1 + round % 17);
+		for(i = 0; i < 1 + round % 17; i++)
+		{
+			MD5(data[i], len[i], expected);
+			if(memcmp(expected, digest[i], MD5_DIGEST_LENGTH) != 0)
+			{
+				printf(" === ERROR === round %d buffer %d len %lu\n", round, i, len[i]);
+				failed++;
+			}
+		}
+	}
+	if(!failed)
+		{ printf(" Testing 20 batches [OK]\n"); }
+	fflush(stdout);
+}
+
+static void run_latency_test(void)
+{
+	struct s_latency lat;
+	struct s_latency_summary sum;
+	int32_t i;
+
+	printf("ECM latency histogram\n");
+	memset(&lat, 0, sizeof(lat));
+	for(i = 1; i <= 10000; i++)
+		{ latency_add(&lat, LATENCY_TOTAL, i); }
+	latency_add(&lat, LATENCY_CACHE, 0);
+
+	// buckets are at most 12.5% wide and report their upper bound
+	latency_get_summary(&lat, LATENCY_TOTAL, &sum);
+	if(sum.count != 10000 || sum.p50 < 5000 || sum.p50 > 5000 * 9 / 8
+			|| sum.p90 < 9000 || sum.p90 > 9000 * 9 / 8
+			|| sum.p99 < 9900 || sum.p99 > 9900 * 9 / 8
+			|| sum.p999 < 9990 || sum.p999 > 9990 * 9 / 8)
+	{
+		printf(" === ERROR === count %u p50 %u p90 %u p99 %u p99.9 %u\n", sum.count, sum.p50, sum.p90, sum.p99, sum.p999);
+	}
+	else if(latency_get_summary(&lat, LATENCY_CACHE, &sum) != 1 || sum.p999 != 0 || latency_get_summary(&lat, LATENCY_READER, &sum))
+	{
+		printf(" === ERROR === cache/reader summary\n");
+	}
+	else
+	{
+		printf(" Testing percentiles [OK]\n");
+	}
+	latency_free(&lat);
+	fflush(stdout);
+}
+
+extern uint32_t cfg_sidtab_generation;
+
+static uint32_t rules_rand_state = 1;
+
+// small value ranges so that wildcards and collisions are common
+static uint32_t rules_rand(uint32_t range)
+{
+	rules_rand_state = rules_rand_state * 1103515245 + 12345;
+	return (rules_rand_state >> 16) % range;
+}
+
+// oscam.whitelist check as a plain walk of the list, the reference for the compiled one
+static int32_t whitelist_linear(ECM_REQUEST *er, uint32_t *line)
+{
+	struct s_global_whitelist *entry;
+	int8_t caidprov_matches = 0;
+
+	*line = -1;
+	for(entry = cfg.global_whitelist; entry; entry = entry->next)
+	{
+		if(entry->type == 'm' && match_whitelist(er, entry))
+		{
+			er->caid = entry->mapcaid;
+			er->prid = entry->mapprovid;
+			break;
+		}
+	}
+	for(entry = cfg.global_whitelist; entry; entry = entry->next)
+	{
+		if(entry->type != 'l')
+			{ continue; }
+		if(match_whitelist(er, entry))
+		{
+			*line = entry->line;
+			return 1;
+		}
+		if((!entry->caid || entry->caid == er->caid) && (!entry->provid || entry->provid == er->prid)
+				&& (!entry->srvid || entry->srvid == er->srvid) && (!entry->chid || entry->chid == er->chid)
+				&& (!entry->pid || entry->pid == er->pid))
+		{
+			caidprov_matches = 1;
+			*line = entry->line;
+		}
+	}
+	if(caidprov_matches)
+		{ return 0; }
+	for(entry = cfg.global_whitelist; entry; entry = entry->next)
+	{
+		if(match_whitelist(er, entry))
+		{
+			*line = entry->line;
+			if(entry->type == 'w')
+				{ return 1; }
+			else if(entry->type == 'i')
+				{ return 0; }
+		}
+	}
+	return 0;
+}
+
+static int32_t sidtab_linear(SIDTABS *sidtabs, ECM_REQUEST *er)
+{
+	int32_t nr, rc = !sidtabs->ok;
+	SIDTAB *sidtab;
+
+	if(!sidtabs->ok && !sidtabs->no)
+		{ return 1; }
+	for(nr = 0, sidtab = cfg.sidtab; sidtab; sidtab = sidtab->next, nr++)
+	{
+		if(!(sidtab->num_caid | sidtab->num_provid | sidtab->num_srvid))
+			{ continue; }
+		if((sidtabs->no & ((SIDTABBITS)1 << nr)) && chk_srvid_match(er, sidtab))
+			{ return 0; }
+		if((sidtabs->ok & ((SIDTABBITS)1 << nr)) && chk_srvid_match(er, sidtab))
+			{ rc = 1; }
+	}
+	return rc;
+}
+
+static void run_rules_test(void)
+{
+	static const char types[] = "wwwwiilm";
+	struct s_global_whitelist *wl = NULL, *entry, **last = &wl;
+	struct s_sidtab *sidtab, **last_sidtab = &cfg.sidtab;
+	struct s_client *cl;
+	ECM_REQUEST er, er_c;
+	uint32_t line, line_c;
+	int32_t i, j, rc, rc_c, failed = 0;
+
+	printf("Compiled whitelist and services\n");
+	for(i = 0; i < 500; i++)
+	{
+		if(!cs_malloc(&entry, sizeof(struct s_global_whitelist)))
+			{ return; }
+		entry->line = i + 1;
+		entry->type = types[rules_rand(8)];
+		entry->caid = rules_rand(4) ? 0x0500 + rules_rand(4) : 0;
+		entry->provid = rules_rand(2) ? rules_rand(3) : 0;
+		entry->srvid = rules_rand(3) ? 1 + rules_rand(40) : 0;
+		entry->chid = rules_rand(4) ? 0 : rules_rand(3);
+		entry->ecmlen = rules_rand(3) ? 0 : 0x80 + rules_rand(2);
+		entry->mapcaid = 0x0500 + rules_rand(4);
+		entry->mapprovid = rules_rand(3);
+		*last = entry;
+		last = &entry->next;
+	}
+	global_whitelist_set(wl);
+
+	for(i = 0; i < 40; i++)
+	{
+		if(!cs_malloc(&sidtab, sizeof(struct s_sidtab)) || !cs_malloc(&sidtab->caid, 4 * sizeof(uint16_t))
+				|| !cs_malloc(&sidtab->provid, 4 * sizeof(uint32_t)) || !cs_malloc(&sidtab->srvid, 20 * sizeof(uint16_t)))
+			{ return; }
+		sidtab->num_caid = rules_rand(3);
+		sidtab->num_provid = rules_rand(3);
+		sidtab->num_srvid = rules_rand(3) ? rules_rand(20) : 0;
+		for(j = 0; j < sidtab->num_caid; j++) { sidtab->caid[j] = 0x0500 + rules_rand(4); }
+		for(j = 0; j < sidtab->num_provid; j++) { sidtab->provid[j] = rules_rand(3); }
+		for(j = 0; j < sidtab->num_srvid; j++) { sidtab->srvid[j] = 1 + rules_rand(40); }
+		*last_sidtab = sidtab;
+		last_sidtab = &sidtab->next;
+	}
+	cfg_sidtab_generation++;
+	if(!cs_malloc(&cl, sizeof(struct s_client)))
+		{ return; }
+
+	for(i = 0; i < 20000; i++)
+	{
+		memset(&er, 0, sizeof(er));
+		er.caid = 0x0500 + rules_rand(5);
+		er.prid = rules_rand(4);
+		er.srvid = rules_rand(45);
+		er.chid = rules_rand(3);
+		er.ecmlen = 0x80 + rules_rand(3);
+		er_c = er;
+		rc = whitelist_linear(&er, &line);
+		rc_c = chk_global_whitelist(&er_c, &line_c);
+		if(rc != rc_c || line != line_c || er.caid != er_c.caid || er.prid != er_c.prid)
+		{
+			printf(" === ERROR === whitelist %04X@%06X:%04X rc %d/%d line %u/%u\n", er.caid, er.prid, er.srvid, rc, rc_c, line, line_c);
+			failed++;
+		}
+
+		cl->sidtabs.ok = ((SIDTABBITS)rules_rand(0x10000) << 24) | rules_rand(0x10000);
+		cl->sidtabs.no = rules_rand(2) ? ((SIDTABBITS)rules_rand(0x10000) << 8) : 0;
+		cl->lb_sidtabs.ok = cl->sidtabs.ok;
+		if(chk_srvid(cl, &er) != sidtab_linear(&cl->sidtabs, &er))
+		{
+			printf(" === ERROR === services %04X@%06X:%04X\n", er.caid, er.prid, er.srvid);
+			failed++;
+		}
+		if(failed > 10)
+			{ break; }
+	}
+	if(!failed)
+		{ printf(" Testing 20000 ECMs against the plain lists [OK]\n"); }
+
+	global_whitelist_set(NULL);
+	init_free_sidtab();
+	NULLFREE(cl);
+	fflush(stdout);
+}
+
 void run_all_tests(void)
 {
 	ECM_WHITELIST ecm_whitelist, ecm_whitelist_c;
@@ -314,4 +551,8 @@ void run_all_tests(void)
 		},
 	};
 	run_parser_test(&caidtab_test);
+
+	run_md5_multi_test();
+	run_latency_test();
+	run_rules_test();
 }